@@ -0,0 +1,390 @@
+#include "baseline.h"
+#include "capacity.h"
+#include "json.h"
+#include "log.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yaml.h>
+
+// Fewer latencies than this on either side are too few for the normal approximation
+#define MIN_SAMPLES 20
+
+void init_baseline(Baseline *b) {
+    memset(b, 0, sizeof(Baseline));
+}
+
+void free_baseline(Baseline *b) {
+    for (int i = 0; i < b->count; i++) {
+        free(b->cases[i].name);
+    }
+    free(b->cases);
+    init_baseline(b);
+}
+
+static BaselineCase *find_case(const Baseline *b, const char *name) {
+    for (int i = 0; i < b->count; i++) {
+        if (strcmp(b->cases[i].name, name) == 0) return &b->cases[i];
+    }
+    return NULL;
+}
+
+int add_baseline_case(Baseline *b, const char *name, const Stats *s, double elapsed) {
+    BaselineCase *c = find_case(b, name);
+    if (!c) {
+        if (b->count == b->cap) {
+            int cap = b->cap ? b->cap * 2 : 8;
+            BaselineCase *temp = realloc(b->cases, cap * sizeof(BaselineCase));
+            if (!temp) return -1;
+            b->cases = temp;
+            b->cap = cap;
+        }
+        char *copy = strdup(name);
+        if (!copy) return -1;
+        c = &b->cases[b->count++];
+        c->name = copy;
+    }
+    c->stats = *s;
+    c->elapsed = elapsed;
+    return 0;
+}
+
+int save_baseline(const char *path, const Baseline *b) {
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        LOG_ERROR("Failed to open baseline file %s", path);
+        return -1;
+    }
+
+    // Buckets are stored sparse as [index, count] pairs, the layout is fixed by gamma
+    fprintf(fp, "{\n  \"version\": %d,\n  \"gamma\": %g,\n  \"cases\": [", BASELINE_VERSION, STATS_GAMMA);
+    for (int i = 0; i < b->count; i++) {
+        const BaselineCase *c = &b->cases[i];
+        const Stats *s = &c->stats;
+        char *name = json_quote(c->name);
+        fprintf(fp, "%s\n    {\"name\": %s, \"elapsed\": %.6f, \"count\": %llu, \"failures\": %llu, "
+                "\"http_errors\": %llu, \"bytes\": %llu, \"total_us\": %.3f, \"min_us\": %.3f, \"max_us\": %.3f,\n"
+                "     \"buckets\": [",
+                i ? "," : "", name ? name : "\"\"", c->elapsed, (unsigned long long)s->count,
+                (unsigned long long)s->failures, (unsigned long long)s->http_errors,
+                (unsigned long long)s->bytes, s->total_us, s->count ? s->min_us : 0, s->max_us);
+        free(name);
+        int first = 1;
+        for (int k = 0; k < STATS_BUCKETS; k++) {
+            if (s->buckets[k] == 0) continue;
+            fprintf(fp, "%s[%d, %u]", first ? "" : ", ", k, s->buckets[k]);
+            first = 0;
+        }
+        fprintf(fp, "]}");
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+    int rc = ferror(fp) ? -1 : 0;
+    if (fclose(fp) != 0) rc = -1;
+    if (rc) LOG_ERROR("Failed to write baseline file %s", path);
+    return rc;
+}
+
+// Read the [index, count] pairs of a histogram, the opening bracket already consumed
+static int read_buckets(yaml_parser_t *parser, Stats *s) {
+    yaml_event_t event;
+    while (1) {
+        if (!yaml_parser_parse(parser, &event)) return -1;
+        yaml_event_type_t type = event.type;
+        yaml_event_delete(&event);
+        if (type == YAML_SEQUENCE_END_EVENT) return 0;
+        if (type != YAML_SEQUENCE_START_EVENT) return -1;
+
+        long pair[2];
+        for (int i = 0; i < 2; i++) {
+            if (!yaml_parser_parse(parser, &event)) return -1;
+            int scalar = event.type == YAML_SCALAR_EVENT;
+            pair[i] = scalar ? strtol((char *)event.data.scalar.value, NULL, 10) : -1;
+            yaml_event_delete(&event);
+            if (!scalar) return -1;
+        }
+        if (!yaml_parser_parse(parser, &event)) return -1;
+        type = event.type;
+        yaml_event_delete(&event);
+        if (type != YAML_SEQUENCE_END_EVENT || pair[0] < 0 || pair[0] >= STATS_BUCKETS || pair[1] < 0) return -1;
+        s->buckets[pair[0]] = (uint32_t)pair[1];
+    }
+}
+
+// Read one case mapping, the opening brace already consumed
+static int read_case(yaml_parser_t *parser, Baseline *b) {
+    yaml_event_t event;
+    char *name = NULL;
+    double elapsed = 0;
+    Stats s;
+    init_stats(&s);
+    int failed = 0;
+
+    while (!failed) {
+        if (!yaml_parser_parse(parser, &event)) {
+            failed = 1;
+            break;
+        }
+        if (event.type == YAML_MAPPING_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        char *key = event.type == YAML_SCALAR_EVENT ? strdup((char *)event.data.scalar.value) : NULL;
+        yaml_event_delete(&event);
+        if (!key || !yaml_parser_parse(parser, &event)) {
+            free(key);
+            failed = 1;
+            break;
+        }
+
+        if (strcmp(key, "buckets") == 0 && event.type == YAML_SEQUENCE_START_EVENT) {
+            yaml_event_delete(&event);
+            failed = read_buckets(parser, &s);
+        } else if (event.type != YAML_SCALAR_EVENT) {
+            yaml_event_delete(&event);
+            failed = 1;
+        } else {
+            const char *value = (char *)event.data.scalar.value;
+            if (strcmp(key, "name") == 0) {
+                free(name);
+                name = strdup(value);
+            } else if (strcmp(key, "elapsed") == 0) {
+                elapsed = strtod(value, NULL);
+            } else if (strcmp(key, "count") == 0) {
+                s.count = strtoull(value, NULL, 10);
+            } else if (strcmp(key, "failures") == 0) {
+                s.failures = strtoull(value, NULL, 10);
+            } else if (strcmp(key, "http_errors") == 0) {
+                s.http_errors = strtoull(value, NULL, 10);
+            } else if (strcmp(key, "bytes") == 0) {
+                s.bytes = strtoull(value, NULL, 10);
+            } else if (strcmp(key, "total_us") == 0) {
+                s.total_us = strtod(value, NULL);
+            } else if (strcmp(key, "min_us") == 0) {
+                s.min_us = strtod(value, NULL);
+            } else if (strcmp(key, "max_us") == 0) {
+                s.max_us = strtod(value, NULL);
+            }
+            yaml_event_delete(&event);
+        }
+        free(key);
+    }
+
+    if (s.count == 0) s.min_us = INFINITY;
+    if (!failed && name) failed = add_baseline_case(b, name, &s, elapsed);
+    free(name);
+    return failed || !name ? -1 : 0;
+}
+
+// The file is JSON, which libyaml reads like any other flow-style YAML
+int load_baseline(const char *path, Baseline *b) {
+    init_baseline(b);
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        LOG_ERROR("Failed to open baseline file %s", path);
+        return -1;
+    }
+
+    yaml_parser_t parser;
+    yaml_event_t event;
+    if (!yaml_parser_initialize(&parser)) {
+        fclose(fp);
+        return -1;
+    }
+    yaml_parser_set_input_file(&parser, fp);
+
+    // Stream, document and top-level mapping starts
+    int failed = 0;
+    for (int i = 0; i < 3 && !failed; i++) {
+        if (!yaml_parser_parse(&parser, &event)) {
+            failed = 1;
+            break;
+        }
+        if (i == 2 && event.type != YAML_MAPPING_START_EVENT) failed = 1;
+        yaml_event_delete(&event);
+    }
+
+    while (!failed) {
+        if (!yaml_parser_parse(&parser, &event)) {
+            failed = 1;
+            break;
+        }
+        if (event.type == YAML_MAPPING_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        char *key = event.type == YAML_SCALAR_EVENT ? strdup((char *)event.data.scalar.value) : NULL;
+        yaml_event_delete(&event);
+        if (!key || !yaml_parser_parse(&parser, &event)) {
+            free(key);
+            failed = 1;
+            break;
+        }
+
+        if (strcmp(key, "cases") == 0 && event.type == YAML_SEQUENCE_START_EVENT) {
+            yaml_event_delete(&event);
+            while (!failed) {
+                if (!yaml_parser_parse(&parser, &event)) {
+                    failed = 1;
+                    break;
+                }
+                yaml_event_type_t type = event.type;
+                yaml_event_delete(&event);
+                if (type == YAML_SEQUENCE_END_EVENT) break;
+                failed = type != YAML_MAPPING_START_EVENT || read_case(&parser, b);
+            }
+        } else if (event.type == YAML_SCALAR_EVENT) {
+            const char *value = (char *)event.data.scalar.value;
+            if (strcmp(key, "version") == 0 && atoi(value) != BASELINE_VERSION) {
+                LOG_ERROR("Baseline %s has version %s, expected %d", path, value, BASELINE_VERSION);
+                failed = 1;
+            } else if (strcmp(key, "gamma") == 0 && strtod(value, NULL) != STATS_GAMMA) {
+                LOG_ERROR("Baseline %s uses a different latency histogram", path);
+                failed = 1;
+            }
+            yaml_event_delete(&event);
+        } else {
+            yaml_event_delete(&event);
+            failed = 1;
+        }
+        free(key);
+    }
+
+    yaml_parser_delete(&parser);
+    fclose(fp);
+    if (failed) {
+        LOG_ERROR("Invalid baseline file %s", path);
+        free_baseline(b);
+        return -1;
+    }
+    return 0;
+}
+
+void init_allowed_delta(AllowedDelta *d) {
+    d->p50 = 0.10;
+    d->p99 = 0.20;
+    d->rps = 0.10;
+    d->errors = 0.01;
+    d->alpha = 0.01;
+}
+
+int parse_allowed_delta(const char *s, AllowedDelta *d) {
+    char *copy = strdup(s);
+    if (!copy) return -1;
+
+    int rc = 0;
+    char *save = NULL;
+    for (char *item = strtok_r(copy, ",", &save); item && rc == 0; item = strtok_r(NULL, ",", &save)) {
+        char *eq = strchr(item, '=');
+        if (!eq) {
+            rc = -1;
+            break;
+        }
+        *eq = '\0';
+        double *field = strcmp(item, "p50") == 0 ? &d->p50 : strcmp(item, "p99") == 0 ? &d->p99 :
+                        strcmp(item, "rps") == 0 ? &d->rps : strcmp(item, "errors") == 0 ? &d->errors :
+                        strcmp(item, "alpha") == 0 ? &d->alpha : NULL;
+        if (!field || parse_percent(eq + 1, field)) rc = -1;
+    }
+    free(copy);
+    return rc;
+}
+
+// One-sided Mann-Whitney U test that run is slower than base. Both histograms share their
+// buckets, so latencies in the same bucket count as ties. Returns the p-value and sets
+// *effect to the probability that a request of run took longer than one of base.
+static double mann_whitney(const Stats *base, const Stats *run, double *effect) {
+    double n1 = (double)run->count;
+    double n2 = (double)base->count;
+    *effect = 0.5;
+    if (n1 < MIN_SAMPLES || n2 < MIN_SAMPLES) return 1;
+
+    double u = 0;      // Pairs where run is slower, ties count half
+    double ties = 0;   // Sum of t^3 - t over tied groups
+    double below = 0;  // Base latencies in lower buckets
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        double r = run->buckets[i];
+        double b = base->buckets[i];
+        u += r * (below + b / 2);
+        double t = r + b;
+        ties += t * t * t - t;
+        below += b;
+    }
+
+    double n = n1 + n2;
+    double var = n1 * n2 / 12 * ((n + 1) - ties / (n * (n - 1)));
+    *effect = u / (n1 * n2);
+    if (var <= 0) return 1;
+    double z = (u - n1 * n2 / 2) / sqrt(var);
+    return 0.5 * erfc(z / M_SQRT2);
+}
+
+static double change(double before, double after) {
+    return before > 0 ? after / before - 1 : 0;
+}
+
+static double error_rate(const Stats *s) {
+    uint64_t total = s->count + s->failures;
+    return total ? (double)(s->failures + s->http_errors) / total : 0;
+}
+
+static double throughput(const BaselineCase *c) {
+    return c->elapsed > 0 ? (c->stats.count + c->stats.failures) / c->elapsed : 0;
+}
+
+int compare_baseline(const Baseline *base, const Baseline *run, const AllowedDelta *d) {
+    int regressed = 0;
+    LOG_INFO("========== BASELINE COMPARISON =======");
+    LOG_INFO("%-28s %-26s %-26s %-28s %-16s %8s  %s",
+             "case", "p50 ms", "p99 ms", "req/s", "errors", "p-value", "result");
+    for (int i = 0; i < run->count; i++) {
+        const BaselineCase *now = &run->cases[i];
+        const BaselineCase *was = find_case(base, now->name);
+        if (!was) {
+            LOG_INFO("%-28s not in the baseline", now->name);
+            continue;
+        }
+
+        const Stats *a = &was->stats;
+        const Stats *b = &now->stats;
+        double p50[2] = {stats_quantile(a, 0.50) / 1000, stats_quantile(b, 0.50) / 1000};
+        double p99[2] = {stats_quantile(a, 0.99) / 1000, stats_quantile(b, 0.99) / 1000};
+        double rps[2] = {throughput(was), throughput(now)};
+        double errors[2] = {error_rate(a), error_rate(b)};
+        double effect;
+        double p = mann_whitney(a, b, &effect);
+
+        // Significance alone flags tiny shifts on large runs, the allowed deltas bound the size
+        char result[64] = "";
+        size_t len = 0;
+        if (p < d->alpha && change(p50[0], p50[1]) > d->p50) len += snprintf(result + len, sizeof(result) - len, " p50");
+        if (p < d->alpha && change(p99[0], p99[1]) > d->p99) len += snprintf(result + len, sizeof(result) - len, " p99");
+        if (-change(rps[0], rps[1]) > d->rps) len += snprintf(result + len, sizeof(result) - len, " req/s");
+        if (errors[1] - errors[0] > d->errors) snprintf(result + len, sizeof(result) - len, " errors");
+
+        char cells[3][32];
+        snprintf(cells[0], sizeof(cells[0]), "%.2f -> %.2f (%+.1f%%)", p50[0], p50[1], change(p50[0], p50[1]) * 100);
+        snprintf(cells[1], sizeof(cells[1]), "%.2f -> %.2f (%+.1f%%)", p99[0], p99[1], change(p99[0], p99[1]) * 100);
+        snprintf(cells[2], sizeof(cells[2]), "%.1f -> %.1f (%+.1f%%)", rps[0], rps[1], change(rps[0], rps[1]) * 100);
+        char error_cell[32];
+        snprintf(error_cell, sizeof(error_cell), "%.2f%% -> %.2f%%", errors[0] * 100, errors[1] * 100);
+
+        if (result[0]) {
+            regressed++;
+            LOG_ERROR("%-28s %-26s %-26s %-28s %-16s %8.2g  REGRESSED:%s",
+                      now->name, cells[0], cells[1], cells[2], error_cell, p, result);
+        } else {
+            LOG_INFO("%-28s %-26s %-26s %-28s %-16s %8.2g  %s", now->name, cells[0], cells[1], cells[2],
+                     error_cell, p, 1 - p < d->alpha && effect < 0.5 ? "faster" : "ok");
+        }
+    }
+    for (int i = 0; i < base->count; i++) {
+        // A case that stopped running would otherwise pass unnoticed
+        if (!find_case(run, base->cases[i].name)) {
+            LOG_ERROR("%-28s in the baseline but not run", base->cases[i].name);
+            regressed++;
+        }
+    }
+    return regressed;
+}
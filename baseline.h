@@ -0,0 +1,51 @@
+#ifndef BASELINE_H
+#define BASELINE_H
+
+#include "stats.h"
+
+#define BASELINE_VERSION 1
+
+// Load test results of one case, keyed by the name it is reported under
+typedef struct {
+    char *name;
+    Stats stats;
+    double elapsed;
+} BaselineCase;
+
+typedef struct {
+    BaselineCase *cases;
+    int count;
+    int cap;
+} Baseline;
+
+// How much worse a run may get before it counts as a regression
+typedef struct {
+    double p50;    // Allowed relative increase of the median
+    double p99;    // Allowed relative increase of p99
+    double rps;    // Allowed relative drop in throughput
+    double errors; // Allowed increase of the error rate, as a fraction of requests
+    double alpha;  // Significance level of the Mann-Whitney test on latency
+} AllowedDelta;
+
+void init_baseline(Baseline *b);
+void free_baseline(Baseline *b);
+
+// Record the results of a case, replacing an earlier load test of the same name
+int add_baseline_case(Baseline *b, const char *name, const Stats *s, double elapsed);
+
+// Store every case with its full latency histogram as JSON
+int save_baseline(const char *path, const Baseline *b);
+int load_baseline(const char *path, Baseline *b);
+
+void init_allowed_delta(AllowedDelta *d);
+
+// Parse p50=10%,p99=20%,rps=5%,errors=1% into d, keys not given keep their value; -1 if invalid
+int parse_allowed_delta(const char *s, AllowedDelta *d);
+
+// Log a diff table of run against base. A case regresses when its latency is significantly
+// higher and p50 or p99 grew by more than allowed, or its throughput or error rate got worse
+// by more than allowed.
+// Returns the number of regressed cases plus the baseline cases missing from run.
+int compare_baseline(const Baseline *base, const Baseline *run, const AllowedDelta *d);
+
+#endif
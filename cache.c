@@ -0,0 +1,479 @@
+#include "cache.h"
+#include "log.h"
+#include "utils.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define PLAN_MAGIC "CAPISPLN"
+// Bump whenever the METADATA layout written below changes
+#define PLAN_VERSION 9
+#define NULL_STRING 0xFFFFFFFFu
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t content_hash;  // Hash of the YAML file the plan was built from
+    uint64_t content_size;
+} PlanHeader;
+
+// Read cursor over a mapped plan; any overrun marks it failed
+typedef struct {
+    const char *p;
+    const char *end;
+    int failed;
+} Reader;
+
+static uint32_t read_u32(Reader *r) {
+    uint32_t v = 0;
+    if (r->end - r->p < 4) {
+        r->failed = 1;
+        return 0;
+    }
+    memcpy(&v, r->p, 4);
+    r->p += 4;
+    return v;
+}
+
+static double read_f64(Reader *r) {
+    double v = 0;
+    if ((size_t)(r->end - r->p) < sizeof(v)) {
+        r->failed = 1;
+        return 0;
+    }
+    memcpy(&v, r->p, sizeof(v));
+    r->p += sizeof(v);
+    return v;
+}
+
+static uint64_t read_u64(Reader *r) {
+    uint64_t v = 0;
+    if (r->end - r->p < 8) {
+        r->failed = 1;
+        return 0;
+    }
+    memcpy(&v, r->p, 8);
+    r->p += 8;
+    return v;
+}
+
+static char *read_str(Reader *r, size_t *len_out) {
+    uint32_t len = read_u32(r);
+    if (r->failed || len == NULL_STRING) return NULL;
+    if ((size_t)(r->end - r->p) < len) {
+        r->failed = 1;
+        return NULL;
+    }
+    char *s = malloc(len + 1);
+    if (!s) {
+        r->failed = 1;
+        return NULL;
+    }
+    memcpy(s, r->p, len);
+    s[len] = '\0';
+    r->p += len;
+    if (len_out) *len_out = len;
+    return s;
+}
+
+static void write_u32(FILE *fp, uint32_t v) {
+    fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void write_u64(FILE *fp, uint64_t v) {
+    fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void write_f64(FILE *fp, double v) {
+    fwrite(&v, sizeof(v), 1, fp);
+}
+
+static void write_str(FILE *fp, const char *s, size_t len) {
+    if (!s) {
+        write_u32(fp, NULL_STRING);
+        return;
+    }
+    write_u32(fp, (uint32_t)len);
+    fwrite(s, 1, len, fp);
+}
+
+static void write_cstr(FILE *fp, const char *s) {
+    write_str(fp, s, s ? strlen(s) : 0);
+}
+
+// NULL-terminated string list, stored as a count and the strings
+static void write_list(FILE *fp, char **list) {
+    uint32_t count = 0;
+    if (list) while (list[count]) count++;
+    write_u32(fp, count);
+    for (uint32_t i = 0; i < count; i++) {
+        write_cstr(fp, list[i]);
+    }
+}
+
+// Read back a list from write_list, NULL when it is empty
+static char **read_list(Reader *r) {
+    uint32_t count = read_u32(r);
+    if (count == 0 || r->failed) return NULL;
+
+    char **list = calloc(count + 1, sizeof(char *));
+    for (uint32_t i = 0; list && i < count && !r->failed; i++) {
+        list[i] = read_str(r, NULL);
+    }
+    return list;
+}
+
+// Cache entry path: cache_dir/<hash of the YAML path>.plan
+static char *plan_path(const char *path, const char *cache_dir) {
+    size_t len = strlen(cache_dir) + 32;
+    char *out = malloc(len);
+    if (out) {
+        snprintf(out, len, "%s/%016llx.plan", cache_dir,
+                 (unsigned long long)hash_bytes(path, strlen(path)));
+    }
+    return out;
+}
+
+// Serialize the parsed fields of md; compiled templates and encodings are rebuilt on load
+static int write_plan(const char *file, const PlanHeader *header, const METADATA *md) {
+    size_t len = strlen(file) + 8;
+    char *tmp = malloc(len);
+    if (!tmp) return -1;
+    snprintf(tmp, len, "%s.tmp", file);
+
+    FILE *fp = fopen(tmp, "wb");
+    if (!fp) {
+        free(tmp);
+        return -1;
+    }
+
+    fwrite(header, sizeof(PlanHeader), 1, fp);
+    write_u32(fp, (uint32_t)md->method);
+    write_cstr(fp, md->host);
+    write_cstr(fp, md->path);
+    write_cstr(fp, md->url);
+    write_u32(fp, (uint32_t)md->timeout);
+    write_u32(fp, md->secure);
+
+    uint32_t count = 0;
+    if (md->headers) for (Header *h = md->headers; h->key; h++) count++;
+    write_u32(fp, count);
+    for (uint32_t i = 0; i < count; i++) {
+        write_cstr(fp, md->headers[i].key);
+        write_cstr(fp, md->headers[i].value);
+    }
+
+    count = 0;
+    if (md->params) for (Param *p = md->params; p->key; p++) count++;
+    write_u32(fp, count);
+    for (uint32_t i = 0; i < count; i++) {
+        write_cstr(fp, md->params[i].key);
+        write_cstr(fp, md->params[i].value);
+    }
+
+    count = 0;
+    if (md->cookies) for (Cookie *c = md->cookies; c->name; c++) count++;
+    write_u32(fp, count);
+    for (uint32_t i = 0; i < count; i++) {
+        Cookie *c = &md->cookies[i];
+        write_cstr(fp, c->name);
+        write_cstr(fp, c->value);
+        write_cstr(fp, c->domain);
+        write_cstr(fp, c->path);
+        write_cstr(fp, c->expires);
+        write_u32(fp, c->httpOnly);
+        write_u32(fp, c->secure);
+    }
+
+    write_cstr(fp, md->body_file ? md->body_file->path : NULL);
+
+    const BodyGenerator *g = md->body_generator;
+    write_u32(fp, g ? 1 : 0);
+    if (g) {
+        write_u64(fp, g->size);
+        write_u32(fp, (uint32_t)g->pattern);
+        write_str(fp, g->text, g->text_len);
+        write_u32(fp, g->chunked);
+    }
+
+    count = 0;
+    if (md->multipart) for (Part *p = md->multipart; p->name; p++) count++;
+    write_u32(fp, count);
+    for (uint32_t i = 0; i < count; i++) {
+        Part *p = &md->multipart[i];
+        write_cstr(fp, p->name);
+        write_cstr(fp, p->value);
+        write_cstr(fp, p->filename);
+        write_cstr(fp, p->type);
+        write_cstr(fp, p->file ? p->file->path : NULL);
+    }
+
+    write_str(fp, md->json_body, md->json_len);
+    write_cstr(fp, md->feeder ? md->feeder->file->path : NULL);
+    write_u32(fp, md->feeder ? (uint32_t)md->feeder->mode : 0);
+
+    write_cstr(fp, md->id);
+    write_list(fp, md->depends_on);
+    write_list(fp, md->resolve);
+    write_cstr(fp, md->unix_socket);
+
+    write_u32(fp, (uint32_t)md->stage_count);
+    for (int i = 0; i < md->stage_count; i++) {
+        write_f64(fp, md->stages[i].duration);
+        write_u32(fp, (uint32_t)md->stages[i].target);
+    }
+
+    const Throughput *tp = md->throughput;
+    write_u32(fp, tp ? 1 : 0);
+    if (tp) {
+        write_u32(fp, (uint32_t)tp->segments);
+        write_u32(fp, (uint32_t)tp->downloads);
+        write_u32(fp, (uint32_t)tp->sink);
+        write_u32(fp, tp->verify);
+        write_u32(fp, tp->crc32c);
+    }
+
+    const Stream *st = md->stream;
+    write_u32(fp, st ? 1 : 0);
+    if (st) {
+        write_u32(fp, (uint32_t)st->type);
+        write_u32(fp, (uint32_t)st->connections);
+        write_f64(fp, st->duration);
+        write_cstr(fp, st->timestamp);
+        write_cstr(fp, st->message);
+        write_f64(fp, st->interval);
+        write_u32(fp, st->reconnect);
+    }
+
+    const HostLimits *hl = md->host_limits;
+    write_u32(fp, hl ? 1 : 0);
+    if (hl) {
+        write_u32(fp, (uint32_t)hl->connections);
+        write_u32(fp, (uint32_t)hl->in_flight);
+        write_f64(fp, hl->rate);
+        write_u32(fp, (uint32_t)hl->burst);
+    }
+
+    int rc = ferror(fp) ? -1 : 0;
+    if (fclose(fp) != 0) rc = -1;
+    // Publish atomically so concurrent runs never see a half-written plan
+    if (rc == 0 && rename(tmp, file) != 0) rc = -1;
+    if (rc) unlink(tmp);
+    free(tmp);
+    return rc;
+}
+
+// Rebuild a METADATA from a mapped plan
+static METADATA *read_plan(const char *data, size_t size) {
+    Reader r = {data + sizeof(PlanHeader), data + size, 0};
+    METADATA *md = init_metadata();
+    if (!md) return NULL;
+
+    md->method = (enum CURL_METHOD)read_u32(&r);
+    free(md->host);
+    free(md->path);
+    free(md->url);
+    md->host = read_str(&r, NULL);
+    md->path = read_str(&r, NULL);
+    md->url = read_str(&r, NULL);
+    md->timeout = (long)read_u32(&r);
+    md->secure = read_u32(&r) != 0;
+
+    uint32_t count = read_u32(&r);
+    if (count > 0 && !r.failed) {
+        md->headers = calloc(count + 1, sizeof(Header));
+        for (uint32_t i = 0; md->headers && i < count && !r.failed; i++) {
+            md->headers[i].key = read_str(&r, NULL);
+            md->headers[i].value = read_str(&r, NULL);
+        }
+    }
+
+    count = read_u32(&r);
+    if (count > 0 && !r.failed) {
+        md->params = calloc(count + 1, sizeof(Param));
+        for (uint32_t i = 0; md->params && i < count && !r.failed; i++) {
+            md->params[i].key = read_str(&r, NULL);
+            md->params[i].value = read_str(&r, NULL);
+        }
+    }
+
+    count = read_u32(&r);
+    if (count > 0 && !r.failed) {
+        md->cookies = calloc(count + 1, sizeof(Cookie));
+        for (uint32_t i = 0; md->cookies && i < count && !r.failed; i++) {
+            Cookie *c = &md->cookies[i];
+            c->name = read_str(&r, NULL);
+            c->value = read_str(&r, NULL);
+            c->domain = read_str(&r, NULL);
+            c->path = read_str(&r, NULL);
+            c->expires = read_str(&r, NULL);
+            c->httpOnly = read_u32(&r) != 0;
+            c->secure = read_u32(&r) != 0;
+        }
+    }
+
+    // Data files are mapped afresh, only the plan itself is cached
+    char *body_file = read_str(&r, NULL);
+    if (body_file) {
+        md->body_file = map_file(body_file);
+        if (!md->body_file) {
+            LOG_ERROR("Failed to map body file: %s", body_file);
+            r.failed = 1;
+        }
+        free(body_file);
+    }
+
+    if (read_u32(&r) && !r.failed) {
+        md->body_generator = calloc(1, sizeof(BodyGenerator));
+        if (md->body_generator) {
+            md->body_generator->size = read_u64(&r);
+            md->body_generator->pattern = (GenPattern)read_u32(&r);
+            md->body_generator->text = read_str(&r, &md->body_generator->text_len);
+            md->body_generator->chunked = read_u32(&r) != 0;
+        } else {
+            r.failed = 1;
+        }
+    }
+
+    count = read_u32(&r);
+    if (count > 0 && !r.failed) {
+        md->multipart = calloc(count + 1, sizeof(Part));
+        for (uint32_t i = 0; md->multipart && i < count && !r.failed; i++) {
+            Part *p = &md->multipart[i];
+            p->name = read_str(&r, NULL);
+            p->value = read_str(&r, NULL);
+            p->filename = read_str(&r, NULL);
+            p->type = read_str(&r, NULL);
+            char *file = read_str(&r, NULL);
+            if (file) {
+                p->file = map_file(file);
+                if (!p->file) {
+                    LOG_ERROR("Failed to map multipart file: %s", file);
+                    r.failed = 1;
+                }
+                free(file);
+            }
+        }
+    }
+
+    md->json_body = read_str(&r, &md->json_len);
+    char *feeder = read_str(&r, NULL);
+    uint32_t mode = read_u32(&r);
+    if (feeder && !r.failed) {
+        md->feeder = load_feeder(feeder, (FeedMode)mode);
+        if (!md->feeder) r.failed = 1;
+    }
+    free(feeder);
+
+    md->id = read_str(&r, NULL);
+    md->depends_on = read_list(&r);
+    md->resolve = read_list(&r);
+    md->unix_socket = read_str(&r, NULL);
+
+    count = read_u32(&r);
+    if (count > 0 && !r.failed) {
+        md->stages = calloc(count, sizeof(Stage));
+        for (uint32_t i = 0; md->stages && i < count && !r.failed; i++) {
+            md->stages[i].duration = read_f64(&r);
+            md->stages[i].target = (int)read_u32(&r);
+        }
+        if (md->stages) md->stage_count = (int)count;
+    }
+
+    if (read_u32(&r) && !r.failed) {
+        md->throughput = calloc(1, sizeof(Throughput));
+        if (md->throughput) {
+            md->throughput->segments = (int)read_u32(&r);
+            md->throughput->downloads = (int)read_u32(&r);
+            md->throughput->sink = (BodySink)read_u32(&r);
+            md->throughput->verify = read_u32(&r) != 0;
+            md->throughput->crc32c = read_u32(&r);
+        } else {
+            r.failed = 1;
+        }
+    }
+
+    if (read_u32(&r) && !r.failed) {
+        md->stream = calloc(1, sizeof(Stream));
+        if (md->stream) {
+            md->stream->type = (StreamType)read_u32(&r);
+            md->stream->connections = (int)read_u32(&r);
+            md->stream->duration = read_f64(&r);
+            md->stream->timestamp = read_str(&r, NULL);
+            md->stream->message = read_str(&r, NULL);
+            md->stream->interval = read_f64(&r);
+            md->stream->reconnect = read_u32(&r) != 0;
+        } else {
+            r.failed = 1;
+        }
+    }
+
+    if (read_u32(&r) && !r.failed) {
+        md->host_limits = calloc(1, sizeof(HostLimits));
+        if (md->host_limits) {
+            md->host_limits->connections = (int)read_u32(&r);
+            md->host_limits->in_flight = (int)read_u32(&r);
+            md->host_limits->rate = read_f64(&r);
+            md->host_limits->burst = (int)read_u32(&r);
+        } else {
+            r.failed = 1;
+        }
+    }
+
+    if (r.failed || !md->host || !md->path || !md->url) {
+        free_metadata(md);
+        return NULL;
+    }
+    return md;
+}
+
+METADATA *load_cached_metadata(const char *path, const char *cache_dir) {
+    if (!cache_dir) return load_metadata(path);
+
+    MappedFile *yaml = map_file(path);
+    if (!yaml) {
+        LOG_ERROR("Failed to open %s", path);
+        return NULL;
+    }
+    PlanHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PLAN_MAGIC, sizeof(header.magic));
+    header.version = PLAN_VERSION;
+    header.content_hash = hash_bytes(yaml->data, yaml->size);
+    header.content_size = yaml->size;
+    unmap_file(yaml);
+
+    char *file = plan_path(path, cache_dir);
+    if (!file) return load_metadata(path);
+
+    METADATA *md = NULL;
+    MappedFile *plan = map_file(file);
+    if (plan && plan->size >= sizeof(PlanHeader) && memcmp(plan->data, &header, sizeof(PlanHeader)) == 0) {
+        md = read_plan(plan->data, plan->size);
+        if (md && compile_metadata(md)) {
+            free_metadata(md);
+            md = NULL;
+        }
+        if (md) LOG_INFO("Processing METADATA: %s (cached)", path);
+    }
+    unmap_file(plan);
+
+    if (!md) {
+        // Missing, stale or unreadable: parse the YAML and rebuild the entry
+        md = load_metadata(path);
+        if (md) {
+            if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+                LOG_WARN("Failed to create cache directory %s", cache_dir);
+            } else if (write_plan(file, &header, md)) {
+                LOG_WARN("Failed to write plan cache for %s", path);
+            }
+        }
+    }
+
+    free(file);
+    return md;
+}
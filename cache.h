@@ -0,0 +1,11 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "read_yaml.h"
+
+// Load a case through the plan cache in cache_dir: an entry whose content hash matches
+// the YAML file is loaded without parsing, a missing or stale one is rebuilt.
+// Without a cache_dir this is load_metadata.
+METADATA *load_cached_metadata(const char *path, const char *cache_dir);
+
+#endif
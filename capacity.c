@@ -0,0 +1,204 @@
+#include "capacity.h"
+#include "log.h"
+#include "profile.h"
+#include <stdlib.h>
+#include <string.h>
+
+// The two halves of a step must agree this closely for it to count as steady;
+// latency may also move by a small share of the SLO bound, which absorbs noise at low latencies
+#define STEADY_RATE_DRIFT 0.10
+#define STEADY_LATENCY_DRIFT 0.25
+#define STEADY_SLO_SHARE 0.10
+
+typedef struct {
+    double rate;       // Target req/s
+    double achieved;   // Measured req/s after warm-up
+    double p50_ms;
+    double slo_ms;     // Latency at the SLO quantile
+    double errors;     // Error fraction
+    bool steady;
+    bool pass;
+    bool client_bound; // capis ran out of CPU, the step says little about the server
+} CapacityStep;
+
+void init_capacity_options(CapacityOptions *c) {
+    c->slo.quantile = 0.99;
+    c->slo.latency_ms = 0;
+    c->slo.error_rate = 0.01;
+    c->start_rate = 10;
+    c->step = 10;
+    c->window = 2;
+    c->precision = 0.05;
+    c->max_steps = 20;
+}
+
+int parse_slo(const char *s, Slo *slo) {
+    if (s[0] != 'p' && s[0] != 'P') return -1;
+    char *end = NULL;
+    double q = strtod(s + 1, &end);
+    if (end == s + 1 || *end != '<' || q <= 0 || q >= 100) return -1;
+    double limit = parse_duration(end + 1);
+    if (limit <= 0) return -1;
+    slo->quantile = q / 100;
+    slo->latency_ms = limit * 1000;
+    return 0;
+}
+
+int parse_percent(const char *s, double *out) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    if (*end == '%') {
+        v /= 100;
+        end++;
+    }
+    if (*end != '\0' || v > 1) return -1;
+    *out = v;
+    return 0;
+}
+
+static double step_rate(const Stats *s, double seconds) {
+    return seconds > 0 ? (s->count + s->failures) / seconds : 0;
+}
+
+static bool close_enough(double a, double b, double drift) {
+    double hi = a > b ? a : b;
+    return hi <= 0 || (a > b ? a - b : b - a) <= hi * drift;
+}
+
+// Hold one rate and judge it on the windows after warm-up
+static int measure_step(const Scenario *mix, const LoadOptions *base, const CapacityOptions *c,
+                        double rate, double seconds, CapacityStep *step) {
+    LoadOptions opts = *base;
+    opts.rate = rate;
+    opts.duration = seconds;
+    opts.requests = 0;
+    opts.stages = NULL;
+    opts.stage_count = 0;
+    opts.window = c->window;
+    opts.quiet = true;
+    opts.timeseries = NULL;
+    opts.trace = NULL;
+    opts.results = NULL;
+
+    LoadResult result;
+    if (run_load(mix, &opts, &result)) return -1;
+    if (result.window_count < 3) {
+        free_load_result(&result);
+        return -1;
+    }
+
+    // Window 0 is warm-up, the rest is compared half against half
+    Stats measured, first, second;
+    init_stats(&measured);
+    init_stats(&first);
+    init_stats(&second);
+    int mid = 1 + (result.window_count - 1) / 2;
+    for (int i = 1; i < result.window_count; i++) {
+        merge_stats(&measured, &result.windows[i]);
+        merge_stats(i < mid ? &first : &second, &result.windows[i]);
+    }
+    // The last window is cut short when the step is not a whole number of windows
+    double measured_time = result.elapsed - c->window;
+    double first_time = (mid - 1) * c->window;
+    double second_time = measured_time - first_time;
+
+    uint64_t total = measured.count + measured.failures;
+    step->rate = rate;
+    step->achieved = step_rate(&measured, measured_time);
+    step->p50_ms = measured.count ? stats_quantile(&measured, 0.5) / 1000 : 0;
+    step->slo_ms = measured.count ? stats_quantile(&measured, c->slo.quantile) / 1000 : 0;
+    step->errors = total ? (double)(measured.failures + measured.http_errors) / total : 1;
+    step->steady = close_enough(step_rate(&first, first_time), step_rate(&second, second_time), STEADY_RATE_DRIFT);
+    if (step->steady && first.count > 0 && second.count > 0) {
+        double a = stats_quantile(&first, c->slo.quantile) / 1000;
+        double b = stats_quantile(&second, c->slo.quantile) / 1000;
+        double drift = a > b ? a - b : b - a;
+        step->steady = drift <= c->slo.latency_ms * STEADY_SLO_SHARE || close_enough(a, b, STEADY_LATENCY_DRIFT);
+    }
+    // Falling behind the schedule means the client or server is saturated
+    step->pass = total > 0 && step->achieved >= rate * 0.95 &&
+                 step->slo_ms <= c->slo.latency_ms && step->errors <= c->slo.error_rate;
+    step->client_bound = client_saturated(result.client_cpu);
+
+    free_load_result(&result);
+    return 0;
+}
+
+static int compare_steps(const void *a, const void *b) {
+    double x = ((const CapacityStep *)a)->rate;
+    double y = ((const CapacityStep *)b)->rate;
+    return (x > y) - (x < y);
+}
+
+int find_capacity(METADATA *md, const LoadOptions *base, const CapacityOptions *c) {
+    ScenarioCase only = {NULL, md, 1.0, NULL};
+    Scenario mix = {&only, 1, NULL, NULL};
+    CapacityStep *steps = calloc(c->max_steps, sizeof(CapacityStep));
+    if (!steps) return -1;
+
+    LOG_INFO("Capacity search: p%g < %.1f ms, errors < %g%%, %g s per step",
+             c->slo.quantile * 100, c->slo.latency_ms, c->slo.error_rate * 100, c->step);
+
+    double lo = 0;  // Highest rate that passed
+    double hi = 0;  // Lowest rate that failed, 0 until one does
+    double rate = c->start_rate;
+    bool client_bound = false;  // A failed step ran capis out of CPU
+    int count = 0;
+    int rc = 0;
+    while (count < c->max_steps && rate >= 0.5) {
+        CapacityStep *step = &steps[count];
+        if (measure_step(&mix, base, c, rate, c->step, step)) {
+            LOG_ERROR("Capacity step at %.1f req/s failed to run", rate);
+            rc = -1;
+            break;
+        }
+        // A drifting step that looks fine gets one longer retry before it is judged
+        if (step->pass && !step->steady) {
+            LOG_INFO("%.1f req/s has not settled, holding it for %g s", rate, c->step * 2);
+            if (measure_step(&mix, base, c, rate, c->step * 2, step)) {
+                rc = -1;
+                break;
+            }
+            if (!step->steady) step->pass = false;
+        }
+        count++;
+
+        LOG_INFO("Step %d: %.1f req/s -> %.1f achieved, p50 %.2f ms, p%g %.2f ms, errors %.2f%% [%s]%s",
+                 count, step->rate, step->achieved, step->p50_ms, c->slo.quantile * 100, step->slo_ms,
+                 step->errors * 100, step->pass ? "pass" : step->steady ? "FAIL" : "FAIL, unsteady",
+                 step->client_bound ? " client saturated" : "");
+        if (!step->pass && step->client_bound) client_bound = true;
+
+        if (step->pass) lo = rate; else hi = rate;
+        if (hi == 0) {
+            rate *= 2;
+        } else if (lo == 0) {
+            rate = hi / 2;
+        } else if ((hi - lo) / hi <= c->precision) {
+            break;
+        } else {
+            rate = (lo + hi) / 2;
+        }
+    }
+
+    qsort(steps, count, sizeof(CapacityStep), compare_steps);
+    LOG_INFO("========== CAPACITY CURVE ============");
+    for (int i = 0; i < count; i++) {
+        LOG_INFO("%10.1f req/s  achieved %10.1f  p50 %8.2f ms  p%g %8.2f ms  errors %6.2f%%  %s",
+                 steps[i].rate, steps[i].achieved, steps[i].p50_ms, c->slo.quantile * 100,
+                 steps[i].slo_ms, steps[i].errors * 100, steps[i].pass ? "pass" : "fail");
+    }
+    if (lo > 0) {
+        LOG_INFO("Max sustainable rate: %.1f req/s", lo);
+        if (client_bound) {
+            LOG_WARN("capis ran out of CPU on a failed step, the server may sustain more; retry with more --threads");
+        }
+    } else if (rc == 0) {
+        LOG_WARN("No rate met the SLO");
+        rc = -1;
+    }
+
+    free(steps);
+    return rc;
+}
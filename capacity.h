@@ -0,0 +1,35 @@
+#ifndef CAPACITY_H
+#define CAPACITY_H
+
+#include "multi_curl.h"
+#include "read_yaml.h"
+
+typedef struct {
+    double quantile;    // Latency quantile the SLO bounds, e.g. 0.99
+    double latency_ms;  // Upper bound on that quantile
+    double error_rate;  // Highest fraction of failed or HTTP >= 400 responses
+} Slo;
+
+typedef struct {
+    Slo slo;
+    double start_rate;  // First rate tried in req/s
+    double step;        // Seconds each rate is held
+    double window;      // Steady-state window in seconds, the first one is warm-up
+    double precision;   // Stop once the bracket is this narrow relative to its upper end
+    int max_steps;
+} CapacityOptions;
+
+void init_capacity_options(CapacityOptions *c);
+
+// Parse a latency objective such as p99<200ms or p95<1.5s, -1 if invalid
+int parse_slo(const char *s, Slo *slo);
+
+// Parse a percentage such as 0.1% into a fraction, -1 if invalid
+int parse_percent(const char *s, double *out);
+
+// Search for the highest request rate md sustains within the SLO: double the rate
+// while it holds, then bisect between the last pass and the first failure.
+// Logs every step and the resulting latency curve.
+int find_capacity(METADATA *md, const LoadOptions *base, const CapacityOptions *c);
+
+#endif
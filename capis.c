@@ -0,0 +1,268 @@
+#include "capis.h"
+#include "easy_curl.h"
+#include "log.h"
+#include "multi_curl.h"
+#include "profile.h"
+#include "read_yaml.h"
+#include <curl/curl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct CapisContext {
+    CURLSH *pool;   // Connections, DNS and TLS sessions shared by every run
+    CURLM *multi;   // Event loop for capis_run_all, kept for its connection cache
+};
+
+struct CapisPlan {
+    char *name;
+    METADATA *md;
+    FeedCursor cursor;  // Successive runs walk the plan's feeder
+};
+
+// The library stays quiet unless its user asks for logs
+static bool level_chosen = false;
+
+void capis_set_log_level(CapisLogLevel level) {
+    level_chosen = true;
+    set_log_level((level_t)level);
+}
+
+void capis_set_seed(uint64_t seed) {
+    set_generator_seed(seed);
+}
+
+CapisContext *capis_context_new(void) {
+    if (!level_chosen) set_log_level(LOG_LEVEL_OFF);
+    if (curl_global_init(CURL_GLOBAL_ALL) != CURLE_OK) return NULL;
+    init_profiling();
+
+    CapisContext *ctx = calloc(1, sizeof(CapisContext));
+    if (!ctx) goto FAIL;
+    ctx->pool = new_connection_pool();
+    ctx->multi = curl_multi_init();
+    if (!ctx->pool || !ctx->multi) goto FAIL;
+    return ctx;
+
+FAIL:
+    capis_context_free(ctx);
+    if (!ctx) curl_global_cleanup();
+    return NULL;
+}
+
+void capis_context_free(CapisContext *ctx) {
+    if (!ctx) return;
+    if (ctx->multi) curl_multi_cleanup(ctx->multi);
+    if (ctx->pool) curl_share_cleanup(ctx->pool);
+    free(ctx);
+    curl_global_cleanup();
+}
+
+static CapisPlan *new_plan(const char *name, FILE *fp) {
+    CapisPlan *plan = calloc(1, sizeof(CapisPlan));
+    if (!plan) return NULL;
+    plan->name = strdup(name);
+    plan->md = init_metadata();
+    if (!plan->name || !plan->md || read_yaml(fp, plan->md)) {
+        LOG_ERROR("Failed to load plan %s", name);
+        capis_plan_free(plan);
+        return NULL;
+    }
+    // Same seed and name, same walk through the feeder
+    init_feed_cursor(&plan->cursor, plan->md->feeder, mix64(generator_seed() ^ hash_bytes(name, strlen(name))));
+    return plan;
+}
+
+CapisPlan *capis_plan_load_file(const char *path) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        LOG_ERROR("Failed to open %s", path);
+        return NULL;
+    }
+    CapisPlan *plan = new_plan(path, fp);
+    fclose(fp);
+    return plan;
+}
+
+CapisPlan *capis_plan_load_buffer(const char *yaml, size_t len, const char *name) {
+    if (!yaml || len == 0) return NULL;
+    FILE *fp = fmemopen((void *)yaml, len, "r");
+    if (!fp) {
+        LOG_ERROR("Failed to read plan %s", name ? name : "(buffer)");
+        return NULL;
+    }
+    CapisPlan *plan = new_plan(name ? name : "(buffer)", fp);
+    fclose(fp);
+    return plan;
+}
+
+void capis_plan_free(CapisPlan *plan) {
+    if (!plan) return;
+    free_metadata(plan->md);
+    free(plan->name);
+    free(plan);
+}
+
+// Configure a fresh transfer of plan on the context's pool, errors going to result->error
+static int begin_run(CapisContext *ctx, CapisPlan *plan, Transfer *t, CapisResult *result) {
+    memset(result, 0, sizeof(CapisResult));
+    memset(t, 0, sizeof(Transfer));
+    result->curl_code = CURLE_FAILED_INIT;
+
+    Record rec;
+    if (plan->md->feeder && next_record(&plan->cursor, &rec)) {
+        snprintf(result->error, sizeof(result->error), "Feeder %s has no records left", plan->md->feeder->file->path);
+        return -1;
+    }
+    t->curl = curl_easy_init();
+    if (!t->curl) {
+        snprintf(result->error, sizeof(result->error), "curl_easy_init failed");
+        return -1;
+    }
+    if (setup_transfer(t, plan->md, plan->md->feeder ? &rec : NULL, 0)) {
+        snprintf(result->error, sizeof(result->error), "Failed to build the request of %s", plan->name);
+        free_response(&t->resp);
+        reset_transfer(t);
+        curl_easy_cleanup(t->curl);
+        return -1;
+    }
+    curl_easy_setopt(t->curl, CURLOPT_SHARE, ctx->pool);
+    curl_easy_setopt(t->curl, CURLOPT_ERRORBUFFER, result->error);
+    return 0;
+}
+
+static double phase_ms(CURL *curl, CURLINFO info) {
+    curl_off_t us = 0;
+    curl_easy_getinfo(curl, info, &us);
+    return us / 1000.0;
+}
+
+// Fill result from a performed transfer, taking over its response, and release the handle
+static int end_run(Transfer *t, CURLcode code, CapisResult *result) {
+    CURL *curl = t->curl;
+    result->curl_code = code;
+    if (code == CURLE_OK) {
+        result->error[0] = '\0';
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &result->status);
+    } else if (result->error[0] == '\0') {
+        snprintf(result->error, sizeof(result->error), "%s", curl_easy_strerror(code));
+    }
+    result->ok = code == CURLE_OK && result->status < 400;
+    result->dns_ms = phase_ms(curl, CURLINFO_NAMELOOKUP_TIME_T);
+    result->connect_ms = phase_ms(curl, CURLINFO_CONNECT_TIME_T);
+    result->tls_ms = phase_ms(curl, CURLINFO_APPCONNECT_TIME_T);
+    result->ttfb_ms = phase_ms(curl, CURLINFO_STARTTRANSFER_TIME_T);
+    result->total_ms = phase_ms(curl, CURLINFO_TOTAL_TIME_T);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &result->new_connections);
+
+    // The buffers move to the result, the cookies stay behind
+    result->headers = t->resp.headers;
+    result->headers_size = t->resp.headers_size;
+    result->body = t->resp.body;
+    result->body_size = t->resp.body_size;
+    t->resp.headers = NULL;
+    t->resp.body = NULL;
+    free_response(&t->resp);
+
+    reset_transfer(t);
+    curl_easy_cleanup(curl);
+    t->curl = NULL;
+    return code == CURLE_OK ? 0 : -1;
+}
+
+int capis_run(CapisContext *ctx, CapisPlan *plan, CapisResult *result) {
+    if (!ctx || !plan || !result) return -1;
+    Transfer t;
+    if (begin_run(ctx, plan, &t, result)) return -1;
+    return end_run(&t, curl_easy_perform(t.curl), result);
+}
+
+int capis_run_all(CapisContext *ctx, CapisPlan *const *plans, int count, int jobs, CapisResult *results) {
+    if (!ctx || !plans || !results || count <= 0) return count > 0 ? count : 0;
+    if (jobs < 1) jobs = 1;
+    Transfer *slots = calloc(count, sizeof(Transfer));
+    if (!slots) return count;
+
+    int next = 0, in_flight = 0, failed = 0;
+    while (next < count || in_flight > 0) {
+        while (next < count && in_flight < jobs) {
+            int i = next++;
+            if (begin_run(ctx, plans[i], &slots[i], &results[i])) {
+                failed++;
+                continue;
+            }
+            curl_easy_setopt(slots[i].curl, CURLOPT_PRIVATE, &slots[i]);
+            curl_multi_add_handle(ctx->multi, slots[i].curl);
+            in_flight++;
+        }
+        if (in_flight == 0) continue;
+
+        int active = 0;
+        curl_multi_perform(ctx->multi, &active);
+        CURLMsg *msg;
+        int left;
+        while ((msg = curl_multi_info_read(ctx->multi, &left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL *easy = msg->easy_handle;
+            CURLcode code = msg->data.result;
+            Transfer *t = NULL;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&t);
+            curl_multi_remove_handle(ctx->multi, easy);
+            in_flight--;
+
+            CapisResult *result = &results[t - slots];
+            end_run(t, code, result);
+            if (!result->ok) failed++;
+        }
+        if (active > 0) curl_multi_poll(ctx->multi, NULL, 0, 100, NULL);
+    }
+    free(slots);
+    return failed;
+}
+
+void capis_result_free(CapisResult *result) {
+    if (!result) return;
+    free(result->headers);
+    free(result->body);
+    result->headers = NULL;
+    result->body = NULL;
+}
+
+int capis_load(CapisContext *ctx, CapisPlan *plan, const CapisLoadOptions *opts, CapisLoadResult *result) {
+    if (!ctx || !plan || !opts || !result) return -1;
+    memset(result, 0, sizeof(CapisLoadResult));
+
+    LoadOptions lo;
+    memset(&lo, 0, sizeof(LoadOptions));
+    lo.users = opts->users > 0 ? opts->users : 1;
+    lo.threads = opts->threads > 0 ? opts->threads : 1;
+    lo.requests = opts->requests;
+    lo.duration = opts->duration;
+    lo.rate = opts->rate;
+    lo.quiet = true;
+    lo.share = ctx->pool;
+
+    ScenarioCase only = {plan->name, plan->md, 1.0, NULL};
+    Scenario mix = {&only, 1, NULL, NULL};
+    LoadResult load;
+    if (run_load(&mix, &lo, &load)) return -1;
+
+    const Stats *s = &load.total;
+    result->requests = s->count + s->failures;
+    result->failures = s->failures;
+    result->http_errors = s->http_errors;
+    result->bytes = s->bytes;
+    result->elapsed_s = load.elapsed;
+    result->rps = load.elapsed > 0 ? result->requests / load.elapsed : 0;
+    result->client_cpu = load.client_cpu;
+    if (s->count > 0) {
+        result->min_ms = s->min_us / 1000;
+        result->mean_ms = s->total_us / s->count / 1000;
+        result->p50_ms = stats_quantile(s, 0.50) / 1000;
+        result->p90_ms = stats_quantile(s, 0.90) / 1000;
+        result->p99_ms = stats_quantile(s, 0.99) / 1000;
+        result->max_ms = s->max_us / 1000;
+    }
+    free_load_result(&load);
+    return 0;
+}
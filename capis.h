@@ -0,0 +1,102 @@
+#ifndef CAPIS_H
+#define CAPIS_H
+
+/*
+libcapis: run capis cases in-process and get results back as structs instead of log text.
+Every source file except main.c makes up the library:
+
+gcc -O2 -fPIC -c easy_curl.c multi_curl.c log.c read_yaml.c utils.c feeder.c template.c stats.c urlencode.c json.c watch.c cache.c discover.c suite.c scenario.c stages.c capacity.c timeseries.c warmup.c trace.c profile.c baseline.c replay.c throughput.c stream.c governor.c errors.c capis.c
+ar rcs libcapis.a *.o
+gcc -shared -o libcapis.so *.o -lcurl -lyaml -lpthread -lm
+gcc harness.c -L. -lcapis -lcurl -lyaml -lpthread -lm
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Connection pool, DNS cache and TLS sessions kept across runs. A context is not
+// thread-safe: use one per thread, or one thread at a time.
+typedef struct CapisContext CapisContext;
+
+// One parsed and compiled YAML case, reusable across runs of any context
+typedef struct CapisPlan CapisPlan;
+
+typedef enum {
+    CAPIS_LOG_INFO,
+    CAPIS_LOG_WARN,
+    CAPIS_LOG_ERROR,
+    CAPIS_LOG_OFF
+} CapisLogLevel;
+
+// Outcome of one request
+typedef struct {
+    int ok;                // Sent and answered with a status below 400
+    int curl_code;         // CURLcode, 0 on success
+    char error[256];       // curl's message when curl_code is not 0
+    long status;
+    double dns_ms;         // Phases from the start of the request, 0 when skipped
+    double connect_ms;
+    double tls_ms;
+    double ttfb_ms;
+    double total_ms;
+    long new_connections;  // 0 when a pooled connection was reused
+    char *headers;         // Response headers, NUL-terminated; NULL when empty
+    size_t headers_size;
+    char *body;            // Response body, NUL-terminated; NULL when empty
+    size_t body_size;
+} CapisResult;
+
+typedef struct {
+    int users;             // Requests kept in flight, 1 when 0
+    int threads;           // Worker threads, 1 when 0
+    long requests;         // Request budget, 0 for none
+    double duration;       // Seconds to keep sending, 0 for none
+    double rate;           // Requests per second for an open model, 0 for closed-loop users
+} CapisLoadOptions;
+
+typedef struct {
+    uint64_t requests;     // Sent, whatever the outcome
+    uint64_t failures;     // Transport failures
+    uint64_t http_errors;  // Responses with a status of 400 or more
+    uint64_t bytes;        // Response bytes received
+    double elapsed_s;
+    double rps;
+    double min_ms;
+    double mean_ms;
+    double p50_ms;
+    double p90_ms;
+    double p99_ms;
+    double max_ms;
+    double client_cpu;     // Busiest worker's CPU share, near 1 when the client limited the load
+} CapisLoadResult;
+
+// Set what capis logs to stderr, process-wide; CAPIS_LOG_OFF by default for the library
+void capis_set_log_level(CapisLogLevel level);
+
+// Seed feeder walks, ${rand.*} values, random bodies and load test case picks, process-wide.
+// 0 by default, so runs repeat; plans take the seed when they are loaded.
+void capis_set_seed(uint64_t seed);
+
+CapisContext *capis_context_new(void);
+void capis_context_free(CapisContext *ctx);
+
+// Parse a YAML case from a file, or from len bytes of yaml named name for messages. NULL on failure.
+CapisPlan *capis_plan_load_file(const char *path);
+CapisPlan *capis_plan_load_buffer(const char *yaml, size_t len, const char *name);
+void capis_plan_free(CapisPlan *plan);
+
+// Send plan once. Returns 0 when the request was sent and answered, whatever the status,
+// -1 otherwise; result is filled either way and must be released with capis_result_free.
+int capis_run(CapisContext *ctx, CapisPlan *plan, CapisResult *result);
+
+// Send count plans at once, up to jobs in flight, filling results[i] for plans[i].
+// Returns the number of plans that were not ok.
+int capis_run_all(CapisContext *ctx, CapisPlan *const *plans, int count, int jobs, CapisResult *results);
+void capis_result_free(CapisResult *result);
+
+// Load test plan on worker threads with their own event loops. With one thread the load
+// reuses the context's connections, DNS cache and TLS sessions; with more, each worker opens
+// its own, since curl cannot share connections between threads
+int capis_load(CapisContext *ctx, CapisPlan *plan, const CapisLoadOptions *opts, CapisLoadResult *result);
+
+#endif
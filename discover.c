@@ -0,0 +1,355 @@
+#include "discover.h"
+#include "log.h"
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_WALKERS 8
+
+typedef struct {
+    const char *pattern;  // Glob the full path must match, NULL for *.yml / *.yaml
+    int max_depth;        // Deepest directory level to descend into, -1 for no limit
+    bool walked;          // A directory or glob, as opposed to a plain file
+} Input;
+
+typedef struct {
+    char *dir;    // Directory to read, "" for the current directory
+    int input;    // Index of the input that produced it
+    int depth;    // Levels below the input's base directory
+} Job;
+
+typedef struct {
+    const Input *inputs;
+    int input_count;
+    Job *jobs;    // Stack of directories waiting to be read
+    size_t job_count;
+    size_t job_cap;
+    int active;   // Walkers currently reading a directory
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} Walk;
+
+typedef struct {
+    Walk *walk;
+    PathList *found;  // Matches per input, merged once all walkers are done
+    int failed;
+    pthread_t thread;
+} Walker;
+
+bool is_glob(const char *path) {
+    return strpbrk(path, "*?[") != NULL;
+}
+
+// Match one [...] class at p against c, advancing p past it; -1 if p is not a class
+static int match_class(const char **pp, char c) {
+    const char *p = *pp + 1;
+    bool negate = *p == '!' || *p == '^';
+    if (negate) p++;
+    const char *start = p;
+    bool hit = false;
+    while (*p && (*p != ']' || p == start)) {
+        if (p[1] == '-' && p[2] && p[2] != ']') {
+            if (c >= p[0] && c <= p[2]) hit = true;
+            p += 3;
+        } else {
+            if (c == *p) hit = true;
+            p++;
+        }
+    }
+    if (*p != ']') return -1;
+    *pp = p + 1;
+    return hit != negate;
+}
+
+bool glob_match(const char *p, const char *s) {
+    while (*p) {
+        if (p[0] == '*' && p[1] == '*') {
+            p += 2;
+            if (*p == '/') {
+                // "**/" matches zero or more whole directories
+                p++;
+                if (glob_match(p, s)) return true;
+                for (; *s; s++) {
+                    if (*s == '/' && glob_match(p, s + 1)) return true;
+                }
+                return false;
+            }
+            for (;; s++) {
+                if (glob_match(p, s)) return true;
+                if (!*s) return false;
+            }
+        }
+        if (*p == '*') {
+            p++;
+            for (;; s++) {
+                if (glob_match(p, s)) return true;
+                if (!*s || *s == '/') return false;
+            }
+        }
+        if (!*s) return false;
+        if (*p == '?') {
+            if (*s == '/') return false;
+            p++;
+        } else if (*p == '[') {
+            int hit = *s == '/' ? 0 : match_class(&p, *s);
+            if (hit == 0) return false;
+            if (hit < 0) {
+                if (*s != '[') return false;
+                p++;
+            }
+        } else {
+            if (*p != *s) return false;
+            p++;
+        }
+        s++;
+    }
+    return *s == '\0';
+}
+
+bool is_yaml_name(const char *name) {
+    const char *ext = strrchr(name, '.');
+    return ext && (strcmp(ext, ".yml") == 0 || strcmp(ext, ".yaml") == 0);
+}
+
+static char *join_path(const char *dir, const char *name) {
+    size_t dlen = strlen(dir);
+    size_t len = dlen + strlen(name) + 2;
+    char *path = malloc(len);
+    if (!path) return NULL;
+    if (dlen == 0) {
+        snprintf(path, len, "%s", name);
+    } else {
+        snprintf(path, len, dir[dlen - 1] == '/' ? "%s%s" : "%s/%s", dir, name);
+    }
+    return path;
+}
+
+// Queue a directory, taking ownership of dir; caller holds the lock
+static int push_job(Walk *w, char *dir, int input, int depth) {
+    if (w->job_count == w->job_cap) {
+        size_t cap = w->job_cap ? w->job_cap * 2 : 64;
+        Job *temp = realloc(w->jobs, cap * sizeof(Job));
+        if (!temp) {
+            free(dir);
+            return -1;
+        }
+        w->jobs = temp;
+        w->job_cap = cap;
+    }
+    w->jobs[w->job_count++] = (Job){dir, input, depth};
+    return 0;
+}
+
+// Read one directory: matching files go to the walker's list, subdirectories back on the stack
+static void read_job(Walker *wk, Job *job) {
+    Walk *w = wk->walk;
+    const Input *in = &w->inputs[job->input];
+    DIR *dir = opendir(job->dir[0] ? job->dir : ".");
+    if (!dir) {
+        LOG_WARN("Failed to read directory %s", job->dir);
+        return;
+    }
+
+    char **subdirs = NULL;
+    size_t subdir_count = 0;
+    bool descend = in->max_depth < 0 || job->depth < in->max_depth;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        // Skips ., .. and hidden entries such as .git or a plan cache
+        if (ent->d_name[0] == '.') continue;
+
+        bool is_dir = ent->d_type == DT_DIR;
+        bool is_file = ent->d_type == DT_REG;
+        if (ent->d_type == DT_UNKNOWN || ent->d_type == DT_LNK) {
+            // Symlinks are followed for files only, so link cycles cannot trap the walk
+            struct stat st;
+            if (fstatat(dirfd(dir), ent->d_name, &st, 0) != 0) continue;
+            is_file = S_ISREG(st.st_mode);
+            is_dir = ent->d_type == DT_UNKNOWN && S_ISDIR(st.st_mode);
+        }
+
+        if (is_dir && descend) {
+            char **temp = realloc(subdirs, (subdir_count + 1) * sizeof(char *));
+            if (!temp) continue;
+            subdirs = temp;
+            subdirs[subdir_count] = join_path(job->dir, ent->d_name);
+            if (subdirs[subdir_count]) subdir_count++;
+        } else if (is_file) {
+            if (!in->pattern && !is_yaml_name(ent->d_name)) continue;
+            char *path = join_path(job->dir, ent->d_name);
+            if (!path) continue;
+            if (!in->pattern || glob_match(in->pattern, path)) {
+                if (ap_pathlist(&wk->found[job->input], path)) wk->failed = 1;
+            }
+            free(path);
+        }
+    }
+    closedir(dir);
+
+    if (subdir_count > 0) {
+        pthread_mutex_lock(&w->lock);
+        for (size_t i = 0; i < subdir_count; i++) {
+            if (push_job(w, subdirs[i], job->input, job->depth + 1)) wk->failed = 1;
+        }
+        pthread_cond_broadcast(&w->cond);
+        pthread_mutex_unlock(&w->lock);
+    }
+    free(subdirs);
+}
+
+static void *run_walker(void *arg) {
+    Walker *wk = (Walker *)arg;
+    Walk *w = wk->walk;
+
+    pthread_mutex_lock(&w->lock);
+    while (1) {
+        while (w->job_count == 0 && w->active > 0) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->job_count == 0) break;  // Nothing queued and nobody left to queue more
+
+        Job job = w->jobs[--w->job_count];
+        w->active++;
+        pthread_mutex_unlock(&w->lock);
+
+        read_job(wk, &job);
+        free(job.dir);
+
+        pthread_mutex_lock(&w->lock);
+        w->active--;
+        if (w->job_count == 0 && w->active == 0) pthread_cond_broadcast(&w->cond);
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+// Split a glob into the directory to start from and how deep its components reach
+static int plan_glob(const char *pattern, Input *in) {
+    const char *meta = strpbrk(pattern, "*?[");
+    const char *slash = meta;
+    while (slash > pattern && slash[-1] != '/') slash--;
+
+    in->pattern = pattern;
+    in->max_depth = 0;
+    in->walked = true;
+    if (strstr(pattern, "**")) {
+        in->max_depth = -1;
+    } else {
+        for (const char *p = slash; *p; p++) {
+            if (*p == '/') in->max_depth++;
+        }
+    }
+    return (int)(slash - pattern);
+}
+
+// Move every path of src onto the end of dst
+static int take_paths(PathList *dst, PathList *src) {
+    if (src->count == 0) return 0;
+    if (dst->count + src->count > dst->cap) {
+        size_t cap = dst->count + src->count;
+        char **temp = realloc(dst->paths, cap * sizeof(char *));
+        if (!temp) return -1;
+        dst->paths = temp;
+        dst->cap = cap;
+    }
+    memcpy(dst->paths + dst->count, src->paths, src->count * sizeof(char *));
+    dst->count += src->count;
+    src->count = 0;
+    return 0;
+}
+
+int discover_cases(const PathList *inputs, PathList *out) {
+    int count = (int)inputs->count;
+    if (count == 0) return 0;
+
+    int rc = 0;
+    Input *specs = calloc(count, sizeof(Input));
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int walker_count = cpus < 1 ? 1 : cpus > MAX_WALKERS ? MAX_WALKERS : (int)cpus;
+    Walker *walkers = calloc(walker_count, sizeof(Walker));
+    Walk w = {0};
+    w.inputs = specs;
+    w.input_count = count;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+    if (!specs || !walkers) {
+        rc = -1;
+        goto DONE;
+    }
+    for (int t = 0; t < walker_count; t++) {
+        walkers[t].walk = &w;
+        walkers[t].found = calloc(count, sizeof(PathList));
+        if (!walkers[t].found) {
+            rc = -1;
+            goto DONE;
+        }
+    }
+
+    // Plain files are taken as given, directories and globs become the walk's first jobs
+    for (int i = 0; i < count; i++) {
+        const char *arg = inputs->paths[i];
+        struct stat st;
+        if (is_glob(arg)) {
+            int base = plan_glob(arg, &specs[i]);
+            char *dir = strndup(arg, base);
+            if (!dir || push_job(&w, dir, i, 0)) rc = -1;
+        } else if (stat(arg, &st) != 0) {
+            LOG_ERROR("No such file or directory: %s", arg);
+            rc = -1;
+        } else if (S_ISDIR(st.st_mode)) {
+            specs[i].max_depth = -1;
+            specs[i].walked = true;
+            char *dir = strdup(arg);
+            if (!dir || push_job(&w, dir, i, 0)) rc = -1;
+        } else if (ap_pathlist(&walkers[0].found[i], arg)) {
+            rc = -1;
+        }
+    }
+
+    // The walkers share one stack, so even a single directory fans out as its subdirectories are queued
+    int started = 0;
+    if (w.job_count > 0) {
+        for (; started < walker_count - 1; started++) {
+            if (pthread_create(&walkers[started + 1].thread, NULL, run_walker, &walkers[started + 1])) break;
+        }
+    }
+    run_walker(&walkers[0]);
+    for (int t = 1; t <= started; t++) {
+        pthread_join(walkers[t].thread, NULL);
+    }
+
+    for (int i = 0; i < count; i++) {
+        size_t start = out->count;
+        for (int t = 0; t < walker_count; t++) {
+            if (walkers[t].failed || take_paths(out, &walkers[t].found[i])) rc = -1;
+        }
+        sort_pathlist(out, start);
+        if (out->count == start && specs[i].walked) {
+            LOG_WARN("No cases found in %s", inputs->paths[i]);
+        }
+    }
+
+DONE:
+    if (walkers) {
+        for (int t = 0; t < walker_count; t++) {
+            if (!walkers[t].found) continue;
+            for (int i = 0; i < count; i++) {
+                free_pathlist(&walkers[t].found[i]);
+            }
+            free(walkers[t].found);
+        }
+    }
+    for (size_t j = 0; j < w.job_count; j++) {
+        free(w.jobs[j].dir);
+    }
+    free(w.jobs);
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.cond);
+    free(walkers);
+    free(specs);
+    return rc;
+}
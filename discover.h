@@ -0,0 +1,22 @@
+#ifndef DISCOVER_H
+#define DISCOVER_H
+
+#include "utils.h"
+#include <stdbool.h>
+
+// True if the path contains glob characters (*, ?, [)
+bool is_glob(const char *path);
+
+// True if name ends in .yml or .yaml
+bool is_yaml_name(const char *name);
+
+// Match a path against a glob: * and ? stay within one component, ** spans directories
+bool glob_match(const char *pattern, const char *path);
+
+// Expand command-line inputs into case files, appended to out in input order.
+// Files are taken as given, directories yield every *.yml / *.yaml below them and
+// globs every matching file; each input's matches are sorted by path.
+// Directories are walked by a pool of threads. Returns -1 if any input was unusable.
+int discover_cases(const PathList *inputs, PathList *out);
+
+#endif
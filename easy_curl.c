@@ -1,11 +1,41 @@
 #include "easy_curl.h"
 #include "log.h"
+#include "profile.h"
 #include "utils.h"
+#include "urlencode.h"
 #include <curl/curl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <time.h>
+
+// Connections, DNS and TLS sessions shared by every do_easy_curl call
+static CURLSH *pool = NULL;
+
+CURLSH *new_connection_pool(void) {
+    CURLSH *share = curl_share_init();
+    if (!share) {
+        LOG_ERROR("curl_share_init failed");
+        return NULL;
+    }
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+    curl_share_setopt(share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+    return share;
+}
+
+int init_connection_pool(void) {
+    if (pool) return 0;
+    pool = new_connection_pool();
+    return pool ? 0 : -1;
+}
+
+void free_connection_pool(void) {
+    if (!pool) return;
+    curl_share_cleanup(pool);
+    pool = NULL;
+}
 
 // Free memory allocated for Response struct
 void free_response(Response *resp) {
@@ -32,6 +62,7 @@ void free_response(Response *resp) {
 
 // Callback to handle response body data
 static size_t write_body_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    uint64_t start = prof_ticks();
     size_t realsize = size * nmemb;
     Response *resp = (Response *)userp;
 
@@ -45,11 +76,13 @@ static size_t write_body_callback(void *contents, size_t size, size_t nmemb, voi
     memcpy(&(resp->body[resp->body_size]), contents, realsize);
     resp->body_size += realsize;
     resp->body[resp->body_size] = '\0';
+    prof_end(PROF_BODY, start);
     return realsize;
 }
 
 // Callback to handle response header data
 static size_t write_header_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    uint64_t start = prof_ticks();
     size_t realsize = size * nmemb;
     Response *resp = (Response *)userp;
 
@@ -88,143 +121,344 @@ static size_t write_header_callback(void *contents, size_t size, size_t nmemb, v
         }
     }
 
+    prof_end(PROF_HEADERS, start);
     return realsize;
 }
 
-// Perform HTTP request with metadata and store response
-int do_easy_curl(METADATA *md, Response *resp, ...) {
-    va_list args;
-    va_start(args, resp);
-    int verbose = va_arg(args, int);
-    va_end(args);
+// Callback to stream the request body straight out of the mapping
+static size_t read_mapped_callback(char *buffer, size_t size, size_t nitems, void *userp) {
+    BodyCursor *cur = (BodyCursor *)userp;
+    size_t len = size * nitems;
+    size_t left = cur->file->size - cur->offset;
+    if (len > left) len = left;
+    if (len > 0) {
+        memcpy(buffer, cur->file->data + cur->offset, len);
+        cur->offset += len;
+    }
+    return len;
+}
 
-    if (!md || !resp) {
-        LOG_ERROR("Invalid metadata or response pointer");
-        return -1;
+// Callback to rewind the request body on redirects and auth retries
+static int seek_mapped_callback(void *userp, curl_off_t offset, int origin) {
+    BodyCursor *cur = (BodyCursor *)userp;
+    if (origin != SEEK_SET || offset < 0 || (size_t)offset > cur->file->size) {
+        return CURL_SEEKFUNC_CANTSEEK;
     }
+    cur->offset = (size_t)offset;
+    return CURL_SEEKFUNC_OK;
+}
 
-    // Initialize response fields
-    resp->headers = NULL;
-    resp->body = NULL;
-    resp->headers_size = 0;
-    resp->body_size = 0;
-    resp->set_cookies = NULL;
-    resp->status_code = 0;
+// Write len bytes of the generated body starting at offset into out; word i of a random
+// body is mix64(seed + i * golden), so any offset can be generated directly
+static void fill_generated(const GenCursor *cur, uint64_t offset, char *out, size_t len) {
+    const BodyGenerator *g = cur->gen;
+    if (g->pattern == GEN_ZEROS) {
+        memset(out, 0, len);
+    } else if (g->pattern == GEN_REPEAT) {
+        size_t at = (size_t)(offset % g->text_len);
+        while (len > 0) {
+            size_t n = g->text_len - at < len ? g->text_len - at : len;
+            memcpy(out, g->text + at, n);
+            out += n;
+            len -= n;
+            at = 0;
+        }
+    } else {
+        uint64_t word = offset / 8;
+        size_t skip = (size_t)(offset % 8);
+        while (len > 0) {
+            uint64_t v = mix64(cur->seed + word * 0x9E3779B97F4A7C15ULL);
+            size_t n = 8 - skip < len ? 8 - skip : len;
+            memcpy(out, (char *)&v + skip, n);
+            out += n;
+            len -= n;
+            skip = 0;
+            word++;
+        }
+    }
+}
 
-    CURL *curl = curl_easy_init();
-    if (!curl) {
-        LOG_ERROR("curl_easy_init failed");
-        return -1;
+// Callback to generate the request body straight into curl's upload buffer
+static size_t read_generated_callback(char *buffer, size_t size, size_t nitems, void *userp) {
+    GenCursor *cur = (GenCursor *)userp;
+    size_t len = size * nitems;
+    uint64_t left = cur->gen->size - cur->offset;
+    if (len > left) len = (size_t)left;
+    fill_generated(cur, cur->offset, buffer, len);
+    cur->offset += len;
+    return len;
+}
+
+// Callback to rewind the generated body on redirects and auth retries
+static int seek_generated_callback(void *userp, curl_off_t offset, int origin) {
+    GenCursor *cur = (GenCursor *)userp;
+    if (origin != SEEK_SET || offset < 0 || (uint64_t)offset > cur->gen->size) {
+        return CURL_SEEKFUNC_CANTSEEK;
     }
+    cur->offset = (uint64_t)offset;
+    return CURL_SEEKFUNC_OK;
+}
 
-    int url_allocated = 0;
-    if (!md->url || strlen(md->url) == 0) {
-        size_t len = strlen(md->host) + strlen(md->path) + 16;
-        md->url = malloc(len);
-        if (!md->url) {
-            LOG_ERROR("Memory allocation failed for URL");
-            curl_easy_cleanup(curl);
-            return -1;
+// Build the multipart form, file parts are read from their mappings on demand
+static curl_mime *build_mime(CURL *curl, Part *parts) {
+    curl_mime *mime = curl_mime_init(curl);
+    if (!mime) return NULL;
+
+    for (Part *p = parts; p->name != NULL; p++) {
+        curl_mimepart *part = curl_mime_addpart(mime);
+        if (!part) goto FAIL;
+        curl_mime_name(part, p->name);
+        if (p->file) {
+            BodyCursor *cur = malloc(sizeof(BodyCursor));
+            if (!cur) goto FAIL;
+            cur->file = p->file;
+            cur->offset = 0;
+            curl_mime_data_cb(part, (curl_off_t)p->file->size, read_mapped_callback,
+                              seek_mapped_callback, free, cur);
+            curl_mime_filename(part, p->filename);
+        } else {
+            curl_mime_data(part, p->value, CURL_ZERO_TERMINATED);
         }
-        snprintf(md->url, len, "%s://%s%s", md->secure ? "https" : "http", md->host, md->path);
-        url_allocated = 1;
+        if (p->type) curl_mime_type(part, p->type);
     }
+    return mime;
+
+FAIL:
+    curl_mime_free(mime);
+    return NULL;
+}
+
+// Callbacks to count response bytes without keeping them
+static size_t discard_header_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    uint64_t start = prof_ticks();
+    (void)contents;
+    size_t *counter = (size_t *)userp;
+    *counter += size * nmemb;
+    prof_end(PROF_HEADERS, start);
+    return size * nmemb;
+}
+
+static size_t discard_body_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    uint64_t start = prof_ticks();
+    (void)contents;
+    size_t *counter = (size_t *)userp;
+    *counter += size * nmemb;
+    prof_end(PROF_BODY, start);
+    return size * nmemb;
+}
+
+// Count response bytes like the discard callbacks, keeping the first PEEK_MAX of each
+static size_t peek_header_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    uint64_t start = prof_ticks();
+    Transfer *t = (Transfer *)userp;
+    size_t n = size * nmemb;
+    ResponsePeek *peek = t->peek;
+    size_t keep = PEEK_MAX - peek->headers_len;
+    if (keep > n) keep = n;
+    memcpy(peek->headers + peek->headers_len, contents, keep);
+    peek->headers_len += keep;
+    t->resp.headers_size += n;
+    prof_end(PROF_HEADERS, start);
+    return n;
+}
+
+static size_t peek_body_callback(void *contents, size_t size, size_t nmemb, void *userp) {
+    uint64_t start = prof_ticks();
+    Transfer *t = (Transfer *)userp;
+    size_t n = size * nmemb;
+    ResponsePeek *peek = t->peek;
+    size_t keep = PEEK_MAX - peek->body_len;
+    if (keep > n) keep = n;
+    memcpy(peek->body + peek->body_len, contents, keep);
+    peek->body_len += keep;
+    t->resp.body_size += n;
+    prof_end(PROF_BODY, start);
+    return n;
+}
+
+// Render a field for this send, the value itself when it has no placeholders
+static char *render_field(char *value, const Template *tpl, const Record *rec) {
+    return tpl ? render_template(tpl, rec) : value;
+}
 
-    LOG_INFO("Preparing request: %s", md->url);
+static void free_field(char *rendered, const char *value) {
+    if (rendered != value) free(rendered);
+}
 
-    // Handle GET parameters by appending to URL
-    char *final_url = NULL;
-    if (md->method == GET && md->params != NULL) {
-        // Generate query string from parameters
-        size_t param_len = 0;
-        for (Param *p = md->params; p->key != NULL; p++) {
-            param_len += strlen(p->key) + strlen(p->value) + 2; // key=value&
+// Join params as k=v&k=v, encoding only the values rendered for this send
+static char *build_params(METADATA *md, const Record *rec, EncodeMode mode) {
+    int count = 0;
+    for (Param *p = md->params; p->key != NULL; p++) count++;
+
+    char **keys = calloc(count, sizeof(char *));
+    char **values = calloc(count, sizeof(char *));
+    char *out = NULL;
+    if (!keys || !values) goto DONE;
+
+    for (int i = 0; i < count; i++) {
+        Param *p = &md->params[i];
+        keys[i] = p->enc_key;
+        if (p->enc_value) {
+            values[i] = p->enc_value;
+            continue;
         }
+        char *raw = render_field(p->value, p->tpl, rec);
+        values[i] = raw ? url_encode_dup(raw, mode) : NULL;
+        free_field(raw, p->value);
+        if (!values[i]) goto DONE;
+    }
+    out = join_params(keys, values, count);
 
-        char *query_str = malloc(param_len + 1);
-        if (query_str) {
-            char *p = query_str;
-            for (Param *param = md->params; param->key != NULL; param++) {
-                p += snprintf(p, param_len + 1 - (p - query_str), "%s=%s&", param->key, param->value);
-            }
-            if (p > query_str) {
-                if (*(p-1) == '&') *(p-1) = '\0'; // Trim trailing &
-                else *p = '\0';
-            } else {
-                *query_str = '\0';
-            }
+DONE:
+    for (int i = 0; values && i < count; i++) {
+        if (values[i] != md->params[i].enc_value) free(values[i]);
+    }
+    free(keys);
+    free(values);
+    return out;
+}
 
-            // Build final URL with query parameters
-            const char *separator = strchr(md->url, '?') ? "&" : "?";
-            size_t new_url_len = strlen(md->url) + strlen(separator) + strlen(query_str) + 1;
-            final_url = malloc(new_url_len);
-            if (final_url) {
-                snprintf(final_url, new_url_len, "%s%s%s", md->url, separator, query_str);
-                LOG_INFO("GET request with params: %s", final_url);
-            } else {
-                LOG_ERROR("Failed to allocate final URL");
+void set_response_handlers(Transfer *t) {
+    CURL *curl = t->curl;
+    Response *resp = &t->resp;
+    if (t->discard && t->peek) {
+        ResponsePeek *peek = t->peek;
+        peek->error[0] = '\0';
+        peek->headers_len = 0;
+        peek->body_len = 0;
+        curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, peek->error);
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, peek_header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, t);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, peek_body_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, t);
+    } else if (t->discard) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, discard_header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &resp->headers_size);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard_body_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &resp->body_size);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, write_header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, resp);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_body_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp);
+    }
+}
+
+// Configure t->curl for one send of md, rec fills ${column} placeholders
+static int build_transfer(Transfer *t, METADATA *md, const Record *rec, int verbose) {
+    CURL *curl = t->curl;
+    Response *resp = &t->resp;
+    t->md = md;
+    next_request_number();
+
+    // Initialize response fields
+    resp->headers = NULL;
+    resp->body = NULL;
+    resp->headers_size = 0;
+    resp->body_size = 0;
+    resp->set_cookies = NULL;
+    resp->status_code = 0;
+
+    EncodeMode mode = md->method == GET ? ENCODE_QUERY : ENCODE_FORM;
+    char *query = NULL;
+    if (md->request_url) {
+        t->url = md->request_url;
+    } else {
+        // Only the parts holding placeholders are rendered and encoded per send
+        if (md->method == GET && md->params && md->params->key != NULL) {
+            query = md->encoded_params ? md->encoded_params : build_params(md, rec, mode);
+            if (!query) {
+                LOG_ERROR("Failed to allocate query string");
+                return -1;
             }
-            free(query_str);
-        } else {
-            LOG_ERROR("Failed to allocate query string");
         }
+        char *url = render_field(md->url, md->url_tpl, rec);
+        char *host = render_field(md->host, md->host_tpl, rec);
+        char *path = render_field(md->path, md->path_tpl, rec);
+        t->url_buf = url && host && path ? build_url(url, host, path, md->secure, query) : NULL;
+        free_field(url, md->url);
+        free_field(host, md->host);
+        free_field(path, md->path);
+        if (query != md->encoded_params) free(query);
+        if (!t->url_buf) {
+            LOG_ERROR("Memory allocation failed for URL");
+            return -1;
+        }
+        t->url = t->url_buf;
     }
 
     // Set final URL for CURL
-    curl_easy_setopt(curl, CURLOPT_URL, final_url ? final_url : md->url);
+    curl_easy_setopt(curl, CURLOPT_URL, t->url);
     curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
     curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, md->timeout);
     curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
 
     if (!md->secure) {
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
         curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
-        LOG_WARN("SSL verification disabled - security risk");
     }
 
-    struct curl_slist *header_list = NULL;
+    // Local sidecars: the URL still names the host for the Host header and TLS
+    if (md->unix_socket) {
+        curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, md->unix_socket);
+    }
+
+    // Send to the backends named in resolve: instead of looking the host up
+    if (md->resolve) {
+        for (char **entry = md->resolve; *entry; entry++) {
+            struct curl_slist *temp = curl_slist_append(t->resolve_list, *entry);
+            if (!temp) {
+                LOG_ERROR("Failed to allocate resolve list");
+                return -1;
+            }
+            t->resolve_list = temp;
+        }
+        curl_easy_setopt(curl, CURLOPT_RESOLVE, t->resolve_list);
+    }
+
     bool has_content_type = false;
     if (md->headers) {
         for (Header *h = md->headers; h->key != NULL; h++) {
-            char *header = malloc(strlen(h->key) + strlen(h->value) + 3); // +3 for ": " and '\0'
+            char *value = render_field(h->value, h->tpl, rec);
+            char *header = value ? malloc(strlen(h->key) + strlen(value) + 3) : NULL; // +3 for ": " and '\0'
             if (!header) {
                 LOG_ERROR("Failed to allocate header string");
-                free(final_url);
-                free_response(resp);
-                curl_slist_free_all(header_list);
-                curl_easy_cleanup(curl);
+                free_field(value, h->value);
                 return -1;
             }
-            snprintf(header, strlen(h->key) + strlen(h->value) + 3, "%s: %s", h->key, h->value);
-            header_list = curl_slist_append(header_list, header);
+            snprintf(header, strlen(h->key) + strlen(value) + 3, "%s: %s", h->key, value);
+            t->header_list = curl_slist_append(t->header_list, header);
             if (strncasecmp(header, "Content-Type:", 13) == 0) {
                 has_content_type = true;
             }
             free(header);
+            free_field(value, h->value);
         }
     }
 
-    // Add default Content-Type for POST/PUT if not specified
-    if (!has_content_type && (md->method == POST || md->method == PUT)) {
-        header_list = curl_slist_append(header_list, "Content-Type: application/x-www-form-urlencoded");
+    // Add default Content-Type if not specified, curl sets the multipart boundary itself
+    bool has_body = md->method != GET && (md->body_file || md->multipart || md->json_body || md->body_generator);
+    bool raw_body = md->body_file || md->body_generator;
+    if (!has_content_type && has_body && raw_body && !md->multipart) {
+        t->header_list = curl_slist_append(t->header_list, "Content-Type: application/octet-stream");
+    } else if (!has_content_type && has_body && !md->multipart) {
+        t->header_list = curl_slist_append(t->header_list, "Content-Type: application/json");
+    } else if (!has_content_type && !has_body && (md->method == POST || md->method == PUT)) {
+        t->header_list = curl_slist_append(t->header_list, "Content-Type: application/x-www-form-urlencoded");
     }
 
     // Disable Expect: 100-continue to avoid hangs
-    header_list = curl_slist_append(header_list, "Expect:");
-    if (header_list) {
-        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, header_list);
+    t->header_list = curl_slist_append(t->header_list, "Expect:");
+    if (t->header_list) {
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, t->header_list);
     }
 
-    char *cookie_str = NULL;
     if (md->cookies) {
         size_t buf_len = 4096;
-        cookie_str = malloc(buf_len);
+        char *cookie_str = malloc(buf_len);
         if (!cookie_str) {
             LOG_ERROR("Failed to allocate cookie string");
-            free(final_url);
-            free_response(resp);
-            curl_slist_free_all(header_list);
-            curl_easy_cleanup(curl);
             return -1;
         }
 
@@ -239,10 +473,6 @@ int do_easy_curl(METADATA *md, Response *resp, ...) {
                 if (!temp) {
                     LOG_ERROR("Failed to reallocate cookie string");
                     free(cookie_str);
-                    free(final_url);
-                    free_response(resp);
-                    curl_slist_free_all(header_list);
-                    curl_easy_cleanup(curl);
                     return -1;
                 }
                 cookie_str = temp;
@@ -273,40 +503,56 @@ int do_easy_curl(METADATA *md, Response *resp, ...) {
             cookie_str[cookie_str_len - 2] = '\0'; // Remove trailing "; "
         }
 
+        t->cookie_str = cookie_str;
         curl_easy_setopt(curl, CURLOPT_COOKIE, cookie_str);
     }
 
-    char *param_str = NULL;
-    if (md->method == POST || md->method == PUT) {
+    t->body.file = md->body_file;
+    t->body.offset = 0;
+    if (has_body && md->multipart) {
+        t->mime = build_mime(curl, md->multipart);
+        if (!t->mime) {
+            LOG_ERROR("Failed to build multipart form");
+            return -1;
+        }
+        curl_easy_setopt(curl, CURLOPT_MIMEPOST, t->mime);
+    } else if (has_body && md->body_generator) {
+        // Generated into curl's own upload buffer as it goes out, nothing is allocated
+        t->gen.gen = md->body_generator;
+        t->gen.offset = 0;
+        t->gen.seed = next_body_seed();
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_generated_callback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, &t->gen);
+        curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, seek_generated_callback);
+        curl_easy_setopt(curl, CURLOPT_SEEKDATA, &t->gen);
+        // An unknown size makes curl send the body chunked
+        curl_off_t size = md->body_generator->chunked ? -1 : (curl_off_t)md->body_generator->size;
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, size);
+    } else if (has_body && !md->body_file) {
+        // The JSON body was serialized once at load time and is sent without copying
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, md->json_body);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)md->json_len);
+    } else if (has_body) {
+        // Stream the mapped file, nothing is copied into a heap buffer
+        curl_easy_setopt(curl, CURLOPT_POST, 1L);
+        curl_easy_setopt(curl, CURLOPT_READFUNCTION, read_mapped_callback);
+        curl_easy_setopt(curl, CURLOPT_READDATA, &t->body);
+        curl_easy_setopt(curl, CURLOPT_SEEKFUNCTION, seek_mapped_callback);
+        curl_easy_setopt(curl, CURLOPT_SEEKDATA, &t->body);
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)md->body_file->size);
+    } else if (md->method == POST || md->method == PUT) {
         if (md->params && md->params->key != NULL) {
-            // Calculate total length for non-empty params
-            size_t param_len = 0;
-            for (Param *p = md->params; p->key != NULL; p++) {
-                param_len += strlen(p->key) + strlen(p->value) + 2; // +2 for '=' and '&'
-            }
-
-            param_str = malloc(param_len + 1);
+            // Static params were encoded once when the YAML was loaded
+            const char *param_str = md->encoded_params;
             if (!param_str) {
-                LOG_ERROR("Failed to allocate param string");
-                free(cookie_str);
-                free(final_url);
-                free_response(resp);
-                curl_slist_free_all(header_list);
-                curl_easy_cleanup(curl);
-                return -1;
-            }
-
-            // Build param string
-            char *p = param_str;
-            for (Param *param = md->params; param->key != NULL; param++) {
-                p += snprintf(p, param_len + 1 - (p - param_str), "%s=%s&", param->key, param->value);
-            }
-            if (p > param_str && p[-1] == '&') {
-                p[-1] = '\0'; // Remove trailing '&'
-            } else {
-                *p = '\0';
+                t->param_str = build_params(md, rec, mode);
+                if (!t->param_str) {
+                    LOG_ERROR("Failed to allocate param string");
+                    return -1;
+                }
+                param_str = t->param_str;
             }
-
             curl_easy_setopt(curl, CURLOPT_POSTFIELDS, param_str);
         } else {
             // Set empty body for POST/PUT with no params
@@ -321,7 +567,7 @@ int do_easy_curl(METADATA *md, Response *resp, ...) {
 
     switch (md->method) {
         case POST:
-            curl_easy_setopt(curl, CURLOPT_POST, 1L);
+            if (!has_body) curl_easy_setopt(curl, CURLOPT_POST, 1L);
             break;
         case PUT:
             curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, "PUT");
@@ -341,17 +587,84 @@ int do_easy_curl(METADATA *md, Response *resp, ...) {
     if (verbose) {
         curl_easy_setopt(curl, CURLOPT_VERBOSE, 1L);
     }
-    curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, write_header_callback);
-    curl_easy_setopt(curl, CURLOPT_HEADERDATA, resp);
-    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, write_body_callback);
-    curl_easy_setopt(curl, CURLOPT_WRITEDATA, resp);
+    set_response_handlers(t);
+    return 0;
+}
+
+int setup_transfer(Transfer *t, METADATA *md, const Record *rec, int verbose) {
+    uint64_t start = prof_ticks();
+    int rc = build_transfer(t, md, rec, verbose);
+    prof_end(PROF_BUILD, start);
+    return rc;
+}
+
+// Free the per-send state and reset the handle options, keeping its connections
+void reset_transfer(Transfer *t) {
+    if (!t) return;
+
+    if (t->curl) curl_easy_reset(t->curl);
+    free(t->url_buf);
+    free(t->cookie_str);
+    free(t->param_str);
+    curl_slist_free_all(t->header_list);
+    curl_slist_free_all(t->resolve_list);
+    curl_mime_free(t->mime);
+    t->url = NULL;
+    t->url_buf = NULL;
+    t->cookie_str = NULL;
+    t->param_str = NULL;
+    t->header_list = NULL;
+    t->resolve_list = NULL;
+    t->mime = NULL;
+}
+
+// Create a handle and configure it for one send of md, ready to be performed
+int start_easy_transfer(Transfer *t, METADATA *md, int verbose) {
+    memset(t, 0, sizeof(Transfer));
+    t->curl = curl_easy_init();
+    if (!t->curl) {
+        LOG_ERROR("curl_easy_init failed");
+        return -1;
+    }
+
+    // A single run takes the first record the feeder hands out
+    Record rec = {0};
+    FeedCursor cursor;
+    if (md->feeder) {
+        init_feed_cursor(&cursor, md->feeder, (uint64_t)time(NULL));
+        if (next_record(&cursor, &rec)) {
+            LOG_ERROR("Feeder %s has no records left", md->feeder->file->path);
+            curl_easy_cleanup(t->curl);
+            t->curl = NULL;
+            return -1;
+        }
+    }
+
+    if (setup_transfer(t, md, md->feeder ? &rec : NULL, verbose)) {
+        free_response(&t->resp);
+        reset_transfer(t);
+        curl_easy_cleanup(t->curl);
+        t->curl = NULL;
+        return -1;
+    }
+
+    if (pool) curl_easy_setopt(t->curl, CURLOPT_SHARE, pool);
+
+    LOG_INFO("Preparing request: %s", t->url);
+    if (!md->secure) {
+        LOG_WARN("SSL verification disabled - security risk");
+    }
+    return 0;
+}
 
-    CURLcode res = curl_easy_perform(curl);
+// Log the outcome of a performed transfer, hand its response to resp and release the handle
+int finish_easy_transfer(Transfer *t, CURLcode res, Response *resp) {
+    *resp = t->resp;
     if (res != CURLE_OK) {
         LOG_ERROR("curl_easy_perform() failed: %s", curl_easy_strerror(res));
     } else {
         // Get HTTP status code
-        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &resp->status_code);
+        curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &resp->status_code);
         LOG_INFO("Request successful - Status Code: %ld", resp->status_code);
         LOG_INFO("========== RESPONSE HEADERS ==========\n%s", resp->headers ? resp->headers : "(empty)");
         LOG_INFO("========== RESPONSE BODY =============\n%s", resp->body ? resp->body : "(empty)");
@@ -362,15 +675,26 @@ int do_easy_curl(METADATA *md, Response *resp, ...) {
         }
     }
 
-    free(param_str);
-    free(cookie_str);
-    if (final_url) free(final_url);
-    if (header_list) curl_slist_free_all(header_list);
-    if (url_allocated) {
-        free(md->url);
-        md->url = NULL;
+    reset_transfer(t);
+    curl_easy_cleanup(t->curl);
+    t->curl = NULL;
+    return (res == CURLE_OK) ? 0 : -1;
+}
+
+// Perform HTTP request with metadata and store response
+int do_easy_curl(METADATA *md, Response *resp, ...) {
+    va_list args;
+    va_start(args, resp);
+    int verbose = va_arg(args, int);
+    va_end(args);
+
+    if (!md || !resp) {
+        LOG_ERROR("Invalid metadata or response pointer");
+        return -1;
     }
 
-    curl_easy_cleanup(curl);
-    return (res == CURLE_OK) ? 0 : -1;
-}
\ No newline at end of file
+    Transfer t;
+    if (start_easy_transfer(&t, md, verbose)) return -1;
+    CURLcode res = curl_easy_perform(t.curl);
+    return finish_easy_transfer(&t, res, resp);
+}
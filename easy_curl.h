@@ -1,7 +1,9 @@
 #ifndef EASY_CURL_H
 #define EASY_CURL_H
 
+#include "errors.h"
 #include "read_yaml.h"
+#include <curl/curl.h>
 
 typedef struct {
     char *headers;        // Response headers
@@ -12,9 +14,64 @@ typedef struct {
     long status_code;     // HTTP status code
 } Response;
 
+// Read position into a mapped request body, one per send
+typedef struct {
+    const MappedFile *file;
+    size_t offset;
+} BodyCursor;
+
+// Read position into a generated request body, one per send
+typedef struct {
+    const BodyGenerator *gen;
+    uint64_t offset;
+    uint64_t seed;    // Random bodies differ per send, yet any offset can be produced again
+} GenCursor;
+
+// Everything built for one send of a METADATA; the handle is reused across sends
+typedef struct {
+    CURL *curl;
+    METADATA *md;
+    Response resp;
+    bool discard;                    // Count response bytes instead of buffering them
+    ResponsePeek *peek;              // With discard, keep the start of the response here; may be NULL
+    const char *url;                 // Final URL including the query string
+    char *url_buf;                   // Storage for url when it is rendered per send
+    char *cookie_str;
+    char *param_str;
+    struct curl_slist *header_list;
+    struct curl_slist *resolve_list; // CURLOPT_RESOLVE entries from md->resolve
+    curl_mime *mime;
+    BodyCursor body;
+    GenCursor gen;
+} Transfer;
+
+// Connections, DNS and TLS sessions for the transfers given it with CURLOPT_SHARE, without
+// locks, so all of them must run on one thread
+CURLSH *new_connection_pool(void);
+
+// Keep connections, DNS and TLS sessions warm across do_easy_curl calls (single-threaded use)
+int init_connection_pool(void);
+void free_connection_pool(void);
+
 // Free the memory allocated for a Response struct
 void free_response(Response *resp);
 
+// Configure t->curl for one send of md; rec fills ${column} placeholders and may be NULL
+int setup_transfer(Transfer *t, METADATA *md, const Record *rec, int verbose);
+
+// Point the response callbacks of t->curl at t->resp, counting bytes only when t->discard is set
+// and filling t->peek when there is one
+void set_response_handlers(Transfer *t);
+
+// Free the per-send state built by setup_transfer, keeping the handle and its connections
+void reset_transfer(Transfer *t);
+
+// Create and configure a standalone transfer for md, to be run with curl_easy_perform or a multi handle
+int start_easy_transfer(Transfer *t, METADATA *md, int verbose);
+
+// Log the result of a transfer from start_easy_transfer, move its response into resp and clean it up
+int finish_easy_transfer(Transfer *t, CURLcode res, Response *resp);
+
 // Perform an HTTP request with the given metadata and store the response
 int do_easy_curl(METADATA *md, Response *resp, ...);
 
@@ -0,0 +1,267 @@
+#include "errors.h"
+#include "log.h"
+#include "utils.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Rows of the matrix logged before the rest are summed up
+#define MATRIX_ROWS 20
+
+static const char *kind_names[FAIL_KINDS] = {"timeout", "refused", "reset", "connect", "dns", "tls", "other"};
+
+FailureKind classify_failure(CURLcode code, long os_errno) {
+    if (code == CURLE_OPERATION_TIMEDOUT || os_errno == ETIMEDOUT) return FAIL_TIMEOUT;
+    if (os_errno == ECONNREFUSED) return FAIL_REFUSED;
+    if (os_errno == ECONNRESET || os_errno == EPIPE || os_errno == ECONNABORTED) return FAIL_RESET;
+
+    switch (code) {
+        case CURLE_COULDNT_RESOLVE_HOST:
+        case CURLE_COULDNT_RESOLVE_PROXY:
+            return FAIL_DNS;
+        case CURLE_COULDNT_CONNECT:
+            return FAIL_CONNECT;
+        case CURLE_GOT_NOTHING:
+        case CURLE_PARTIAL_FILE:
+        case CURLE_SEND_ERROR:
+        case CURLE_RECV_ERROR:
+        case CURLE_HTTP2_STREAM:
+            return FAIL_RESET;
+        case CURLE_SSL_CONNECT_ERROR:
+        case CURLE_PEER_FAILED_VERIFICATION:
+        case CURLE_SSL_CERTPROBLEM:
+        case CURLE_SSL_CIPHER:
+        case CURLE_SSL_CACERT_BADFILE:
+        case CURLE_SSL_SHUTDOWN_FAILED:
+        case CURLE_SSL_CRL_BADFILE:
+        case CURLE_SSL_ISSUER_ERROR:
+        case CURLE_SSL_PINNEDPUBKEYNOTMATCH:
+        case CURLE_SSL_INVALIDCERTSTATUS:
+        case CURLE_SSL_ENGINE_NOTFOUND:
+        case CURLE_SSL_ENGINE_SETFAILED:
+        case CURLE_SSL_ENGINE_INITFAILED:
+        case CURLE_USE_SSL_FAILED:
+            return FAIL_TLS;
+        default:
+            return FAIL_OTHER;
+    }
+}
+
+void count_failure(ErrorMatrix *m, FailureKind kind, CURLcode code) {
+    if (code < 0 || code >= CURL_LAST) code = CURL_LAST - 1;
+    m->transport[kind][code]++;
+}
+
+void count_status(ErrorMatrix *m, long status) {
+    m->status[status > 0 && status < STATUS_CODES ? status : 0]++;
+}
+
+void merge_error_matrix(ErrorMatrix *dst, const ErrorMatrix *src) {
+    for (int k = 0; k < FAIL_KINDS; k++) {
+        for (int c = 0; c < CURL_LAST; c++) {
+            dst->transport[k][c] += src->transport[k][c];
+        }
+    }
+    for (int s = 0; s < STATUS_CODES; s++) {
+        dst->status[s] += src->status[s];
+    }
+}
+
+typedef struct {
+    uint64_t count;
+    int kind;  // FAIL_KINDS for a status
+    int code;  // CURLcode or status
+} MatrixRow;
+
+static int by_count(const void *a, const void *b) {
+    const MatrixRow *x = a, *y = b;
+    return x->count < y->count ? 1 : x->count > y->count ? -1 : 0;
+}
+
+static double share(uint64_t n, uint64_t total) {
+    return total ? n * 100.0 / total : 0.0;
+}
+
+void print_error_matrix(const ErrorMatrix *m) {
+    uint64_t classes[6] = {0};  // Out of range, then 1xx to 5xx
+    uint64_t kinds[FAIL_KINDS] = {0};
+    uint64_t total = 0, failed = 0;
+    int rows = 0;
+    for (int s = 0; s < STATUS_CODES; s++) {
+        classes[s / 100] += m->status[s];
+        total += m->status[s];
+        if (s >= 400 && m->status[s]) rows++;
+    }
+    for (int k = 0; k < FAIL_KINDS; k++) {
+        for (int c = 0; c < CURL_LAST; c++) {
+            kinds[k] += m->transport[k][c];
+            if (m->transport[k][c]) rows++;
+        }
+        failed += kinds[k];
+    }
+    total += failed;
+    if (rows == 0) return;
+
+    // The shares at a glance, e.g. "2xx 96.40%  5xx 0.40%  reset 3.20%"
+    char line[512];
+    int len = 0;
+    static const char *class_names[6] = {"other", "1xx", "2xx", "3xx", "4xx", "5xx"};
+    for (int i = 1; i <= 6; i++) {
+        int c = i % 6;  // Out of range statuses last
+        if (classes[c] && len < (int)sizeof(line)) {
+            len += snprintf(line + len, sizeof(line) - len, "  %s %.2f%%", class_names[c], share(classes[c], total));
+        }
+    }
+    for (int k = 0; k < FAIL_KINDS; k++) {
+        if (kinds[k] && len < (int)sizeof(line)) {
+            len += snprintf(line + len, sizeof(line) - len, "  %s %.2f%%", kind_names[k], share(kinds[k], total));
+        }
+    }
+    LOG_INFO("Outcomes of %llu requests:%s", (unsigned long long)total, line);
+
+    MatrixRow *row = malloc(rows * sizeof(MatrixRow));
+    if (!row) return;
+    int n = 0;
+    for (int k = 0; k < FAIL_KINDS; k++) {
+        for (int c = 0; c < CURL_LAST; c++) {
+            if (m->transport[k][c]) row[n++] = (MatrixRow){m->transport[k][c], k, c};
+        }
+    }
+    for (int s = 400; s < STATUS_CODES; s++) {
+        if (m->status[s]) row[n++] = (MatrixRow){m->status[s], FAIL_KINDS, s};
+    }
+    qsort(row, n, sizeof(MatrixRow), by_count);
+
+    uint64_t rest = 0;
+    for (int i = 0; i < n; i++) {
+        if (i >= MATRIX_ROWS) {
+            rest += row[i].count;
+        } else if (row[i].kind == FAIL_KINDS) {
+            LOG_INFO("  %10llu  %6.2f%%  http     status %d", (unsigned long long)row[i].count,
+                     share(row[i].count, total), row[i].code);
+        } else {
+            LOG_INFO("  %10llu  %6.2f%%  %-8s curl %d: %s", (unsigned long long)row[i].count,
+                     share(row[i].count, total), kind_names[row[i].kind], row[i].code,
+                     curl_easy_strerror((CURLcode)row[i].code));
+        }
+    }
+    if (rest) {
+        LOG_INFO("  %10llu  %6.2f%%  in %d more kinds", (unsigned long long)rest, share(rest, total), n - MATRIX_ROWS);
+    }
+    free(row);
+}
+
+void init_failure_sampler(FailureSampler *s, uint64_t seed) {
+    memset(s, 0, sizeof(FailureSampler));
+    s->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+static void clear_sample(FailureSample *f) {
+    free(f->method);
+    free(f->url);
+    memset(f, 0, sizeof(FailureSample));
+}
+
+// Index of the kept sample with the highest key, the next one to give way
+static int highest_key(const FailureSampler *s) {
+    int top = 0;
+    for (int i = 1; i < s->count; i++) {
+        if (s->samples[i].key > s->samples[top].key) top = i;
+    }
+    return top;
+}
+
+FailureSample *sample_failure(FailureSampler *s) {
+    s->seen++;
+    uint64_t key = next_random(&s->rng);
+    FailureSample *f;
+    if (s->count < SAMPLE_MAX) {
+        f = &s->samples[s->count++];
+    } else {
+        f = &s->samples[highest_key(s)];
+        if (key >= f->key) return NULL;
+    }
+    clear_sample(f);
+    f->key = key;
+    return f;
+}
+
+void merge_failure_sampler(FailureSampler *dst, FailureSampler *src) {
+    for (int i = 0; i < src->count; i++) {
+        FailureSample *f = &src->samples[i];
+        FailureSample *slot = NULL;
+        if (dst->count < SAMPLE_MAX) {
+            slot = &dst->samples[dst->count++];
+        } else {
+            int top = highest_key(dst);
+            if (f->key < dst->samples[top].key) {
+                slot = &dst->samples[top];
+                clear_sample(slot);
+            }
+        }
+        // Move the sample over, or drop it
+        if (slot) {
+            *slot = *f;
+        } else {
+            clear_sample(f);
+        }
+        memset(f, 0, sizeof(FailureSample));
+    }
+    dst->seen += src->seen;
+    src->count = 0;
+    src->seen = 0;
+}
+
+// Log captured response bytes, dropping carriage returns and masking other control characters
+static void print_peek(const char *label, const char *data, size_t len) {
+    char text[PEEK_MAX + 1];
+    size_t n = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)data[i];
+        if (c == '\r') continue;
+        text[n++] = c == '\n' || (c >= 0x20 && c != 0x7f) ? (char)c : '.';
+    }
+    while (n > 0 && text[n - 1] == '\n') n--;
+    if (n == 0) return;
+    text[n] = '\0';
+    LOG_INFO("  %s%s:\n%s", label, len == PEEK_MAX ? " (truncated)" : "", text);
+}
+
+void print_failure_samples(const FailureSampler *s, const char *const *names) {
+    if (s->count == 0) return;
+    LOG_INFO("========== SAMPLED FAILURES ==========");
+    LOG_INFO("%d of %llu failures, picked uniformly at random", s->count, (unsigned long long)s->seen);
+
+    // Oldest first
+    int order[SAMPLE_MAX];
+    for (int i = 0; i < s->count; i++) {
+        int j = i;
+        while (j > 0 && s->samples[order[j - 1]].at > s->samples[i].at) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    for (int i = 0; i < s->count; i++) {
+        const FailureSample *f = &s->samples[order[i]];
+        if (f->kind == FAIL_KINDS) {
+            LOG_INFO("[%d] %.3f s  %s  %s %s -> HTTP %ld in %.2f ms", i + 1, f->at, names[f->case_index],
+                     f->method ? f->method : "?", f->url ? f->url : "?", f->status, f->total_ms);
+        } else {
+            LOG_INFO("[%d] %.3f s  %s  %s %s -> %s, curl %d: %s%s%s", i + 1, f->at, names[f->case_index],
+                     f->method ? f->method : "?", f->url ? f->url : "?", kind_names[f->kind], f->code,
+                     f->peek.error[0] ? f->peek.error : curl_easy_strerror(f->code),
+                     f->os_errno ? ", " : "", f->os_errno ? strerror((int)f->os_errno) : "");
+        }
+        print_peek("Headers", f->peek.headers, f->peek.headers_len);
+        print_peek("Body", f->peek.body, f->peek.body_len);
+    }
+}
+
+void free_failure_sampler(FailureSampler *s) {
+    for (int i = 0; i < s->count; i++) {
+        clear_sample(&s->samples[i]);
+    }
+    s->count = 0;
+}
@@ -0,0 +1,87 @@
+#ifndef ERRORS_H
+#define ERRORS_H
+
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Response bytes kept per slot, enough to show a failure without buffering bodies
+#define PEEK_MAX 256
+// Failures kept with their details in a load test
+#define SAMPLE_MAX 5
+#define STATUS_CODES 600
+
+// What went wrong with a transfer, from its CURLcode and the socket error behind it
+typedef enum {
+    FAIL_TIMEOUT,
+    FAIL_REFUSED,
+    FAIL_RESET,    // Connection reset or closed by the peer mid-request
+    FAIL_CONNECT,  // Other connect failures, e.g. unreachable
+    FAIL_DNS,
+    FAIL_TLS,
+    FAIL_OTHER,
+    FAIL_KINDS
+} FailureKind;
+
+// Outcome counts of one case; plain counters since each worker keeps its own
+typedef struct {
+    uint64_t transport[FAIL_KINDS][CURL_LAST];
+    uint64_t status[STATUS_CODES];  // Responses by status, 0 for anything out of range
+} ErrorMatrix;
+
+// Start of the response of one slot and curl's error message, overwritten every send
+typedef struct {
+    char error[CURL_ERROR_SIZE];
+    char headers[PEEK_MAX];
+    size_t headers_len;
+    char body[PEEK_MAX];
+    size_t body_len;
+} ResponsePeek;
+
+typedef struct {
+    uint64_t key;      // Random; the SAMPLE_MAX lowest keys over all failures are kept
+    int case_index;
+    FailureKind kind;  // FAIL_KINDS for a response with an error status
+    CURLcode code;
+    long status;
+    long os_errno;
+    double at;         // Seconds into the test
+    double total_ms;
+    char *method;
+    char *url;
+    ResponsePeek peek;
+} FailureSample;
+
+// Uniform sample of failures: every failure gets a random key and the lowest ones stay,
+// so samples of different workers merge into a uniform sample of all of them
+typedef struct {
+    FailureSample samples[SAMPLE_MAX];
+    int count;
+    uint64_t seen;
+    uint64_t rng;
+} FailureSampler;
+
+FailureKind classify_failure(CURLcode code, long os_errno);
+
+void count_failure(ErrorMatrix *m, FailureKind kind, CURLcode code);
+void count_status(ErrorMatrix *m, long status);
+void merge_error_matrix(ErrorMatrix *dst, const ErrorMatrix *src);
+
+// Log the share of every outcome class, then each failure kind and status by count.
+// Nothing is logged when every request succeeded.
+void print_error_matrix(const ErrorMatrix *m);
+
+void init_failure_sampler(FailureSampler *s, uint64_t seed);
+
+// Count a failure and return the sample to fill in if it is kept, NULL otherwise.
+// The returned sample has been cleared.
+FailureSample *sample_failure(FailureSampler *s);
+
+// Fold src into dst, emptying src
+void merge_failure_sampler(FailureSampler *dst, FailureSampler *src);
+
+// Log the kept failures in full; names holds the case names by index
+void print_failure_samples(const FailureSampler *s, const char *const *names);
+void free_failure_sampler(FailureSampler *s);
+
+#endif
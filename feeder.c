@@ -0,0 +1,460 @@
+#include "feeder.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+// Check whether a span only holds line endings
+static int is_blank(const char *p, const char *end) {
+    for (; p < end; p++) {
+        if (*p != '\r' && *p != '\n') return 0;
+    }
+    return 1;
+}
+
+// Append a record start offset, growing the index geometrically
+static int push_offset(Feeder *f, size_t *cap, size_t offset) {
+    if (f->count + 1 >= *cap) {
+        size_t new_cap = *cap ? *cap * 2 : 1024;
+        size_t *temp = realloc(f->offsets, new_cap * sizeof(size_t));
+        if (!temp) return -1;
+        f->offsets = temp;
+        *cap = new_cap;
+    }
+    f->offsets[f->count++] = offset;
+    return 0;
+}
+
+// Index record start offsets in one pass; CSV records may span lines inside quotes
+static int index_records(Feeder *f) {
+    const char *data = f->file->data;
+    const char *end = data + f->file->size;
+    const char *p = data;
+    size_t cap = 0;
+
+    while (p < end) {
+        const char *start = p;
+        int quoted = 0;
+        while (p < end) {
+            const char *nl = memchr(p, '\n', end - p);
+            const char *stop = nl ? nl : end;
+            if (f->format == FEED_CSV) {
+                for (const char *q = memchr(p, '"', stop - p); q; q = memchr(q + 1, '"', stop - q - 1)) {
+                    quoted ^= 1;
+                }
+            }
+            p = nl ? nl + 1 : end;
+            if (!quoted) break;
+        }
+        if (!is_blank(start, p) && push_offset(f, &cap, start - data)) return -1;
+    }
+
+    // Terminating offset so every record is [offsets[i], offsets[i + 1])
+    if (push_offset(f, &cap, f->file->size)) return -1;
+    f->count--;
+    return 0;
+}
+
+// Skip JSON whitespace
+static const char *skip_ws(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) p++;
+    return p;
+}
+
+// Skip a JSON string starting at the opening quote, returns the position past the closing quote
+static const char *skip_string(const char *p, const char *end) {
+    for (p++; p < end; p++) {
+        if (*p == '\\') p++;
+        else if (*p == '"') return p + 1;
+    }
+    return end;
+}
+
+// Skip any JSON value, returns the position just past it
+static const char *skip_value(const char *p, const char *end) {
+    if (p >= end) return end;
+    if (*p == '"') return skip_string(p, end);
+    if (*p == '{' || *p == '[') {
+        int depth = 0;
+        while (p < end) {
+            if (*p == '"') {
+                p = skip_string(p, end);
+                continue;
+            }
+            if (*p == '{' || *p == '[') depth++;
+            else if (*p == '}' || *p == ']') {
+                if (--depth == 0) return p + 1;
+            }
+            p++;
+        }
+        return end;
+    }
+    while (p < end && *p != ',' && *p != '}' && *p != ']' &&
+           *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') p++;
+    return p;
+}
+
+// Iterate the members of a flat JSON object line; calls visit(key, value) until it returns non-zero
+static int each_member(const char *p, const char *end,
+                       int (*visit)(const char *, size_t, const char *, size_t, void *), void *arg) {
+    p = skip_ws(p, end);
+    if (p >= end || *p != '{') return -1;
+    p++;
+    while (1) {
+        p = skip_ws(p, end);
+        if (p >= end || *p != '"') return -1;
+        const char *key = p + 1;
+        p = skip_string(p, end);
+        size_t key_len = p - key - 1;
+        p = skip_ws(p, end);
+        if (p >= end || *p != ':') return -1;
+        p = skip_ws(p + 1, end);
+        const char *value = p;
+        p = skip_value(p, end);
+        if (visit(key, key_len, value, p - value, arg)) return 0;
+        p = skip_ws(p, end);
+        if (p < end && *p == '}') return 0;
+        if (p >= end || *p != ',') return -1;
+        p++;
+    }
+}
+
+// End of the CSV field starting at p, quotes included
+static const char *csv_field_end(const char *p, const char *end) {
+    if (p < end && *p == '"') {
+        for (p++; p < end; p++) {
+            if (*p == '"') {
+                if (p + 1 < end && p[1] == '"') p++;
+                else break;
+            }
+        }
+    }
+    while (p < end && *p != ',') p++;
+    return p;
+}
+
+// Locate field number column of a CSV record, quotes included
+static int csv_field(const char *p, const char *end, int column, const char **start, size_t *len) {
+    for (int i = 0; p <= end; i++) {
+        const char *field = p;
+        p = csv_field_end(p, end);
+        if (i == column) {
+            *start = field;
+            *len = p - field;
+            return 0;
+        }
+        p++;
+    }
+    return -1;
+}
+
+// Trim trailing line endings off a record
+static void record_span(const Feeder *f, size_t i, Record *rec) {
+    const char *start = f->file->data + f->offsets[i];
+    const char *end = f->file->data + f->offsets[i + 1];
+    while (end > start && (end[-1] == '\n' || end[-1] == '\r')) end--;
+    rec->feeder = f;
+    rec->data = start;
+    rec->len = end - start;
+    rec->resolved = 0;
+}
+
+typedef struct {
+    Record *rec;
+    int columns;          // Columns to resolve
+    int found;
+} Resolve;
+
+static int resolve_member(const char *key, size_t key_len, const char *value, size_t value_len, void *arg) {
+    Resolve *r = (Resolve *)arg;
+    for (int i = 0; i < r->columns; i++) {
+        const char *name = r->rec->feeder->columns[i];
+        if (r->rec->field[i][0] >= 0 || strncmp(name, key, key_len) != 0 || name[key_len] != '\0') continue;
+        r->rec->field[i][0] = (int32_t)(value - r->rec->data);
+        r->rec->field[i][1] = value_len == 4 && memcmp(value, "null", 4) == 0 ? 0 : (int32_t)value_len;
+        return ++r->found == r->columns;
+    }
+    return 0;
+}
+
+// Find every column of a record in one pass, so rendering never scans it again
+static void resolve_fields(Record *rec) {
+    const Feeder *f = rec->feeder;
+    int columns = f->column_count < RECORD_FIELDS ? f->column_count : RECORD_FIELDS;
+    if (rec->len > INT32_MAX) return;
+    for (int i = 0; i < columns; i++) {
+        rec->field[i][0] = -1;
+        rec->field[i][1] = 0;
+    }
+
+    const char *p = rec->data;
+    const char *end = rec->data + rec->len;
+    if (f->format == FEED_CSV) {
+        for (int i = 0; i < columns && p <= end; i++) {
+            const char *start = p;
+            p = csv_field_end(p, end);
+            rec->field[i][0] = (int32_t)(start - rec->data);
+            rec->field[i][1] = (int32_t)(p - start);
+            p++;
+        }
+    } else {
+        Resolve r = {rec, columns, 0};
+        each_member(p, end, resolve_member, &r);
+    }
+    rec->resolved = columns;
+}
+
+// Append a column name, copied without quotes or escapes
+static int add_column(Feeder *f, const char *start, size_t len) {
+    char **temp = realloc(f->columns, (f->column_count + 1) * sizeof(char *));
+    if (!temp) return -1;
+    f->columns = temp;
+    char *name = malloc(len + 1);
+    if (!name) return -1;
+    name[copy_field(f, start, len, name)] = '\0';
+    f->columns[f->column_count++] = name;
+    return 0;
+}
+
+static int visit_column(const char *key, size_t key_len, const char *value, size_t value_len, void *arg) {
+    (void)value;
+    (void)value_len;
+    Feeder *f = (Feeder *)arg;
+    char **temp = realloc(f->columns, (f->column_count + 1) * sizeof(char *));
+    if (!temp) return 1;
+    f->columns = temp;
+    f->columns[f->column_count] = strndup(key, key_len);
+    if (f->columns[f->column_count]) f->column_count++;
+    return 0;
+}
+
+// Read column names: the CSV header row (dropped from the records), or the first JSONL object's keys
+static int read_columns(Feeder *f) {
+    if (f->count == 0) return 0;
+
+    Record rec;
+    record_span(f, 0, &rec);
+    if (f->format == FEED_JSONL) {
+        return each_member(rec.data, rec.data + rec.len, visit_column, f) < 0 ? -1 : 0;
+    }
+
+    const char *start;
+    size_t len;
+    for (int i = 0; csv_field(rec.data, rec.data + rec.len, i, &start, &len) == 0; i++) {
+        if (add_column(f, start, len)) return -1;
+    }
+    memmove(f->offsets, f->offsets + 1, f->count * sizeof(size_t));
+    f->count--;
+    return 0;
+}
+
+// Map and index a CSV or JSONL feeder file
+Feeder *load_feeder(const char *path, FeedMode mode) {
+    Feeder *f = calloc(1, sizeof(Feeder));
+    if (!f) {
+        LOG_ERROR("Failed to allocate feeder");
+        return NULL;
+    }
+
+    f->mode = mode;
+    atomic_init(&f->next, 0);
+    const char *ext = strrchr(path, '.');
+    f->format = ext && (strcasecmp(ext, ".jsonl") == 0 || strcasecmp(ext, ".ndjson") == 0) ? FEED_JSONL : FEED_CSV;
+
+    f->file = map_file(path);
+    if (!f->file) {
+        LOG_ERROR("Failed to map feeder file: %s", path);
+        free(f);
+        return NULL;
+    }
+
+    if (index_records(f) || read_columns(f)) {
+        LOG_ERROR("Failed to index feeder file: %s", path);
+        free_feeder(f);
+        return NULL;
+    }
+    if (f->count == 0) {
+        LOG_WARN("Feeder %s has no records", path);
+    }
+    return f;
+}
+
+void free_feeder(Feeder *f) {
+    if (!f) return;
+
+    for (int i = 0; i < f->column_count; i++) {
+        free(f->columns[i]);
+    }
+    free(f->columns);
+    free(f->offsets);
+    unmap_file(f->file);
+    free(f);
+}
+
+int parse_feed_mode(const char *mode) {
+    if (strcasecmp(mode, "sequential") == 0) return FEED_SEQUENTIAL;
+    if (strcasecmp(mode, "random") == 0) return FEED_RANDOM;
+    if (strcasecmp(mode, "circular") == 0) return FEED_CIRCULAR;
+    return -1;
+}
+
+const char *feed_mode_toString(FeedMode mode) {
+    switch (mode) {
+        case FEED_SEQUENTIAL: return "sequential";
+        case FEED_RANDOM: return "random";
+        case FEED_CIRCULAR: return "circular";
+        default: return "unknown";
+    }
+}
+
+int feeder_column(const Feeder *f, const char *name) {
+    for (int i = 0; i < f->column_count; i++) {
+        if (strcmp(f->columns[i], name) == 0) return i;
+    }
+    return -1;
+}
+
+void init_feed_cursor(FeedCursor *c, Feeder *f, uint64_t seed) {
+    c->feeder = f;
+    c->rng = seed ? seed : 0x9E3779B97F4A7C15ULL;
+}
+
+int next_record(FeedCursor *c, Record *rec) {
+    Feeder *f = c->feeder;
+    if (!f || f->count == 0) return -1;
+
+    size_t i;
+    switch (f->mode) {
+        case FEED_RANDOM:
+            i = next_random(&c->rng) % f->count;
+            break;
+        case FEED_CIRCULAR:
+            i = atomic_fetch_add_explicit(&f->next, 1, memory_order_relaxed) % f->count;
+            break;
+        case FEED_SEQUENTIAL:
+        default:
+            i = atomic_fetch_add_explicit(&f->next, 1, memory_order_relaxed);
+            if (i >= f->count) return -1;
+            break;
+    }
+
+    record_span(f, i, rec);
+    resolve_fields(rec);
+    return 0;
+}
+
+typedef struct {
+    const char *name;
+    const char *start;
+    size_t len;
+} FieldLookup;
+
+static int visit_field(const char *key, size_t key_len, const char *value, size_t value_len, void *arg) {
+    FieldLookup *lookup = (FieldLookup *)arg;
+    if (strlen(lookup->name) != key_len || memcmp(lookup->name, key, key_len) != 0) return 0;
+    lookup->start = value;
+    lookup->len = value_len;
+    return 1;
+}
+
+int record_field(const Record *rec, int column, const char **start, size_t *len) {
+    const Feeder *f = rec->feeder;
+    if (column < 0 || column >= f->column_count) return -1;
+    if (column < rec->resolved) {
+        if (rec->field[column][0] < 0) return -1;
+        *start = rec->data + rec->field[column][0];
+        *len = (size_t)rec->field[column][1];
+        return 0;
+    }
+
+    if (f->format == FEED_CSV) {
+        return csv_field(rec->data, rec->data + rec->len, column, start, len);
+    }
+
+    FieldLookup lookup = {f->columns[column], NULL, 0};
+    each_member(rec->data, rec->data + rec->len, visit_field, &lookup);
+    if (!lookup.start) return -1;
+    *start = lookup.start;
+    *len = lookup.len == 4 && memcmp(lookup.start, "null", 4) == 0 ? 0 : lookup.len;
+    return 0;
+}
+
+// Encode a code point as UTF-8
+static size_t put_utf8(unsigned long cp, char *out) {
+    if (cp < 0x80) {
+        out[0] = (char)cp;
+        return 1;
+    }
+    if (cp < 0x800) {
+        out[0] = (char)(0xC0 | (cp >> 6));
+        out[1] = (char)(0x80 | (cp & 0x3F));
+        return 2;
+    }
+    if (cp < 0x10000) {
+        out[0] = (char)(0xE0 | (cp >> 12));
+        out[1] = (char)(0x80 | ((cp >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (cp & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (cp >> 18));
+    out[1] = (char)(0x80 | ((cp >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((cp >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (cp & 0x3F));
+    return 4;
+}
+
+static unsigned long read_hex4(const char *p) {
+    char hex[5] = {p[0], p[1], p[2], p[3], '\0'};
+    return strtoul(hex, NULL, 16);
+}
+
+size_t copy_field(const Feeder *f, const char *start, size_t len, char *out) {
+    if (len < 2 || start[0] != '"') {
+        memcpy(out, start, len);
+        return len;
+    }
+
+    const char *p = start + 1;
+    const char *end = start + len - 1; // Closing quote
+    char *o = out;
+    if (f->format == FEED_CSV) {
+        while (p < end) {
+            if (*p == '"' && p + 1 < end && p[1] == '"') p++;
+            *o++ = *p++;
+        }
+        return o - out;
+    }
+
+    while (p < end) {
+        if (*p != '\\' || p + 1 >= end) {
+            *o++ = *p++;
+            continue;
+        }
+        p++;
+        switch (*p) {
+            case 'n': *o++ = '\n'; p++; break;
+            case 't': *o++ = '\t'; p++; break;
+            case 'r': *o++ = '\r'; p++; break;
+            case 'b': *o++ = '\b'; p++; break;
+            case 'f': *o++ = '\f'; p++; break;
+            case 'u':
+                if (p + 4 < end) {
+                    unsigned long cp = read_hex4(p + 1);
+                    p += 5;
+                    if (cp >= 0xD800 && cp < 0xDC00 && p + 5 < end && p[0] == '\\' && p[1] == 'u') {
+                        unsigned long lo = read_hex4(p + 2);
+                        if (lo >= 0xDC00 && lo < 0xE000) {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+                            p += 6;
+                        }
+                    }
+                    o += put_utf8(cp, o);
+                } else {
+                    p = end;
+                }
+                break;
+            default: *o++ = *p++; break; // \" \\ \/
+        }
+    }
+    return o - out;
+}
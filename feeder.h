@@ -0,0 +1,71 @@
+#ifndef FEEDER_H
+#define FEEDER_H
+
+#include "utils.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    FEED_SEQUENTIAL,  // Each record once, then the feeder is exhausted
+    FEED_RANDOM,      // Uniformly random records, per-worker PRNG
+    FEED_CIRCULAR     // Each record in order, wrapping around at the end
+} FeedMode;
+
+typedef enum {
+    FEED_CSV,
+    FEED_JSONL
+} FeedFormat;
+
+typedef struct {
+    MappedFile *file;     // Read-only mapping of the whole feeder file
+    FeedFormat format;
+    FeedMode mode;
+    char **columns;       // Column names, from the CSV header or the first JSONL object
+    int column_count;
+    size_t *offsets;      // Record start offsets, offsets[count] is the end of the data
+    size_t count;         // Number of records
+    atomic_size_t next;   // Shared position for sequential and circular cursors
+} Feeder;
+
+// Columns whose place in a record is found once when it is fetched; later ones are
+// looked up as they are rendered
+#define RECORD_FIELDS 32
+
+// One record, pointing into the mapping
+typedef struct {
+    const Feeder *feeder;
+    const char *data;
+    size_t len;
+    int resolved;         // Leading columns with their place in field
+    int32_t field[RECORD_FIELDS][2];  // Offset and length of each column in data, offset -1 if absent
+} Record;
+
+// Per-worker cursor over a shared feeder
+typedef struct {
+    Feeder *feeder;
+    uint64_t rng;
+} FeedCursor;
+
+// Map and index a CSV or JSONL feeder file, NULL on failure
+Feeder *load_feeder(const char *path, FeedMode mode);
+void free_feeder(Feeder *f);
+
+// Parse a feeder mode name, -1 if unknown
+int parse_feed_mode(const char *mode);
+const char *feed_mode_toString(FeedMode mode);
+
+// Look up a column by name, -1 if the feeder has no such column
+int feeder_column(const Feeder *f, const char *name);
+
+void init_feed_cursor(FeedCursor *c, Feeder *f, uint64_t seed);
+// Fetch the next record for this cursor, -1 once a sequential feeder is exhausted
+int next_record(FeedCursor *c, Record *rec);
+
+// Locate the raw text of a column in a record, -1 if the record lacks it. Columns
+// next_record resolved cost nothing, others are looked up.
+int record_field(const Record *rec, int column, const char **start, size_t *len);
+// Copy a raw field into out (at least len bytes) without quoting/escapes, returns the length written
+size_t copy_field(const Feeder *f, const char *start, size_t len, char *out);
+
+#endif
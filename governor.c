@@ -0,0 +1,234 @@
+#include "governor.h"
+#include "log.h"
+#include "warmup.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// How soon a request held by another loop's in-flight requests tries again
+#define RECHECK_S 0.005
+
+enum { HELD_CONNECTIONS, HELD_IN_FLIGHT, HELD_RATE };
+
+bool has_host_limits(const HostLimits *hl) {
+    return hl && (hl->connections > 0 || hl->in_flight > 0 || hl->rate > 0);
+}
+
+bool governor_active(const Governor *g) {
+    for (int i = 0; i < g->count; i++) {
+        if (has_host_limits(&g->hosts[i].limits)) return true;
+    }
+    return false;
+}
+
+// The stricter of two limits where 0 means none
+static int min_limit(int a, int b) {
+    return a == 0 ? b : b == 0 ? a : a < b ? a : b;
+}
+
+static void tighten(HostLimits *dst, const HostLimits *src) {
+    dst->connections = min_limit(dst->connections, src->connections);
+    dst->in_flight = min_limit(dst->in_flight, src->in_flight);
+    if (src->rate > 0 && (dst->rate == 0 || src->rate < dst->rate)) dst->rate = src->rate;
+    dst->burst = min_limit(dst->burst, src->burst);
+}
+
+void init_governor(Governor *g, const HostLimits *defaults) {
+    memset(g, 0, sizeof(Governor));
+    if (defaults) g->defaults = *defaults;
+}
+
+void free_governor(Governor *g) {
+    for (int i = 0; i < g->count; i++) {
+        free(g->hosts[i].origin);
+    }
+    free(g->hosts);
+    g->hosts = NULL;
+    g->count = 0;
+}
+
+// Derive the token bucket from the final limits
+static void set_bucket(HostGovernor *h) {
+    int burst = h->limits.burst > 0 ? h->limits.burst : 1;
+    h->interval_ns = h->limits.rate > 0 ? (int64_t)(1e9 / h->limits.rate) : 0;
+    h->tolerance_ns = h->interval_ns * (burst - 1);
+}
+
+int govern_case(Governor *g, const METADATA *md) {
+    char *scheme, *host;
+    long port;
+    if (case_origin(md, &scheme, &host, &port)) {
+        if (has_host_limits(&g->defaults) || has_host_limits(md->host_limits)) {
+            LOG_WARN("Host limits do not apply to %s, its host is only known per request",
+                     md->url[0] ? md->url : md->host);
+        }
+        return -1;
+    }
+    size_t len = strlen(scheme) + strlen(host) + 32;
+    char *origin = malloc(len);
+    if (origin) snprintf(origin, len, "%s://%s:%ld", scheme, host, port);
+    curl_free(scheme);
+    curl_free(host);
+    if (!origin) return -1;
+
+    int i = 0;
+    while (i < g->count && strcmp(g->hosts[i].origin, origin) != 0) i++;
+    if (i == g->count) {
+        HostGovernor *temp = realloc(g->hosts, (g->count + 1) * sizeof(HostGovernor));
+        if (!temp) {
+            free(origin);
+            return -1;
+        }
+        g->hosts = temp;
+        HostGovernor *h = &g->hosts[g->count++];
+        memset(h, 0, sizeof(HostGovernor));
+        h->origin = origin;
+        h->limits = g->defaults;
+        atomic_init(&h->tat, 0);
+        atomic_init(&h->in_flight, 0);
+        atomic_init(&h->peak, 0);
+        atomic_init(&h->admitted, 0);
+        for (int k = 0; k < 3; k++) atomic_init(&h->held[k], 0);
+    } else {
+        free(origin);
+    }
+    if (md->host_limits) tighten(&g->hosts[i].limits, md->host_limits);
+    set_bucket(&g->hosts[i]);
+    return i;
+}
+
+int governor_lanes(const Governor *g) {
+    int lanes = 0;
+    for (int i = 0; i < g->count; i++) {
+        lanes = min_limit(lanes, g->hosts[i].limits.connections);
+    }
+    return lanes;
+}
+
+int init_lane(HostLane *l, Governor *g, int lanes, int id) {
+    memset(l, 0, sizeof(HostLane));
+    l->gov = g;
+    if (g->count == 0) return 0;
+    l->busy = calloc(g->count, sizeof(int));
+    l->conn_share = calloc(g->count, sizeof(int));
+    l->multiplexed = calloc(g->count, sizeof(bool));
+    if (!l->busy || !l->conn_share || !l->multiplexed) {
+        free_lane(l);
+        return -1;
+    }
+    for (int i = 0; i < g->count; i++) {
+        int conns = g->hosts[i].limits.connections;
+        // Callers keep lanes within governor_lanes, so every loop gets one at least
+        l->conn_share[i] = conns > 0 ? conns / lanes + (id < conns % lanes ? 1 : 0) : -1;
+    }
+    return 0;
+}
+
+void free_lane(HostLane *l) {
+    free(l->busy);
+    free(l->conn_share);
+    free(l->multiplexed);
+    l->busy = NULL;
+    l->conn_share = NULL;
+    l->multiplexed = NULL;
+}
+
+int lane_connections(const HostLane *l, const char *url) {
+    for (int i = 0; l->conn_share && i < l->gov->count; i++) {
+        size_t len = strlen(l->gov->hosts[i].origin);
+        if (strncmp(url, l->gov->hosts[i].origin, len) == 0 && (url[len] == '/' || url[len] == '\0')) {
+            return l->conn_share[i];
+        }
+    }
+    return -1;
+}
+
+static void hold(HostLane *l, HostGovernor *h, int reason, double until, bool retry) {
+    if (!retry) atomic_fetch_add_explicit(&h->held[reason], 1, memory_order_relaxed);
+    if (l->wake == 0 || until < l->wake) l->wake = until;
+}
+
+// Take a token if one is due: the request may go once now is within tolerance of tat
+static bool take_token(HostGovernor *h, double now, double *due) {
+    int64_t now_ns = (int64_t)(now * 1e9);
+    int64_t tat = atomic_load_explicit(&h->tat, memory_order_relaxed);
+    for (;;) {
+        int64_t from = tat > now_ns ? tat : now_ns;
+        if (from - now_ns > h->tolerance_ns) {
+            *due = (from - h->tolerance_ns) / 1e9;
+            return false;
+        }
+        if (atomic_compare_exchange_weak_explicit(&h->tat, &tat, from + h->interval_ns,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return true;
+        }
+    }
+}
+
+bool admit_request(HostLane *l, int host, double now, bool retry) {
+    if (host < 0) return true;
+    HostGovernor *h = &l->gov->hosts[host];
+
+    // A multiplexing host carries every request of this loop on the connections it has
+    if (l->conn_share[host] >= 0 && !l->multiplexed[host] && l->busy[host] >= l->conn_share[host]) {
+        hold(l, h, HELD_CONNECTIONS, now + RECHECK_S, retry);
+        return false;
+    }
+    int in_flight = atomic_fetch_add_explicit(&h->in_flight, 1, memory_order_relaxed) + 1;
+    if (h->limits.in_flight > 0 && in_flight > h->limits.in_flight) {
+        atomic_fetch_sub_explicit(&h->in_flight, 1, memory_order_relaxed);
+        hold(l, h, HELD_IN_FLIGHT, now + RECHECK_S, retry);
+        return false;
+    }
+    double due;
+    if (h->interval_ns > 0 && !take_token(h, now, &due)) {
+        atomic_fetch_sub_explicit(&h->in_flight, 1, memory_order_relaxed);
+        hold(l, h, HELD_RATE, due, retry);
+        return false;
+    }
+
+    int peak = atomic_load_explicit(&h->peak, memory_order_relaxed);
+    while (in_flight > peak &&
+           !atomic_compare_exchange_weak_explicit(&h->peak, &peak, in_flight, memory_order_relaxed, memory_order_relaxed)) {
+    }
+    atomic_fetch_add_explicit(&h->admitted, 1, memory_order_relaxed);
+    l->busy[host]++;
+    return true;
+}
+
+void limit_transfer(const HostLane *l, int host, CURL *curl) {
+    if (host >= 0 && l->conn_share[host] >= 0) curl_easy_setopt(curl, CURLOPT_PIPEWAIT, 1L);
+}
+
+void release_request(HostLane *l, int host, CURL *curl) {
+    if (host < 0) return;
+    atomic_fetch_sub_explicit(&l->gov->hosts[host].in_flight, 1, memory_order_relaxed);
+    l->busy[host]--;
+    if (curl && !l->multiplexed[host]) {
+        long version = 0;
+        curl_easy_getinfo(curl, CURLINFO_HTTP_VERSION, &version);
+        if (version >= CURL_HTTP_VERSION_2_0) l->multiplexed[host] = true;
+    }
+}
+
+void print_governor(const Governor *g) {
+    for (int i = 0; i < g->count; i++) {
+        const HostGovernor *h = &g->hosts[i];
+        const HostLimits *hl = &h->limits;
+        if (!has_host_limits(hl)) continue;
+        char limits[160];
+        int n = 0;
+        limits[0] = '\0';
+        if (hl->connections) n += snprintf(limits + n, sizeof(limits) - n, ", %d connections", hl->connections);
+        if (hl->in_flight) n += snprintf(limits + n, sizeof(limits) - n, ", %d in flight", hl->in_flight);
+        if (hl->rate > 0) {
+            snprintf(limits + n, sizeof(limits) - n, ", %g req/s burst %d", hl->rate, hl->burst > 0 ? hl->burst : 1);
+        }
+        unsigned long long held[3];
+        for (int k = 0; k < 3; k++) held[k] = atomic_load(&h->held[k]);
+        LOG_INFO("Host %s limited to%s: %llu requests, peak %d in flight, %llu held back "
+                 "(connections %llu, in flight %llu, rate %llu)",
+                 h->origin, limits + 1, (unsigned long long)atomic_load(&h->admitted), atomic_load(&h->peak),
+                 held[0] + held[1] + held[2], held[0], held[1], held[2]);
+    }
+}
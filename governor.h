@@ -0,0 +1,79 @@
+#ifndef GOVERNOR_H
+#define GOVERNOR_H
+
+#include "read_yaml.h"
+#include <curl/curl.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Shared by every event loop sending to one host. The counters are atomic, so loops on
+// different threads admit requests without taking a lock.
+typedef struct {
+    char *origin;            // scheme://host:port
+    HostLimits limits;
+    int64_t interval_ns;     // Rate limit: spacing of requests, 0 for none
+    int64_t tolerance_ns;    // How far ahead of the spacing a burst may run
+    _Atomic int64_t tat;     // Token bucket as GCRA: when the next request is due, in ns
+    atomic_int in_flight;
+    atomic_int peak;         // Most requests in flight at once
+    atomic_ullong admitted;
+    atomic_ullong held[3];   // Requests that waited for the connection, in-flight and rate limits
+} HostGovernor;
+
+typedef struct {
+    HostLimits defaults;     // From the command line, for hosts no case sets limits for
+    HostGovernor *hosts;
+    int count;
+} Governor;
+
+// One event loop's view of the hosts: its share of each connection limit, so the loops
+// together never open more than the limit, and what it has in flight
+typedef struct {
+    Governor *gov;
+    int *busy;               // Requests this loop has in flight per host
+    int *conn_share;         // Connections this loop may use per host, -1 for no limit
+    bool *multiplexed;       // The host answered over HTTP/2 or later on this loop
+    double wake;             // Earliest time a held request could go, 0 for none
+} HostLane;
+
+bool has_host_limits(const HostLimits *hl);
+
+// Whether any host of g has limits; without them a loop need not consult g at all
+bool governor_active(const Governor *g);
+
+// Start a governor with defaults applied to every host, which may have no limits set
+void init_governor(Governor *g, const HostLimits *defaults);
+void free_governor(Governor *g);
+
+// Add the host of md and fold in its host_limits, the strictest of all cases winning.
+// Returns the host's index, or -1 when it is only known per send. Call for every case
+// before any lane is set up, so hosts limited by one case hold back all of them.
+int govern_case(Governor *g, const METADATA *md);
+
+// Most event loops that can share g's connection limits, one connection each at least;
+// 0 when no host limits its connections
+int governor_lanes(const Governor *g);
+
+// Share the connection limits among lanes event loops, no more than governor_lanes; this is loop id
+int init_lane(HostLane *l, Governor *g, int lanes, int id);
+void free_lane(HostLane *l);
+
+// This loop's share of the connection limit of the host url is on, -1 for no limit
+int lane_connections(const HostLane *l, const char *url);
+
+// Whether a request to host may go now. A held request moves l->wake to when to try again;
+// retry marks one held before, so it is counted as held only once.
+bool admit_request(HostLane *l, int host, double now, bool retry);
+
+// Configure a transfer admitted for host: with a connection limit, wait for a connection to
+// multiplex on instead of opening another
+void limit_transfer(const HostLane *l, int host, CURL *curl);
+
+// Hand back the slot of a finished request; curl is the finished handle, NULL if never sent
+void release_request(HostLane *l, int host, CURL *curl);
+
+// Log each limited host: its limits, requests sent, peak in flight and why requests waited
+void print_governor(const Governor *g);
+
+#endif
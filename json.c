@@ -0,0 +1,205 @@
+#include "json.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    char *data;
+    size_t len;
+    size_t cap;
+} Buffer;
+
+static int buf_reserve(Buffer *b, size_t extra) {
+    if (b->len + extra + 1 <= b->cap) return 0;
+    size_t cap = b->cap ? b->cap : 256;
+    while (cap < b->len + extra + 1) cap *= 2;
+    char *temp = realloc(b->data, cap);
+    if (!temp) return -1;
+    b->data = temp;
+    b->cap = cap;
+    return 0;
+}
+
+static int buf_append(Buffer *b, const char *s, size_t len) {
+    if (buf_reserve(b, len)) return -1;
+    memcpy(b->data + b->len, s, len);
+    b->len += len;
+    b->data[b->len] = '\0';
+    return 0;
+}
+
+// 1 for bytes that must be escaped inside a JSON string
+static const unsigned char needs_escape[256] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    0, 0, 1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0,
+};
+
+// Append s as a quoted JSON string, copying runs that need no escaping in one go
+static int append_string(Buffer *b, const char *s, size_t len) {
+    static const char hex[] = "0123456789abcdef";
+    // Worst case every byte becomes \u00XX
+    if (buf_reserve(b, len * 6 + 2)) return -1;
+
+    char *o = b->data + b->len;
+    *o++ = '"';
+    const char *end = s + len;
+    while (s < end) {
+        const char *run = s;
+        while (s < end && !needs_escape[(unsigned char)*s]) s++;
+        memcpy(o, run, s - run);
+        o += s - run;
+        if (s >= end) break;
+
+        unsigned char c = (unsigned char)*s++;
+        *o++ = '\\';
+        switch (c) {
+            case '"': *o++ = '"'; break;
+            case '\\': *o++ = '\\'; break;
+            case '\n': *o++ = 'n'; break;
+            case '\r': *o++ = 'r'; break;
+            case '\t': *o++ = 't'; break;
+            case '\b': *o++ = 'b'; break;
+            case '\f': *o++ = 'f'; break;
+            default:
+                *o++ = 'u';
+                *o++ = '0';
+                *o++ = '0';
+                *o++ = hex[c >> 4];
+                *o++ = hex[c & 0x0F];
+                break;
+        }
+    }
+    *o++ = '"';
+    *o = '\0';
+    b->len = o - b->data;
+    return 0;
+}
+
+char *json_quote(const char *s) {
+    Buffer b = {0};
+    if (append_string(&b, s, strlen(s))) {
+        free(b.data);
+        return NULL;
+    }
+    return b.data;
+}
+
+// Check a plain scalar against the JSON number grammar
+static int is_json_number(const char *s) {
+    if (*s == '-') s++;
+    if (*s == '0') {
+        s++;
+    } else if (*s >= '1' && *s <= '9') {
+        while (*s >= '0' && *s <= '9') s++;
+    } else {
+        return 0;
+    }
+    if (*s == '.') {
+        s++;
+        if (*s < '0' || *s > '9') return 0;
+        while (*s >= '0' && *s <= '9') s++;
+    }
+    if (*s == 'e' || *s == 'E') {
+        s++;
+        if (*s == '+' || *s == '-') s++;
+        if (*s < '0' || *s > '9') return 0;
+        while (*s >= '0' && *s <= '9') s++;
+    }
+    return *s == '\0';
+}
+
+// Emit a scalar: untagged plain numbers, booleans and nulls stay bare, everything else is a string
+static int append_scalar(Buffer *b, yaml_event_t *event) {
+    const char *value = (char*)event->data.scalar.value;
+    size_t len = event->data.scalar.length;
+    const char *tag = (char*)event->data.scalar.tag;
+
+    if (event->data.scalar.style == YAML_PLAIN_SCALAR_STYLE && !tag) {
+        if (is_json_number(value)) return buf_append(b, value, len);
+        if (strcmp(value, "true") == 0 || strcmp(value, "True") == 0 || strcmp(value, "TRUE") == 0) {
+            return buf_append(b, "true", 4);
+        }
+        if (strcmp(value, "false") == 0 || strcmp(value, "False") == 0 || strcmp(value, "FALSE") == 0) {
+            return buf_append(b, "false", 5);
+        }
+        if (len == 0 || strcmp(value, "~") == 0 || strcmp(value, "null") == 0 ||
+            strcmp(value, "Null") == 0 || strcmp(value, "NULL") == 0) {
+            return buf_append(b, "null", 4);
+        }
+    }
+    return append_string(b, value, len);
+}
+
+// Serialize one node; event holds its first event and is consumed
+static int append_node(yaml_parser_t *parser, yaml_event_t *event, Buffer *b) {
+    int rc = 0;
+    switch (event->type) {
+        case YAML_SCALAR_EVENT:
+            rc = append_scalar(b, event);
+            yaml_event_delete(event);
+            return rc;
+        case YAML_SEQUENCE_START_EVENT:
+        case YAML_MAPPING_START_EVENT: {
+            int mapping = event->type == YAML_MAPPING_START_EVENT;
+            yaml_event_type_t end_type = mapping ? YAML_MAPPING_END_EVENT : YAML_SEQUENCE_END_EVENT;
+            yaml_event_delete(event);
+            if (buf_append(b, mapping ? "{" : "[", 1)) return -1;
+            for (int i = 0;; i++) {
+                if (!yaml_parser_parse(parser, event)) return -1;
+                if (event->type == end_type) {
+                    yaml_event_delete(event);
+                    break;
+                }
+                if (i > 0 && buf_append(b, ",", 1)) rc = -1;
+                if (mapping) {
+                    // JSON keys are always strings
+                    if (event->type != YAML_SCALAR_EVENT) {
+                        LOG_ERROR("JSON object keys must be scalars");
+                        yaml_event_delete(event);
+                        return -1;
+                    }
+                    if (append_string(b, (char*)event->data.scalar.value, event->data.scalar.length) ||
+                        buf_append(b, ":", 1)) rc = -1;
+                    yaml_event_delete(event);
+                    if (!yaml_parser_parse(parser, event)) return -1;
+                }
+                if (append_node(parser, event, b)) return -1;
+                if (rc) return rc;
+            }
+            return buf_append(b, mapping ? "}" : "]", 1);
+        }
+        case YAML_ALIAS_EVENT:
+            LOG_ERROR("YAML aliases are not supported in json bodies");
+            yaml_event_delete(event);
+            return -1;
+        default:
+            yaml_event_delete(event);
+            return -1;
+    }
+}
+
+int yaml_to_json(yaml_parser_t *parser, yaml_event_t *event, char **out, size_t *len) {
+    Buffer b = {0};
+    int plain = event->type == YAML_SCALAR_EVENT;
+
+    // A scalar json value is taken as a ready-made JSON document
+    if (plain) {
+        int rc = buf_append(&b, (char*)event->data.scalar.value, event->data.scalar.length);
+        yaml_event_delete(event);
+        if (rc) {
+            free(b.data);
+            return -1;
+        }
+    } else if (append_node(parser, event, &b)) {
+        free(b.data);
+        return -1;
+    }
+
+    *out = b.data;
+    *len = b.len;
+    return 0;
+}
@@ -0,0 +1,14 @@
+#ifndef JSON_H
+#define JSON_H
+
+#include <stddef.h>
+#include <yaml.h>
+
+// Serialize the YAML node starting at event as JSON, consuming its events from the parser.
+// The result is one contiguous, NUL-terminated buffer in *out; returns 0 on success.
+int yaml_to_json(yaml_parser_t *parser, yaml_event_t *event, char **out, size_t *len);
+
+// Quote and escape s as a JSON string, NULL if out of memory
+char *json_quote(const char *s);
+
+#endif
@@ -1,4 +1,5 @@
 #include "log.h"
+#include "profile.h"
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -22,7 +23,15 @@ static const char *lss[] = {
 
 #define DEFAULT_TIME_FORMAT "%Y-%m-%d %H:%M:%S"
 
+static level_t min_level = DEFAULT_LOG_LEVEL;
+
+void set_log_level(level_t level) {
+    min_level = level;
+}
+
 void dolog(level_t level, const char *fmt, ...) {
+    if (level < min_level) return;
+    uint64_t start = prof_ticks();
     time_t t = time(NULL);
     struct tm *lt = localtime(&t);
     char timebuf[20];
@@ -36,4 +45,5 @@ void dolog(level_t level, const char *fmt, ...) {
     va_end(args);
 
     fprintf(stderr, "%s\n", rc);
+    prof_end(PROF_LOG, start);
 }
@@ -6,13 +6,17 @@
 typedef enum {
     LOG_LEVEL_INFO,
     LOG_LEVEL_WARN,
-    LOG_LEVEL_ERROR
+    LOG_LEVEL_ERROR,
+    LOG_LEVEL_OFF    // Only for set_log_level, silences everything
 } level_t;
 
 #define DEFAULT_LOG_LEVEL LOG_LEVEL_INFO
 
 void dolog(level_t level, const char *fmt, ...);
 
+// Drop messages below level, e.g. when capis is embedded as a library
+void set_log_level(level_t level);
+
 #define LOG(level, fmt, ...) dolog(level, fmt, ##__VA_ARGS__)
 #define LOG_INFO(fmt, ...)  dolog(LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
 #define LOG_WARN(fmt, ...)  dolog(LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
@@ -1,73 +1,282 @@
 #include "read_yaml.h"
+#include "replay.h"
 #include "log.h"
 #include "easy_curl.h"
 #include "multi_curl.h"
 #include "utils.h"
+#include "watch.h"
+#include "discover.h"
+#include "suite.h"
+#include "baseline.h"
+#include "capacity.h"
+#include "profile.h"
 #include <curl/curl.h>
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 /* 
-gcc main.c easy_curl.c multi_curl.c log.c read_yaml.c utils.c -I. -I./curl/include -I.\libyaml\include -L./curl/lib -lcurl -lyaml
-gcc main.c easy_curl.c log.c read_yaml.c utils.c -lcurl -lyaml -o capis.out
+gcc main.c easy_curl.c multi_curl.c log.c read_yaml.c utils.c feeder.c template.c stats.c urlencode.c json.c watch.c cache.c discover.c suite.c scenario.c stages.c capacity.c timeseries.c warmup.c trace.c profile.c baseline.c replay.c throughput.c stream.c governor.c errors.c -I. -I./curl/include -I.\libyaml\include -L./curl/lib -lcurl -lyaml -lpthread -lm
+gcc main.c easy_curl.c multi_curl.c log.c read_yaml.c utils.c feeder.c template.c stats.c urlencode.c json.c watch.c cache.c discover.c suite.c scenario.c stages.c capacity.c timeseries.c warmup.c trace.c profile.c baseline.c replay.c throughput.c stream.c governor.c errors.c -lcurl -lyaml -lpthread -lm -o capis.out
 */
 int main(int argc, char *argv[]) {
+    init_profiling();
     LOG_INFO("CAPIS RUNNING");
 
-    int verbose = 0;
-    StrLList filepaths = init_strllist();
+    int watch = 0;
+    const char *scenario = NULL;
+    RunConfig cfg = {0};
+    cfg.jobs = 64;
+    cfg.opts.threads = 1;
+    Stage *stages = NULL;
+    CapacityOptions capacity;
+    init_capacity_options(&capacity);
+    int bad_args = 0;
+    LoadOptions *opts = &cfg.opts;
+    PathList inputs = {0};
+    const char *save_path = NULL;     // --save-baseline
+    const char *compare_path = NULL;  // --compare
+    AllowedDelta deltas;
+    init_allowed_delta(&deltas);
+    Baseline base, results;
+    init_baseline(&base);
+    init_baseline(&results);
+    const char *replay = NULL;        // capis replay FILE: re-issue recorded traffic instead of cases
+    const char *target = NULL;
+    int insecure = 0;
+    int first = 1;
+    if (argc > 2 && strcmp(argv[1], "replay") == 0) {
+        replay = argv[2];
+        first = 3;
+    }
 
     curl_global_init(CURL_GLOBAL_ALL);
+    init_connection_pool();
+    set_generator_seed(mix64((uint64_t)time(NULL) ^ (uint64_t)getpid() << 32));
 
     // Parse command-line arguments
-    for (int a = 1; a < argc; a++) {
+    for (int a = first; a < argc; a++) {
         char *arg = argv[a];
         if (arg[0] != '-') {
-            ap_strllist(filepaths, arg);
+            ap_pathlist(&inputs, arg);
         } else if (strcmp(arg, "--verbose") == 0 || strcmp(arg, "-v") == 0) {
-            verbose = 1;
+            cfg.verbose = 1;
+        } else if (strcmp(arg, "--watch") == 0 || strcmp(arg, "-w") == 0) {
+            watch = 1;
+        } else if (strcmp(arg, "--cache") == 0 && a + 1 < argc) {
+            cfg.cache_dir = argv[++a];
+        } else if (strcmp(arg, "--scenario") == 0 && a + 1 < argc) {
+            scenario = argv[++a];
+        } else if ((strcmp(arg, "--jobs") == 0 || strcmp(arg, "-j") == 0) && a + 1 < argc) {
+            cfg.jobs = atoi(argv[++a]);
+        } else if ((strcmp(arg, "--users") == 0 || strcmp(arg, "-u") == 0) && a + 1 < argc) {
+            opts->users = atoi(argv[++a]);
+            if (opts->users < 1) {
+                LOG_ERROR("Invalid --users %s, expected 1 or more", argv[a]);
+                bad_args = 1;
+            }
+            cfg.load = 1;
+        } else if ((strcmp(arg, "--requests") == 0 || strcmp(arg, "-n") == 0) && a + 1 < argc) {
+            opts->requests = atol(argv[++a]);
+            cfg.load = 1;
+        } else if ((strcmp(arg, "--duration") == 0 || strcmp(arg, "-d") == 0) && a + 1 < argc) {
+            // Seconds, or with a unit for long soaks: 90s, 30m, 12h
+            opts->duration = parse_duration(argv[++a]);
+            if (opts->duration < 0) {
+                LOG_ERROR("Invalid --duration %s, expected e.g. 300, 30m or 12h", argv[a]);
+                bad_args = 1;
+            }
+            cfg.load = 1;
+        } else if (strcmp(arg, "--stages") == 0 && a + 1 < argc) {
+            free(stages);
+            stages = NULL;
+            if (parse_stages(argv[++a], &stages, &opts->stage_count)) {
+                LOG_ERROR("Invalid --stages, expected e.g. 30s:100,5m:1000,30s:0");
+                bad_args = 1;
+            }
+            opts->stages = stages;
+            cfg.load = 1;
+        } else if (strcmp(arg, "--rate") == 0 && a + 1 < argc) {
+            opts->rate = atof(argv[++a]);
+            capacity.start_rate = opts->rate;
+            cfg.load = 1;
+        } else if (strcmp(arg, "--find-capacity") == 0) {
+            cfg.capacity = &capacity;
+            cfg.load = 1;
+        } else if (strcmp(arg, "--slo") == 0 && a + 1 < argc) {
+            if (parse_slo(argv[++a], &capacity.slo)) {
+                LOG_ERROR("Invalid --slo %s, expected e.g. p99<200ms", argv[a]);
+                bad_args = 1;
+            }
+        } else if (strncmp(arg, "--error-rate", 12) == 0) {
+            // Accepts --error-rate<0.1%, --error-rate=0.1% and --error-rate 0.1%
+            const char *value = arg[12] == '<' || arg[12] == '=' ? arg + 13 : arg[12] == '\0' && a + 1 < argc ? argv[++a] : NULL;
+            if (!value || parse_percent(value, &capacity.slo.error_rate)) {
+                LOG_ERROR("Invalid --error-rate, expected e.g. --error-rate<0.1%%");
+                bad_args = 1;
+            }
+        } else if (strcmp(arg, "--warmup") == 0 && a + 1 < argc) {
+            // Pre-opened connections per host, 0 to skip them
+            int conns = atoi(argv[++a]);
+            opts->warmup = conns > 0 ? conns : -1;
+        } else if (strcmp(arg, "--timeseries") == 0 && a + 1 < argc) {
+            opts->timeseries = argv[++a];
+        } else if (strcmp(arg, "--trace") == 0 && a + 1 < argc) {
+            opts->trace = argv[++a];
+        } else if (strcmp(arg, "--speed") == 0 && a + 1 < argc) {
+            opts->speed = parse_speed(argv[++a]);
+            if (opts->speed <= 0) {
+                LOG_ERROR("Invalid --speed %s, expected e.g. 2x", argv[a]);
+                bad_args = 1;
+            }
+        } else if (strcmp(arg, "--target") == 0 && a + 1 < argc) {
+            target = argv[++a];
+        } else if (strcmp(arg, "--insecure") == 0 || strcmp(arg, "-k") == 0) {
+            insecure = 1;
+        } else if (strcmp(arg, "--save-baseline") == 0 && a + 1 < argc) {
+            save_path = argv[++a];
+        } else if (strcmp(arg, "--compare") == 0 && a + 1 < argc) {
+            compare_path = argv[++a];
+        } else if (strcmp(arg, "--max-delta") == 0 && a + 1 < argc) {
+            if (parse_allowed_delta(argv[++a], &deltas)) {
+                LOG_ERROR("Invalid --max-delta %s, expected e.g. p50=10%%,p99=20%%,rps=10%%,errors=1%%", argv[a]);
+                bad_args = 1;
+            }
+        } else if (strcmp(arg, "--seed") == 0 && a + 1 < argc) {
+            // Repeats the ${rand.*} values of an earlier run
+            char *end = NULL;
+            unsigned long long seed = strtoull(argv[++a], &end, 10);
+            if (end == argv[a] || *end != '\0') {
+                LOG_ERROR("Invalid --seed %s, expected a number", argv[a]);
+                bad_args = 1;
+            }
+            set_generator_seed(seed);
+        } else if (strncmp(arg, "--host-", 7) == 0 && a + 1 < argc) {
+            // Caps on every host: --host-connections, --host-in-flight, --host-rate, --host-burst
+            char key[16];
+            snprintf(key, sizeof(key), "%s", arg + 7);
+            for (char *k = key; *k; k++) {
+                if (*k == '-') *k = '_';
+            }
+            if (strcmp(key, "connections") != 0 && strcmp(key, "in_flight") != 0 &&
+                strcmp(key, "rate") != 0 && strcmp(key, "burst") != 0) {
+                LOG_ERROR("Unknown option %s", arg);
+                bad_args = 1;
+            } else if (set_host_limit(&opts->host_limits, key, argv[++a])) {
+                bad_args = 1;
+            }
+        } else if ((strcmp(arg, "--threads") == 0 || strcmp(arg, "-t") == 0) && a + 1 < argc) {
+            opts->threads = atoi(argv[++a]);
         }
     }
 
-    // Process each YAML file
-    Node *cur = filepaths->next;
-    while (cur) {
-        METADATA *md = init_metadata();
-        if (!md) {
-            LOG_ERROR("Failed to initialize metadata for %s", cur->val);
-            continue;
+    if (cfg.capacity) {
+        if (capacity.slo.latency_ms <= 0) {
+            LOG_ERROR("--find-capacity needs a latency objective, e.g. --slo p99<200ms");
+            bad_args = 1;
         }
-
-        FILE *fp = fopen(cur->val, "r");
-        if (!fp) {
-            LOG_ERROR("Failed to open %s", cur->val);
-            free_metadata(md);
-            cur = cur->next;
-            continue;
+        // With --find-capacity, -d is the length of each step and -u caps the requests in flight
+        if (opts->duration > 0) capacity.step = opts->duration;
+        if (opts->users == 0) opts->users = 1000;
+        // Each step needs a warm-up window and a window for each half it is judged on
+        if ((int)(capacity.step / capacity.window + 0.999) < 3) {
+            LOG_ERROR("--find-capacity needs steps longer than %g s, two windows of %g s; got -d %g",
+                      2 * capacity.window, capacity.window, capacity.step);
+            bad_args = 1;
+        }
+    }
+    // Start fresh output files, each load test of this run adds to them
+    const char *outputs[] = {opts->timeseries, opts->trace};
+    for (int i = 0; i < 2; i++) {
+        if (!outputs[i]) continue;
+        FILE *fp = fopen(outputs[i], "w");
+        if (fp) {
+            fclose(fp);
+        } else {
+            LOG_ERROR("Cannot write output file %s", outputs[i]);
+            bad_args = 1;
         }
+    }
+    // Load the baseline up front so a bad file fails before anything is sent
+    if (compare_path && load_baseline(compare_path, &base)) bad_args = 1;
+    if (save_path || compare_path) opts->results = &results;
+    if (bad_args) {
+        free_baseline(&base);
+        free_pathlist(&inputs);
+        free(stages);
+        free_connection_pool();
+        curl_global_cleanup();
+        return 1;
+    }
+
+    if (watch && !replay) {
+        watch_cases(&inputs, run_case, &cfg);
+        free_baseline(&base);
+        free_baseline(&results);
+        free_pathlist(&inputs);
+        free(stages);
+        free_connection_pool();
+        curl_global_cleanup();
+        return 0;
+    }
 
-        LOG_INFO("Processing METADATA: %s", cur->val);
-        if (read_yaml(fp, md)) goto SKIP_REQ;
-        
-        if (verbose) print_metadata(md);
+    if (cfg.jobs < 1) cfg.jobs = 1;
 
-        Response resp = {0}; // Initialize response
-        if (do_easy_curl(md, &resp, verbose) == 0) {
-            LOG_INFO("Request completed for %s", cur->val);
+    // Expand directories and globs, then run the cases in dependency order
+    PathList cases = {0};
+    int failed = 0;
+    if (replay) {
+        // Recorded traffic goes out on its own schedule, -u only caps the requests in flight
+        ReplayPlan *plan = load_replay(replay, target, !insecure);
+        if (plan) {
+            opts->replay = plan;
+            if (opts->users == 0) opts->users = 1000;
+            if (do_multi_scenario(plan->origins, opts)) failed = 1;
+            opts->replay = NULL;
+            free_replay(plan);
         } else {
-            LOG_ERROR("Request failed for %s", cur->val);
+            failed = 1;
         }
+    } else {
+        if (discover_cases(&inputs, &cases)) failed = 1;
+        if (run_suite(&cases, &cfg)) failed = 1;
+    }
+    free_pathlist(&inputs);
 
-        free_response(&resp);
-
-    SKIP_REQ:
-        fclose(fp);
-        free_metadata(md);
+    // A scenario load-tests its cases together, each request picking one by weight
+    if (scenario) {
+        Scenario *mix = load_scenario(scenario, cfg.cache_dir);
+        if (!mix || do_multi_scenario(mix, opts)) failed = 1;
+        free_scenario(mix);
+    }
 
-        cur = cur->next;
+    // Compare before saving, so a run can be checked against the baseline it replaces
+    int regressed = 0;
+    if (compare_path) {
+        if (results.count == 0) {
+            // Nothing to compare is no pass: most likely -u, -n or -d was left out
+            LOG_ERROR("No load test results to compare with %s", compare_path);
+            regressed = 1;
+        } else {
+            regressed = compare_baseline(&base, &results, &deltas);
+            if (regressed) LOG_ERROR("%d of %d cases regressed or were not run against %s", regressed, base.count, compare_path);
+        }
+    }
+    if (save_path) {
+        if (save_baseline(save_path, &results) == 0) {
+            LOG_INFO("Baseline of %d cases saved to %s", results.count, save_path);
+        } else {
+            failed = 1;
+        }
     }
 
-    free_strllist(filepaths);
+    free_baseline(&base);
+    free_baseline(&results);
+    free_pathlist(&cases);
+    free(stages);
+    free_connection_pool();
     curl_global_cleanup();
-    return 0;
-}
\ No newline at end of file
+    return regressed ? 2 : failed;
+}
@@ -0,0 +1,927 @@
+#include "multi_curl.h"
+#include "easy_curl.h"
+#include "errors.h"
+#include "governor.h"
+#include "stats.h"
+#include "log.h"
+#include "profile.h"
+#include "utils.h"
+#include "trace.h"
+#include "warmup.h"
+#include <curl/curl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Poll interval while a staged profile is ramping, so user counts follow it closely
+#define RAMP_POLL_MS 10
+
+// Set by SIGUSR1 to log the time series of a running test
+static volatile sig_atomic_t dump_series = 0;
+
+static void on_dump(int sig) {
+    (void)sig;
+    dump_series = 1;
+}
+
+// State shared by all workers of one load test
+typedef struct {
+    const Scenario *mix;   // Cases to send, a single case has weight 1
+    const LoadOptions *opts;
+    const Stage *stages;   // Load profile, NULL for a flat load of opts->users
+    int stage_count;
+    int threads;
+    long requests;         // Request budget, 0 for none
+    double rate;           // Paced requests per second over all workers, 0 for closed-loop users
+    const ReplayPlan *replay;  // Recorded requests, sent at their own times divided by speed
+    double speed;
+    bool paced;            // Open model: requests go out on a schedule, users only cap those in flight
+    double window;         // Length of a result window, 0 for none
+    int window_count;
+    atomic_long issued;    // Requests handed out so far
+    atomic_int stop;       // Set once a sequential feeder runs dry
+    atomic_int finished;   // Workers that have left their loop
+    Warmup warmup;         // Pinned addresses and the hosts to open connections to
+    Governor governor;     // Per-host limits, shared by the workers without a lock
+    bool governed;         // Some host has limits
+    int *case_host;        // Governor host of each case, -1 for none
+    CURLSH *share;         // Caller's connection pool, only with one worker since curl cannot share connections across threads
+    int warm_conns;        // Connections to open per host over all workers
+    atomic_int warmed;     // Connections opened before measuring
+    pthread_mutex_t start_lock;
+    pthread_cond_t start_cond;
+    int ready;             // Workers done warming up
+    bool go;               // Set once start and deadline are known
+    double start;
+    double deadline;       // Monotonic time to stop sending, 0 for none
+} LoadState;
+
+typedef struct {
+    int id;
+    int users;             // User slots of this worker, its share of the peak
+    LoadState *state;
+    uint64_t rng;          // Picks the case of each request
+    FeedCursor *cursors;   // Per case, lock-free: shared atomic position or a private PRNG
+    Stats *stats;          // Per case
+    ErrorMatrix *errors;   // Per case
+    FailureSampler sampler;  // Failures kept in full, over all cases
+    Stats *stage_stats;    // Per stage, NULL without a profile
+    Stats *window_stats;   // Per window, NULL unless windows were asked for
+    Series *series;        // Per case, NULL without a time series
+    pthread_mutex_t series_lock;  // Taken by the worker per result, and by snapshots
+    double compacted;      // When the series were last compacted
+    TraceBuffer *trace;    // NULL unless requests are traced
+    double *slot_start;    // Traced mode: when each slot's request was added, in microseconds
+    double next_send;      // Paced mode: when the next request is due
+    double interval;       // Paced mode: seconds between this worker's requests
+    size_t next_entry;     // Replay: next recorded request of this worker, which sends every threads-th one
+    double late_total;     // Replay: seconds requests went out behind their schedule
+    double late_max;
+    uint64_t sent;
+    int *slot_case;        // Case each user slot is sending
+    bool *slot_held;       // The slot's case was held back by its host and goes next as is
+    int *slot_stage;       // Stage each slot's request was sent in, NULL without a profile
+    int *idle;             // Stack of slots with no request in flight
+    int idle_count;
+    int held_count;        // Paced mode: slots at the bottom of the idle stack held by their host
+    HostLane lane;         // This worker's share of the per-host limits
+    bool done;             // Budget, deadline or feeder ran out
+    Profile profile;       // Hot path counters of the worker thread while measuring
+    double cpu_s;          // CPU time the worker thread used while measuring
+    pthread_t thread;
+} Worker;
+
+// Users this worker should keep busy right now
+static int worker_target(const Worker *w) {
+    const LoadState *state = w->state;
+    if (!state->stages) return w->users;
+
+    double t = stage_target(state->stages, state->stage_count, now_seconds() - state->start, NULL);
+    int total = (int)(t + 0.5);
+    int share = total / state->threads + (w->id < total % state->threads ? 1 : 0);
+    return share < w->users ? share : w->users;
+}
+
+// Governor host of the request on a slot, -1 when its host has no limits
+static int slot_host(const Worker *w, int slot) {
+    return w->state->governed ? w->state->case_host[w->slot_case[slot]] : -1;
+}
+
+// Claim the next request for a user slot and add it to the loop. Returns 1 when started,
+// 0 when this request failed to start, 2 when its host's limits hold it back and -1 once
+// the test is over.
+static int start_request(Worker *w, CURLM *multi, Transfer *t, int slot) {
+    LoadState *state = w->state;
+    if (atomic_load_explicit(&state->stop, memory_order_relaxed)) return -1;
+    double now = now_seconds();
+    if (state->deadline > 0 && now >= state->deadline) return -1;
+
+    const ReplayEntry *entry = state->replay ? &state->replay->entries[w->next_entry] : NULL;
+    int c = entry ? entry->origin : w->slot_held[slot] ? w->slot_case[slot] : pick_case(state->mix, next_random(&w->rng));
+    METADATA *md = state->mix->cases[c].md;
+    w->slot_case[slot] = c;
+    // Held requests keep their case, so limits do not skew the mix, and are not charged to the budget
+    int host = slot_host(w, slot);
+    w->slot_held[slot] = !admit_request(&w->lane, host, now, w->slot_held[slot]);
+    if (w->slot_held[slot]) return 2;
+    if (state->requests > 0 &&
+        atomic_fetch_add_explicit(&state->issued, 1, memory_order_relaxed) >= state->requests) {
+        release_request(&w->lane, host, NULL);
+        return -1;
+    }
+
+    Record rec;
+    if (!entry && md->feeder && next_record(&w->cursors[c], &rec)) {
+        release_request(&w->lane, host, NULL);
+        atomic_store(&state->stop, 1);
+        return -1;
+    }
+
+    int rc = entry ? setup_replay_transfer(t, entry, md) : setup_transfer(t, md, md->feeder ? &rec : NULL, 0);
+    if (rc) {
+        release_request(&w->lane, host, NULL);
+        reset_transfer(t);
+        w->stats[c].failures++;
+        count_failure(&w->errors[c], FAIL_OTHER, CURLE_FAILED_INIT);
+        return 0;
+    }
+    // Pinned addresses, which include the case's own resolve: entries
+    if (state->warmup.pins) curl_easy_setopt(t->curl, CURLOPT_RESOLVE, state->warmup.pins);
+    limit_transfer(&w->lane, host, t->curl);
+    if (w->trace) w->slot_start[slot] = now_seconds() * 1e6;
+    if (w->slot_stage) stage_target(state->stages, state->stage_count, now - state->start, &w->slot_stage[slot]);
+    if (state->share) curl_easy_setopt(t->curl, CURLOPT_SHARE, state->share);
+    if (curl_multi_add_handle(multi, t->curl) != CURLM_OK) {
+        release_request(&w->lane, host, NULL);
+        reset_transfer(t);
+        w->stats[c].failures++;
+        count_failure(&w->errors[c], FAIL_OTHER, CURLE_FAILED_INIT);
+        return 0;
+    }
+    return 1;
+}
+
+static void record_result(Stats *stats, const Transfer *t, CURLcode result, curl_off_t total_us) {
+    if (result != CURLE_OK) {
+        stats->failures++;
+        return;
+    }
+    record_latency(stats, (double)total_us);
+    stats->bytes += t->resp.body_size;
+    if (t->resp.status_code >= 400) stats->http_errors++;
+}
+
+// Offer a failed request to the sampler, copying its details if it is kept
+static void keep_failure(Worker *w, int slot, const Transfer *t, CURLcode result, FailureKind kind, long os_errno) {
+    FailureSample *f = sample_failure(&w->sampler);
+    if (!f) return;
+    char *method = NULL, *url = NULL;
+    curl_off_t total_us = 0;
+    curl_easy_getinfo(t->curl, CURLINFO_EFFECTIVE_METHOD, &method);
+    curl_easy_getinfo(t->curl, CURLINFO_EFFECTIVE_URL, &url);
+    curl_easy_getinfo(t->curl, CURLINFO_TOTAL_TIME_T, &total_us);
+    f->case_index = w->slot_case[slot];
+    f->kind = kind;
+    f->code = result;
+    f->status = t->resp.status_code;
+    f->os_errno = os_errno;
+    f->at = now_seconds() - w->state->start;
+    f->total_ms = total_us / 1000.0;
+    f->method = method ? strdup(method) : NULL;
+    f->url = url ? strdup(url) : NULL;
+    if (t->peek) f->peek = *t->peek;
+}
+
+// Count the outcome of a transfer in its case's error matrix
+static void classify_result(Worker *w, int slot, const Transfer *t, CURLcode result) {
+    ErrorMatrix *errors = &w->errors[w->slot_case[slot]];
+    if (result == CURLE_OK) {
+        count_status(errors, t->resp.status_code);
+        if (t->resp.status_code >= 400) keep_failure(w, slot, t, result, FAIL_KINDS, 0);
+        return;
+    }
+    long os_errno = 0;
+    curl_easy_getinfo(t->curl, CURLINFO_OS_ERRNO, &os_errno);
+    FailureKind kind = classify_failure(result, os_errno);
+    count_failure(errors, kind, result);
+    keep_failure(w, slot, t, result, kind, os_errno);
+}
+
+// Record the outcome of a finished transfer against its case and the stage it was sent in
+static void finish_request(Worker *w, int slot, Transfer *t, CURLcode result) {
+    curl_off_t total_us = 0;
+    if (result == CURLE_OK) {
+        curl_easy_getinfo(t->curl, CURLINFO_TOTAL_TIME_T, &total_us);
+        curl_easy_getinfo(t->curl, CURLINFO_RESPONSE_CODE, &t->resp.status_code);
+    }
+    record_result(&w->stats[w->slot_case[slot]], t, result, total_us);
+    classify_result(w, slot, t, result);
+    if (w->trace) trace_transfer(w->trace, t->curl, w->slot_start[slot], w->slot_case[slot], result);
+
+    const LoadState *state = w->state;
+    if (w->series) {
+        pthread_mutex_lock(&w->series_lock);
+        Stats *win = series_window(&w->series[w->slot_case[slot]], now_seconds() - state->start);
+        if (win) record_result(win, t, result, total_us);
+        pthread_mutex_unlock(&w->series_lock);
+    }
+    // A slow request sent during a ramp belongs to that ramp, not the stage it ends in
+    if (w->stage_stats) record_result(&w->stage_stats[w->slot_stage[slot]], t, result, total_us);
+    if (w->window_stats) {
+        int i = (int)((now_seconds() - state->start) / state->window);
+        if (i >= state->window_count) i = state->window_count - 1;
+        record_result(&w->window_stats[i], t, result, total_us);
+    }
+}
+
+// Paced mode: move on to the time of this worker's next request
+static void advance_schedule(Worker *w, double now) {
+    const LoadState *state = w->state;
+    if (!state->replay) {
+        w->next_send += w->interval;
+        return;
+    }
+    double late = now - w->next_send;
+    w->late_total += late;
+    if (late > w->late_max) w->late_max = late;
+    w->sent++;
+
+    w->next_entry += state->threads;
+    if (w->next_entry < state->replay->count) {
+        w->next_send = state->start + state->replay->entries[w->next_entry].at / state->speed;
+    } else {
+        w->done = true;
+    }
+}
+
+// Start requests on idle slots until the worker's target is busy, returns how many started
+static int fill_slots(Worker *w, CURLM *multi, Transfer *slots, int active) {
+    LoadState *state = w->state;
+    if (atomic_load_explicit(&state->stop, memory_order_relaxed) ||
+        (state->deadline > 0 && now_seconds() >= state->deadline)) {
+        w->done = true;
+    }
+
+    int started = 0;
+    if (state->paced) {
+        // Open model: send on schedule whenever a slot is free, a full pool delays the schedule
+        double now = now_seconds();
+        if (!state->replay && w->next_send < now - 1.0) w->next_send = now - 1.0;
+        // Requests held by their host go as soon as it lets them, the schedule carries on without them
+        for (int k = 0; k < w->held_count && !w->done;) {
+            int slot = w->idle[k];
+            int rc = start_request(w, multi, &slots[slot], slot);
+            if (rc == 2) {
+                k++;
+                continue;
+            }
+            if (rc < 0) {
+                w->done = true;
+                break;
+            }
+            // Out of the held part of the stack, and off it once sent
+            w->idle[k] = w->idle[--w->held_count];
+            w->idle[w->held_count] = slot;
+            if (rc == 1) {
+                w->idle[w->held_count] = w->idle[--w->idle_count];
+                started++;
+            }
+        }
+        while (!w->done && w->next_send <= now && w->idle_count > w->held_count) {
+            int slot = w->idle[--w->idle_count];
+            int rc = start_request(w, multi, &slots[slot], slot);
+            if (rc < 0) {
+                w->idle[w->idle_count++] = slot;
+                w->done = true;
+                break;
+            }
+            if (rc == 2 && state->replay) {
+                // A recorded request stays due until its host lets it go, to keep their order
+                w->idle[w->idle_count++] = slot;
+                break;
+            }
+            if (rc == 2) {
+                w->idle[w->idle_count++] = w->idle[w->held_count];
+                w->idle[w->held_count++] = slot;
+            } else if (rc == 0) {
+                w->idle[w->idle_count++] = slot;
+                // A recorded request that failed to start is counted and left behind
+                if (!state->replay) break;
+            } else {
+                started++;
+            }
+            advance_schedule(w, now);
+        }
+        return started;
+    }
+
+    // Walk down the idle stack, slots held by their host's limits stay idle for the next turn
+    int target = worker_target(w);
+    for (int k = w->idle_count - 1; k >= 0 && !w->done && active + started < target; k--) {
+        int slot = w->idle[k];
+        int rc = start_request(w, multi, &slots[slot], slot);
+        if (rc == 2) continue;
+        if (rc < 0) w->done = true;
+        if (rc != 1) break;
+        w->idle[k] = w->idle[--w->idle_count];
+        started++;
+    }
+    return started;
+}
+
+// Roll aged windows into coarser ones, about once a second
+static void compact_worker_series(Worker *w) {
+    double now = now_seconds();
+    if (!w->series || now - w->compacted < 1.0) return;
+
+    pthread_mutex_lock(&w->series_lock);
+    for (int c = 0; c < w->state->mix->count; c++) {
+        compact_series(&w->series[c], now - w->state->start);
+    }
+    pthread_mutex_unlock(&w->series_lock);
+    w->compacted = now;
+}
+
+// Report this worker warmed up and wait until every worker is, so measuring starts together
+static void wait_for_start(Worker *w) {
+    LoadState *state = w->state;
+    pthread_mutex_lock(&state->start_lock);
+    state->ready++;
+    pthread_cond_broadcast(&state->start_cond);
+    while (!state->go) {
+        pthread_cond_wait(&state->start_cond, &state->start_lock);
+    }
+    pthread_mutex_unlock(&state->start_lock);
+}
+
+// Worker loop: keep the target number of user slots busy until the budget or deadline runs out
+static void *run_worker(void *arg) {
+    Worker *w = (Worker *)arg;
+    CURLM *multi = curl_multi_init();
+    Transfer *slots = calloc(w->users, sizeof(Transfer));
+    ResponsePeek *peeks = calloc(w->users, sizeof(ResponsePeek));
+    w->slot_case = calloc(w->users, sizeof(int));
+    w->slot_held = calloc(w->users, sizeof(bool));
+    w->idle = calloc(w->users, sizeof(int));
+    if (w->trace) w->slot_start = calloc(w->users, sizeof(double));
+    if (w->stage_stats) w->slot_stage = calloc(w->users, sizeof(int));
+    if (!multi || !slots || !peeks || !w->slot_case || !w->slot_held || !w->idle || (w->trace && !w->slot_start) ||
+        (w->stage_stats && !w->slot_stage)) {
+        LOG_ERROR("Failed to initialize worker %d", w->id);
+        curl_multi_cleanup(multi);
+        free(slots);
+        free(peeks);
+        wait_for_start(w);
+        atomic_fetch_add(&w->state->finished, 1);
+        return NULL;
+    }
+
+    // Idle stack in reverse so slot 0 is used first
+    for (int i = w->users - 1; i >= 0; i--) {
+        slots[i].discard = true;
+        slots[i].peek = &peeks[i];
+        slots[i].curl = curl_easy_init();
+        if (slots[i].curl) w->idle[w->idle_count++] = i;
+    }
+
+    // Keep every pre-opened connection in the pool even while few users are busy
+    LoadState *state = w->state;
+    int conns = state->warm_conns / state->threads + (w->id < state->warm_conns % state->threads ? 1 : 0);
+    if (conns > w->users) conns = w->users;
+    int origins = state->warmup.count > 0 ? state->warmup.count : 1;
+    curl_multi_setopt(multi, CURLMOPT_MAXCONNECTS, (long)w->users * origins);
+    if (conns > 0) {
+        // No more than this worker's share of a host's connection limit
+        int *caps = state->governed ? calloc(state->warmup.count, sizeof(int)) : NULL;
+        for (int o = 0; caps && o < state->warmup.count; o++) {
+            caps[o] = lane_connections(&w->lane, state->warmup.origins[o].url);
+        }
+        atomic_fetch_add(&state->warmed, open_connections(&state->warmup, multi, slots, conns, caps, state->share));
+        free(caps);
+    }
+    wait_for_start(w);
+    // Warm-up is not charged to the client
+    memset(&thread_profile, 0, sizeof(Profile));
+    seed_thread_generators(w->id, state->threads);
+    double cpu_start = thread_cpu_seconds();
+    if (state->replay) {
+        // Workers take turns through the recording
+        w->next_entry = w->id;
+        if (w->next_entry < state->replay->count) {
+            w->next_send = state->start + state->replay->entries[w->next_entry].at / state->speed;
+        } else {
+            w->done = true;
+        }
+    } else if (state->rate > 0) {
+        // Stagger the workers so their schedules interleave
+        w->interval = state->threads / state->rate;
+        w->next_send = state->start + w->interval * w->id / state->threads;
+    }
+
+    int poll_ms = w->state->stages ? RAMP_POLL_MS : 100;
+    int active = fill_slots(w, multi, slots, 0);
+    while (active > 0 || !w->done) {
+        uint64_t turn = prof_ticks();
+        int running = 0;
+        curl_multi_perform(multi, &running);
+
+        CURLMsg *msg;
+        int left;
+        while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL *easy = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            Transfer *t = NULL;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&t);
+
+            int slot = (int)(t - slots);
+            finish_request(w, slot, t, result);
+            release_request(&w->lane, slot_host(w, slot), easy);
+            curl_multi_remove_handle(multi, easy);
+            reset_transfer(t);
+            active--;
+            w->idle[w->idle_count++] = slot;
+        }
+
+        compact_worker_series(w);
+        active += fill_slots(w, multi, slots, active);
+        if (active == 0 && w->done) break;
+        int wait_ms = poll_ms;
+        if (w->state->paced && w->idle_count > w->held_count && !w->done) {
+            // Wake up in time for the next scheduled request
+            int due_ms = (int)((w->next_send - now_seconds()) * 1000) + 1;
+            wait_ms = due_ms < 1 ? 1 : due_ms > poll_ms ? poll_ms : due_ms;
+        }
+        if (w->lane.wake > 0) {
+            // Try a held request again once its host could take it, even when it is overdue
+            double now = now_seconds();
+            int held_ms = (int)((w->lane.wake - now) * 1000) + 1;
+            if (held_ms < 1) held_ms = 1;
+            if (held_ms < wait_ms || w->next_send <= now) wait_ms = held_ms > poll_ms ? poll_ms : held_ms;
+            w->lane.wake = 0;
+        }
+        prof_end(PROF_LOOP, turn);
+        uint64_t wait = prof_ticks();
+        curl_multi_poll(multi, NULL, 0, wait_ms, NULL);
+        prof_end(PROF_WAIT, wait);
+    }
+    w->profile = thread_profile;
+    w->cpu_s = thread_cpu_seconds() - cpu_start;
+
+    for (int i = 0; i < w->users; i++) {
+        if (slots[i].curl) curl_easy_cleanup(slots[i].curl);
+    }
+    free(slots);
+    free(peeks);
+    curl_multi_cleanup(multi);
+    atomic_fetch_add(&w->state->finished, 1);
+    return NULL;
+}
+
+// Merge the time series of every worker into one per case, compacted as of now
+static int collect_series(Worker *workers, int started, int n, double now, Series *out) {
+    for (int c = 0; c < n; c++) {
+        init_series(&out[c]);
+    }
+    for (int i = 0; i < started; i++) {
+        for (int c = 0; c < n; c++) {
+            // Copy under the lock, the worker keeps recording while the copy is compacted
+            Series copy;
+            init_series(&copy);
+            pthread_mutex_lock(&workers[i].series_lock);
+            int rc = merge_series(&copy, &workers[i].series[c]);
+            pthread_mutex_unlock(&workers[i].series_lock);
+            compact_series(&copy, now);
+            if (rc == 0) rc = merge_series(&out[c], &copy);
+            free_series(&copy);
+            if (rc) return -1;
+        }
+    }
+    return 0;
+}
+
+static const char *case_name(const ScenarioCase *c) {
+    return c->path ? c->path : c->md->id ? c->md->id : c->md->url;
+}
+
+// Log the series so far on SIGUSR1, until all workers are done
+static void wait_for_workers(LoadState *state, Worker *workers, int started, Series *series) {
+    struct sigaction sa, old;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_dump;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGUSR1, &sa, &old);
+
+    struct timespec tick = {0, 100 * 1000000L};
+    while (atomic_load(&state->finished) < started) {
+        nanosleep(&tick, NULL);
+        if (!dump_series) continue;
+        dump_series = 0;
+
+        double now = now_seconds() - state->start;
+        int n = state->mix->count;
+        if (collect_series(workers, started, n, now, series) == 0) {
+            for (int c = 0; c < n; c++) {
+                print_series(case_name(&state->mix->cases[c]), &series[c], now);
+            }
+        }
+        for (int c = 0; c < n; c++) {
+            free_series(&series[c]);
+        }
+    }
+    sigaction(SIGUSR1, &old, NULL);
+}
+
+// Append the final series of every case to the CSV file
+static int write_timeseries(const char *file, const Scenario *mix, const Series *series, double elapsed) {
+    for (int c = 0; c < mix->count; c++) {
+        if (append_series_csv(file, case_name(&mix->cases[c]), &series[c], elapsed)) return -1;
+    }
+    return 0;
+}
+
+// How far replayed requests fell behind the recording, which a full pool of users causes
+static void print_replay_schedule(const Worker *workers, int started) {
+    double late_total = 0, late_max = 0;
+    uint64_t sent = 0;
+    for (int i = 0; i < started; i++) {
+        late_total += workers[i].late_total;
+        if (workers[i].late_max > late_max) late_max = workers[i].late_max;
+        sent += workers[i].sent;
+    }
+    LOG_INFO("Replay schedule: %llu sent, behind by mean %.2f ms, max %.2f ms",
+             (unsigned long long)sent, sent ? late_total / sent * 1000 : 0.0, late_max * 1000);
+    if (late_max > 1.0) {
+        LOG_WARN("Replay fell behind the recording by up to %.1f s, raise -u to allow more requests in flight", late_max);
+    }
+}
+
+int do_multi_curl(const char *path, METADATA *md, const LoadOptions *opts) {
+    ScenarioCase only = {(char *)path, md, 1.0, NULL};
+    Scenario mix = {&only, 1, NULL, NULL};
+    return do_multi_scenario(&mix, opts);
+}
+
+int do_multi_scenario(const Scenario *mix, const LoadOptions *opts) {
+    return run_load(mix, opts, NULL);
+}
+
+void free_load_result(LoadResult *result) {
+    if (!result) return;
+    free(result->windows);
+    result->windows = NULL;
+    result->window_count = 0;
+}
+
+int run_load(const Scenario *mix, const LoadOptions *opts, LoadResult *result) {
+    if (!mix || mix->count == 0 || !opts) {
+        LOG_ERROR("Invalid metadata or load options");
+        return -1;
+    }
+
+    LoadState state;
+    state.mix = mix;
+    state.opts = opts;
+    state.requests = opts->requests;
+    state.rate = opts->replay ? 0 : opts->rate;
+    state.replay = opts->replay;
+    state.speed = opts->speed > 0 ? opts->speed : 1;
+    state.paced = state.rate > 0 || state.replay;
+    state.window = 0;
+    state.window_count = 0;
+    atomic_init(&state.issued, 0);
+    atomic_init(&state.stop, 0);
+    atomic_init(&state.finished, 0);
+
+    // A profile from the command line wins over one in a single case's YAML
+    state.stages = opts->stages;
+    state.stage_count = opts->stage_count;
+    if (state.replay) {
+        // A recording brings its own schedule
+        state.stages = NULL;
+        state.requests = 0;
+    } else if (!state.stages && mix->count == 1 && mix->cases[0].md->stages) {
+        state.stages = mix->cases[0].md->stages;
+        state.stage_count = mix->cases[0].md->stage_count;
+    } else if (!state.stages) {
+        // A mix shares one schedule, so no single case's profile can drive it
+        for (int c = 0; c < mix->count; c++) {
+            if (mix->cases[c].md->stages) {
+                LOG_WARN("%s: stages ignored in a mix of %d cases, use --stages for the whole mix",
+                         case_name(&mix->cases[c]), mix->count);
+            }
+        }
+    }
+
+    int users = opts->users > 0 ? opts->users : 1;
+    double duration = opts->duration;
+    if (state.stages) {
+        users = stages_peak(state.stages, state.stage_count);
+        duration = stages_duration(state.stages, state.stage_count);
+    } else if (state.requests <= 0 && duration <= 0 && !state.replay) {
+        // Without a budget every user sends one request
+        state.requests = users;
+    }
+    if (opts->window > 0 && duration > 0) {
+        state.window = opts->window;
+        state.window_count = (int)(duration / opts->window + 0.999);
+        if (state.window_count < 1) state.window_count = 1;
+    }
+    if (users <= 0) {
+        LOG_ERROR("Invalid metadata or load options");
+        return -1;
+    }
+
+    int n = mix->count;
+    // Hosts are shared by the cases sending to them, the strictest limits of any case win
+    init_governor(&state.governor, &opts->host_limits);
+    state.case_host = calloc(n, sizeof(int));
+    for (int c = 0; state.case_host && c < n; c++) {
+        state.case_host[c] = govern_case(&state.governor, mix->cases[c].md);
+    }
+    state.governed = state.case_host && governor_active(&state.governor);
+
+    int threads = opts->threads > 0 ? opts->threads : 1;
+    if (threads > users) threads = users;
+    // Each thread needs a connection of its own to every host with a connection limit
+    int lanes = state.governed ? governor_lanes(&state.governor) : 0;
+    if (lanes > 0 && threads > lanes) {
+        LOG_WARN("Running %d threads instead of %d, a host allows only %d connections", lanes, threads, lanes);
+        threads = lanes;
+    }
+    state.threads = threads;
+    state.share = threads == 1 ? opts->share : NULL;
+    int ns = (state.stages ? state.stage_count : 0) + state.window_count;
+    Worker *workers = calloc(threads, sizeof(Worker));
+    Stats *stats = calloc((size_t)threads * (n + ns), sizeof(Stats));
+    ErrorMatrix *errors = calloc((size_t)threads * n, sizeof(ErrorMatrix));
+    FeedCursor *cursors = calloc((size_t)threads * n, sizeof(FeedCursor));
+    // One series per case and worker, plus one per case to merge them into
+    Series *series = opts->timeseries ? calloc((size_t)(threads + 1) * n, sizeof(Series)) : NULL;
+    TraceBuffer *traces = opts->trace ? calloc(threads, sizeof(TraceBuffer)) : NULL;
+    if (!workers || !stats || !errors || !cursors || (opts->timeseries && !series) || (opts->trace && !traces)) {
+        LOG_ERROR("Failed to allocate workers");
+        free_governor(&state.governor);
+        free(state.case_host);
+        free(workers);
+        free(stats);
+        free(errors);
+        free(cursors);
+        free(series);
+        free(traces);
+        return -1;
+    }
+
+    if (!opts->quiet) {
+        if (state.replay) {
+            LOG_INFO("Replay: %zu requests over %.1f s at %gx with up to %d in flight on %d threads",
+                     state.replay->count, state.replay->span / state.speed, state.speed, users, threads);
+        } else if (state.rate > 0) {
+            LOG_INFO("Load test: %.1f req/s with up to %d in flight on %d threads, %ld requests, %.0f s",
+                     state.rate, users, threads, state.requests, duration);
+        } else if (state.stages) {
+            LOG_INFO("Load test: %d stages up to %d users on %d threads, %ld requests, %.0f s",
+                     state.stage_count, users, threads, state.requests, duration);
+        } else {
+            LOG_INFO("Load test: %d users on %d threads, %ld requests, %.0f s",
+                     users, threads, state.requests, duration);
+        }
+        if (generators_used()) {
+            LOG_INFO("Generator seed %llu, pass --seed %llu to repeat these values",
+                     (unsigned long long)generator_seed(), (unsigned long long)generator_seed());
+        }
+        for (int c = 0; c < n; c++) {
+            if (!mix->cases[c].md->secure) {
+                LOG_WARN("SSL verification disabled - security risk");
+                break;
+            }
+        }
+    }
+
+    // Resolve every host once and pre-open connections, none of it measured
+    double warm_start = now_seconds();
+    prepare_warmup(&state.warmup, mix);
+    state.warm_conns = opts->warmup > 0 ? opts->warmup : opts->warmup == 0 ? users : 0;
+    atomic_init(&state.warmed, 0);
+    pthread_mutex_init(&state.start_lock, NULL);
+    pthread_cond_init(&state.start_cond, NULL);
+    state.ready = 0;
+    state.go = false;
+    state.start = 0;
+    state.deadline = 0;
+
+    int started = 0;
+    for (int i = 0; i < threads; i++) {
+        Worker *w = &workers[i];
+        w->id = i;
+        w->users = users / threads + (i < users % threads ? 1 : 0);
+        w->state = &state;
+        // From the generator seed, so --seed also repeats the case picks and feeder walks
+        w->rng = mix64(generator_seed() + (uint64_t)(i + 1) * 0x9E3779B97F4A7C15ULL);
+        w->stats = &stats[(size_t)i * (n + ns)];
+        w->errors = &errors[(size_t)i * n];
+        init_failure_sampler(&w->sampler, next_random(&w->rng));
+        w->stage_stats = state.stages ? w->stats + n : NULL;
+        w->window_stats = state.window_count > 0 ? w->stats + n + ns - state.window_count : NULL;
+        w->cursors = &cursors[(size_t)i * n];
+        if (traces) {
+            w->trace = &traces[i];
+            init_trace_buffer(w->trace, TRACE_MAX_EVENTS / threads);
+        }
+        if (series) {
+            w->series = &series[(size_t)(i + 1) * n];
+            pthread_mutex_init(&w->series_lock, NULL);
+        }
+        for (int c = 0; c < n + ns; c++) {
+            init_stats(&w->stats[c]);
+        }
+        for (int c = 0; c < n; c++) {
+            init_feed_cursor(&w->cursors[c], mix->cases[c].md->feeder, next_random(&w->rng));
+        }
+        if (init_lane(&w->lane, &state.governor, threads, i)) {
+            LOG_ERROR("Failed to start worker %d", i);
+            break;
+        }
+        if (pthread_create(&w->thread, NULL, run_worker, w) != 0) {
+            LOG_ERROR("Failed to start worker %d", i);
+            free_lane(&w->lane);
+            break;
+        }
+        started++;
+    }
+
+    pthread_mutex_lock(&state.start_lock);
+    while (state.ready < started) {
+        pthread_cond_wait(&state.start_cond, &state.start_lock);
+    }
+    state.start = now_seconds();
+    state.deadline = duration > 0 ? state.start + duration : 0;
+    state.go = true;
+    pthread_cond_broadcast(&state.start_cond);
+    pthread_mutex_unlock(&state.start_lock);
+    double process_start = process_cpu_seconds();
+    if (!opts->quiet) {
+        LOG_INFO("Warm-up: %d hosts resolved in %.1f ms, %d connections opened in %.0f ms",
+                 state.warmup.resolved, state.warmup.resolve_ms, atomic_load(&state.warmed),
+                 (state.start - warm_start) * 1000);
+    }
+
+    if (series) wait_for_workers(&state, workers, started, series);
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        free(workers[i].slot_case);
+        free(workers[i].slot_held);
+        free(workers[i].slot_stage);
+        free(workers[i].idle);
+        free(workers[i].slot_start);
+        free_lane(&workers[i].lane);
+    }
+    double elapsed = now_seconds() - state.start;
+
+    // What capis itself cost, to tell a saturated client from a slow server
+    ClientProfile client;
+    memset(&client, 0, sizeof(ClientProfile));
+    for (int i = 0; i < started; i++) {
+        merge_profile(&client.hot, &workers[i].profile);
+        client.cpu_s += workers[i].cpu_s;
+        double share = elapsed > 0 ? workers[i].cpu_s / elapsed : 0;
+        if (share > client.busiest) {
+            client.busiest = share;
+            client.busiest_worker = i;
+        }
+    }
+    // Cases are parsed before the test, on whichever thread loaded them, so count this test's own
+    for (int c = 0; c < n; c++) {
+        uint64_t spent = mix->cases[c].md->parse_ticks;
+        if (!spent) continue;
+        client.hot.calls[PROF_YAML]++;
+        client.hot.ticks[PROF_YAML] += spent;
+        if (spent > client.hot.max[PROF_YAML]) client.hot.max[PROF_YAML] = spent;
+    }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    client.cores = cores > 0 ? (int)cores : 1;
+    if (elapsed > 0) client.process = (process_cpu_seconds() - process_start) / (elapsed * client.cores);
+
+    // Fold the per-thread histograms into one per stage and per case, then into the total
+    for (int i = 1; i < started; i++) {
+        for (int c = 0; c < n + ns; c++) {
+            merge_stats(&stats[c], &stats[(size_t)i * (n + ns) + c]);
+        }
+        for (int c = 0; c < n; c++) {
+            merge_error_matrix(&errors[c], &errors[(size_t)i * n + c]);
+        }
+        merge_failure_sampler(&workers[0].sampler, &workers[i].sampler);
+    }
+
+    double from = 0;
+    double stage_start = 0;
+    for (int s = 0; state.stages && s < state.stage_count && !opts->quiet; s++) {
+        const Stage *st = &state.stages[s];
+        double stage_time = elapsed - stage_start;
+        if (stage_time > st->duration) stage_time = st->duration;
+        LOG_INFO("========== STAGE %d: %g s, %.0f -> %d users ==========", s + 1, st->duration, from, st->target);
+        print_stats(&stats[n + s], stage_time);
+        from = st->target;
+        stage_start += st->duration;
+    }
+
+    Stats total;
+    init_stats(&total);
+    ErrorMatrix *total_errors = calloc(1, sizeof(ErrorMatrix));
+    for (int c = 0; c < n; c++) {
+        merge_stats(&total, &stats[c]);
+        if (total_errors) merge_error_matrix(total_errors, &errors[c]);
+        if (n > 1 && !opts->quiet) {
+            LOG_INFO("========== %s (%.1f%%) ==========", mix->cases[c].path, mix->cases[c].weight * 100);
+            print_stats(&stats[c], elapsed);
+            print_error_matrix(&errors[c]);
+        }
+    }
+
+    for (int c = 0; opts->results && c < n; c++) {
+        if (add_baseline_case(opts->results, case_name(&mix->cases[c]), &stats[c], elapsed)) {
+            LOG_ERROR("Failed to keep the results of %s", case_name(&mix->cases[c]));
+        }
+    }
+
+    if (!opts->quiet) {
+        LOG_INFO("========== LOAD SUMMARY ==============");
+        print_stats(&total, elapsed);
+        if (total_errors) print_error_matrix(total_errors);
+        if (state.replay) print_replay_schedule(workers, started);
+        if (state.governed) print_governor(&state.governor);
+        print_client_profile(&client, total.count + total.failures, elapsed);
+    }
+    free(total_errors);
+
+    if (series) {
+        if (collect_series(workers, started, n, elapsed, series) == 0 &&
+            write_timeseries(opts->timeseries, mix, series, elapsed) == 0 && !opts->quiet) {
+            LOG_INFO("Time series written to %s", opts->timeseries);
+        }
+        for (int i = 0; i < (threads + 1) * n; i++) {
+            free_series(&series[i]);
+        }
+        for (int i = 0; i < threads; i++) {
+            if (workers[i].series) pthread_mutex_destroy(&workers[i].series_lock);
+        }
+        free(series);
+    }
+
+    if (result) {
+        result->total = total;
+        result->elapsed = elapsed;
+        result->client_cpu = client.busiest;
+        result->windows = NULL;
+        result->window_count = 0;
+        if (state.window_count > 0) {
+            result->windows = malloc(state.window_count * sizeof(Stats));
+            if (result->windows) {
+                memcpy(result->windows, &stats[n + ns - state.window_count], state.window_count * sizeof(Stats));
+                result->window_count = state.window_count;
+            }
+        }
+    }
+
+    if (started > 0 && !opts->quiet && workers[0].sampler.count > 0) {
+        const char **names = calloc(n, sizeof(char *));
+        for (int c = 0; names && c < n; c++) {
+            names[c] = case_name(&mix->cases[c]);
+        }
+        if (names) print_failure_samples(&workers[0].sampler, names);
+        free(names);
+    }
+    for (int i = 0; i < started; i++) {
+        free_failure_sampler(&workers[i].sampler);
+    }
+
+    if (traces) {
+        const char **names = calloc(n + 1, sizeof(char *));
+        for (int c = 0; names && c < n; c++) {
+            names[c] = case_name(&mix->cases[c]);
+        }
+        if (names && write_trace(opts->trace, traces, started, names) == 0 && !opts->quiet) {
+            LOG_INFO("Trace written to %s", opts->trace);
+        }
+        free(names);
+        for (int i = 0; i < threads; i++) {
+            free_trace_buffer(&traces[i]);
+        }
+        free(traces);
+    }
+
+    free_warmup(&state.warmup);
+    free_governor(&state.governor);
+    free(state.case_host);
+    pthread_mutex_destroy(&state.start_lock);
+    pthread_cond_destroy(&state.start_cond);
+    free(workers);
+    free(stats);
+    free(errors);
+    free(cursors);
+    return started == threads ? 0 : -1;
+}
@@ -0,0 +1,52 @@
+#ifndef MULTI_CURL_H
+#define MULTI_CURL_H
+
+#include "baseline.h"
+#include "read_yaml.h"
+#include "replay.h"
+#include "scenario.h"
+#include "stats.h"
+#include "timeseries.h"
+#include <curl/curl.h>
+#include <stdbool.h>
+
+typedef struct {
+    int users;        // Concurrent virtual users, i.e. requests kept in flight; 0 when not given, for 1
+    int threads;      // Worker threads, each driving its own event loop
+    long requests;    // Requests to send per case, 0 for no limit
+    double duration;  // Seconds to keep sending, 0 for no limit
+    const Stage *stages;  // Load profile replacing users and duration, NULL for a flat load
+    int stage_count;
+    double rate;      // Open model: requests per second, users caps the requests in flight; 0 for closed
+    double window;    // Split the results into windows of this many seconds, 0 for none
+    bool quiet;       // Skip the log output, for callers that read the LoadResult
+    const char *timeseries;  // Append per-case time windows to this CSV file, NULL for none
+    const char *trace;       // Add a Chrome trace of every request to this JSON file, NULL for none
+    int warmup;       // Connections to pre-open per host before measuring, 0 for one per user, < 0 for none
+    Baseline *results;       // Add the results of every case here, NULL to keep none
+    const ReplayPlan *replay;  // Send these recorded requests on their own schedule instead of the cases
+    double speed;     // Replay time scale, 2 replays twice as fast
+    HostLimits host_limits;  // Caps on every host, a case's host_limits may only tighten them
+    CURLSH *share;    // Connections, DNS and TLS sessions to reuse with a single thread, NULL for the worker's own
+} LoadOptions;
+
+typedef struct {
+    Stats total;
+    Stats *windows;   // Results by completion time when LoadOptions.window is set
+    int window_count;
+    double elapsed;   // Seconds the test ran
+    double client_cpu;  // CPU share of the busiest worker, near 1 when capis itself limits the load
+} LoadResult;
+
+// Drive a load test of md on a curl multi event loop per worker and log a summary.
+// path names the case in the time series.
+int do_multi_curl(const char *path, METADATA *md, const LoadOptions *opts);
+
+// Same, with every request sampled from a weighted mix of cases; logs a summary per case
+int do_multi_scenario(const Scenario *mix, const LoadOptions *opts);
+
+// Run a load test and hand back its results; result may be NULL
+int run_load(const Scenario *mix, const LoadOptions *opts, LoadResult *result);
+void free_load_result(LoadResult *result);
+
+#endif
@@ -0,0 +1,92 @@
+#include "profile.h"
+#include "log.h"
+#include "utils.h"
+#include <stdio.h>
+#include <string.h>
+
+_Thread_local Profile thread_profile;
+
+static const char *section_names[PROF_SECTIONS] = {
+    "read_yaml", "build", "headers", "body", "log", "loop", "wait"
+};
+
+// Reference point the tick rate is measured from
+static uint64_t ref_ticks = 0;
+static double ref_seconds = 0;
+
+void init_profiling(void) {
+    ref_ticks = prof_ticks();
+    ref_seconds = now_seconds();
+}
+
+double ticks_to_seconds(uint64_t ticks) {
+    uint64_t from = ref_ticks;
+    double since = ref_seconds;
+    if (since == 0 || now_seconds() - since < 0.01) {
+        // Too close to the reference to tell the rate, time a short sleep instead
+        struct timespec pause = {0, 10 * 1000000L};
+        from = prof_ticks();
+        since = now_seconds();
+        nanosleep(&pause, NULL);
+    }
+    uint64_t elapsed = prof_ticks() - from;
+    return elapsed > 0 ? ticks * ((now_seconds() - since) / elapsed) : 0;
+}
+
+static double cpu_clock(clockid_t id) {
+    struct timespec ts;
+    if (clock_gettime(id, &ts) != 0) return 0;
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+double thread_cpu_seconds(void) {
+    return cpu_clock(CLOCK_THREAD_CPUTIME_ID);
+}
+
+double process_cpu_seconds(void) {
+    return cpu_clock(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+void merge_profile(Profile *dst, const Profile *src) {
+    for (int s = 0; s < PROF_SECTIONS; s++) {
+        dst->calls[s] += src->calls[s];
+        dst->ticks[s] += src->ticks[s];
+        if (src->max[s] > dst->max[s]) dst->max[s] = src->max[s];
+    }
+}
+
+int client_saturated(double cpu_share) {
+    return cpu_share >= PROFILE_SATURATION;
+}
+
+void print_client_profile(const ClientProfile *p, uint64_t requests, double elapsed) {
+    const Profile *h = &p->hot;
+    uint64_t turns = h->calls[PROF_LOOP];
+    double lag_ms = turns ? ticks_to_seconds(h->ticks[PROF_LOOP]) / turns * 1000 : 0;
+
+    LOG_INFO("========== CLIENT ====================");
+    LOG_INFO("CPU: %.2f s over %.2f s, busiest worker %d at %.0f%%, process at %.0f%% of %d cores",
+             p->cpu_s, elapsed, p->busiest_worker + 1, p->busiest * 100, p->process * 100, p->cores);
+    LOG_INFO("Overhead: %.1f us CPU per request, loop lag mean %.3f ms, max %.3f ms over %llu turns",
+             requests ? p->cpu_s / requests * 1e6 : 0.0, lag_ms,
+             ticks_to_seconds(h->max[PROF_LOOP]) * 1000, (unsigned long long)turns);
+
+    char line[512] = "";
+    size_t len = 0;
+    for (int s = 0; s < PROF_SECTIONS && len < sizeof(line); s++) {
+        if (s == PROF_LOOP || h->calls[s] == 0) continue;
+        double spent = ticks_to_seconds(h->ticks[s]);
+        len += snprintf(line + len, sizeof(line) - len, "%s %s %.1f ms (%.2f us/call)", len ? "," : "",
+                        section_names[s], spent * 1000, spent / h->calls[s] * 1e6);
+    }
+    LOG_INFO("Hot paths:%s", line);
+
+    if (client_saturated(p->busiest)) {
+        LOG_WARN("Client saturated: worker %d was on CPU %.0f%% of the test, results may reflect capis "
+                 "rather than the server; add --threads or spread the load over more machines",
+                 p->busiest_worker + 1, p->busiest * 100);
+    } else if (client_saturated(p->process)) {
+        LOG_WARN("Client saturated: capis used %.0f%% of %d cores, results may reflect capis rather than the server",
+                 p->process * 100, p->cores);
+    }
+}
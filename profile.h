@@ -0,0 +1,79 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Share of a worker's time on CPU above which capis, not the server, limits the load
+#define PROFILE_SATURATION 0.90
+
+// Hot paths of capis itself, timed per thread
+typedef enum {
+    PROF_YAML,      // read_yaml
+    PROF_BUILD,     // setup_transfer: rendering and configuring one send
+    PROF_HEADERS,   // Response header callbacks
+    PROF_BODY,      // Response body callbacks
+    PROF_LOG,       // dolog
+    PROF_LOOP,      // One event loop turn outside of waiting, its length is the loop lag
+    PROF_WAIT,      // Event loop blocked in curl_multi_poll
+    PROF_SECTIONS
+} ProfSection;
+
+// Calls and ticks per section, plain counters since each thread only touches its own
+typedef struct {
+    uint64_t calls[PROF_SECTIONS];
+    uint64_t ticks[PROF_SECTIONS];
+    uint64_t max[PROF_SECTIONS];  // Longest single call
+} Profile;
+
+extern _Thread_local Profile thread_profile;
+
+// Cycle counter where there is one, the monotonic clock in nanoseconds elsewhere
+static inline uint64_t prof_ticks(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// Charge the time since start, taken with prof_ticks, to section s of the calling thread
+static inline void prof_end(ProfSection s, uint64_t start) {
+    uint64_t spent = prof_ticks() - start;
+    thread_profile.calls[s]++;
+    thread_profile.ticks[s] += spent;
+    if (spent > thread_profile.max[s]) thread_profile.max[s] = spent;
+}
+
+// Take a reference point to convert ticks into seconds, once at startup
+void init_profiling(void);
+double ticks_to_seconds(uint64_t ticks);
+
+// CPU time used so far by the calling thread and by the whole process
+double thread_cpu_seconds(void);
+double process_cpu_seconds(void);
+
+void merge_profile(Profile *dst, const Profile *src);
+
+// What the client itself spent on one load test
+typedef struct {
+    Profile hot;           // Summed over the workers
+    double cpu_s;          // CPU time of the workers
+    double busiest;        // Highest share of the test one worker spent on CPU, 0..1
+    int busiest_worker;
+    double process;        // Process CPU time over the cores available, 0..1
+    int cores;
+} ClientProfile;
+
+// True when a share of the test spent on CPU, 0..1, means capis ran out of it
+int client_saturated(double cpu_share);
+
+// Log CPU use, per-request overhead, loop lag and hot paths, and warn when the client was saturated
+void print_client_profile(const ClientProfile *p, uint64_t requests, double elapsed);
+
+#endif
@@ -1,8 +1,13 @@
 #include "read_yaml.h"
 #include "log.h"
+#include "profile.h"
+#include "template.h"
+#include "urlencode.h"
+#include "json.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <ctype.h>
 #include <yaml.h>
 
@@ -11,6 +16,31 @@ static void to_lowercase(char *str) {
     for (; *str; ++str) *str = tolower(*str);
 }
 
+// Free a NULL-terminated array of multipart parts
+static void free_parts(Part *parts) {
+    for (Part *p = parts; p->name != NULL; p++) {
+        free(p->name);
+        free(p->value);
+        free(p->filename);
+        free(p->type);
+        unmap_file(p->file);
+    }
+    free(parts);
+}
+
+static void free_body_generator(BodyGenerator *g) {
+    if (!g) return;
+    free(g->text);
+    free(g);
+}
+
+static void free_stream(Stream *st) {
+    if (!st) return;
+    free(st->timestamp);
+    free(st->message);
+    free(st);
+}
+
 // Free memory allocated for METADATA struct
 void free_metadata(METADATA *md) {
     if (!md) return;
@@ -23,6 +53,7 @@ void free_metadata(METADATA *md) {
         for (Header *h = md->headers; h->key != NULL; h++) {
             free(h->key);
             free(h->value);
+            free_template(h->tpl);
         }
         free(md->headers);
     }
@@ -31,6 +62,9 @@ void free_metadata(METADATA *md) {
         for (Param *p = md->params; p->key != NULL; p++) {
             free(p->key);
             free(p->value);
+            free_template(p->tpl);
+            free(p->enc_key);
+            free(p->enc_value);
         }
         free(md->params);
     }
@@ -46,6 +80,28 @@ void free_metadata(METADATA *md) {
         free(md->cookies);
     }
 
+    unmap_file(md->body_file);
+    free_body_generator(md->body_generator);
+    free(md->json_body);
+    free_feeder(md->feeder);
+    free_template(md->url_tpl);
+    free_template(md->host_tpl);
+    free_template(md->path_tpl);
+    free(md->encoded_params);
+    free(md->request_url);
+    free(md->id);
+    free_string_list(md->depends_on);
+    free_string_list(md->resolve);
+    free(md->unix_socket);
+    free(md->stages);
+    free(md->throughput);
+    free_stream(md->stream);
+    free(md->host_limits);
+
+    if (md->multipart) {
+        free_parts(md->multipart);
+    }
+
     free(md);
 }
 
@@ -66,6 +122,26 @@ METADATA *init_metadata(void) {
     meta->headers = NULL;
     meta->params = NULL;
     meta->cookies = NULL;
+    meta->body_file = NULL;
+    meta->body_generator = NULL;
+    meta->multipart = NULL;
+    meta->json_body = NULL;
+    meta->json_len = 0;
+    meta->feeder = NULL;
+    meta->url_tpl = NULL;
+    meta->host_tpl = NULL;
+    meta->path_tpl = NULL;
+    meta->encoded_params = NULL;
+    meta->request_url = NULL;
+    meta->id = NULL;
+    meta->depends_on = NULL;
+    meta->resolve = NULL;
+    meta->unix_socket = NULL;
+    meta->stages = NULL;
+    meta->stage_count = 0;
+    meta->throughput = NULL;
+    meta->stream = NULL;
+    meta->host_limits = NULL;
 
     if (!meta->host || !meta->path || !meta->url) {
         LOG_ERROR("Failed to allocate strings in init_metadata");
@@ -86,10 +162,863 @@ static enum CURL_METHOD parse_method(const char *method) {
     return GET;
 }
 
+// Build a multipart part; a value starting with '@' names a file to upload
+static int make_part(Part *part, char *name, char *value, char *file, char *filename, char *type) {
+    if (value && value[0] == '@' && !file) {
+        file = strdup(value + 1);
+        free(value);
+        value = NULL;
+    }
+
+    part->name = name;
+    part->value = value;
+    part->filename = filename;
+    part->type = type;
+    part->file = NULL;
+
+    if (file) {
+        part->file = map_file(file);
+        if (!part->file) {
+            LOG_ERROR("Failed to map multipart file: %s", file);
+            free(file);
+            return -1;
+        }
+        if (!part->filename) {
+            const char *base = strrchr(file, '/');
+            part->filename = strdup(base ? base + 1 : file);
+        }
+        free(file);
+    } else if (!part->value) {
+        part->value = strdup("");
+    }
+    return 0;
+}
+
+// Parse the multipart key, either a sequence of part mappings or direct name-value pairs
+static int parse_multipart(yaml_parser_t *parser, yaml_event_t *event, METADATA *meta) {
+    Part *parts = NULL;
+    int count = 0;
+    int failed = 0;
+
+    if (event->type == YAML_SEQUENCE_START_EVENT) {
+        yaml_event_delete(event);
+        while (1) {
+            if (!yaml_parser_parse(parser, event)) {
+                failed = 1;
+                break;
+            }
+            if (event->type == YAML_SEQUENCE_END_EVENT) {
+                yaml_event_delete(event);
+                break;
+            }
+            if (event->type != YAML_MAPPING_START_EVENT) {
+                yaml_event_delete(event);
+                continue;
+            }
+            yaml_event_delete(event);
+            char *name = NULL, *value = NULL, *file = NULL, *filename = NULL, *type = NULL;
+            while (1) {
+                if (!yaml_parser_parse(parser, event)) {
+                    failed = 1;
+                    break;
+                }
+                if (event->type == YAML_MAPPING_END_EVENT) {
+                    yaml_event_delete(event);
+                    break;
+                }
+                if (event->type != YAML_SCALAR_EVENT) {
+                    yaml_event_delete(event);
+                    continue;
+                }
+                char *map_key = strdup((char*)event->data.scalar.value);
+                yaml_event_delete(event);
+                if (!map_key) {
+                    LOG_ERROR("Failed to allocate map_key string");
+                    failed = 1;
+                    break;
+                }
+                to_lowercase(map_key);
+                if (!yaml_parser_parse(parser, event)) {
+                    free(map_key);
+                    failed = 1;
+                    break;
+                }
+                if (event->type == YAML_SCALAR_EVENT) {
+                    char **slot = NULL;
+                    if (strcmp(map_key, "name") == 0) slot = &name;
+                    else if (strcmp(map_key, "value") == 0) slot = &value;
+                    else if (strcmp(map_key, "file") == 0) slot = &file;
+                    else if (strcmp(map_key, "filename") == 0) slot = &filename;
+                    else if (strcmp(map_key, "type") == 0) slot = &type;
+                    if (slot) {
+                        free(*slot);
+                        *slot = strdup((char*)event->data.scalar.value);
+                        if (!*slot) LOG_ERROR("Failed to allocate multipart %s", map_key);
+                    }
+                }
+                yaml_event_delete(event);
+                free(map_key);
+            }
+            if (!name || failed) {
+                if (!name && !failed) LOG_WARN("Skipping multipart part without a name");
+                free(name);
+                free(value);
+                free(file);
+                free(filename);
+                free(type);
+                if (failed) break;
+                continue;
+            }
+            Part *temp = realloc(parts, (count + 2) * sizeof(Part));
+            if (!temp) {
+                LOG_ERROR("Failed to reallocate multipart array");
+                free(name);
+                free(value);
+                free(file);
+                free(filename);
+                free(type);
+                failed = 1;
+                break;
+            }
+            parts = temp;
+            if (make_part(&parts[count], name, value, file, filename, type)) {
+                free(parts[count].name);
+                free(parts[count].value);
+                free(parts[count].filename);
+                free(parts[count].type);
+                failed = 1;
+                break;
+            }
+            count++;
+        }
+    } else if (event->type == YAML_MAPPING_START_EVENT) {
+        yaml_event_delete(event);
+        while (1) {
+            if (!yaml_parser_parse(parser, event)) {
+                failed = 1;
+                break;
+            }
+            if (event->type == YAML_MAPPING_END_EVENT) {
+                yaml_event_delete(event);
+                break;
+            }
+            if (event->type != YAML_SCALAR_EVENT) {
+                yaml_event_delete(event);
+                continue;
+            }
+            char *name = strdup((char*)event->data.scalar.value);
+            yaml_event_delete(event);
+            if (!yaml_parser_parse(parser, event)) {
+                free(name);
+                failed = 1;
+                break;
+            }
+            char *value = event->type == YAML_SCALAR_EVENT ? strdup((char*)event->data.scalar.value) : NULL;
+            yaml_event_delete(event);
+            if (!name || !value) {
+                LOG_ERROR("Failed to allocate multipart part");
+                free(name);
+                free(value);
+                continue;
+            }
+            Part *temp = realloc(parts, (count + 2) * sizeof(Part));
+            if (!temp) {
+                LOG_ERROR("Failed to reallocate multipart array");
+                free(name);
+                free(value);
+                failed = 1;
+                break;
+            }
+            parts = temp;
+            if (make_part(&parts[count], name, value, NULL, NULL, NULL)) {
+                free(parts[count].name);
+                failed = 1;
+                break;
+            }
+            count++;
+        }
+    } else {
+        yaml_event_delete(event);
+        return 0;
+    }
+
+    if (parts) {
+        parts[count].name = NULL;
+        if (failed) {
+            free_parts(parts);
+        } else {
+            if (meta->multipart) free_parts(meta->multipart);
+            meta->multipart = parts;
+        }
+    }
+    return failed ? -1 : 0;
+}
+
+void free_string_list(char **list) {
+    if (!list) return;
+    for (char **item = list; *item; item++) {
+        free(*item);
+    }
+    free(list);
+}
+
+// Parse a key holding either a single string or a sequence of them into a NULL-terminated list
+static int parse_string_list(yaml_parser_t *parser, yaml_event_t *event, const char *key, char ***out) {
+    char **list = NULL;
+    int count = 0;
+    int failed = 0;
+    int sequence = event->type == YAML_SEQUENCE_START_EVENT;
+
+    if (!sequence && event->type != YAML_SCALAR_EVENT) {
+        LOG_ERROR("%s must be a string or a list of them", key);
+        yaml_event_delete(event);
+        return -1;
+    }
+
+    while (1) {
+        if (sequence) {
+            yaml_event_delete(event);
+            if (!yaml_parser_parse(parser, event)) {
+                failed = 1;
+                break;
+            }
+            if (event->type == YAML_SEQUENCE_END_EVENT) break;
+        }
+        if (event->type == YAML_SCALAR_EVENT) {
+            char **temp = realloc(list, (count + 2) * sizeof(char *));
+            if (!temp) {
+                failed = 1;
+                break;
+            }
+            list = temp;
+            list[count] = strdup((char*)event->data.scalar.value);
+            list[++count] = NULL;
+        } else {
+            LOG_ERROR("%s entries must be strings", key);
+            failed = 1;
+        }
+        if (!sequence) break;
+    }
+    yaml_event_delete(event);
+
+    free_string_list(*out);
+    *out = list;
+    return failed ? -1 : 0;
+}
+
+// Parse resolve, host:port:address entries in the form CURLOPT_RESOLVE takes
+static int parse_resolve(yaml_parser_t *parser, yaml_event_t *event, METADATA *meta) {
+    if (parse_string_list(parser, event, "resolve", &meta->resolve)) return -1;
+
+    for (char **entry = meta->resolve; entry && *entry; entry++) {
+        const char *colon = strchr(*entry, ':');
+        char *end = NULL;
+        long port = colon && colon != *entry ? strtol(colon + 1, &end, 10) : 0;
+        if (port <= 0 || port > 65535 || *end != ':' || end[1] == '\0') {
+            LOG_ERROR("Invalid resolve entry \"%s\", expected host:port:address", *entry);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+// Parse stages, either a "30s:100,5m:1000" string or a sequence of {duration, target}
+static int parse_stages_key(yaml_parser_t *parser, yaml_event_t *event, METADATA *meta) {
+    free(meta->stages);
+    meta->stages = NULL;
+    meta->stage_count = 0;
+
+    if (event->type == YAML_SCALAR_EVENT) {
+        int rc = parse_stages((char*)event->data.scalar.value, &meta->stages, &meta->stage_count);
+        yaml_event_delete(event);
+        return rc;
+    }
+    if (event->type != YAML_SEQUENCE_START_EVENT) {
+        LOG_ERROR("stages must be a list of {duration, target}");
+        yaml_event_delete(event);
+        return -1;
+    }
+    yaml_event_delete(event);
+
+    int failed = 0;
+    while (!failed) {
+        if (!yaml_parser_parse(parser, event)) return -1;
+        if (event->type == YAML_SEQUENCE_END_EVENT) {
+            yaml_event_delete(event);
+            break;
+        }
+        if (event->type != YAML_MAPPING_START_EVENT) {
+            LOG_ERROR("stages entries must be {duration, target}");
+            yaml_event_delete(event);
+            return -1;
+        }
+        yaml_event_delete(event);
+
+        Stage stage = {-1, -1};
+        while (1) {
+            if (!yaml_parser_parse(parser, event)) return -1;
+            if (event->type == YAML_MAPPING_END_EVENT) {
+                yaml_event_delete(event);
+                break;
+            }
+            char *map_key = event->type == YAML_SCALAR_EVENT ? strdup((char*)event->data.scalar.value) : NULL;
+            yaml_event_delete(event);
+            if (!yaml_parser_parse(parser, event)) {
+                free(map_key);
+                return -1;
+            }
+            if (map_key && event->type == YAML_SCALAR_EVENT) {
+                const char *value = (char*)event->data.scalar.value;
+                if (strcmp(map_key, "duration") == 0) {
+                    stage.duration = parse_duration(value);
+                } else if (strcmp(map_key, "target") == 0 || strcmp(map_key, "users") == 0) {
+                    stage.target = atoi(value);
+                }
+            }
+            yaml_event_delete(event);
+            free(map_key);
+        }
+
+        if (stage.duration < 0 || stage.target < 0) {
+            LOG_ERROR("Each stage needs a duration and a target");
+            failed = 1;
+            break;
+        }
+        Stage *temp = realloc(meta->stages, (meta->stage_count + 1) * sizeof(Stage));
+        if (!temp) {
+            failed = 1;
+            break;
+        }
+        meta->stages = temp;
+        meta->stages[meta->stage_count++] = stage;
+    }
+    return failed ? -1 : 0;
+}
+
+// Parse the feeder key, either a file path or a mapping with file and mode
+static int parse_feeder(yaml_parser_t *parser, yaml_event_t *event, METADATA *meta) {
+    char *file = NULL;
+    int mode = FEED_SEQUENTIAL;
+    int failed = 0;
+
+    if (event->type == YAML_SCALAR_EVENT) {
+        file = strdup((char*)event->data.scalar.value);
+        yaml_event_delete(event);
+    } else if (event->type == YAML_MAPPING_START_EVENT) {
+        yaml_event_delete(event);
+        while (1) {
+            if (!yaml_parser_parse(parser, event)) {
+                failed = 1;
+                break;
+            }
+            if (event->type == YAML_MAPPING_END_EVENT) {
+                yaml_event_delete(event);
+                break;
+            }
+            if (event->type != YAML_SCALAR_EVENT) {
+                yaml_event_delete(event);
+                continue;
+            }
+            char *map_key = strdup((char*)event->data.scalar.value);
+            yaml_event_delete(event);
+            if (!map_key || !yaml_parser_parse(parser, event)) {
+                free(map_key);
+                failed = 1;
+                break;
+            }
+            to_lowercase(map_key);
+            if (event->type == YAML_SCALAR_EVENT) {
+                const char *value = (char*)event->data.scalar.value;
+                if (strcmp(map_key, "file") == 0) {
+                    free(file);
+                    file = strdup(value);
+                } else if (strcmp(map_key, "mode") == 0) {
+                    mode = parse_feed_mode(value);
+                    if (mode < 0) {
+                        LOG_ERROR("Unknown feeder mode: %s", value);
+                        failed = 1;
+                    }
+                }
+            }
+            yaml_event_delete(event);
+            free(map_key);
+        }
+    } else {
+        yaml_event_delete(event);
+        return 0;
+    }
+
+    if (!failed && file) {
+        free_feeder(meta->feeder);
+        meta->feeder = load_feeder(file, (FeedMode)mode);
+        if (!meta->feeder) failed = 1;
+    } else if (!failed) {
+        LOG_ERROR("Feeder is missing a file");
+        failed = 1;
+    }
+    free(file);
+    return failed ? -1 : 0;
+}
+
+// Apply one body_generator setting, -1 if its value is invalid
+static int set_body_generator(BodyGenerator *g, const char *key, const char *value) {
+    if (strcmp(key, "size") == 0) {
+        int64_t size = parse_size(value);
+        if (size < 0) {
+            LOG_ERROR("Invalid body_generator size: %s", value);
+            return -1;
+        }
+        g->size = (uint64_t)size;
+    } else if (strcmp(key, "pattern") == 0) {
+        if (strcasecmp(value, "random") == 0) {
+            g->pattern = GEN_RANDOM;
+        } else if (strcasecmp(value, "zeros") == 0) {
+            g->pattern = GEN_ZEROS;
+        } else if (strcasecmp(value, "repeat") == 0) {
+            g->pattern = GEN_REPEAT;
+        } else {
+            LOG_ERROR("Unknown body_generator pattern: %s, expected random, zeros or repeat", value);
+            return -1;
+        }
+    } else if (strcmp(key, "text") == 0) {
+        if (value[0] == '\0') {
+            LOG_ERROR("body_generator text must not be empty");
+            return -1;
+        }
+        free(g->text);
+        g->text = strdup(value);
+        if (!g->text) return -1;
+        g->text_len = strlen(value);
+        g->pattern = GEN_REPEAT;
+    } else if (strcmp(key, "chunked") == 0) {
+        g->chunked = strcmp(value, "true") == 0;
+    }
+    return 0;
+}
+
+// Parse the body_generator key, either a size of random bytes or a mapping of settings
+static int parse_body_generator(yaml_parser_t *parser, yaml_event_t *event, METADATA *meta) {
+    BodyGenerator *g = calloc(1, sizeof(BodyGenerator));
+    if (!g) {
+        yaml_event_delete(event);
+        return -1;
+    }
+    g->pattern = GEN_RANDOM;
+
+    int failed = 0;
+    bool sized = false;
+    if (event->type == YAML_SCALAR_EVENT) {
+        failed = set_body_generator(g, "size", (char*)event->data.scalar.value);
+        sized = true;
+        yaml_event_delete(event);
+    } else if (event->type == YAML_MAPPING_START_EVENT) {
+        yaml_event_delete(event);
+        while (!failed) {
+            if (!yaml_parser_parse(parser, event)) {
+                failed = 1;
+                break;
+            }
+            if (event->type == YAML_MAPPING_END_EVENT) {
+                yaml_event_delete(event);
+                break;
+            }
+            if (event->type != YAML_SCALAR_EVENT) {
+                yaml_event_delete(event);
+                continue;
+            }
+            char *map_key = strdup((char*)event->data.scalar.value);
+            yaml_event_delete(event);
+            if (!map_key || !yaml_parser_parse(parser, event)) {
+                free(map_key);
+                failed = 1;
+                break;
+            }
+            to_lowercase(map_key);
+            if (event->type == YAML_SCALAR_EVENT) {
+                if (set_body_generator(g, map_key, (char*)event->data.scalar.value)) failed = 1;
+                if (strcmp(map_key, "size") == 0) sized = true;
+            }
+            yaml_event_delete(event);
+            free(map_key);
+        }
+    } else {
+        LOG_ERROR("body_generator must be a size or a mapping");
+        yaml_event_delete(event);
+        failed = 1;
+    }
+
+    if (!failed && !sized) {
+        LOG_ERROR("body_generator needs a size");
+        failed = 1;
+    }
+    if (!failed && g->pattern == GEN_REPEAT && !g->text) {
+        g->text = strdup("capis");
+        g->text_len = 5;
+        if (!g->text) failed = 1;
+    }
+    if (failed) {
+        free_body_generator(g);
+        return -1;
+    }
+    if (g->pattern == GEN_RANDOM) use_generators();
+    free_body_generator(meta->body_generator);
+    meta->body_generator = g;
+    return 0;
+}
+
+// Apply one throughput setting, -1 if its value is invalid
+static int set_throughput(Throughput *tp, const char *key, const char *value) {
+    char *end = NULL;
+    if (strcmp(key, "segments") == 0) {
+        long n = strtol(value, &end, 10);
+        if (*end || n < 1 || n > 1024) {
+            LOG_ERROR("throughput segments must be 1 to 1024");
+            return -1;
+        }
+        tp->segments = (int)n;
+    } else if (strcmp(key, "downloads") == 0) {
+        long n = strtol(value, &end, 10);
+        if (*end || n < 1) {
+            LOG_ERROR("throughput downloads must be a positive number");
+            return -1;
+        }
+        tp->downloads = (int)n;
+    } else if (strcmp(key, "sink") == 0) {
+        if (strcasecmp(value, "discard") == 0) {
+            tp->sink = SINK_DISCARD;
+        } else if (strcasecmp(value, "crc32c") == 0 || strcasecmp(value, "hash") == 0) {
+            tp->sink = SINK_CRC32C;
+        } else {
+            LOG_ERROR("Unknown throughput sink: %s, expected discard or crc32c", value);
+            return -1;
+        }
+    } else if (strcmp(key, "crc32c") == 0) {
+        unsigned long crc = strtoul(value, &end, 16);
+        if (*end || end == value || crc > 0xffffffffUL) {
+            LOG_ERROR("throughput crc32c must be a hex checksum");
+            return -1;
+        }
+        tp->sink = SINK_CRC32C;
+        tp->verify = true;
+        tp->crc32c = (uint32_t)crc;
+    }
+    return 0;
+}
+
+// Parse the throughput key, either a number of segments or a mapping of settings
+static int parse_throughput(yaml_parser_t *parser, yaml_event_t *event, METADATA *meta) {
+    Throughput *tp = calloc(1, sizeof(Throughput));
+    if (!tp) {
+        yaml_event_delete(event);
+        return -1;
+    }
+    tp->segments = 1;
+    tp->downloads = 1;
+    tp->sink = SINK_DISCARD;
+
+    int failed = 0;
+    if (event->type == YAML_SCALAR_EVENT) {
+        // throughput: true downloads in one piece, throughput: 8 in eight
+        const char *value = (char*)event->data.scalar.value;
+        if (strcmp(value, "false") == 0) {
+            free(tp);
+            tp = NULL;
+        } else if (strcmp(value, "true") != 0) {
+            failed = set_throughput(tp, "segments", value);
+        }
+        yaml_event_delete(event);
+    } else if (event->type == YAML_MAPPING_START_EVENT) {
+        yaml_event_delete(event);
+        while (!failed) {
+            if (!yaml_parser_parse(parser, event)) {
+                failed = 1;
+                break;
+            }
+            if (event->type == YAML_MAPPING_END_EVENT) {
+                yaml_event_delete(event);
+                break;
+            }
+            if (event->type != YAML_SCALAR_EVENT) {
+                yaml_event_delete(event);
+                continue;
+            }
+            char *map_key = strdup((char*)event->data.scalar.value);
+            yaml_event_delete(event);
+            if (!map_key || !yaml_parser_parse(parser, event)) {
+                free(map_key);
+                failed = 1;
+                break;
+            }
+            to_lowercase(map_key);
+            if (event->type == YAML_SCALAR_EVENT) {
+                if (set_throughput(tp, map_key, (char*)event->data.scalar.value)) failed = 1;
+            }
+            yaml_event_delete(event);
+            free(map_key);
+        }
+    } else {
+        LOG_ERROR("throughput must be a number of segments or a mapping");
+        yaml_event_delete(event);
+        failed = 1;
+    }
+
+    if (failed) {
+        free(tp);
+        return -1;
+    }
+    free(meta->throughput);
+    meta->throughput = tp;
+    return 0;
+}
+
+// Apply one stream setting, -1 if its value is invalid
+static int set_stream(Stream *st, const char *key, const char *value) {
+    char *end = NULL;
+    if (strcmp(key, "type") == 0) {
+        if (strcasecmp(value, "sse") == 0) {
+            st->type = STREAM_SSE;
+        } else if (strcasecmp(value, "websocket") == 0 || strcasecmp(value, "ws") == 0) {
+            st->type = STREAM_WEBSOCKET;
+        } else {
+            LOG_ERROR("Unknown stream type: %s, expected sse or websocket", value);
+            return -1;
+        }
+    } else if (strcmp(key, "connections") == 0) {
+        long n = strtol(value, &end, 10);
+        if (*end || n < 1 || n > 1000000) {
+            LOG_ERROR("stream connections must be 1 to 1000000");
+            return -1;
+        }
+        st->connections = (int)n;
+    } else if (strcmp(key, "duration") == 0 || strcmp(key, "interval") == 0) {
+        double seconds = parse_duration(value);
+        if (seconds < 0) {
+            LOG_ERROR("Invalid stream %s: %s, expected e.g. 30s or 5m", key, value);
+            return -1;
+        }
+        if (key[0] == 'd') st->duration = seconds; else st->interval = seconds;
+    } else if (strcmp(key, "timestamp") == 0) {
+        free(st->timestamp);
+        st->timestamp = *value ? strdup(value) : NULL;
+        if (*value && !st->timestamp) return -1;
+    } else if (strcmp(key, "message") == 0) {
+        free(st->message);
+        st->message = strdup(value);
+        if (!st->message) return -1;
+    } else if (strcmp(key, "reconnect") == 0) {
+        st->reconnect = strcmp(value, "true") == 0;
+    }
+    return 0;
+}
+
+// Parse the stream key, either a type or a mapping of settings
+static int parse_stream(yaml_parser_t *parser, yaml_event_t *event, METADATA *meta) {
+    Stream *st = calloc(1, sizeof(Stream));
+    if (!st) {
+        yaml_event_delete(event);
+        return -1;
+    }
+    st->type = STREAM_SSE;
+    st->connections = 1;
+    st->reconnect = true;
+
+    int failed = 0;
+    if (event->type == YAML_SCALAR_EVENT) {
+        failed = set_stream(st, "type", (char*)event->data.scalar.value);
+        yaml_event_delete(event);
+    } else if (event->type == YAML_MAPPING_START_EVENT) {
+        yaml_event_delete(event);
+        while (!failed) {
+            if (!yaml_parser_parse(parser, event)) {
+                failed = 1;
+                break;
+            }
+            if (event->type == YAML_MAPPING_END_EVENT) {
+                yaml_event_delete(event);
+                break;
+            }
+            if (event->type != YAML_SCALAR_EVENT) {
+                yaml_event_delete(event);
+                continue;
+            }
+            char *map_key = strdup((char*)event->data.scalar.value);
+            yaml_event_delete(event);
+            if (!map_key || !yaml_parser_parse(parser, event)) {
+                free(map_key);
+                failed = 1;
+                break;
+            }
+            to_lowercase(map_key);
+            if (event->type == YAML_SCALAR_EVENT) {
+                if (set_stream(st, map_key, (char*)event->data.scalar.value)) failed = 1;
+            }
+            yaml_event_delete(event);
+            free(map_key);
+        }
+    } else {
+        LOG_ERROR("stream must be sse, websocket or a mapping");
+        yaml_event_delete(event);
+        failed = 1;
+    }
+
+    // Messages carry their send time in ts unless told otherwise
+    if (!failed && !st->timestamp) {
+        st->timestamp = strdup("ts");
+        if (!st->timestamp) failed = 1;
+    }
+    if (!failed && st->type == STREAM_WEBSOCKET && !st->message) {
+        st->message = strdup("{\"ts\":${now}}");
+        if (!st->message) failed = 1;
+    }
+    if (failed) {
+        free_stream(st);
+        return -1;
+    }
+    free_stream(meta->stream);
+    meta->stream = st;
+    return 0;
+}
+
+// Apply one host limit, -1 if its value is invalid
+int set_host_limit(HostLimits *hl, const char *key, const char *value) {
+    char *end = NULL;
+    if (strcmp(key, "connections") == 0 || strcmp(key, "in_flight") == 0 || strcmp(key, "burst") == 0) {
+        long n = strtol(value, &end, 10);
+        if (*end || end == value || n < 1 || n > 1000000) {
+            LOG_ERROR("host_limits %s must be 1 to 1000000", key);
+            return -1;
+        }
+        if (key[0] == 'c') hl->connections = (int)n;
+        else if (key[0] == 'i') hl->in_flight = (int)n;
+        else hl->burst = (int)n;
+    } else if (strcmp(key, "rate") == 0) {
+        // 50 or 50/s
+        double rate = strtod(value, &end);
+        if (end == value || (*end && strcmp(end, "/s") != 0) || rate <= 0) {
+            LOG_ERROR("host_limits rate must be a positive number of requests per second, e.g. 50/s");
+            return -1;
+        }
+        hl->rate = rate;
+    } else {
+        LOG_WARN("Unknown host_limits key: %s, expected connections, in_flight, rate or burst", key);
+    }
+    return 0;
+}
+
+// Parse the host_limits mapping
+static int parse_host_limits(yaml_parser_t *parser, yaml_event_t *event, METADATA *meta) {
+    if (event->type != YAML_MAPPING_START_EVENT) {
+        LOG_ERROR("host_limits must be a mapping of connections, in_flight, rate and burst");
+        yaml_event_delete(event);
+        return -1;
+    }
+    yaml_event_delete(event);
+    HostLimits *hl = calloc(1, sizeof(HostLimits));
+    if (!hl) return -1;
+
+    int failed = 0;
+    while (!failed) {
+        if (!yaml_parser_parse(parser, event)) {
+            failed = 1;
+            break;
+        }
+        if (event->type == YAML_MAPPING_END_EVENT) {
+            yaml_event_delete(event);
+            break;
+        }
+        if (event->type != YAML_SCALAR_EVENT) {
+            yaml_event_delete(event);
+            continue;
+        }
+        char *map_key = strdup((char*)event->data.scalar.value);
+        yaml_event_delete(event);
+        if (!map_key || !yaml_parser_parse(parser, event)) {
+            free(map_key);
+            failed = 1;
+            break;
+        }
+        to_lowercase(map_key);
+        for (char *c = map_key; *c; c++) {
+            if (*c == '-') *c = '_';  // in-flight reads as in_flight
+        }
+        if (event->type == YAML_SCALAR_EVENT) {
+            if (set_host_limit(hl, map_key, (char*)event->data.scalar.value)) failed = 1;
+        }
+        yaml_event_delete(event);
+        free(map_key);
+    }
+
+    if (failed) {
+        free(hl);
+        return -1;
+    }
+    free(meta->host_limits);
+    meta->host_limits = hl;
+    return 0;
+}
+
+// Compile placeholders and pre-encode everything that does not change between sends
+int compile_metadata(METADATA *meta) {
+    meta->url_tpl = compile_template(meta->url, meta->feeder);
+    meta->host_tpl = compile_template(meta->host, meta->feeder);
+    meta->path_tpl = compile_template(meta->path, meta->feeder);
+    // Values substituted into the URL or path are percent-encoded as they are rendered, keeping
+    // the reserved bytes that give them structure; query values are encoded in full by build_params
+    if (meta->url_tpl) meta->url_tpl->encode = true;
+    if (meta->path_tpl) meta->path_tpl->encode = true;
+
+    if (meta->headers) {
+        for (Header *h = meta->headers; h->key != NULL; h++) {
+            h->tpl = compile_template(h->value, meta->feeder);
+        }
+    }
+
+    EncodeMode mode = meta->method == GET ? ENCODE_QUERY : ENCODE_FORM;
+    int count = 0;
+    bool dynamic = false;
+    if (meta->params) {
+        for (Param *p = meta->params; p->key != NULL; p++, count++) {
+            p->tpl = compile_template(p->value, meta->feeder);
+            p->enc_key = url_encode_dup(p->key, mode);
+            if (!p->enc_key) return -1;
+            if (p->tpl) {
+                dynamic = true;
+            } else {
+                p->enc_value = url_encode_dup(p->value, mode);
+                if (!p->enc_value) return -1;
+            }
+        }
+    }
+
+    if (count > 0 && !dynamic) {
+        char **keys = malloc(count * sizeof(char *));
+        char **values = malloc(count * sizeof(char *));
+        if (keys && values) {
+            for (int i = 0; i < count; i++) {
+                keys[i] = meta->params[i].enc_key;
+                values[i] = meta->params[i].enc_value;
+            }
+            meta->encoded_params = join_params(keys, values, count);
+        }
+        free(keys);
+        free(values);
+        if (!meta->encoded_params) return -1;
+    }
+
+    bool has_query = meta->method == GET && count > 0;
+    if (!meta->url_tpl && !meta->host_tpl && !meta->path_tpl && (!has_query || !dynamic)) {
+        meta->request_url = build_url(meta->url, meta->host, meta->path, meta->secure,
+                                      has_query ? meta->encoded_params : NULL);
+        if (!meta->request_url) return -1;
+    }
+    return 0;
+}
+
 // Read YAML file and populate METADATA
 int read_yaml(FILE *fp, METADATA *meta) {
     yaml_parser_t parser;
     yaml_event_t event;
+    uint64_t start = prof_ticks();
 
     if (!yaml_parser_initialize(&parser)) {
         LOG_ERROR("Failed to initialize YAML parser");
@@ -99,6 +1028,7 @@ int read_yaml(FILE *fp, METADATA *meta) {
     yaml_parser_set_input_file(&parser, fp);
 
     int done = 0;
+    int failed = 0;
     while (!done) {
         if (!yaml_parser_parse(&parser, &event)) {
             LOG_ERROR("YAML parsing failed");
@@ -151,6 +1081,54 @@ int read_yaml(FILE *fp, METADATA *meta) {
                             meta->timeout = strtol((char*)event.data.scalar.value, NULL, 10);
                         } else if (strcmp(key, "secure") == 0 && event.type == YAML_SCALAR_EVENT) {
                             meta->secure = strcmp((char*)event.data.scalar.value, "true") == 0;
+                        } else if (strcmp(key, "body_file") == 0 && event.type == YAML_SCALAR_EVENT) {
+                            unmap_file(meta->body_file);
+                            meta->body_file = map_file((char*)event.data.scalar.value);
+                            if (!meta->body_file) {
+                                LOG_ERROR("Failed to map body file: %s", (char*)event.data.scalar.value);
+                                failed = 1;
+                            }
+                            yaml_event_delete(&event);
+                        } else if (strcmp(key, "body_generator") == 0) {
+                            if (parse_body_generator(&parser, &event, meta)) failed = 1;
+                        } else if (strcmp(key, "multipart") == 0) {
+                            if (parse_multipart(&parser, &event, meta)) failed = 1;
+                        } else if (strcmp(key, "json") == 0) {
+                            free(meta->json_body);
+                            meta->json_body = NULL;
+                            if (yaml_to_json(&parser, &event, &meta->json_body, &meta->json_len)) {
+                                LOG_ERROR("Failed to serialize json body");
+                                failed = 1;
+                            }
+                        } else if (strcmp(key, "feeder") == 0) {
+                            if (parse_feeder(&parser, &event, meta)) failed = 1;
+                        } else if (strcmp(key, "id") == 0 && event.type == YAML_SCALAR_EVENT) {
+                            free(meta->id);
+                            meta->id = strdup((char*)event.data.scalar.value);
+                            yaml_event_delete(&event);
+                        } else if (strcmp(key, "depends_on") == 0) {
+                            if (parse_string_list(&parser, &event, "depends_on", &meta->depends_on)) failed = 1;
+                        } else if (strcmp(key, "resolve") == 0) {
+                            if (parse_resolve(&parser, &event, meta)) failed = 1;
+                        } else if (strcmp(key, "unix_socket") == 0) {
+                            // sockaddr_un holds at most 107 bytes of path
+                            if (event.type != YAML_SCALAR_EVENT || event.data.scalar.length == 0 ||
+                                event.data.scalar.length > 107) {
+                                LOG_ERROR("unix_socket must be a path of 1 to 107 bytes");
+                                failed = 1;
+                            } else {
+                                free(meta->unix_socket);
+                                meta->unix_socket = strdup((char*)event.data.scalar.value);
+                            }
+                            yaml_event_delete(&event);
+                        } else if (strcmp(key, "stages") == 0) {
+                            if (parse_stages_key(&parser, &event, meta)) failed = 1;
+                        } else if (strcmp(key, "throughput") == 0) {
+                            if (parse_throughput(&parser, &event, meta)) failed = 1;
+                        } else if (strcmp(key, "stream") == 0) {
+                            if (parse_stream(&parser, &event, meta)) failed = 1;
+                        } else if (strcmp(key, "host_limits") == 0) {
+                            if (parse_host_limits(&parser, &event, meta)) failed = 1;
                         } else if (strcmp(key, "headers") == 0) {
                             if (event.type == YAML_SEQUENCE_START_EVENT) {
                                 // Parse headers as a sequence of key-value mappings
@@ -213,6 +1191,7 @@ int read_yaml(FILE *fp, METADATA *meta) {
                                                 headers = temp;
                                                 headers[count].key = header_key;
                                                 headers[count].value = header_value;
+                                                headers[count].tpl = NULL;
                                                 count++;
                                             } else {
                                                 free(header_key);
@@ -233,6 +1212,7 @@ int read_yaml(FILE *fp, METADATA *meta) {
                                         headers = temp;
                                         headers[count].key = NULL;
                                         headers[count].value = NULL;
+                                        headers[count].tpl = NULL;
                                         meta->headers = headers;
                                     } else {
                                         LOG_ERROR("Failed to reallocate headers array");
@@ -279,6 +1259,7 @@ int read_yaml(FILE *fp, METADATA *meta) {
                                                     headers = temp;
                                                     headers[count].key = header_key;
                                                     headers[count].value = header_value;
+                                                    headers[count].tpl = NULL;
                                                     count++;
                                                 } else {
                                                     free(header_key);
@@ -300,6 +1281,7 @@ int read_yaml(FILE *fp, METADATA *meta) {
                                         headers = temp;
                                         headers[count].key = NULL;
                                         headers[count].value = NULL;
+                                        headers[count].tpl = NULL;
                                         meta->headers = headers;
                                     } else {
                                         LOG_ERROR("Failed to reallocate headers array");
@@ -375,6 +1357,9 @@ int read_yaml(FILE *fp, METADATA *meta) {
                                                 params = temp;
                                                 params[count].key = param_key;
                                                 params[count].value = param_value;
+                                                params[count].tpl = NULL;
+                                                params[count].enc_key = NULL;
+                                                params[count].enc_value = NULL;
                                                 count++;
                                             } else {
                                                 free(param_key);
@@ -395,6 +1380,9 @@ int read_yaml(FILE *fp, METADATA *meta) {
                                         params = temp;
                                         params[count].key = NULL;
                                         params[count].value = NULL;
+                                        params[count].tpl = NULL;
+                                        params[count].enc_key = NULL;
+                                        params[count].enc_value = NULL;
                                         meta->params = params;
                                     } else {
                                         LOG_ERROR("Failed to reallocate params array");
@@ -441,6 +1429,9 @@ int read_yaml(FILE *fp, METADATA *meta) {
                                                     params = temp;
                                                     params[count].key = param_key;
                                                     params[count].value = param_value;
+                                                    params[count].tpl = NULL;
+                                                    params[count].enc_key = NULL;
+                                                    params[count].enc_value = NULL;
                                                     count++;
                                                 } else {
                                                     free(param_key);
@@ -462,6 +1453,9 @@ int read_yaml(FILE *fp, METADATA *meta) {
                                         params = temp;
                                         params[count].key = NULL;
                                         params[count].value = NULL;
+                                        params[count].tpl = NULL;
+                                        params[count].enc_key = NULL;
+                                        params[count].enc_value = NULL;
                                         meta->params = params;
                                     } else {
                                         LOG_ERROR("Failed to reallocate params array");
@@ -624,7 +1618,38 @@ int read_yaml(FILE *fp, METADATA *meta) {
     }
 
     yaml_parser_delete(&parser);
-    return !done;
+    if (!failed && compile_metadata(meta)) {
+        LOG_ERROR("Failed to compile request");
+        failed = 1;
+    }
+    meta->parse_ticks = prof_ticks() - start;
+    prof_end(PROF_YAML, start);
+    return !done || failed;
+}
+
+// Open, parse and compile one YAML case, NULL on failure
+METADATA *load_metadata(const char *path) {
+    METADATA *md = init_metadata();
+    if (!md) {
+        LOG_ERROR("Failed to initialize metadata for %s", path);
+        return NULL;
+    }
+
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        LOG_ERROR("Failed to open %s", path);
+        free_metadata(md);
+        return NULL;
+    }
+
+    LOG_INFO("Processing METADATA: %s", path);
+    int rc = read_yaml(fp, md);
+    fclose(fp);
+    if (rc) {
+        free_metadata(md);
+        return NULL;
+    }
+    return md;
 }
 
 // Convert CURL_METHOD enum to string
@@ -646,12 +1671,32 @@ void print_metadata(METADATA *metadata) {
         return;
     }
 
+    if (metadata->id) {
+        printf("Id: %s\n", metadata->id);
+    }
+    if (metadata->depends_on) {
+        printf("Depends On:");
+        for (char **id = metadata->depends_on; *id; id++) {
+            printf(" %s", *id);
+        }
+        printf("\n");
+    }
+    if (metadata->resolve) {
+        printf("Resolve:");
+        for (char **entry = metadata->resolve; *entry; entry++) {
+            printf(" %s", *entry);
+        }
+        printf("\n");
+    }
     printf("Method: %s\n", method_toString(metadata->method));
     printf("Host: %s\n", metadata->host ? metadata->host : "(null)");
     printf("Path: %s\n", metadata->path ? metadata->path : "(null)");
     printf("URL: %s\n", metadata->url ? metadata->url : "(null)");
     printf("Timeout: %ld\n", metadata->timeout);
     printf("Secure: %s\n", metadata->secure ? "true" : "false");
+    if (metadata->unix_socket) {
+        printf("Unix Socket: %s\n", metadata->unix_socket);
+    }
 
     printf("Headers:\n");
     if (metadata->headers) {
@@ -680,4 +1725,70 @@ void print_metadata(METADATA *metadata) {
     } else {
         printf("  (none)\n");
     }
+
+    if (metadata->body_file) {
+        printf("Body File: %s (%zu bytes)\n", metadata->body_file->path, metadata->body_file->size);
+    }
+
+    if (metadata->body_generator) {
+        const BodyGenerator *g = metadata->body_generator;
+        const char *patterns[] = {"random", "zeros", "repeat"};
+        printf("Body Generator: %llu bytes of %s%s\n", (unsigned long long)g->size, patterns[g->pattern],
+               g->chunked ? ", chunked" : "");
+    }
+
+    if (metadata->json_body) {
+        printf("JSON: %s\n", metadata->json_body);
+    }
+
+    if (metadata->feeder) {
+        printf("Feeder: %s (%zu records, %d columns, %s)\n", metadata->feeder->file->path,
+               metadata->feeder->count, metadata->feeder->column_count,
+               feed_mode_toString(metadata->feeder->mode));
+    }
+
+    if (metadata->stages) {
+        printf("Stages:\n");
+        for (int i = 0; i < metadata->stage_count; i++) {
+            printf("  %g s -> %d users\n", metadata->stages[i].duration, metadata->stages[i].target);
+        }
+    }
+
+    if (metadata->throughput) {
+        const Throughput *tp = metadata->throughput;
+        printf("Throughput: %d segments, %d downloads, sink %s", tp->segments, tp->downloads,
+               tp->sink == SINK_CRC32C ? "crc32c" : "discard");
+        if (tp->verify) printf(", expecting %08x", tp->crc32c);
+        printf("\n");
+    }
+
+    if (metadata->stream) {
+        const Stream *st = metadata->stream;
+        printf("Stream: %s, %d connections", st->type == STREAM_WEBSOCKET ? "websocket" : "sse", st->connections);
+        if (st->duration > 0) printf(", %g s", st->duration);
+        if (st->timestamp) printf(", timestamp %s", st->timestamp);
+        if (!st->reconnect) printf(", no reconnect");
+        printf("\n");
+        if (st->message) printf("  Message every %g s: %s\n", st->interval, st->message);
+    }
+
+    if (metadata->host_limits) {
+        const HostLimits *hl = metadata->host_limits;
+        printf("Host limits:");
+        if (hl->connections) printf(" %d connections", hl->connections);
+        if (hl->in_flight) printf(" %d in flight", hl->in_flight);
+        if (hl->rate > 0) printf(" %g req/s, burst %d", hl->rate, hl->burst > 0 ? hl->burst : 1);
+        printf("\n");
+    }
+
+    if (metadata->multipart) {
+        printf("Multipart:\n");
+        for (Part *p = metadata->multipart; p->name != NULL; p++) {
+            if (p->file) {
+                printf("  %s: @%s (%zu bytes)\n", p->name, p->file->path, p->file->size);
+            } else {
+                printf("  %s: %s\n", p->name, p->value);
+            }
+        }
+    }
 }
\ No newline at end of file
@@ -2,6 +2,10 @@
 #define READ_YAML_H
 
 #include <stdbool.h>
+#include "utils.h"
+#include "feeder.h"
+#include "template.h"
+#include "stages.h"
 
 enum CURL_METHOD {
     GET, POST, PUT, UPDATE, _DELETE
@@ -10,6 +14,7 @@ enum CURL_METHOD {
 typedef struct {
     char *key;
     char *value;
+    Template *tpl;  // Compiled value when it references feeder columns
 } Header;
 
 typedef struct {
@@ -25,8 +30,72 @@ typedef struct {
 typedef struct {
     char *key;
     char *value;
+    Template *tpl;    // Compiled value when it references feeder columns
+    char *enc_key;    // Percent-encoded key
+    char *enc_value;  // Percent-encoded value, NULL when it is rendered per send
 } Param;
 
+typedef struct {
+    char *name;
+    char *value;        // Inline value for text parts
+    char *filename;     // Remote filename for file parts
+    char *type;         // Content type of the part
+    MappedFile *file;   // Mapped file contents for file parts
+} Part;
+
+typedef enum {
+    GEN_RANDOM,     // Incompressible bytes, different for every send
+    GEN_ZEROS,
+    GEN_REPEAT      // text over and over
+} GenPattern;
+
+// Request body produced while it is sent, of any size and never held in memory
+typedef struct {
+    uint64_t size;
+    GenPattern pattern;
+    char *text;         // Repeated by GEN_REPEAT
+    size_t text_len;
+    bool chunked;       // Send with Transfer-Encoding: chunked instead of Content-Length
+} BodyGenerator;
+
+// Where downloaded bytes go in throughput mode; nothing is buffered either way
+typedef enum {
+    SINK_DISCARD,   // Count the bytes only
+    SINK_CRC32C     // Checksum the object while it streams in
+} BodySink;
+
+typedef struct {
+    int segments;       // Range requests each download is split into, 1 for a plain GET
+    int downloads;      // Downloads to run one after another
+    BodySink sink;
+    bool verify;        // Compare the checksum of every download with crc32c
+    uint32_t crc32c;
+} Throughput;
+
+typedef enum {
+    STREAM_SSE,         // text/event-stream over a long-lived GET
+    STREAM_WEBSOCKET
+} StreamType;
+
+// Hold streaming connections open and time the messages they carry
+typedef struct {
+    StreamType type;
+    int connections;    // Streams kept open at once
+    double duration;    // Seconds to hold them, 0 for -d or the default
+    char *timestamp;    // JSON field of a message holding its send time, NULL for none
+    char *message;      // WebSocket: text sent every interval, ${now} becoming the time in microseconds
+    double interval;    // WebSocket: seconds between messages on each connection, 0 to only listen
+    bool reconnect;     // Reopen streams the server closes
+} Stream;
+
+// Caps on the traffic sent to one scheme://host:port, 0 for no limit
+typedef struct {
+    int connections;    // Connections open at once
+    int in_flight;      // Requests in flight at once
+    double rate;        // Requests per second, as a token bucket
+    int burst;          // Requests the bucket holds, 0 for 1
+} HostLimits;
+
 typedef struct {
     enum CURL_METHOD method;
     char *host;
@@ -37,11 +106,35 @@ typedef struct {
     Header *headers;
     Param *params;
     Cookie *cookies;
+    MappedFile *body_file;  // Raw request body streamed from a mapped file
+    BodyGenerator *body_generator;  // Synthetic request body generated per send
+    Part *multipart;        // multipart/form-data parts
+    char *json_body;        // JSON body serialized once from the json key
+    size_t json_len;
+    Feeder *feeder;         // Per-request data for ${column} placeholders
+    Template *url_tpl;      // Compiled url/host/path when they hold placeholders
+    Template *host_tpl;
+    Template *path_tpl;
+    char *encoded_params;   // Encoded query string or form body, NULL when params are rendered per send
+    char *request_url;      // Final URL, NULL when it is rendered per send
+    char *id;               // Name other cases use to depend on this one
+    char **depends_on;      // NULL-terminated ids of the cases that must pass first
+    char **resolve;         // NULL-terminated host:port:address overrides for name resolution
+    char *unix_socket;      // Connect through this Unix domain socket instead of TCP, NULL for TCP
+    Stage *stages;          // Load profile used when load testing, NULL for a flat load
+    int stage_count;
+    Throughput *throughput; // Measure download goodput instead of latency, NULL for a normal case
+    Stream *stream;         // Benchmark a stream of messages instead of requests, NULL for a normal case
+    HostLimits *host_limits;  // Caps on the traffic to this case's host, NULL for the command line's
+    uint64_t parse_ticks;   // What read_yaml spent on this case, 0 when it came from the cache
 } METADATA;
 
 // Free the memory allocated for a METADATA struct
 void free_metadata(METADATA *md);
 
+// Free a NULL-terminated list of strings such as depends_on
+void free_string_list(char **list);
+
 // Initialize a new METADATA struct
 METADATA *init_metadata(void);
 
@@ -49,7 +142,16 @@ METADATA *init_metadata(void);
 // Read YAML file and populate METADATA
 int read_yaml(FILE *fp, METADATA *metadata);
 
+// Compile placeholders and pre-encode the request parts that do not change between sends
+int compile_metadata(METADATA *meta);
+
+// Open, parse and compile one YAML case, NULL on failure
+METADATA *load_metadata(const char *path);
+
 // Print METADATA contents for debugging
 void print_metadata(METADATA *metadata);
 
+// Set one host_limits key, connections, in_flight, rate or burst, from its text
+int set_host_limit(HostLimits *hl, const char *key, const char *value);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,602 @@
+#include "replay.h"
+#include "log.h"
+#include "profile.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <yaml.h>
+
+// Headers curl derives from the URL and body, or that only described the recorded connection
+static const char *dropped_headers[] = {
+    "Host", "Content-Length", "Connection", "Keep-Alive", "Transfer-Encoding", "Expect", NULL
+};
+
+static const char *months[] = {
+    "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"
+};
+
+// State of one conversion pass
+typedef struct {
+    ReplayPlan *plan;
+    CURLU *target;   // Origin every request is sent to instead, NULL to keep their own
+    bool secure;
+    size_t skipped;  // Entries that could not be replayed
+} Builder;
+
+void free_replay(ReplayPlan *p) {
+    if (!p) return;
+    for (size_t i = 0; i < p->count; i++) {
+        free(p->entries[i].method);
+        free(p->entries[i].url);
+        curl_slist_free_all(p->entries[i].headers);
+        free(p->entries[i].body);
+    }
+    free(p->entries);
+    free_scenario(p->origins);
+    free(p);
+}
+
+double parse_speed(const char *s) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || v <= 0) return -1;
+    if (*end == 'x' || *end == 'X') end++;
+    return *end == '\0' ? v : -1;
+}
+
+// Case index of origin, added with its own METADATA the first time it is seen
+static int find_origin(Builder *b, const char *origin) {
+    Scenario *s = b->plan->origins;
+    for (int i = 0; i < s->count; i++) {
+        if (strcmp(s->cases[i].path, origin) == 0) return i;
+    }
+
+    ScenarioCase *temp = realloc(s->cases, (s->count + 1) * sizeof(ScenarioCase));
+    if (!temp) return -1;
+    s->cases = temp;
+    ScenarioCase *c = &s->cases[s->count];
+    c->path = strdup(origin);
+    c->md = init_metadata();
+    c->weight = 0;
+    c->unix_socket = NULL;
+    if (!c->path || !c->md) goto FAIL;
+
+    size_t len = strlen(origin) + 2;
+    free(c->md->url);
+    c->md->url = malloc(len);
+    if (!c->md->url) goto FAIL;
+    snprintf(c->md->url, len, "%s/", origin);
+    c->md->secure = b->secure;
+    if (compile_metadata(c->md)) goto FAIL;
+    return s->count++;
+
+FAIL:
+    free(c->path);
+    free_metadata(c->md);
+    return -1;
+}
+
+// Final URL of a recorded request and the origin it goes to. A bare path is resolved
+// against the target, a full URL keeps its path and query and takes the target's origin.
+static char *replay_url(Builder *b, const char *url, char **origin) {
+    CURLU *u = url[0] == '/' && b->target ? curl_url_dup(b->target) : curl_url();
+    char *scheme = NULL, *host = NULL, *port = NULL, *out = NULL;
+    *origin = NULL;
+    if (!u || curl_url_set(u, CURLUPART_URL, url, 0) != CURLUE_OK) goto DONE;
+
+    if (b->target && url[0] != '/') {
+        char *part = NULL;
+        curl_url_get(b->target, CURLUPART_SCHEME, &part, 0);
+        curl_url_set(u, CURLUPART_SCHEME, part, 0);
+        curl_free(part);
+        part = NULL;
+        curl_url_get(b->target, CURLUPART_HOST, &part, 0);
+        curl_url_set(u, CURLUPART_HOST, part, 0);
+        curl_free(part);
+        part = NULL;
+        // A target without a port clears the recorded one
+        curl_url_get(b->target, CURLUPART_PORT, &part, 0);
+        curl_url_set(u, CURLUPART_PORT, part, 0);
+        curl_free(part);
+    }
+
+    if (curl_url_get(u, CURLUPART_SCHEME, &scheme, 0) != CURLUE_OK ||
+        (strcasecmp(scheme, "http") != 0 && strcasecmp(scheme, "https") != 0) ||
+        curl_url_get(u, CURLUPART_HOST, &host, 0) != CURLUE_OK ||
+        curl_url_get(u, CURLUPART_PORT, &port, CURLU_DEFAULT_PORT) != CURLUE_OK ||
+        curl_url_get(u, CURLUPART_URL, &out, 0) != CURLUE_OK) {
+        goto DONE;
+    }
+    size_t len = strlen(scheme) + strlen(host) + strlen(port) + 5;
+    *origin = malloc(len);
+    if (*origin) snprintf(*origin, len, "%s://%s:%s", scheme, host, port);
+
+DONE:
+    curl_free(scheme);
+    curl_free(host);
+    curl_free(port);
+    curl_url_cleanup(u);
+    if (!*origin && out) {
+        curl_free(out);
+        out = NULL;
+    }
+    // Own the URL with the heap the plan frees it with
+    char *copy = out ? strdup(out) : NULL;
+    curl_free(out);
+    if (!copy) {
+        free(*origin);
+        *origin = NULL;
+    }
+    return copy;
+}
+
+// Add one request recorded at when, in seconds since the epoch. Takes over headers.
+static int add_entry(Builder *b, double when, const char *method, const char *url,
+                     struct curl_slist *headers, const char *body, size_t body_len) {
+    char *origin = NULL;
+    char *final = replay_url(b, url, &origin);
+    int o = final ? find_origin(b, origin) : -1;
+    free(origin);
+    if (o < 0) {
+        free(final);
+        curl_slist_free_all(headers);
+        b->skipped++;
+        return 0;
+    }
+
+    // Disable Expect: 100-continue like every other send
+    struct curl_slist *temp = curl_slist_append(headers, "Expect:");
+    if (!temp) goto FAIL;
+    headers = temp;
+
+    ReplayPlan *p = b->plan;
+    if (p->count == p->cap) {
+        size_t cap = p->cap ? p->cap * 2 : 1024;
+        ReplayEntry *entries = realloc(p->entries, cap * sizeof(ReplayEntry));
+        if (!entries) goto FAIL;
+        p->entries = entries;
+        p->cap = cap;
+    }
+    ReplayEntry *e = &p->entries[p->count];
+    memset(e, 0, sizeof(ReplayEntry));
+    e->at = when;
+    e->origin = o;
+    e->url = final;
+    e->headers = headers;
+    e->method = strdup(method);
+    for (char *m = e->method; m && *m; m++) *m = toupper((unsigned char)*m);
+    if (body && body_len > 0) {
+        e->body = malloc(body_len);
+        if (e->body) memcpy(e->body, body, body_len);
+        e->body_len = body_len;
+    }
+    if (!e->method || (body_len > 0 && !e->body)) {
+        free(e->method);
+        free(e->body);
+        e->headers = NULL;
+        e->url = NULL;
+        goto FAIL;
+    }
+    p->count++;
+    p->origins->cases[o].weight++;
+    return 0;
+
+FAIL:
+    free(final);
+    curl_slist_free_all(headers);
+    return -1;
+}
+
+static int keep_header(const char *name) {
+    if (name[0] == ':') return 0;  // HTTP/2 pseudo-headers
+    for (const char **h = dropped_headers; *h; h++) {
+        if (strcasecmp(name, *h) == 0) return 0;
+    }
+    return 1;
+}
+
+// Seconds since the epoch of an ISO 8601 time such as 2024-03-01T10:15:30.123+01:00, -1 if invalid
+static double parse_iso_time(const char *s) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    int used = 0;
+    if (sscanf(s, "%d-%d-%dT%d:%d:%d%n", &tm.tm_year, &tm.tm_mon, &tm.tm_mday,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &used) != 6) {
+        return -1;
+    }
+    tm.tm_year -= 1900;
+    tm.tm_mon -= 1;
+    double t = (double)timegm(&tm);
+
+    const char *p = s + used;
+    if (*p == '.') {
+        char *end = NULL;
+        t += strtod(p, &end);
+        p = end;
+    }
+    if ((*p == '+' || *p == '-') && isdigit((unsigned char)p[1]) && isdigit((unsigned char)p[2])) {
+        int sign = *p == '+' ? 1 : -1;
+        int offset = ((p[1] - '0') * 10 + (p[2] - '0')) * 3600;
+        p += 3;
+        if (*p == ':') p++;
+        if (isdigit((unsigned char)p[0]) && isdigit((unsigned char)p[1])) offset += ((p[0] - '0') * 10 + (p[1] - '0')) * 60;
+        t -= sign * offset;
+    }
+    return t;
+}
+
+// Consume the rest of a value whose first event is in event
+static int skip_value(yaml_parser_t *parser, yaml_event_t *event) {
+    int depth = 0;
+    while (1) {
+        if (event->type == YAML_MAPPING_START_EVENT || event->type == YAML_SEQUENCE_START_EVENT) depth++;
+        if (event->type == YAML_MAPPING_END_EVENT || event->type == YAML_SEQUENCE_END_EVENT) depth--;
+        yaml_event_delete(event);
+        if (depth <= 0) return 0;
+        if (!yaml_parser_parse(parser, event)) return -1;
+    }
+}
+
+// Next key of a mapping in *key, 0 at its end and -1 on errors
+static int next_key(yaml_parser_t *parser, char **key) {
+    yaml_event_t event;
+    *key = NULL;
+    if (!yaml_parser_parse(parser, &event)) return -1;
+    int rc = event.type == YAML_MAPPING_END_EVENT ? 0 : -1;
+    if (event.type == YAML_SCALAR_EVENT) {
+        *key = strdup((char *)event.data.scalar.value);
+        rc = *key ? 1 : -1;
+    }
+    yaml_event_delete(&event);
+    return rc;
+}
+
+// Value of a key as a string, NULL for anything else, which is skipped
+static int read_string(yaml_parser_t *parser, char **out) {
+    yaml_event_t event;
+    if (!yaml_parser_parse(parser, &event)) return -1;
+    if (event.type != YAML_SCALAR_EVENT) return skip_value(parser, &event);
+    free(*out);
+    *out = strdup((char *)event.data.scalar.value);
+    yaml_event_delete(&event);
+    return 0;
+}
+
+// Enter the value of a key when it starts with type, skip it otherwise; YAML_NO_EVENT skips any value.
+// Returns 1 when entered, 0 when skipped and -1 on errors.
+static int enter_value(yaml_parser_t *parser, yaml_event_type_t type) {
+    yaml_event_t event;
+    if (!yaml_parser_parse(parser, &event)) return -1;
+    if (event.type == type) {
+        yaml_event_delete(&event);
+        return 1;
+    }
+    return skip_value(parser, &event);
+}
+
+// request.headers: a sequence of {name, value}
+static int read_har_headers(yaml_parser_t *parser, struct curl_slist **headers) {
+    while (1) {
+        yaml_event_t event;
+        if (!yaml_parser_parse(parser, &event)) return -1;
+        yaml_event_type_t type = event.type;
+        if (type == YAML_SEQUENCE_END_EVENT) {
+            yaml_event_delete(&event);
+            return 0;
+        }
+        if (type != YAML_MAPPING_START_EVENT) {
+            if (skip_value(parser, &event)) return -1;
+            continue;
+        }
+        yaml_event_delete(&event);
+
+        char *key, *name = NULL, *value = NULL;
+        int rc;
+        while ((rc = next_key(parser, &key)) > 0) {
+            char **field = strcmp(key, "name") == 0 ? &name : strcmp(key, "value") == 0 ? &value : NULL;
+            rc = field ? read_string(parser, field) : enter_value(parser, YAML_NO_EVENT);
+            free(key);
+            if (rc < 0) break;
+        }
+        if (rc == 0 && name && value && keep_header(name)) {
+            size_t len = strlen(name) + strlen(value) + 3;
+            char *line = malloc(len);
+            struct curl_slist *temp = NULL;
+            if (line) {
+                snprintf(line, len, "%s: %s", name, value);
+                temp = curl_slist_append(*headers, line);
+            }
+            free(line);
+            if (temp) *headers = temp; else rc = -1;
+        }
+        free(name);
+        free(value);
+        if (rc < 0) return -1;
+    }
+}
+
+// One log.entries item
+static int read_har_entry(yaml_parser_t *parser, Builder *b) {
+    char *key, *started = NULL, *method = NULL, *url = NULL, *body = NULL;
+    struct curl_slist *headers = NULL;
+    int rc;
+    while ((rc = next_key(parser, &key)) > 0) {
+        if (strcmp(key, "startedDateTime") == 0) {
+            rc = read_string(parser, &started);
+        } else if (strcmp(key, "request") == 0) {
+            rc = enter_value(parser, YAML_MAPPING_START_EVENT);
+            char *field;
+            while (rc > 0 && (rc = next_key(parser, &field)) > 0) {
+                if (strcmp(field, "method") == 0) {
+                    rc = read_string(parser, &method);
+                } else if (strcmp(field, "url") == 0) {
+                    rc = read_string(parser, &url);
+                } else if (strcmp(field, "headers") == 0) {
+                    rc = enter_value(parser, YAML_SEQUENCE_START_EVENT);
+                    if (rc > 0) rc = read_har_headers(parser, &headers);
+                } else if (strcmp(field, "postData") == 0) {
+                    rc = enter_value(parser, YAML_MAPPING_START_EVENT);
+                    char *part;
+                    while (rc > 0 && (rc = next_key(parser, &part)) > 0) {
+                        rc = strcmp(part, "text") == 0 ? read_string(parser, &body) : enter_value(parser, YAML_NO_EVENT);
+                        free(part);
+                        if (rc == 0) rc = 1;
+                    }
+                } else {
+                    rc = enter_value(parser, YAML_NO_EVENT);
+                }
+                free(field);
+                if (rc == 0) rc = 1;
+            }
+        } else {
+            rc = enter_value(parser, YAML_NO_EVENT);
+        }
+        free(key);
+        if (rc < 0) break;
+    }
+
+    if (rc == 0) {
+        double when = started ? parse_iso_time(started) : -1;
+        if (when < 0 || !method || !url) {
+            curl_slist_free_all(headers);
+            b->skipped++;
+        } else {
+            rc = add_entry(b, when, method, url, headers, body, body ? strlen(body) : 0);
+        }
+    } else {
+        curl_slist_free_all(headers);
+    }
+    free(started);
+    free(method);
+    free(url);
+    free(body);
+    return rc;
+}
+
+// A HAR capture is JSON, which libyaml reads event by event without building a tree
+static int read_har(FILE *fp, Builder *b) {
+    yaml_parser_t parser;
+    if (!yaml_parser_initialize(&parser)) return -1;
+    yaml_parser_set_input_file(&parser, fp);
+
+    // Stream and document starts, then the top-level mapping
+    int rc = 0;
+    yaml_event_t event;
+    for (int i = 0; i < 2 && rc == 0; i++) {
+        if (!yaml_parser_parse(&parser, &event)) rc = -1; else yaml_event_delete(&event);
+    }
+    if (rc == 0) rc = enter_value(&parser, YAML_MAPPING_START_EVENT) > 0 ? 0 : -1;
+
+    char *key;
+    int found = 0;
+    while (rc == 0 && (rc = next_key(&parser, &key)) > 0) {
+        rc = enter_value(&parser, strcmp(key, "log") == 0 ? YAML_MAPPING_START_EVENT : YAML_NO_EVENT);
+        free(key);
+        char *field;
+        while (rc > 0 && (rc = next_key(&parser, &field)) > 0) {
+            int entries = strcmp(field, "entries") == 0;
+            rc = enter_value(&parser, entries ? YAML_SEQUENCE_START_EVENT : YAML_NO_EVENT);
+            free(field);
+            while (entries && rc > 0) {
+                found = 1;
+                if (!yaml_parser_parse(&parser, &event)) {
+                    rc = -1;
+                } else if (event.type == YAML_SEQUENCE_END_EVENT) {
+                    yaml_event_delete(&event);
+                    rc = 0;
+                } else if (event.type == YAML_MAPPING_START_EVENT) {
+                    yaml_event_delete(&event);
+                    rc = read_har_entry(&parser, b) ? -1 : 1;
+                } else {
+                    rc = skip_value(&parser, &event) ? -1 : 1;
+                }
+            }
+            if (rc == 0) rc = 1;
+        }
+    }
+    if (rc == 0 && parser.error != YAML_NO_ERROR) rc = -1;
+    if (rc < 0 && parser.problem) LOG_ERROR("Invalid HAR at line %zu: %s", parser.problem_mark.line + 1, parser.problem);
+    yaml_parser_delete(&parser);
+    if (rc == 0 && !found) {
+        LOG_ERROR("No log.entries in the HAR file");
+        rc = -1;
+    }
+    return rc;
+}
+
+// Time of an access log entry such as 10/Oct/2000:13:55:36 -0700, -1 if invalid
+static double parse_log_time(const char *s) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    char month[4];
+    char sign;
+    int zone;
+    if (sscanf(s, "%d/%3s/%d:%d:%d:%d %c%d", &tm.tm_mday, month, &tm.tm_year,
+               &tm.tm_hour, &tm.tm_min, &tm.tm_sec, &sign, &zone) != 8) {
+        return -1;
+    }
+    tm.tm_mon = -1;
+    for (int m = 0; m < 12; m++) {
+        if (strcmp(month, months[m]) == 0) tm.tm_mon = m;
+    }
+    if (tm.tm_mon < 0) return -1;
+    tm.tm_year -= 1900;
+    int offset = (zone / 100) * 3600 + (zone % 100) * 60;
+    return (double)timegm(&tm) - (sign == '-' ? -offset : offset);
+}
+
+// One line of the common or combined log format:
+// 10.0.0.1 - - [10/Oct/2000:13:55:36 -0700] "GET /goods?id=7 HTTP/1.1" 200 2326 "-" "curl/8.0"
+static int read_log_line(char *line, Builder *b) {
+    char *open = strchr(line, '[');
+    char *close = open ? strchr(open, ']') : NULL;
+    char *request = close ? strchr(close, '"') : NULL;
+    char *end = request ? strchr(request + 1, '"') : NULL;
+    if (!end) return -1;
+    *close = '\0';
+    *end = '\0';
+
+    double when = parse_log_time(open + 1);
+    char *save = NULL;
+    char *method = strtok_r(request + 1, " ", &save);
+    char *target = method ? strtok_r(NULL, " ", &save) : NULL;
+    if (when < 0 || !target || (target[0] != '/' && strncasecmp(target, "http", 4) != 0)) return -1;
+    return add_entry(b, when, method, target, NULL, NULL, 0) ? -2 : 0;
+}
+
+static int read_access_log(FILE *fp, Builder *b) {
+    char *line = NULL;
+    size_t cap = 0;
+    ssize_t len;
+    int rc = 0;
+    while (rc == 0 && (len = getline(&line, &cap, fp)) != -1) {
+        if (len <= 1) continue;
+        int lrc = read_log_line(line, b);
+        if (lrc == -1) b->skipped++;
+        if (lrc == -2) rc = -1;
+    }
+    free(line);
+    return rc;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    double x = ((const ReplayEntry *)a)->at;
+    double y = ((const ReplayEntry *)b)->at;
+    return (x > y) - (x < y);
+}
+
+ReplayPlan *load_replay(const char *path, const char *target, bool secure) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        LOG_ERROR("Failed to open %s", path);
+        return NULL;
+    }
+
+    Builder b = {0};
+    b.secure = secure;
+    b.plan = calloc(1, sizeof(ReplayPlan));
+    if (b.plan) b.plan->origins = calloc(1, sizeof(Scenario));
+    if (!b.plan || !b.plan->origins) {
+        free(b.plan);
+        fclose(fp);
+        return NULL;
+    }
+    if (target) {
+        b.target = curl_url();
+        if (!b.target || curl_url_set(b.target, CURLUPART_URL, target, 0) != CURLUE_OK) {
+            LOG_ERROR("Invalid --target %s, expected e.g. http://staging:8080", target);
+            goto FAIL;
+        }
+    }
+
+    // HAR files are JSON objects, anything else is read as an access log
+    int c;
+    while ((c = fgetc(fp)) != EOF && isspace(c)) {}
+    bool har = c == '{';
+    rewind(fp);
+    if (!har && !target) {
+        LOG_ERROR("Access logs hold no host, pass --target with the origin to replay against");
+        goto FAIL;
+    }
+    if ((har ? read_har(fp, &b) : read_access_log(fp, &b)) != 0) {
+        LOG_ERROR("Failed to read %s", path);
+        goto FAIL;
+    }
+
+    ReplayPlan *p = b.plan;
+    if (p->count == 0) {
+        LOG_ERROR("No requests to replay in %s", path);
+        goto FAIL;
+    }
+    qsort(p->entries, p->count, sizeof(ReplayEntry), compare_entries);
+    double first = p->entries[0].at;
+    for (size_t i = 0; i < p->count; i++) {
+        p->entries[i].at -= first;
+    }
+    // Access logs only have whole seconds, spread the requests of each second evenly across it
+    for (size_t i = 0; !har && i < p->count;) {
+        size_t j = i;
+        while (j < p->count && p->entries[j].at == p->entries[i].at) j++;
+        for (size_t k = i; k < j; k++) {
+            p->entries[k].at += (double)(k - i) / (j - i);
+        }
+        i = j;
+    }
+    p->span = p->entries[p->count - 1].at;
+    if (build_alias_table(p->origins)) goto FAIL;
+
+    LOG_INFO("Replay plan: %zu requests to %d origins over %.1f s from %s", p->count, p->origins->count, p->span, path);
+    if (b.skipped > 0) {
+        LOG_WARN("Skipped %zu entries that are not HTTP requests or could not be parsed", b.skipped);
+    }
+    curl_url_cleanup(b.target);
+    fclose(fp);
+    return p;
+
+FAIL:
+    curl_url_cleanup(b.target);
+    free_replay(b.plan);
+    fclose(fp);
+    return NULL;
+}
+
+int setup_replay_transfer(Transfer *t, const ReplayEntry *e, const METADATA *origin) {
+    uint64_t start = prof_ticks();
+    CURL *curl = t->curl;
+    memset(&t->resp, 0, sizeof(Response));
+    t->md = (METADATA *)origin;
+    t->url = e->url;
+
+    curl_easy_setopt(curl, CURLOPT_URL, e->url);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, origin->timeout);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, t);
+    if (!origin->secure) {
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+        curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+    }
+
+    // The recorded headers are shared by every send, curl only reads them
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, e->headers);
+
+    bool upload = e->body || strcmp(e->method, "POST") == 0 || strcmp(e->method, "PUT") == 0 ||
+                  strcmp(e->method, "PATCH") == 0;
+    if (strcmp(e->method, "HEAD") == 0) {
+        curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+    } else if (upload) {
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDS, e->body ? e->body : "");
+        curl_easy_setopt(curl, CURLOPT_POSTFIELDSIZE_LARGE, (curl_off_t)e->body_len);
+        if (strcmp(e->method, "POST") != 0) curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, e->method);
+    } else if (strcmp(e->method, "GET") == 0) {
+        curl_easy_setopt(curl, CURLOPT_HTTPGET, 1L);
+    } else {
+        curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, e->method);
+    }
+
+    set_response_handlers(t);
+    prof_end(PROF_BUILD, start);
+    return 0;
+}
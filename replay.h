@@ -0,0 +1,41 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "easy_curl.h"
+#include "scenario.h"
+#include <curl/curl.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// One recorded request, ready to be sent again
+typedef struct {
+    double at;                    // Seconds after the first request of the capture
+    int origin;                   // Case of the plan's origins it is reported under
+    char *method;
+    char *url;
+    struct curl_slist *headers;   // Recorded request headers, NULL for none
+    char *body;                   // Recorded request body, NULL for none
+    size_t body_len;
+} ReplayEntry;
+
+typedef struct {
+    ReplayEntry *entries;         // Sorted by time
+    size_t count;
+    size_t cap;
+    Scenario *origins;            // One case per scheme://host:port, named after it
+    double span;                  // Seconds from the first to the last request
+} ReplayPlan;
+
+// Convert a HAR capture or an access log (common or combined format) into a plan in one
+// streaming pass. target, when set, replaces the scheme, host and port of every request;
+// access logs hold no host, so they need one. secure verifies TLS like a case's secure:.
+ReplayPlan *load_replay(const char *path, const char *target, bool secure);
+void free_replay(ReplayPlan *p);
+
+// Parse a replay speed such as 2x, 0.5x or 5, -1 if invalid
+double parse_speed(const char *s);
+
+// Configure t->curl to send e again, with the timeout and TLS settings of its origin
+int setup_replay_transfer(Transfer *t, const ReplayEntry *e, const METADATA *origin);
+
+#endif
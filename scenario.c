@@ -0,0 +1,333 @@
+#include "scenario.h"
+#include "cache.h"
+#include "log.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <yaml.h>
+
+// Consume one value, including everything nested inside it
+static int skip_node(yaml_parser_t *parser) {
+    yaml_event_t event;
+    int depth = 0;
+    do {
+        if (!yaml_parser_parse(parser, &event)) return -1;
+        if (event.type == YAML_MAPPING_START_EVENT || event.type == YAML_SEQUENCE_START_EVENT) depth++;
+        if (event.type == YAML_MAPPING_END_EVENT || event.type == YAML_SEQUENCE_END_EVENT) depth--;
+        yaml_event_delete(&event);
+    } while (depth > 0);
+    return 0;
+}
+
+static int add_case(Scenario *s, const char *base, const char *file, const char *weight, const char *unix_socket) {
+    char *end = NULL;
+    double w = weight ? strtod(weight, &end) : 1.0;
+    if (weight && (end == weight || *end != '\0' || w < 0)) {
+        LOG_ERROR("Invalid weight for %s: %s", file, weight);
+        return -1;
+    }
+
+    ScenarioCase *temp = realloc(s->cases, (s->count + 1) * sizeof(ScenarioCase));
+    if (!temp) return -1;
+    s->cases = temp;
+    ScenarioCase *c = &s->cases[s->count];
+
+    // Case paths are relative to the scenario file
+    if (file[0] == '/' || !base) {
+        c->path = strdup(file);
+    } else {
+        size_t len = strlen(base) + strlen(file) + 2;
+        c->path = malloc(len);
+        if (c->path) snprintf(c->path, len, "%s/%s", base, file);
+    }
+    if (!c->path) return -1;
+    c->md = NULL;
+    c->weight = w;
+    c->unix_socket = unix_socket ? strdup(unix_socket) : NULL;
+    s->count++;
+    return unix_socket && !c->unix_socket ? -1 : 0;
+}
+
+// Parse one sequence entry: {case: file, weight: n, unix_socket: path}
+static int parse_entry(yaml_parser_t *parser, Scenario *s, const char *base) {
+    yaml_event_t event;
+    char *file = NULL;
+    char *weight = NULL;
+    char *unix_socket = NULL;
+    int failed = 0;
+
+    while (1) {
+        if (!yaml_parser_parse(parser, &event)) {
+            failed = 1;
+            break;
+        }
+        if (event.type == YAML_MAPPING_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        if (event.type != YAML_SCALAR_EVENT) {
+            yaml_event_delete(&event);
+            failed = 1;
+            break;
+        }
+        char *key = strdup((char*)event.data.scalar.value);
+        yaml_event_delete(&event);
+        if (!key || !yaml_parser_parse(parser, &event)) {
+            free(key);
+            failed = 1;
+            break;
+        }
+        if (event.type == YAML_SCALAR_EVENT) {
+            char **field = strcmp(key, "case") == 0 ? &file : strcmp(key, "weight") == 0 ? &weight
+                         : strcmp(key, "unix_socket") == 0 ? &unix_socket : NULL;
+            if (field) {
+                free(*field);
+                *field = strdup((char*)event.data.scalar.value);
+            }
+        }
+        yaml_event_delete(&event);
+        free(key);
+    }
+
+    if (!failed && !file) {
+        LOG_ERROR("Scenario entry is missing a case");
+        failed = 1;
+    }
+    // none sends the case over TCP even when its YAML names a socket
+    if (!failed && unix_socket && strcmp(unix_socket, "none") != 0 &&
+        (unix_socket[0] == '\0' || strlen(unix_socket) > 107)) {
+        LOG_ERROR("unix_socket of %s must be none or a path of 1 to 107 bytes", file);
+        failed = 1;
+    }
+    if (!failed && add_case(s, base, file, weight, unix_socket && strcmp(unix_socket, "none") == 0 ? "" : unix_socket)) {
+        failed = 1;
+    }
+    free(file);
+    free(weight);
+    free(unix_socket);
+    return failed ? -1 : 0;
+}
+
+// Parse the scenario key: a list of {case, weight} entries or a file: weight mapping
+static int parse_cases(yaml_parser_t *parser, Scenario *s, const char *base) {
+    yaml_event_t event;
+    if (!yaml_parser_parse(parser, &event)) return -1;
+    yaml_event_type_t type = event.type;
+    yaml_event_delete(&event);
+
+    if (type == YAML_SEQUENCE_START_EVENT) {
+        while (1) {
+            if (!yaml_parser_parse(parser, &event)) return -1;
+            yaml_event_type_t t = event.type;
+            if (t == YAML_SEQUENCE_END_EVENT) {
+                yaml_event_delete(&event);
+                return 0;
+            }
+            if (t == YAML_SCALAR_EVENT) {
+                int rc = add_case(s, base, (char*)event.data.scalar.value, NULL, NULL);
+                yaml_event_delete(&event);
+                if (rc) return -1;
+                continue;
+            }
+            yaml_event_delete(&event);
+            if (t != YAML_MAPPING_START_EVENT || parse_entry(parser, s, base)) return -1;
+        }
+    }
+
+    if (type == YAML_MAPPING_START_EVENT) {
+        while (1) {
+            if (!yaml_parser_parse(parser, &event)) return -1;
+            if (event.type == YAML_MAPPING_END_EVENT) {
+                yaml_event_delete(&event);
+                return 0;
+            }
+            if (event.type != YAML_SCALAR_EVENT) {
+                yaml_event_delete(&event);
+                return -1;
+            }
+            char *file = strdup((char*)event.data.scalar.value);
+            yaml_event_delete(&event);
+            if (!file || !yaml_parser_parse(parser, &event)) {
+                free(file);
+                return -1;
+            }
+            int rc = event.type == YAML_SCALAR_EVENT
+                         ? add_case(s, base, file, (char*)event.data.scalar.value, NULL)
+                         : -1;
+            yaml_event_delete(&event);
+            free(file);
+            if (rc) return -1;
+        }
+    }
+
+    LOG_ERROR("scenario must be a list or a mapping of cases to weights");
+    return -1;
+}
+
+// Send an entry's case over its own transport, and name it after the transport so the same
+// case can be compared over TCP and a Unix socket in one run
+static int override_socket(ScenarioCase *c) {
+    METADATA *md = c->md;
+    free(md->unix_socket);
+    md->unix_socket = c->unix_socket[0] ? strdup(c->unix_socket) : NULL;
+    size_t len = strlen(c->path) + strlen(c->unix_socket) + 16;
+    char *name = malloc(len);
+    if (!name || (c->unix_socket[0] && !md->unix_socket)) {
+        free(name);
+        return -1;
+    }
+    snprintf(name, len, "%s via %s", c->path, c->unix_socket[0] ? c->unix_socket : "tcp");
+    free(c->path);
+    c->path = name;
+    return 0;
+}
+
+Scenario *load_scenario(const char *path, const char *cache_dir) {
+    FILE *fp = fopen(path, "r");
+    if (!fp) {
+        LOG_ERROR("Failed to open %s", path);
+        return NULL;
+    }
+    Scenario *s = calloc(1, sizeof(Scenario));
+    if (!s) {
+        fclose(fp);
+        return NULL;
+    }
+
+    const char *slash = strrchr(path, '/');
+    char *base = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : NULL;
+
+    yaml_parser_t parser;
+    yaml_event_t event;
+    yaml_parser_initialize(&parser);
+    yaml_parser_set_input_file(&parser, fp);
+
+    // Find the top-level mapping, then look for the scenario key; other keys are skipped
+    int failed = 0;
+    int found = 0;
+    while (!failed) {
+        if (!yaml_parser_parse(&parser, &event)) {
+            failed = 1;
+            break;
+        }
+        yaml_event_type_t type = event.type;
+        yaml_event_delete(&event);
+        if (type == YAML_MAPPING_START_EVENT) break;
+        if (type == YAML_STREAM_END_EVENT) failed = 1;
+    }
+    while (!failed) {
+        if (!yaml_parser_parse(&parser, &event)) {
+            failed = 1;
+            break;
+        }
+        if (event.type == YAML_MAPPING_END_EVENT) {
+            yaml_event_delete(&event);
+            break;
+        }
+        int is_scenario = event.type == YAML_SCALAR_EVENT &&
+                          strcmp((char*)event.data.scalar.value, "scenario") == 0;
+        yaml_event_delete(&event);
+        if (is_scenario) {
+            found = 1;
+            if (parse_cases(&parser, s, base)) failed = 1;
+        } else if (skip_node(&parser)) {
+            failed = 1;
+        }
+    }
+    if (failed && parser.problem) {
+        LOG_ERROR("YAML parse error in %s: %s", path, parser.problem);
+    } else if (!failed && !found) {
+        LOG_ERROR("%s has no scenario key", path);
+        failed = 1;
+    }
+    yaml_parser_delete(&parser);
+    fclose(fp);
+    free(base);
+
+    if (!failed && s->count == 0) {
+        LOG_ERROR("Scenario %s lists no cases", path);
+        failed = 1;
+    }
+    for (int i = 0; i < s->count && !failed; i++) {
+        s->cases[i].md = load_cached_metadata(s->cases[i].path, cache_dir);
+        if (!s->cases[i].md || (s->cases[i].unix_socket && override_socket(&s->cases[i]))) failed = 1;
+    }
+    if (!failed && build_alias_table(s)) failed = 1;
+    if (failed) {
+        free_scenario(s);
+        return NULL;
+    }
+    return s;
+}
+
+void free_scenario(Scenario *s) {
+    if (!s) return;
+    for (int i = 0; i < s->count; i++) {
+        free(s->cases[i].path);
+        free(s->cases[i].unix_socket);
+        free_metadata(s->cases[i].md);
+    }
+    free(s->cases);
+    free(s->prob);
+    free(s->alias);
+    free(s);
+}
+
+// Vose's alias method: split every column into at most two cases
+int build_alias_table(Scenario *s) {
+    int n = s->count;
+    double sum = 0;
+    for (int i = 0; i < n; i++) sum += s->cases[i].weight;
+    if (n == 0 || sum <= 0) {
+        LOG_ERROR("Scenario weights must add up to more than 0");
+        return -1;
+    }
+    for (int i = 0; i < n; i++) s->cases[i].weight /= sum;
+
+    free(s->prob);
+    free(s->alias);
+    s->prob = malloc(n * sizeof(uint32_t));
+    s->alias = malloc(n * sizeof(int));
+    double *scaled = malloc(n * sizeof(double));
+    int *small = malloc(n * sizeof(int));
+    int *large = malloc(n * sizeof(int));
+    if (!s->prob || !s->alias || !scaled || !small || !large) {
+        free(scaled);
+        free(small);
+        free(large);
+        return -1;
+    }
+
+    int ns = 0, nl = 0;
+    for (int i = 0; i < n; i++) {
+        scaled[i] = s->cases[i].weight * n;
+        if (scaled[i] < 1.0) small[ns++] = i; else large[nl++] = i;
+    }
+    while (ns > 0 && nl > 0) {
+        int lo = small[--ns];
+        int hi = large[nl - 1];
+        s->prob[lo] = (uint32_t)(scaled[lo] * 4294967296.0);
+        s->alias[lo] = hi;
+        scaled[hi] -= 1.0 - scaled[lo];
+        if (scaled[hi] < 1.0) {
+            nl--;
+            small[ns++] = hi;
+        }
+    }
+    // Whatever is left is full up to rounding and always keeps its own case
+    while (nl > 0) {
+        int i = large[--nl];
+        s->prob[i] = UINT32_MAX;
+        s->alias[i] = i;
+    }
+    while (ns > 0) {
+        int i = small[--ns];
+        s->prob[i] = UINT32_MAX;
+        s->alias[i] = i;
+    }
+
+    free(scaled);
+    free(small);
+    free(large);
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef SCENARIO_H
+#define SCENARIO_H
+
+#include "read_yaml.h"
+#include <stdint.h>
+
+typedef struct {
+    char *path;      // Case file, relative paths resolved against the scenario file
+    METADATA *md;
+    double weight;   // Share of requests, normalized so the weights sum to 1
+    char *unix_socket;  // Entry's override of the case's unix_socket, "" for TCP, NULL for none
+} ScenarioCase;
+
+// Weighted mix of cases, sampled in O(1) through an alias table
+typedef struct {
+    ScenarioCase *cases;
+    int count;
+    uint32_t *prob;  // Column i keeps case i when the low 32 random bits are below prob[i]
+    int *alias;      // ...and falls through to alias[i] otherwise
+} Scenario;
+
+// Parse a scenario file and load every case it references, NULL on failure
+Scenario *load_scenario(const char *path, const char *cache_dir);
+void free_scenario(Scenario *s);
+
+// Normalize the weights and build the alias table
+int build_alias_table(Scenario *s);
+
+// Pick a case index from one 64-bit random number
+static inline int pick_case(const Scenario *s, uint64_t r) {
+    if (s->count <= 1) return 0;
+    int i = (int)(((r >> 32) * (uint64_t)s->count) >> 32);
+    return (uint32_t)r < s->prob[i] ? i : s->alias[i];
+}
+
+#endif
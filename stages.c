@@ -0,0 +1,86 @@
+#include "stages.h"
+#include "log.h"
+#include <stdlib.h>
+#include <string.h>
+
+double parse_duration(const char *s) {
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    if (*end == '\0' || strcmp(end, "s") == 0) return v;
+    if (strcmp(end, "ms") == 0) return v / 1000;
+    if (strcmp(end, "m") == 0) return v * 60;
+    if (strcmp(end, "h") == 0) return v * 3600;
+    return -1;
+}
+
+int parse_stages(const char *s, Stage **stages, int *count) {
+    char *copy = strdup(s);
+    if (!copy) return -1;
+
+    Stage *list = NULL;
+    int n = 0;
+    int failed = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(copy, ",", &save); tok; tok = strtok_r(NULL, ",", &save)) {
+        char *colon = strchr(tok, ':');
+        char *end = NULL;
+        if (colon) *colon = '\0';
+        double duration = parse_duration(tok);
+        long target = colon ? strtol(colon + 1, &end, 10) : -1;
+        if (!colon || duration < 0 || end == colon + 1 || *end != '\0' || target < 0) {
+            LOG_ERROR("Invalid stage \"%s%s%s\", expected duration:users", tok, colon ? ":" : "", colon ? colon + 1 : "");
+            failed = 1;
+            break;
+        }
+        Stage *temp = realloc(list, (n + 1) * sizeof(Stage));
+        if (!temp) {
+            failed = 1;
+            break;
+        }
+        list = temp;
+        list[n].duration = duration;
+        list[n].target = (int)target;
+        n++;
+    }
+    free(copy);
+
+    if (failed || n == 0) {
+        free(list);
+        return -1;
+    }
+    *stages = list;
+    *count = n;
+    return 0;
+}
+
+double stages_duration(const Stage *stages, int count) {
+    double total = 0;
+    for (int i = 0; i < count; i++) total += stages[i].duration;
+    return total;
+}
+
+int stages_peak(const Stage *stages, int count) {
+    int peak = 0;
+    for (int i = 0; i < count; i++) {
+        if (stages[i].target > peak) peak = stages[i].target;
+    }
+    return peak;
+}
+
+double stage_target(const Stage *stages, int count, double t, int *stage) {
+    double from = 0;
+    double start = 0;
+    for (int i = 0; i < count; i++) {
+        double end = start + stages[i].duration;
+        if (t < end) {
+            if (stage) *stage = i;
+            double f = stages[i].duration > 0 ? (t - start) / stages[i].duration : 1;
+            return from + (stages[i].target - from) * f;
+        }
+        from = stages[i].target;
+        start = end;
+    }
+    if (stage) *stage = count - 1;
+    return from;
+}
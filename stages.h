@@ -0,0 +1,25 @@
+#ifndef STAGES_H
+#define STAGES_H
+
+// One step of a load profile: move linearly from the previous target to this one
+typedef struct {
+    double duration;  // Seconds
+    int target;       // Concurrent users at the end of the stage
+} Stage;
+
+// Parse a duration such as 500ms, 30s, 5m, 1h or a plain number of seconds, -1 if invalid
+double parse_duration(const char *s);
+
+// Parse a stage list such as "30s:100,5m:1000,30s:0" into a new array, -1 if invalid
+int parse_stages(const char *s, Stage **stages, int *count);
+
+// Total length of a profile in seconds
+double stages_duration(const Stage *stages, int count);
+
+// Highest target of a profile
+int stages_peak(const Stage *stages, int count);
+
+// Target users at t seconds into the profile; stage receives the index of the current stage
+double stage_target(const Stage *stages, int count, double t, int *stage);
+
+#endif
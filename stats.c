@@ -0,0 +1,71 @@
+#include "stats.h"
+#include "log.h"
+#include <math.h>
+#include <string.h>
+
+void init_stats(Stats *s) {
+    memset(s, 0, sizeof(Stats));
+    s->min_us = INFINITY;
+}
+
+static int bucket_index(double us) {
+    if (us <= 1.0) return 0;
+    int i = (int)ceil(log(us) / log(STATS_GAMMA));
+    return i < STATS_BUCKETS ? i : STATS_BUCKETS - 1;
+}
+
+// Midpoint of a bucket, so the estimate is within (gamma - 1) / 2 of any value in it
+static double bucket_value(int i) {
+    return 2.0 * pow(STATS_GAMMA, i) / (STATS_GAMMA + 1.0);
+}
+
+void record_latency(Stats *s, double us) {
+    s->count++;
+    s->total_us += us;
+    if (us < s->min_us) s->min_us = us;
+    if (us > s->max_us) s->max_us = us;
+    s->buckets[bucket_index(us)]++;
+}
+
+void merge_stats(Stats *dst, const Stats *src) {
+    dst->count += src->count;
+    dst->failures += src->failures;
+    dst->http_errors += src->http_errors;
+    dst->bytes += src->bytes;
+    dst->total_us += src->total_us;
+    if (src->min_us < dst->min_us) dst->min_us = src->min_us;
+    if (src->max_us > dst->max_us) dst->max_us = src->max_us;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        dst->buckets[i] += src->buckets[i];
+    }
+}
+
+double stats_quantile(const Stats *s, double q) {
+    if (s->count == 0) return 0;
+
+    uint64_t rank = (uint64_t)ceil(q * s->count);
+    if (rank == 0) rank = 1;
+    uint64_t seen = 0;
+    for (int i = 0; i < STATS_BUCKETS; i++) {
+        seen += s->buckets[i];
+        if (seen >= rank) {
+            double v = bucket_value(i);
+            return v < s->min_us ? s->min_us : v > s->max_us ? s->max_us : v;
+        }
+    }
+    return s->max_us;
+}
+
+void print_stats(const Stats *s, double elapsed) {
+    uint64_t total = s->count + s->failures;
+    LOG_INFO("Requests: %llu (failed %llu, HTTP >= 400: %llu)",
+             (unsigned long long)total, (unsigned long long)s->failures,
+             (unsigned long long)s->http_errors);
+    LOG_INFO("Duration: %.2f s, %.1f req/s, %.2f MB received",
+             elapsed, elapsed > 0 ? total / elapsed : 0.0, s->bytes / 1e6);
+    if (s->count == 0) return;
+    LOG_INFO("Latency (ms): min %.2f  mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f",
+             s->min_us / 1000, s->total_us / s->count / 1000,
+             stats_quantile(s, 0.50) / 1000, stats_quantile(s, 0.90) / 1000,
+             stats_quantile(s, 0.99) / 1000, s->max_us / 1000);
+}
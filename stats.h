@@ -0,0 +1,35 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+
+// Log-bucketed latency histogram, ~1% relative error from 1us to 1000s
+#define STATS_GAMMA 1.02
+#define STATS_BUCKETS 1048
+
+typedef struct {
+    uint64_t count;        // Completed responses
+    uint64_t failures;     // Transfers that failed at the transport level
+    uint64_t http_errors;  // Responses with a status >= 400
+    uint64_t bytes;        // Response bytes received
+    double total_us;
+    double min_us;
+    double max_us;
+    uint32_t buckets[STATS_BUCKETS];
+} Stats;
+
+void init_stats(Stats *s);
+
+// Record the latency of one completed response in microseconds
+void record_latency(Stats *s, double us);
+
+// Fold src into dst; histograms from different threads merge exactly
+void merge_stats(Stats *dst, const Stats *src);
+
+// Estimate the q-quantile (0..1) latency in microseconds
+double stats_quantile(const Stats *s, double q);
+
+// Log a summary of s over elapsed seconds
+void print_stats(const Stats *s, double elapsed);
+
+#endif
@@ -0,0 +1,954 @@
+#include "stream.h"
+#include "easy_curl.h"
+#include "log.h"
+#include "profile.h"
+#include "stats.h"
+#include "timeseries.h"
+#include "utils.h"
+#include <curl/curl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+// Bytes of a line or message kept for the timestamp search; the rest is only counted
+#define SCAN_MAX 4096
+// Payload limit of WebSocket control frames
+#define CONTROL_MAX 125
+// Queued bytes past which a connection skips its sends until it drains
+#define SEND_BACKLOG (64 * 1024)
+#define RECV_CHUNK 16384
+// Seconds before a closed or failed stream is opened again, unless the server set a retry
+#define RETRY_DEFAULT 1.0
+#define DEFAULT_DURATION 10.0
+
+typedef enum {
+    CONN_IDLE,        // Waiting for retry_at to open
+    CONN_CONNECTING,  // Request or TCP and TLS connect in progress
+    CONN_HANDSHAKE,   // WebSocket: upgrade request sent, waiting for 101
+    CONN_OPEN,
+    CONN_DONE         // Closed for good
+} ConnState;
+
+// Where the WebSocket frame parser is
+typedef enum {
+    FRAME_HEADER,
+    FRAME_PAYLOAD
+} FrameState;
+
+typedef struct StreamBench StreamBench;
+
+typedef struct {
+    Transfer t;             // First, so CURLINFO_PRIVATE leads back to the connection
+    StreamBench *bench;
+    int index;
+    ConnState state;
+    bool in_multi;
+    double opened;          // When the stream opened
+    double retry_at;        // When to open it again while idle
+    double retry;           // SSE: reconnection delay set by the server, 0 for the default
+    double next_send;       // WebSocket: when the next message is due
+    bool rejected;          // SSE: the response was not a 200 event stream
+    char last_id[256];      // SSE: last event ID, sent back on reconnect
+
+    // Current line of an SSE stream, or the WebSocket handshake response, then the current message
+    char scan[SCAN_MAX + 1];
+    size_t scan_len;
+    bool last_cr;           // SSE: the previous chunk ended in \r, so a leading \n is part of it
+    bool has_data;          // SSE: the pending event carries data
+    double event_ts;        // Send time found in the pending event or message, 0 for none
+
+    // WebSocket
+    curl_socket_t sock;
+    FrameState frame;
+    unsigned char header[14];
+    size_t header_len;
+    uint64_t payload_left;
+    unsigned char opcode;   // Of the frame being read
+    unsigned char message_op;  // Of the message being assembled from fragments, 0 outside one
+    bool fin;
+    unsigned char mask[4];
+    bool masked;
+    uint64_t mask_pos;
+    unsigned char control[CONTROL_MAX];
+    size_t control_len;
+    char *out;              // Frames waiting for the socket to take them
+    size_t out_len;
+    size_t out_sent;
+    size_t out_cap;
+} StreamConn;
+
+struct StreamBench {
+    METADATA *md;
+    const Stream *st;
+    CURLM *multi;
+    StreamConn *conns;
+    int count;
+    char *field;            // "timestamp" with its quotes
+    size_t field_len;
+    uint64_t rng;
+    Stats stats;            // Latency of every timestamped message
+    Series series;
+    double start;
+    double compacted;
+
+    uint64_t messages;
+    uint64_t untimed;       // Messages without a timestamp
+    uint64_t skewed;        // Timestamps ahead of this clock
+    uint64_t sent;
+    uint64_t skipped;       // Sends dropped while the connection was backlogged
+    uint64_t opened;
+    uint64_t failed;        // Attempts that never opened a stream
+    uint64_t closed;        // Open streams the server or network ended
+    uint64_t reconnects;
+    double lifetime;        // Seconds the closed streams were open
+    char error[CURL_ERROR_SIZE];  // First failure, logged in the summary
+};
+
+// Wall clock in seconds since the epoch, the clock message timestamps come from
+static double epoch_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Keep the first failure's reason for the summary; later ones are only counted
+static void note_error(StreamBench *b, const char *fmt, ...) {
+    if (b->error[0]) return;
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(b->error, sizeof(b->error), fmt, args);
+    va_end(args);
+}
+
+// Read an epoch time in s, ms, us or ns, told apart by magnitude
+static double epoch_from(double v) {
+    if (v > 1e17) return v / 1e9;
+    if (v > 1e14) return v / 1e6;
+    if (v > 1e11) return v / 1e3;
+    return v;
+}
+
+// Send time in a message: the number after "field": or the whole message if it is a number.
+// Returns 0 when there is none. text must be NUL-terminated.
+static double message_time(const StreamBench *b, const char *text, size_t len) {
+    char *end;
+    const char *p = text;
+    while (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r') p++;
+    double v = strtod(p, &end);
+    if (end != p) {
+        while (*end == ' ' || *end == '\t' || *end == '\n' || *end == '\r') end++;
+        if (*end == '\0' && v > 0) return epoch_from(v);
+    }
+
+    const char *hit = text;
+    while ((hit = strstr(hit, b->field)) != NULL && hit < text + len) {
+        p = hit + b->field_len;
+        while (*p == ' ' || *p == '\t') p++;
+        if (*p == ':') {
+            p++;
+            while (*p == ' ' || *p == '\t') p++;
+            if (*p == '"') p++;  // Numbers sent as strings
+            v = strtod(p, &end);
+            if (end != p && v > 0) return epoch_from(v);
+        }
+        hit++;
+    }
+    return 0;
+}
+
+// Count bytes received on any stream against the test and the current second
+static void count_bytes(StreamBench *b, size_t len) {
+    b->stats.bytes += len;
+    Stats *win = series_window(&b->series, now_seconds() - b->start);
+    if (win) win->bytes += len;
+}
+
+// Count one received message and time it from its embedded send time; every message counts in
+// the rate of its second, timed or not
+static void count_message(StreamBench *b, double ts) {
+    Window *win = series_slot(&b->series, now_seconds() - b->start);
+    b->messages++;
+    double us = ts > 0 ? (epoch_seconds() - ts) * 1e6 : 0;
+    if (ts <= 0) {
+        b->untimed++;
+    } else if (us < 0) {
+        b->skewed++;
+    } else {
+        record_latency(&b->stats, us);
+        if (win) record_latency(&win->stats, us);
+        return;
+    }
+    if (win) win->untimed++;
+}
+
+// Keep up to SCAN_MAX bytes of the current line or message
+static void scan_append(StreamConn *c, const char *data, size_t len) {
+    size_t room = SCAN_MAX - c->scan_len;
+    if (len > room) len = room;
+    memcpy(c->scan + c->scan_len, data, len);
+    c->scan_len += len;
+}
+
+static void scan_reset(StreamConn *c) {
+    c->scan_len = 0;
+}
+
+// Count a stream closed by the server or failed to open in the churn of the current second
+static void count_churn(StreamBench *b) {
+    Window *win = series_slot(&b->series, now_seconds() - b->start);
+    if (win) win->churn++;
+}
+
+// Count an attempt that never opened a stream
+static void count_failed_open(StreamBench *b) {
+    b->failed++;
+    count_churn(b);
+}
+
+// Act on one complete line of the event stream
+static void sse_line(StreamConn *c) {
+    StreamBench *b = c->bench;
+    c->scan[c->scan_len] = '\0';
+    if (c->scan_len == 0) {
+        // A blank line dispatches the event, if it had data
+        if (c->has_data) count_message(b, c->event_ts);
+        c->has_data = false;
+        c->event_ts = 0;
+        return;
+    }
+    if (c->scan[0] == ':') return;  // Comment, often a keep-alive
+
+    char *value = memchr(c->scan, ':', c->scan_len);
+    size_t name_len = value ? (size_t)(value - c->scan) : c->scan_len;
+    if (value) {
+        value++;
+        if (*value == ' ') value++;
+    } else {
+        value = c->scan + c->scan_len;
+    }
+    if (name_len == 4 && memcmp(c->scan, "data", 4) == 0) {
+        c->has_data = true;
+        if (c->event_ts == 0) c->event_ts = message_time(b, value, c->scan + c->scan_len - value);
+    } else if (name_len == 2 && memcmp(c->scan, "id", 2) == 0) {
+        snprintf(c->last_id, sizeof(c->last_id), "%s", value);
+    } else if (name_len == 5 && memcmp(c->scan, "retry", 5) == 0) {
+        char *end;
+        long ms = strtol(value, &end, 10);
+        if (end != value && *end == '\0' && ms >= 0) c->retry = ms / 1000.0;
+    }
+}
+
+// Split the stream into lines on \n, \r\n or \r as it arrives
+static size_t sse_callback(char *data, size_t size, size_t nmemb, void *userp) {
+    uint64_t start = prof_ticks();
+    StreamConn *c = (StreamConn *)userp;
+    StreamBench *b = c->bench;
+    size_t len = size * nmemb;
+    if (c->state == CONN_CONNECTING) {
+        long code = 0;
+        char *type = NULL;
+        curl_easy_getinfo(c->t.curl, CURLINFO_RESPONSE_CODE, &code);
+        curl_easy_getinfo(c->t.curl, CURLINFO_CONTENT_TYPE, &type);
+        if (code != 200 || !type || strncasecmp(type, "text/event-stream", 17) != 0) {
+            c->rejected = true;
+            if (code != 200) {
+                note_error(b, "HTTP %ld", code);
+            } else {
+                note_error(b, "Content-Type %s instead of text/event-stream", type ? type : "(none)");
+            }
+            return 0;
+        }
+        c->state = CONN_OPEN;
+        c->opened = now_seconds();
+        b->opened++;
+    }
+    count_bytes(b, len);
+
+    size_t i = 0;
+    if (c->last_cr && len > 0 && data[0] == '\n') i = 1;
+    c->last_cr = false;
+    while (i < len) {
+        const char *p = data + i;
+        size_t n = len - i;
+        size_t eol = 0;
+        while (eol < n && p[eol] != '\n' && p[eol] != '\r') eol++;
+        scan_append(c, p, eol);
+        if (eol == n) break;  // The line continues in the next chunk
+
+        sse_line(c);
+        scan_reset(c);
+        i += eol + 1;
+        if (p[eol] == '\r') {
+            if (i < len && data[i] == '\n') {
+                i++;
+            } else if (i == len) {
+                c->last_cr = true;
+            }
+        }
+    }
+    prof_end(PROF_BODY, start);
+    return len;
+}
+
+static const char base64_chars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static void base64_encode(const unsigned char *in, size_t len, char *out) {
+    size_t i;
+    for (i = 0; i + 2 < len; i += 3) {
+        *out++ = base64_chars[in[i] >> 2];
+        *out++ = base64_chars[((in[i] & 3) << 4) | (in[i + 1] >> 4)];
+        *out++ = base64_chars[((in[i + 1] & 15) << 2) | (in[i + 2] >> 6)];
+        *out++ = base64_chars[in[i + 2] & 63];
+    }
+    if (i < len) {
+        *out++ = base64_chars[in[i] >> 2];
+        if (i + 1 < len) {
+            *out++ = base64_chars[((in[i] & 3) << 4) | (in[i + 1] >> 4)];
+            *out++ = base64_chars[(in[i + 1] & 15) << 2];
+        } else {
+            *out++ = base64_chars[(in[i] & 3) << 4];
+            *out++ = '=';
+        }
+        *out++ = '=';
+    }
+    *out = '\0';
+}
+
+// Make room for len more bytes in the send queue, dropping what was already sent
+static int reserve_out(StreamConn *c, size_t len) {
+    if (c->out_sent > 0) {
+        memmove(c->out, c->out + c->out_sent, c->out_len - c->out_sent);
+        c->out_len -= c->out_sent;
+        c->out_sent = 0;
+    }
+    if (c->out_len + len <= c->out_cap) return 0;
+    size_t cap = c->out_cap ? c->out_cap : 1024;
+    while (cap < c->out_len + len) cap *= 2;
+    char *temp = realloc(c->out, cap);
+    if (!temp) return -1;
+    c->out = temp;
+    c->out_cap = cap;
+    return 0;
+}
+
+// Queue one masked frame, as a client must send them
+static int queue_frame(StreamConn *c, unsigned char opcode, const void *payload, size_t len) {
+    if (reserve_out(c, len + 14)) return -1;
+    unsigned char *p = (unsigned char *)c->out + c->out_len;
+    size_t n = 0;
+    p[n++] = 0x80 | opcode;
+    if (len < 126) {
+        p[n++] = 0x80 | (unsigned char)len;
+    } else if (len <= 0xffff) {
+        p[n++] = 0x80 | 126;
+        p[n++] = (unsigned char)(len >> 8);
+        p[n++] = (unsigned char)len;
+    } else {
+        p[n++] = 0x80 | 127;
+        for (int i = 7; i >= 0; i--) p[n++] = (unsigned char)((uint64_t)len >> (i * 8));
+    }
+    uint64_t key = next_random(&c->bench->rng);
+    unsigned char *mask = p + n;
+    memcpy(mask, &key, 4);
+    n += 4;
+    const unsigned char *in = payload;
+    for (size_t i = 0; i < len; i++) p[n + i] = in[i] ^ mask[i & 3];
+    c->out_len += n + len;
+    return 0;
+}
+
+// Write queued bytes until the socket would block; -1 when the connection is gone
+static int flush_out(StreamConn *c) {
+    while (c->out_sent < c->out_len) {
+        size_t n = 0;
+        CURLcode rc = curl_easy_send(c->t.curl, c->out + c->out_sent, c->out_len - c->out_sent, &n);
+        if (rc == CURLE_AGAIN) return 0;
+        if (rc != CURLE_OK) {
+            note_error(c->bench, "send: %s", curl_easy_strerror(rc));
+            return -1;
+        }
+        c->out_sent += n;
+    }
+    c->out_len = c->out_sent = 0;
+    return 0;
+}
+
+// Render the message, ${now} becoming the time in microseconds, and queue it
+static int send_message(StreamConn *c) {
+    const char *msg = c->bench->st->message;
+    char stack[512];
+    char *text = stack;
+    size_t cap = sizeof(stack), len = 0;
+    char now[32];
+    int now_len = snprintf(now, sizeof(now), "%.0f", epoch_seconds() * 1e6);
+
+    for (const char *p = msg; *p;) {
+        const char *hit = strstr(p, "${now}");
+        size_t part = hit ? (size_t)(hit - p) : strlen(p);
+        size_t need = len + part + (hit ? now_len : 0) + 1;
+        if (need > cap) {
+            while (cap < need) cap *= 2;
+            char *temp = text == stack ? malloc(cap) : realloc(text, cap);
+            if (!temp) {
+                if (text != stack) free(text);
+                return -1;
+            }
+            if (text == stack) memcpy(temp, stack, len);
+            text = temp;
+        }
+        memcpy(text + len, p, part);
+        len += part;
+        if (!hit) break;
+        memcpy(text + len, now, now_len);
+        len += now_len;
+        p = hit + 6;
+    }
+    int rc = queue_frame(c, 0x1, text, len);
+    if (text != stack) free(text);
+    if (rc == 0) c->bench->sent++;
+    return rc;
+}
+
+// The upgrade request for the URL curl connected to, with the case's headers and cookies
+static int send_handshake(StreamConn *c) {
+    CURLU *u = curl_url();
+    char *host = NULL, *port = NULL, *path = NULL, *query = NULL;
+    int rc = -1;
+    if (!u || curl_url_set(u, CURLUPART_URL, c->t.url, 0) != CURLUE_OK ||
+        curl_url_get(u, CURLUPART_HOST, &host, 0) != CURLUE_OK ||
+        curl_url_get(u, CURLUPART_PATH, &path, 0) != CURLUE_OK) {
+        note_error(c->bench, "Invalid URL %s", c->t.url);
+        goto DONE;
+    }
+    curl_url_get(u, CURLUPART_PORT, &port, 0);
+    curl_url_get(u, CURLUPART_QUERY, &query, 0);
+
+    unsigned char nonce[16];
+    uint64_t r1 = next_random(&c->bench->rng), r2 = next_random(&c->bench->rng);
+    memcpy(nonce, &r1, 8);
+    memcpy(nonce + 8, &r2, 8);
+    char key[32];
+    base64_encode(nonce, sizeof(nonce), key);
+
+    size_t extra = 0;
+    for (struct curl_slist *h = c->t.header_list; h; h = h->next) extra += strlen(h->data) + 2;
+    if (c->t.cookie_str) extra += strlen(c->t.cookie_str) + 10;
+    size_t len = strlen(host) + strlen(path) + (port ? strlen(port) : 0) + (query ? strlen(query) : 0) + extra + 256;
+    if (reserve_out(c, len)) goto DONE;
+
+    char *p = c->out + c->out_len;
+    int n = snprintf(p, len, "GET %s%s%s HTTP/1.1\r\nHost: %s%s%s\r\nUpgrade: websocket\r\nConnection: Upgrade\r\n"
+                     "Sec-WebSocket-Key: %s\r\nSec-WebSocket-Version: 13\r\n",
+                     path, query ? "?" : "", query ? query : "", host, port ? ":" : "", port ? port : "", key);
+    for (struct curl_slist *h = c->t.header_list; h; h = h->next) {
+        // Headers given without a value only remove curl's defaults
+        const char *colon = strchr(h->data, ':');
+        if (!colon || colon[1] == '\0') continue;
+        n += snprintf(p + n, len - n, "%s\r\n", h->data);
+    }
+    if (c->t.cookie_str) n += snprintf(p + n, len - n, "Cookie: %s\r\n", c->t.cookie_str);
+    n += snprintf(p + n, len - n, "\r\n");
+    c->out_len += n;
+    rc = 0;
+
+DONE:
+    curl_free(host);
+    curl_free(port);
+    curl_free(path);
+    curl_free(query);
+    curl_url_cleanup(u);
+    return rc;
+}
+
+// Check the upgrade response once its headers are in; -1 if the server refused
+static int finish_handshake(StreamConn *c) {
+    StreamBench *b = c->bench;
+    c->scan[c->scan_len] = '\0';
+    int major = 0, minor = 0, code = 0;
+    if (sscanf(c->scan, "HTTP/%d.%d %d", &major, &minor, &code) < 3 || code != 101) {
+        note_error(b, "HTTP %d instead of 101 Switching Protocols", code);
+        return -1;
+    }
+    c->state = CONN_OPEN;
+    c->opened = now_seconds();
+    c->frame = FRAME_HEADER;
+    c->header_len = 0;
+    c->message_op = 0;
+    c->event_ts = 0;
+    scan_reset(c);
+    // Stagger the first sends over one interval so connections opened together do not send together
+    double interval = b->st->interval;
+    c->next_send = c->opened + (interval > 0 ? interval * c->index / b->count : 0);
+    b->opened++;
+    return 0;
+}
+
+// Act on a complete control frame; -1 when the server closed
+static int control_frame(StreamConn *c) {
+    switch (c->opcode) {
+        case 0x9:  // Ping
+            return queue_frame(c, 0xA, c->control, c->control_len);
+        case 0x8:  // Close: echo its status code, then drop the connection
+            queue_frame(c, 0x8, c->control, c->control_len < 2 ? c->control_len : 2);
+            flush_out(c);
+            return -1;
+        default:   // Pong
+            return 0;
+    }
+}
+
+// Frame length from the header bytes so far, 0 until the header is complete
+static size_t header_size(const unsigned char *h, size_t have) {
+    if (have < 2) return 0;
+    size_t need = 2 + ((h[1] & 0x80) ? 4 : 0);
+    unsigned char len7 = h[1] & 0x7f;
+    if (len7 == 126) need += 2;
+    if (len7 == 127) need += 8;
+    return have >= need ? need : 0;
+}
+
+// Parse received frames incrementally; -1 when the connection should close
+static int ws_receive(StreamConn *c, const unsigned char *data, size_t len) {
+    StreamBench *b = c->bench;
+    size_t i = 0;
+    while (i < len) {
+        if (c->frame == FRAME_HEADER) {
+            c->header[c->header_len++] = data[i++];
+            size_t size = header_size(c->header, c->header_len);
+            if (size == 0) continue;
+
+            unsigned char *h = c->header;
+            c->fin = h[0] & 0x80;
+            c->opcode = h[0] & 0x0f;
+            c->masked = h[1] & 0x80;
+            uint64_t plen = h[1] & 0x7f;
+            size_t at = 2;
+            if (plen == 126) {
+                plen = (uint64_t)h[2] << 8 | h[3];
+                at = 4;
+            } else if (plen == 127) {
+                plen = 0;
+                for (int k = 0; k < 8; k++) plen = plen << 8 | h[2 + k];
+                at = 10;
+            }
+            if (c->masked) memcpy(c->mask, h + at, 4);
+            c->mask_pos = 0;
+            c->header_len = 0;
+            c->payload_left = plen;
+            c->control_len = 0;
+            if (c->opcode >= 0x8) {
+                if (plen > CONTROL_MAX) {
+                    note_error(b, "Control frame of %llu bytes", (unsigned long long)plen);
+                    return -1;
+                }
+            } else if (c->opcode != 0x0) {
+                // A new data message; continuation frames extend the current one
+                c->message_op = c->opcode;
+                scan_reset(c);
+            }
+            c->frame = FRAME_PAYLOAD;
+        } else {
+            size_t n = len - i < c->payload_left ? len - i : (size_t)c->payload_left;
+            const unsigned char *p = data + i;
+            if (c->opcode >= 0x8) {
+                memcpy(c->control + c->control_len, p, n);
+                if (c->masked) {
+                    for (size_t k = 0; k < n; k++) c->control[c->control_len + k] ^= c->mask[(c->mask_pos + k) & 3];
+                }
+                c->control_len += n;
+            } else if (c->message_op == 0x1 && c->scan_len < SCAN_MAX) {
+                // Only text messages are searched for a timestamp
+                size_t before = c->scan_len;
+                scan_append(c, (const char *)p, n);
+                if (c->masked) {
+                    for (size_t k = before; k < c->scan_len; k++) c->scan[k] ^= c->mask[(c->mask_pos + k - before) & 3];
+                }
+            }
+            c->mask_pos += n;
+            c->payload_left -= n;
+            i += n;
+        }
+
+        if (c->frame == FRAME_PAYLOAD && c->payload_left == 0) {
+            c->frame = FRAME_HEADER;
+            if (c->opcode >= 0x8) {
+                if (control_frame(c)) return -1;
+            } else if (c->fin && c->message_op) {
+                double ts = 0;
+                if (c->message_op == 0x1) {
+                    c->scan[c->scan_len] = '\0';
+                    ts = message_time(b, c->scan, c->scan_len);
+                }
+                count_message(b, ts);
+                c->message_op = 0;
+                scan_reset(c);
+            }
+        }
+    }
+    return 0;
+}
+
+// Take the bytes the socket holds: the upgrade response first, then frames.
+// -1 when the connection is gone.
+static int ws_read(StreamConn *c) {
+    unsigned char buf[RECV_CHUNK];
+    for (;;) {
+        size_t n = 0;
+        CURLcode rc = curl_easy_recv(c->t.curl, buf, sizeof(buf), &n);
+        if (rc == CURLE_AGAIN) return 0;
+        if (rc != CURLE_OK) {
+            note_error(c->bench, "recv: %s", curl_easy_strerror(rc));
+            return -1;
+        }
+        if (n == 0) return -1;  // Closed by the server
+        count_bytes(c->bench, n);
+
+        size_t i = 0;
+        if (c->state == CONN_HANDSHAKE) {
+            // Byte by byte up to the blank line, so frames right behind it stay unread
+            while (i < n && c->state == CONN_HANDSHAKE) {
+                if (c->scan_len >= SCAN_MAX) {
+                    note_error(c->bench, "Upgrade response headers over %d bytes", SCAN_MAX);
+                    return -1;
+                }
+                c->scan[c->scan_len++] = buf[i++];
+                if (c->scan_len >= 4 && memcmp(c->scan + c->scan_len - 4, "\r\n\r\n", 4) == 0) {
+                    if (finish_handshake(c)) return -1;
+                }
+            }
+        }
+        if (i < n && ws_receive(c, buf + i, n - i)) return -1;
+    }
+}
+
+// ws://, wss:// and plain URLs as the http(s) URL curl connects to
+static char *connect_url(const char *url) {
+    const char *rest = url;
+    const char *scheme = "http";
+    if (strncasecmp(url, "wss://", 6) == 0) {
+        rest = url + 6;
+        scheme = "https";
+    } else if (strncasecmp(url, "ws://", 5) == 0) {
+        rest = url + 5;
+    } else {
+        return strdup(url);
+    }
+    size_t len = strlen(scheme) + strlen(rest) + 4;
+    char *out = malloc(len);
+    if (out) snprintf(out, len, "%s://%s", scheme, rest);
+    return out;
+}
+
+// Build the transfer of one stream and add it to the loop
+static int open_conn(StreamBench *b, StreamConn *c) {
+    Transfer *t = &c->t;
+    t->discard = true;
+    t->peek = NULL;
+    if (setup_transfer(t, b->md, NULL, 0)) goto FAIL;
+    CURL *curl = t->curl;
+    // Streams last as long as the test; only connecting is bounded by the case's timeout
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, 0L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, b->md->timeout);
+    curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, NULL);
+
+    if (b->st->type == STREAM_SSE) {
+        t->header_list = curl_slist_append(t->header_list, "Accept: text/event-stream");
+        t->header_list = curl_slist_append(t->header_list, "Cache-Control: no-cache");
+        if (c->last_id[0]) {
+            char header[300];
+            snprintf(header, sizeof(header), "Last-Event-ID: %s", c->last_id);
+            t->header_list = curl_slist_append(t->header_list, header);
+        }
+        if (!t->header_list) goto FAIL;
+        curl_easy_setopt(curl, CURLOPT_HTTPHEADER, t->header_list);
+        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, sse_callback);
+        curl_easy_setopt(curl, CURLOPT_WRITEDATA, c);
+        c->rejected = false;
+        c->last_cr = false;
+        c->has_data = false;
+        c->event_ts = 0;
+    } else {
+        // curl opens the TCP and TLS connection, the upgrade and framing happen here
+        char *url = connect_url(t->url);
+        if (!url) goto FAIL;
+        free(t->url_buf);
+        t->url_buf = url;
+        t->url = url;
+        curl_easy_setopt(curl, CURLOPT_URL, url);
+        curl_easy_setopt(curl, CURLOPT_CONNECT_ONLY, 1L);
+        c->sock = CURL_SOCKET_BAD;
+        c->out_len = c->out_sent = 0;
+    }
+    scan_reset(c);
+    if (curl_multi_add_handle(b->multi, curl) != CURLM_OK) goto FAIL;
+    c->in_multi = true;
+    c->state = CONN_CONNECTING;
+    return 0;
+
+FAIL:
+    reset_transfer(t);
+    return -1;
+}
+
+// Take a stream off the loop, closing its connection, and schedule its return
+static void close_conn(StreamBench *b, StreamConn *c, bool failed) {
+    double now = now_seconds();
+    if (c->state == CONN_OPEN) {
+        b->closed++;
+        b->lifetime += now - c->opened;
+        count_churn(b);
+    } else if (failed) {
+        count_failed_open(b);
+    }
+    // Removing a connect-only handle from the multi closes its connection
+    if (c->in_multi) curl_multi_remove_handle(b->multi, c->t.curl);
+    c->in_multi = false;
+    reset_transfer(&c->t);
+    c->sock = CURL_SOCKET_BAD;
+
+    if (b->st->reconnect) {
+        c->state = CONN_IDLE;
+        c->retry_at = now + (c->retry > 0 ? c->retry : RETRY_DEFAULT);
+    } else {
+        c->state = CONN_DONE;
+    }
+}
+
+// A transfer curl finished: an SSE stream ended, or a WebSocket connection is ready
+static void finish_transfer(StreamBench *b, StreamConn *c, CURLcode result) {
+    if (result != CURLE_OK) {
+        if (!c->rejected && c->state != CONN_OPEN) note_error(b, "%s", curl_easy_strerror(result));
+        close_conn(b, c, true);
+        return;
+    }
+    if (b->st->type == STREAM_SSE) {
+        // The server ended the stream; a response that never opened one failed
+        long code = 0;
+        curl_easy_getinfo(c->t.curl, CURLINFO_RESPONSE_CODE, &code);
+        if (c->state != CONN_OPEN) note_error(b, "HTTP %ld with an empty body", code);
+        close_conn(b, c, c->state != CONN_OPEN);
+        return;
+    }
+
+    // Connect-only transfers stay in the multi, which owns their connection
+    curl_socket_t sock = CURL_SOCKET_BAD;
+    curl_easy_getinfo(c->t.curl, CURLINFO_ACTIVESOCKET, &sock);
+    if (sock == CURL_SOCKET_BAD || send_handshake(c) || flush_out(c)) {
+        note_error(b, "WebSocket upgrade request could not be sent");
+        close_conn(b, c, true);
+        return;
+    }
+    c->sock = sock;
+    c->state = CONN_HANDSHAKE;
+}
+
+// Send the messages that are due, skipping connections the server is not reading from
+static void send_due(StreamBench *b, StreamConn *c, double now) {
+    double interval = b->st->interval;
+    if (interval <= 0 || c->state != CONN_OPEN || now < c->next_send) return;
+    if (c->out_len - c->out_sent > SEND_BACKLOG) {
+        b->skipped++;
+    } else if (send_message(c)) {
+        LOG_ERROR("Failed to queue a WebSocket message");
+    }
+    c->next_send += interval;
+    if (c->next_send < now) c->next_send = now + interval;  // Do not burst to catch up
+}
+
+static void sample_series(StreamBench *b) {
+    double now = now_seconds();
+    if (now - b->compacted >= 1.0) {
+        compact_series(&b->series, now - b->start);
+        b->compacted = now;
+    }
+}
+
+static void print_summary(const StreamBench *b, const char *path, double elapsed, double cpu, int open, int opening) {
+    const Stats *s = &b->stats;
+    const char *type = b->st->type == STREAM_SSE ? "SSE" : "WebSocket";
+    LOG_INFO("========== STREAM SUMMARY ============");
+    LOG_INFO("%s %s: %d connections for %.2f s", type, path, b->count, elapsed);
+    LOG_INFO("Messages: %llu, %.1f msg/s, %.2f MB, %.2f MB/s", (unsigned long long)b->messages,
+             elapsed > 0 ? b->messages / elapsed : 0.0, s->bytes / 1e6, elapsed > 0 ? s->bytes / 1e6 / elapsed : 0.0);
+    if (b->st->type == STREAM_WEBSOCKET && b->st->interval > 0) {
+        LOG_INFO("Sent: %llu messages, %llu skipped on backlogged connections", (unsigned long long)b->sent,
+                 (unsigned long long)b->skipped);
+    }
+    if (s->count > 0) {
+        LOG_INFO("Latency of %llu timestamped messages: min %.2f  mean %.2f  p50 %.2f  p90 %.2f  p99 %.2f  max %.2f ms",
+                 (unsigned long long)s->count, s->min_us / 1000, s->total_us / s->count / 1000,
+                 stats_quantile(s, 0.50) / 1000, stats_quantile(s, 0.90) / 1000, stats_quantile(s, 0.99) / 1000,
+                 s->max_us / 1000);
+    }
+    if (b->untimed > 0) {
+        LOG_INFO("Untimed: %llu messages without a numeric \"%s\" field", (unsigned long long)b->untimed,
+                 b->st->timestamp);
+    }
+    if (b->skewed > 0) {
+        LOG_WARN("Clock skew: %llu timestamps were ahead of this clock and were not timed",
+                 (unsigned long long)b->skewed);
+    }
+    LOG_INFO("Churn: %llu opened, %llu closed by the server, %llu failed to open, %llu reconnects",
+             (unsigned long long)b->opened, (unsigned long long)b->closed, (unsigned long long)b->failed,
+             (unsigned long long)b->reconnects);
+    LOG_INFO("At the end: %d open, %d still opening", open, opening);
+    if (b->closed > 0) LOG_INFO("Mean lifetime of closed streams: %.2f s", b->lifetime / b->closed);
+    if (b->error[0]) LOG_WARN("First failure: %s", b->error);
+    LOG_INFO("Client: %.2f s CPU, %.0f%% of the test", cpu, elapsed > 0 ? cpu / elapsed * 100 : 0.0);
+    if (elapsed > 0 && client_saturated(cpu / elapsed)) {
+        LOG_WARN("Client saturated: message rates and latency may be limited by capis rather than the server");
+    }
+}
+
+int run_stream(const char *path, METADATA *md, const LoadOptions *opts) {
+    const Stream *st = md->stream;
+    StreamBench b;
+    memset(&b, 0, sizeof(StreamBench));
+    b.md = md;
+    b.st = st;
+    b.count = opts->users > 0 ? opts->users : st->connections;
+    b.rng = mix64((uint64_t)time(NULL) ^ (uint64_t)getpid() << 32);
+    init_stats(&b.stats);
+    init_series(&b.series);
+    double duration = opts->duration > 0 ? opts->duration : st->duration > 0 ? st->duration : DEFAULT_DURATION;
+
+    int rc = -1;
+    struct curl_waitfd *fds = NULL;
+    int *fd_conn = NULL;
+    b.multi = curl_multi_init();
+    b.conns = calloc(b.count, sizeof(StreamConn));
+    b.field_len = strlen(st->timestamp) + 2;
+    b.field = malloc(b.field_len + 1);
+    if (st->type == STREAM_WEBSOCKET) {
+        fds = calloc(b.count, sizeof(struct curl_waitfd));
+        fd_conn = calloc(b.count, sizeof(int));
+    }
+    if (!b.multi || !b.conns || !b.field || (st->type == STREAM_WEBSOCKET && (!fds || !fd_conn))) {
+        LOG_ERROR("Failed to allocate stream test");
+        goto DONE;
+    }
+    snprintf(b.field, b.field_len + 1, "\"%s\"", st->timestamp);
+    // One connection per stream even over HTTP/2, and none closed to make room for another
+    curl_multi_setopt(b.multi, CURLMOPT_PIPELINING, (long)CURLPIPE_NOTHING);
+    curl_multi_setopt(b.multi, CURLMOPT_MAXCONNECTS, (long)b.count + 1);
+    for (int i = 0; i < b.count; i++) {
+        StreamConn *c = &b.conns[i];
+        c->bench = &b;
+        c->index = i;
+        c->sock = CURL_SOCKET_BAD;
+        c->state = CONN_IDLE;
+        c->t.curl = curl_easy_init();
+        if (!c->t.curl) {
+            LOG_ERROR("curl_easy_init failed");
+            goto DONE;
+        }
+    }
+
+    LOG_INFO("Streaming %s over %d %s connections for %.0f s", path, b.count,
+             st->type == STREAM_SSE ? "SSE" : "WebSocket", duration);
+    b.start = now_seconds();
+    b.compacted = b.start;
+    double end = b.start + duration;
+    double cpu_start = thread_cpu_seconds();
+    int live = b.count;
+    double now = b.start;
+    while (now < end && live > 0) {
+        uint64_t turn = prof_ticks();
+        for (int i = 0; i < b.count; i++) {
+            StreamConn *c = &b.conns[i];
+            if (c->state != CONN_IDLE || now < c->retry_at) continue;
+            if (c->retry_at > 0) b.reconnects++;
+            if (open_conn(&b, c)) {
+                LOG_ERROR("Failed to set up stream %d", i + 1);
+                count_failed_open(&b);
+                c->state = st->reconnect ? CONN_IDLE : CONN_DONE;
+                c->retry_at = now + RETRY_DEFAULT;
+            }
+        }
+
+        int running = 0;
+        curl_multi_perform(b.multi, &running);
+        CURLMsg *msg;
+        int left;
+        while ((msg = curl_multi_info_read(b.multi, &left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            Transfer *t = NULL;
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&t);
+            finish_transfer(&b, (StreamConn *)t, msg->data.result);
+        }
+
+        // Connected WebSockets are no longer curl's to drive, their sockets are polled here
+        double wake = end;
+        live = 0;
+        int nfds = 0;
+        now = now_seconds();
+        for (int i = 0; i < b.count; i++) {
+            StreamConn *c = &b.conns[i];
+            if (c->state == CONN_DONE) continue;
+            live++;
+            if (c->state == CONN_IDLE && c->retry_at < wake) wake = c->retry_at;
+            if (st->type != STREAM_WEBSOCKET || (c->state != CONN_HANDSHAKE && c->state != CONN_OPEN)) continue;
+            send_due(&b, c, now);
+            if (c->out_sent < c->out_len && flush_out(c)) {
+                close_conn(&b, c, true);
+                continue;
+            }
+            if (st->interval > 0 && c->state == CONN_OPEN && c->next_send < wake) wake = c->next_send;
+            fds[nfds].fd = c->sock;
+            fds[nfds].events = CURL_WAIT_POLLIN | (c->out_sent < c->out_len ? CURL_WAIT_POLLOUT : 0);
+            fds[nfds].revents = 0;
+            fd_conn[nfds++] = i;
+        }
+        sample_series(&b);
+        prof_end(PROF_LOOP, turn);
+
+        int timeout = wake > now ? (int)((wake - now) * 1000) + 1 : 0;
+        if (timeout > 100) timeout = 100;
+        uint64_t wait = prof_ticks();
+        curl_multi_poll(b.multi, fds, nfds, timeout, NULL);
+        prof_end(PROF_WAIT, wait);
+
+        // Sockets closed or reopened since the poll was set up are skipped
+        for (int k = 0; k < nfds; k++) {
+            StreamConn *c = &b.conns[fd_conn[k]];
+            if (!fds[k].revents || c->sock != fds[k].fd) continue;
+            if (ws_read(c) || (c->out_sent < c->out_len && flush_out(c))) close_conn(&b, c, true);
+        }
+        now = now_seconds();
+    }
+    double elapsed = now_seconds() - b.start;
+    double cpu = thread_cpu_seconds() - cpu_start;
+    compact_series(&b.series, elapsed);
+
+    int open = 0, opening = 0;
+    for (int i = 0; i < b.count; i++) {
+        if (b.conns[i].state == CONN_OPEN) open++;
+        if (b.conns[i].state == CONN_CONNECTING || b.conns[i].state == CONN_HANDSHAKE) opening++;
+    }
+    print_summary(&b, path, elapsed, cpu, open, opening);
+    print_series_unit(path, &b.series, elapsed, "msg/s");
+    if (opts->timeseries) append_series_csv(opts->timeseries, path, &b.series, elapsed);
+    // A test that never got a message through failed
+    rc = b.messages > 0 || (b.opened > 0 && b.failed == 0) ? 0 : -1;
+
+DONE:
+    for (int i = 0; b.conns && i < b.count; i++) {
+        StreamConn *c = &b.conns[i];
+        if (!c->t.curl) continue;
+        if (c->in_multi) curl_multi_remove_handle(b.multi, c->t.curl);
+        reset_transfer(&c->t);
+        curl_easy_cleanup(c->t.curl);
+        free(c->out);
+    }
+    free(b.conns);
+    free(fds);
+    free(fd_conn);
+    free(b.field);
+    if (b.multi) curl_multi_cleanup(b.multi);
+    free_series(&b.series);
+    return rc;
+}
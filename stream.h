@@ -0,0 +1,12 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "multi_curl.h"
+#include "read_yaml.h"
+
+// Hold md->stream's connections open on one event loop and time every message they carry
+// from the send time it embeds. Streams are parsed as they arrive and never buffered.
+// -u replaces the number of connections and -d the duration.
+int run_stream(const char *path, METADATA *md, const LoadOptions *opts);
+
+#endif
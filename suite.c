@@ -0,0 +1,416 @@
+#include "suite.h"
+#include "easy_curl.h"
+#include "cache.h"
+#include "governor.h"
+#include "log.h"
+#include "stream.h"
+#include "throughput.h"
+#include "utils.h"
+#include <curl/curl.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef enum {
+    CASE_PENDING,   // Waiting for prerequisites
+    CASE_READY,     // Queued to run
+    CASE_RUNNING,
+    CASE_PASSED,
+    CASE_FAILED,
+    CASE_SKIPPED    // A prerequisite failed or was skipped
+} CaseState;
+
+typedef struct {
+    const char *path;
+    METADATA *md;
+    CaseState state;
+    int waiting;      // Prerequisites that have not passed yet
+    int *dependents;  // Cases waiting on this one
+    int dependent_count;
+    Transfer t;
+} SuiteCase;
+
+typedef struct {
+    SuiteCase *cases;
+    int count;
+    int *ready;       // FIFO of cases whose prerequisites all passed
+    int ready_head;
+    int ready_tail;
+    int failed;
+} Suite;
+
+typedef struct {
+    const char *id;
+    int index;
+} IdEntry;
+
+int run_case(const char *path, METADATA *md, void *arg) {
+    RunConfig *cfg = (RunConfig *)arg;
+    if (cfg->verbose) print_metadata(md);
+
+    // Download benchmarks measure goodput, whatever the load options say
+    if (md->throughput) {
+        if (run_throughput(path, md, &cfg->opts) == 0) {
+            LOG_INFO("Throughput test completed for %s", path);
+            return 0;
+        }
+        LOG_ERROR("Throughput test failed for %s", path);
+        return -1;
+    }
+
+    // Streams are measured per message, not per request
+    if (md->stream) {
+        if (run_stream(path, md, &cfg->opts) == 0) {
+            LOG_INFO("Stream test completed for %s", path);
+            return 0;
+        }
+        LOG_ERROR("Stream test failed for %s", path);
+        return -1;
+    }
+
+    if (cfg->capacity) {
+        if (find_capacity(md, &cfg->opts, cfg->capacity) == 0) {
+            LOG_INFO("Capacity search completed for %s", path);
+            return 0;
+        }
+        LOG_ERROR("Capacity search failed for %s", path);
+        return -1;
+    }
+
+    // Cases with a load profile are always load tested
+    if (cfg->load || md->stages) {
+        if (do_multi_curl(path, md, &cfg->opts) == 0) {
+            LOG_INFO("Load test completed for %s", path);
+            return 0;
+        }
+        LOG_ERROR("Load test failed for %s", path);
+        return -1;
+    }
+
+    Response resp = {0}; // Initialize response
+    int rc = do_easy_curl(md, &resp, cfg->verbose);
+    if (rc == 0) {
+        LOG_INFO("Request completed for %s", path);
+    } else {
+        LOG_ERROR("Request failed for %s", path);
+    }
+    free_response(&resp);
+    return rc;
+}
+
+static int compare_ids(const void *a, const void *b) {
+    const IdEntry *x = (const IdEntry *)a;
+    const IdEntry *y = (const IdEntry *)b;
+    int c = strcmp(x->id, y->id);
+    return c ? c : x->index - y->index;
+}
+
+static int add_dependent(SuiteCase *c, int dependent) {
+    int *temp = realloc(c->dependents, (c->dependent_count + 1) * sizeof(int));
+    if (!temp) return -1;
+    c->dependents = temp;
+    c->dependents[c->dependent_count++] = dependent;
+    return 0;
+}
+
+// Record the outcome of a case, releasing or skipping everything that waits on it
+static void complete_case(Suite *s, int i, CaseState state) {
+    SuiteCase *c = &s->cases[i];
+    c->state = state;
+    if (state != CASE_PASSED) s->failed++;
+    free_metadata(c->md);
+    c->md = NULL;
+
+    for (int d = 0; d < c->dependent_count; d++) {
+        SuiteCase *dep = &s->cases[c->dependents[d]];
+        if (dep->state != CASE_PENDING) continue;
+        if (state != CASE_PASSED) {
+            LOG_WARN("Skipping %s: prerequisite %s did not pass", dep->path, c->path);
+            complete_case(s, c->dependents[d], CASE_SKIPPED);
+        } else if (--dep->waiting == 0) {
+            dep->state = CASE_READY;
+            s->ready[s->ready_tail++] = c->dependents[d];
+        }
+    }
+}
+
+// Resolve depends_on ids into edges; cases with unknown or duplicate ids fail, and so do
+// cases depending on a duplicate id, which could mean either
+static int build_graph(Suite *s) {
+    if (s->count <= 0) return 0;
+    IdEntry *ids = malloc(((size_t)s->count + 1) * sizeof(IdEntry));
+    // Failed cases are dropped only at the end, ids points into their metadata
+    bool *bad = calloc((size_t)s->count + 1, sizeof(bool));
+    if (!ids || !bad) {
+        free(ids);
+        free(bad);
+        return -1;
+    }
+    int id_count = 0;
+    for (int i = 0; i < s->count; i++) {
+        if (s->cases[i].md && s->cases[i].md->id) {
+            ids[id_count++] = (IdEntry){s->cases[i].md->id, i};
+        }
+    }
+    qsort(ids, id_count, sizeof(IdEntry), compare_ids);
+    for (int k = 1; k < id_count; k++) {
+        if (strcmp(ids[k].id, ids[k - 1].id) == 0) {
+            LOG_ERROR("Duplicate case id %s in %s and %s", ids[k].id,
+                      s->cases[ids[k - 1].index].path, s->cases[ids[k].index].path);
+            bad[ids[k - 1].index] = true;
+            bad[ids[k].index] = true;
+        }
+    }
+
+    for (int i = 0; i < s->count; i++) {
+        SuiteCase *c = &s->cases[i];
+        if (!c->md || !c->md->depends_on) continue;
+        for (char **dep = c->md->depends_on; *dep; dep++) {
+            // Lower bound, so a duplicated id resolves to its first case
+            IdEntry key = {*dep, -1};
+            int lo = 0, hi = id_count;
+            while (lo < hi) {
+                int mid = (lo + hi) / 2;
+                if (compare_ids(&ids[mid], &key) < 0) lo = mid + 1; else hi = mid;
+            }
+            IdEntry *found = lo < id_count && strcmp(ids[lo].id, *dep) == 0 ? &ids[lo] : NULL;
+            if (!found) {
+                LOG_ERROR("Unknown dependency %s in %s", *dep, c->path);
+                bad[i] = true;
+                break;
+            }
+            if (lo + 1 < id_count && strcmp(ids[lo + 1].id, *dep) == 0) {
+                LOG_ERROR("Dependency %s in %s is ambiguous, more than one case has that id", *dep, c->path);
+                bad[i] = true;
+                break;
+            }
+            if (found->index == i) {
+                LOG_ERROR("%s depends on itself", c->path);
+                bad[i] = true;
+                break;
+            }
+            if (add_dependent(&s->cases[found->index], i)) {
+                free(ids);
+                free(bad);
+                return -1;
+            }
+            c->waiting++;
+        }
+    }
+    for (int i = 0; i < s->count; i++) {
+        if (!bad[i]) continue;
+        free_metadata(s->cases[i].md);
+        s->cases[i].md = NULL;
+    }
+    free(ids);
+    free(bad);
+    return 0;
+}
+
+// Whether case start waits on itself through a chain of cases that never ran; seen is
+// scratch space for every case
+static bool on_cycle(const Suite *s, int start, bool *seen, int *stack) {
+    memset(seen, 0, s->count * sizeof(bool));
+    int top = 0;
+    stack[top++] = start;
+    while (top > 0) {
+        const SuiteCase *c = &s->cases[stack[--top]];
+        for (int d = 0; d < c->dependent_count; d++) {
+            int next = c->dependents[d];
+            if (next == start) return true;
+            if (seen[next] || s->cases[next].state != CASE_PENDING) continue;
+            seen[next] = true;
+            stack[top++] = next;
+        }
+    }
+    return false;
+}
+
+// Take the first ready case its host's limits let go now, the ones held keep their place.
+// Returns -1 when every ready case is held.
+static int next_ready(Suite *s, HostLane *lane, const int *hosts, bool *held) {
+    double now = now_seconds();
+    int k = s->ready_head;
+    for (; k < s->ready_tail; k++) {
+        int i = s->ready[k];
+        if (!hosts || admit_request(lane, hosts[i], now, held[i])) break;
+        held[i] = true;
+    }
+    if (k == s->ready_tail) return -1;
+    int i = s->ready[k];
+    memmove(&s->ready[s->ready_head + 1], &s->ready[s->ready_head], (k - s->ready_head) * sizeof(int));
+    s->ready_head++;
+    return i;
+}
+
+// Send every ready case at once on a multi handle, up to cfg->jobs in flight
+static void run_concurrent(Suite *s, const RunConfig *cfg) {
+    CURLM *multi = curl_multi_init();
+    if (!multi) {
+        LOG_ERROR("curl_multi_init failed");
+        return;
+    }
+
+    // One loop sends every case, so it holds all of each host's limits
+    Governor gov;
+    HostLane lane;
+    init_governor(&gov, &cfg->opts.host_limits);
+    int *hosts = calloc(s->count, sizeof(int));
+    bool *held = calloc(s->count, sizeof(bool));
+    for (int i = 0; hosts && i < s->count; i++) {
+        hosts[i] = s->cases[i].md ? govern_case(&gov, s->cases[i].md) : -1;
+    }
+    if (init_lane(&lane, &gov, 1, 0) || !hosts || !held || !governor_active(&gov)) {
+        free(hosts);
+        hosts = NULL;
+    }
+
+    int in_flight = 0;
+    while (s->ready_head < s->ready_tail || in_flight > 0) {
+        while (s->ready_head < s->ready_tail && in_flight < cfg->jobs) {
+            int i = next_ready(s, &lane, hosts, held);
+            if (i < 0) break;
+            SuiteCase *c = &s->cases[i];
+            int host = hosts ? hosts[i] : -1;
+            if (cfg->verbose) print_metadata(c->md);
+            if (start_easy_transfer(&c->t, c->md, cfg->verbose)) {
+                release_request(&lane, host, NULL);
+                LOG_ERROR("Request failed for %s", c->path);
+                complete_case(s, i, CASE_FAILED);
+                continue;
+            }
+            limit_transfer(&lane, host, c->t.curl);
+            curl_easy_setopt(c->t.curl, CURLOPT_PRIVATE, c);
+            curl_multi_add_handle(multi, c->t.curl);
+            c->state = CASE_RUNNING;
+            in_flight++;
+        }
+        // Wait out held cases no earlier than their hosts could take one
+        int wait_ms = 100;
+        if (lane.wake > 0) {
+            int held_ms = (int)((lane.wake - now_seconds()) * 1000) + 1;
+            wait_ms = held_ms < 1 ? 1 : held_ms < wait_ms ? held_ms : wait_ms;
+            lane.wake = 0;
+        }
+        if (in_flight == 0) {
+            if (s->ready_head < s->ready_tail) curl_multi_poll(multi, NULL, 0, wait_ms, NULL);
+            continue;
+        }
+
+        int active = 0;
+        curl_multi_perform(multi, &active);
+
+        CURLMsg *msg;
+        int left;
+        while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL *easy = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            SuiteCase *c = NULL;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&c);
+            release_request(&lane, hosts ? hosts[c - s->cases] : -1, easy);
+            curl_multi_remove_handle(multi, easy);
+            in_flight--;
+
+            // Dependents need a real answer, so HTTP errors fail the case too
+            Response resp = {0};
+            int rc = finish_easy_transfer(&c->t, result, &resp);
+            if (rc == 0 && resp.status_code >= 400) rc = -1;
+            if (rc == 0) {
+                LOG_INFO("Request completed for %s", c->path);
+            } else {
+                LOG_ERROR("Request failed for %s", c->path);
+            }
+            free_response(&resp);
+            complete_case(s, (int)(c - s->cases), rc == 0 ? CASE_PASSED : CASE_FAILED);
+        }
+
+        if (active > 0) curl_multi_poll(multi, NULL, 0, wait_ms, NULL);
+    }
+    if (hosts) print_governor(&gov);
+    free(hosts);
+    free(held);
+    free_lane(&lane);
+    free_governor(&gov);
+    curl_multi_cleanup(multi);
+}
+
+// Load tests saturate the machine on their own, so they run one after another
+static void run_sequential(Suite *s, const RunConfig *cfg) {
+    while (s->ready_head < s->ready_tail) {
+        int i = s->ready[s->ready_head++];
+        SuiteCase *c = &s->cases[i];
+        c->state = CASE_RUNNING;
+        int rc = run_case(c->path, c->md, (void *)cfg);
+        complete_case(s, i, rc == 0 ? CASE_PASSED : CASE_FAILED);
+    }
+}
+
+int run_suite(const PathList *cases, const RunConfig *cfg) {
+    Suite s = {0};
+    s.count = (int)cases->count;
+    if (s.count == 0) return 0;
+    s.cases = calloc(s.count, sizeof(SuiteCase));
+    s.ready = malloc(s.count * sizeof(int));
+    if (!s.cases || !s.ready) {
+        free(s.cases);
+        free(s.ready);
+        return -1;
+    }
+
+    for (int i = 0; i < s.count; i++) {
+        s.cases[i].path = cases->paths[i];
+        s.cases[i].md = load_cached_metadata(cases->paths[i], cfg->cache_dir);
+    }
+    int broken = build_graph(&s);
+    if (broken) s.failed = s.count;
+
+    // Seed the queue in input order; unparsable cases fail and take their dependents with them
+    for (int i = 0; i < s.count && !broken; i++) {
+        SuiteCase *c = &s.cases[i];
+        if (c->state != CASE_PENDING) continue;
+        if (!c->md) {
+            complete_case(&s, i, CASE_FAILED);
+        } else if (c->waiting == 0) {
+            c->state = CASE_READY;
+            s.ready[s.ready_tail++] = i;
+        }
+    }
+
+    int load = cfg->load;
+    for (int i = 0; i < s.count; i++) {
+        if (s.cases[i].md && (s.cases[i].md->stages || s.cases[i].md->throughput ||
+                              s.cases[i].md->stream)) load = 1;
+    }
+    if (load) {
+        run_sequential(&s, cfg);
+    } else {
+        run_concurrent(&s, cfg);
+    }
+
+    // Cases still pending are on a cycle or wait on one
+    bool *seen = calloc(s.count, sizeof(bool));
+    int *stack = malloc(s.count * sizeof(int));
+    for (int i = 0; i < s.count && !broken; i++) {
+        SuiteCase *c = &s.cases[i];
+        if (c->state != CASE_PENDING) continue;
+        if (seen && stack && on_cycle(&s, i, seen, stack)) {
+            LOG_ERROR("Skipping %s: it is on a dependency cycle", c->path);
+        } else {
+            LOG_ERROR("Skipping %s: blocked by a dependency cycle", c->path);
+        }
+    }
+    for (int i = 0; i < s.count; i++) {
+        SuiteCase *c = &s.cases[i];
+        if (c->state == CASE_PENDING && !broken) {
+            c->state = CASE_SKIPPED;
+            s.failed++;
+        }
+        free_metadata(c->md);
+        free(c->dependents);
+    }
+    free(seen);
+    free(stack);
+    free(s.cases);
+    free(s.ready);
+    return s.failed ? -1 : 0;
+}
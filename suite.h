@@ -0,0 +1,26 @@
+#ifndef SUITE_H
+#define SUITE_H
+
+#include "capacity.h"
+#include "multi_curl.h"
+#include "read_yaml.h"
+#include "utils.h"
+
+typedef struct {
+    int verbose;
+    int load;               // Load test each case instead of sending it once
+    int jobs;               // Cases kept in flight at once when sending once
+    LoadOptions opts;
+    const CapacityOptions *capacity;  // Search each case's capacity instead of load testing it
+    const char *cache_dir;  // Plan cache directory, NULL to always parse
+} RunConfig;
+
+// Run one parsed case in the configured mode, a CaseRunner for watch mode
+int run_case(const char *path, METADATA *md, void *arg);
+
+// Run every case, ordered by their id / depends_on graph. Ready cases are sent
+// concurrently (load tests run one at a time) and dependents of a failed case are
+// skipped. Returns -1 if any case failed or was skipped.
+int run_suite(const PathList *cases, const RunConfig *cfg);
+
+#endif
@@ -0,0 +1,333 @@
+#include "template.h"
+#include "log.h"
+#include "urlencode.h"
+#include "utils.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Longest decimal int64, sign included
+#define INT_TEXT_MAX 20
+#define UUID_TEXT_LEN 36
+
+// Generators of one thread; seeded lazily as stream 0 of 1 if nothing seeded it
+typedef struct {
+    uint64_t rng;
+    uint64_t seq;     // Number of the current request
+    uint64_t next;    // Number the next request gets
+    uint64_t stride;  // Threads sharing the sequence
+    uint64_t body;    // Seeds generated bodies, apart from rng so templates draw the same values either way
+    bool seeded;
+} GenState;
+
+static _Thread_local GenState gen_state;
+static uint64_t gen_seed = 0;
+static atomic_bool gen_used = false;
+
+void set_generator_seed(uint64_t seed) {
+    gen_seed = seed;
+}
+
+uint64_t generator_seed(void) {
+    return gen_seed;
+}
+
+bool generators_used(void) {
+    return atomic_load(&gen_used);
+}
+
+void seed_thread_generators(int stream, int streams) {
+    GenState *g = &gen_state;
+    g->rng = mix64(gen_seed + (uint64_t)(stream + 1) * 0x9E3779B97F4A7C15ULL);
+    if (g->rng == 0) g->rng = 0x9E3779B97F4A7C15ULL;
+    g->body = mix64(g->rng ^ 0xD1B54A32D192ED03ULL);
+    if (g->body == 0) g->body = 0xD1B54A32D192ED03ULL;
+    g->stride = streams > 0 ? (uint64_t)streams : 1;
+    g->next = (uint64_t)stream + 1;
+    g->seq = 0;
+    g->seeded = true;
+}
+
+static GenState *thread_generators(void) {
+    if (!gen_state.seeded) seed_thread_generators(0, 1);
+    return &gen_state;
+}
+
+void use_generators(void) {
+    atomic_store(&gen_used, true);
+}
+
+uint64_t next_body_seed(void) {
+    return next_random(&thread_generators()->body);
+}
+
+void next_request_number(void) {
+    GenState *g = thread_generators();
+    g->seq = g->next;
+    g->next += g->stride;
+}
+
+// Append a segment to the template
+static Segment *add_segment(Template *t, SegmentType type, const char *text, size_t len, int column) {
+    Segment *temp = realloc(t->segs, (t->count + 1) * sizeof(Segment));
+    if (!temp) return NULL;
+    t->segs = temp;
+    Segment *seg = &t->segs[t->count++];
+    memset(seg, 0, sizeof(Segment));
+    seg->type = type;
+    seg->text = text;
+    seg->len = len;
+    seg->column = column;
+    return seg;
+}
+
+static const char *skip_spaces(const char *p, const char *end) {
+    while (p < end && isspace((unsigned char)*p)) p++;
+    return p;
+}
+
+// Parse an integer argument such as 42, -7 or 1e6 spanning [p, end)
+static int parse_int_arg(const char *p, const char *end, int64_t *out) {
+    char buf[64];
+    p = skip_spaces(p, end);
+    while (end > p && isspace((unsigned char)end[-1])) end--;
+    if (end == p || (size_t)(end - p) >= sizeof(buf)) return -1;
+    memcpy(buf, p, end - p);
+    buf[end - p] = '\0';
+
+    char *stop = NULL;
+    long long v = strtoll(buf, &stop, 10);
+    if (*stop == '\0') {
+        *out = v;
+        return 0;
+    }
+    double d = strtod(buf, &stop);
+    if (*stop != '\0' || d != floor(d) || d < -9.2e18 || d > 9.2e18) return -1;
+    *out = (int64_t)d;
+    return 0;
+}
+
+// Compile the generator expression in [p, end), -1 if it is not a valid one
+static int compile_generator(Template *t, const char *p, const char *end) {
+    size_t len = end - p;
+    if (len == 3 && strncmp(p, "seq", 3) == 0) {
+        return add_segment(t, SEG_SEQ, NULL, 0, -1) ? 0 : -1;
+    }
+    if (len == 9 && strncmp(p, "rand.uuid", 9) == 0) {
+        return add_segment(t, SEG_UUID, NULL, 0, -1) ? 0 : -1;
+    }
+    if (end[-1] != ')') return -1;
+
+    if (len > 9 && strncmp(p, "rand.int(", 9) == 0) {
+        const char *args = p + 9;
+        const char *comma = memchr(args, ',', end - 1 - args);
+        int64_t min, max;
+        if (!comma || parse_int_arg(args, comma, &min) || parse_int_arg(comma + 1, end - 1, &max) || min > max) {
+            return -1;
+        }
+        Segment *seg = add_segment(t, SEG_RAND_INT, NULL, 0, -1);
+        if (!seg) return -1;
+        seg->min = min;
+        seg->span = (uint64_t)max - (uint64_t)min + 1;
+        return 0;
+    }
+
+    if (len > 12 && strncmp(p, "rand.choice(", 12) == 0) {
+        int first = t->choice_count;
+        const char *opt = p + 12;
+        while (opt <= end - 1) {
+            const char *stop = memchr(opt, ',', end - 1 - opt);
+            if (!stop) stop = end - 1;
+            const char *a = skip_spaces(opt, stop);
+            const char *b = stop;
+            while (b > a && isspace((unsigned char)b[-1])) b--;
+            Choice *temp = realloc(t->choices, (t->choice_count + 1) * sizeof(Choice));
+            if (!temp) return -1;
+            t->choices = temp;
+            t->choices[t->choice_count++] = (Choice){a, (size_t)(b - a)};
+            opt = stop + 1;
+        }
+        Segment *seg = add_segment(t, SEG_CHOICE, NULL, 0, -1);
+        if (!seg) return -1;
+        seg->first = first;
+        seg->options = t->choice_count - first;
+        return 0;
+    }
+    return -1;
+}
+
+// Compile ${name} placeholders in s; feeder columns come first, then generators, and
+// unknown names are kept as literal text
+Template *compile_template(const char *s, const Feeder *feeder) {
+    if (!s || !strstr(s, "${")) return NULL;
+
+    Template *t = calloc(1, sizeof(Template));
+    if (!t) return NULL;
+    t->source = strdup(s);
+    if (!t->source) {
+        free(t);
+        return NULL;
+    }
+
+    const char *p = t->source;
+    const char *text = p;
+    while ((p = strstr(p, "${")) != NULL) {
+        const char *close = strchr(p + 2, '}');
+        if (!close) break;
+
+        char *name = strndup(p + 2, close - p - 2);
+        if (!name) goto FAIL;
+        int column = feeder ? feeder_column(feeder, name) : -1;
+        bool generator = column < 0 && (strcmp(name, "seq") == 0 || strncmp(name, "rand.", 5) == 0);
+        if (column < 0 && !generator) {
+            LOG_WARN("Unknown template variable ${%s}", name);
+            free(name);
+            p = close + 1;
+            continue;
+        }
+
+        if (p > text && !add_segment(t, SEG_TEXT, text, p - text, -1)) {
+            free(name);
+            goto FAIL;
+        }
+        if (generator) {
+            int count = t->count;
+            if (compile_generator(t, p + 2, close)) {
+                // Keep the expression as literal text, like an unknown name
+                LOG_WARN("Invalid generator ${%s}", name);
+                t->count = count;
+                free(name);
+                text = p;
+                p = close + 1;
+                continue;
+            }
+            atomic_store(&gen_used, true);
+        } else if (!add_segment(t, SEG_COLUMN, NULL, 0, column)) {
+            free(name);
+            goto FAIL;
+        }
+        free(name);
+        p = text = close + 1;
+    }
+    if (*text && !add_segment(t, SEG_TEXT, text, strlen(text), -1)) goto FAIL;
+    return t;
+
+FAIL:
+    LOG_ERROR("Failed to compile template: %s", s);
+    free_template(t);
+    return NULL;
+}
+
+void free_template(Template *t) {
+    if (!t) return;
+    free(t->segs);
+    free(t->choices);
+    free(t->source);
+    free(t);
+}
+
+// Uniform in [0, span), span 0 meaning the full 64 bits
+static uint64_t random_below(GenState *g, uint64_t span) {
+    uint64_t r = next_random(&g->rng);
+    return span ? r % span : r;
+}
+
+static size_t write_uuid(GenState *g, char *out) {
+    static const char hex[] = "0123456789abcdef";
+    uint64_t hi = next_random(&g->rng);
+    uint64_t lo = next_random(&g->rng);
+    hi = (hi & ~0xf000ULL) | 0x4000ULL;                        // Version 4
+    lo = (lo & ~(3ULL << 62)) | (2ULL << 62);                  // RFC 4122 variant
+    char *o = out;
+    for (int i = 0; i < 16; i++) {
+        if (i == 4 || i == 6 || i == 8 || i == 10) *o++ = '-';
+        uint8_t byte = (uint8_t)(i < 8 ? hi >> (56 - 8 * i) : lo >> (56 - 8 * (i - 8)));
+        *o++ = hex[byte >> 4];
+        *o++ = hex[byte & 15];
+    }
+    return o - out;
+}
+
+// Longest text seg can render to
+static size_t segment_max(const Template *t, const Segment *seg, const Record *rec) {
+    const char *start;
+    size_t len;
+    switch (seg->type) {
+        case SEG_TEXT:
+            return seg->len;
+        case SEG_COLUMN:
+            if (!rec || record_field(rec, seg->column, &start, &len) != 0) return 0;
+            return t->encode ? URL_ENCODED_MAX(len) : len;
+        case SEG_RAND_INT:
+        case SEG_SEQ:
+            return INT_TEXT_MAX;
+        case SEG_UUID:
+            return UUID_TEXT_LEN;
+        case SEG_CHOICE:
+            len = 0;
+            for (int i = 0; i < seg->options; i++) {
+                size_t l = t->choices[seg->first + i].len;
+                if (l > len) len = l;
+            }
+            return t->encode ? URL_ENCODED_MAX(len) : len;
+    }
+    return 0;
+}
+
+// Render a template for one record; unquoting never grows a field, so one allocation suffices
+char *render_template(const Template *t, const Record *rec) {
+    const char *start;
+    size_t len;
+    size_t total = 0;
+    for (int i = 0; i < t->count; i++) {
+        total += segment_max(t, &t->segs[i], rec);
+    }
+
+    char *out = malloc(total + 1);
+    if (!out) return NULL;
+
+    GenState *g = thread_generators();
+    char *o = out;
+    for (int i = 0; i < t->count; i++) {
+        const Segment *seg = &t->segs[i];
+        if (seg->type == SEG_TEXT) {
+            memcpy(o, seg->text, seg->len);
+            o += seg->len;
+        } else if (seg->type == SEG_RAND_INT) {
+            int64_t v = (int64_t)((uint64_t)seg->min + random_below(g, seg->span));
+            o += snprintf(o, INT_TEXT_MAX + 1, "%" PRId64, v);
+        } else if (seg->type == SEG_SEQ) {
+            o += snprintf(o, INT_TEXT_MAX + 1, "%" PRIu64, g->seq);
+        } else if (seg->type == SEG_UUID) {
+            o += write_uuid(g, o);
+        } else if (seg->type == SEG_CHOICE) {
+            const Choice *c = &t->choices[seg->first + random_below(g, (uint64_t)seg->options)];
+            if (t->encode) {
+                o += url_encode(c->text, c->len, o, ENCODE_URL);
+            } else {
+                memcpy(o, c->text, c->len);
+                o += c->len;
+            }
+        } else if (rec && record_field(rec, seg->column, &start, &len) == 0) {
+            if (t->encode) {
+                // Unquote into scratch space, then encode into the output
+                char scratch[256];
+                char *raw = len <= sizeof(scratch) ? scratch : malloc(len);
+                if (!raw) {
+                    free(out);
+                    return NULL;
+                }
+                o += url_encode(raw, copy_field(rec->feeder, start, len, raw), o, ENCODE_URL);
+                if (raw != scratch) free(raw);
+            } else {
+                o += copy_field(rec->feeder, start, len, o);
+            }
+        }
+    }
+    *o = '\0';
+    return out;
+}
@@ -0,0 +1,72 @@
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include "feeder.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+    SEG_TEXT,      // Literal text
+    SEG_COLUMN,    // ${column} taken from the current feeder record
+    SEG_RAND_INT,  // ${rand.int(min,max)}
+    SEG_UUID,      // ${rand.uuid}, a random version 4 UUID
+    SEG_CHOICE,    // ${rand.choice(a,b,c)}
+    SEG_SEQ        // ${seq}, the number of the request within the run
+} SegmentType;
+
+typedef struct {
+    SegmentType type;
+    const char *text;  // Literal text, points into the template source
+    size_t len;
+    int column;        // Feeder column index for SEG_COLUMN
+    int64_t min;       // Lowest value of SEG_RAND_INT
+    uint64_t span;     // Values of SEG_RAND_INT, 0 for all 2^64
+    int first;         // Options of SEG_CHOICE in the template's choices
+    int options;
+} Segment;
+
+// One option of a ${rand.choice(...)}, pointing into the template source
+typedef struct {
+    const char *text;
+    size_t len;
+} Choice;
+
+typedef struct {
+    char *source;
+    Segment *segs;
+    int count;
+    Choice *choices;
+    int choice_count;
+    bool encode;  // Percent-encode substituted values as ENCODE_URL, for templates inside a URL or path
+} Template;
+
+// Compile ${name} placeholders and generator expressions in s, NULL if s has none
+Template *compile_template(const char *s, const Feeder *feeder);
+void free_template(Template *t);
+
+// Render a template for one record into a newly allocated string; generators draw from
+// the calling thread's state
+char *render_template(const Template *t, const Record *rec);
+
+// Seed every thread's generators; the same seed repeats the same values for the same requests
+void set_generator_seed(uint64_t seed);
+uint64_t generator_seed(void);
+
+// Whether any compiled template or generated body uses a generator
+bool generators_used(void);
+
+// Note a generator outside of templates, so the seed gets logged
+void use_generators(void);
+
+// Make this thread stream of streams: its own random sequence, and ${seq} numbers
+// stream + 1, stream + 1 + streams, ... so threads never hand out the same one
+void seed_thread_generators(int stream, int streams);
+
+// Seed for the next random body generated on this thread
+uint64_t next_body_seed(void);
+
+// Start the next request on this thread, advancing ${seq}
+void next_request_number(void);
+
+#endif
@@ -0,0 +1,542 @@
+#include "throughput.h"
+#include "easy_curl.h"
+#include "log.h"
+#include "profile.h"
+#include "stats.h"
+#include "timeseries.h"
+#include "utils.h"
+#include <curl/curl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+// Reflected Castagnoli polynomial
+#define CRC32C_POLY 0x82f63b78u
+
+// Connections listed one by one in the summary
+#define MAX_LISTED_CONNECTIONS 32
+
+static uint32_t crc_table[8][256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+#if defined(__x86_64__)
+static int crc_hardware = 0;
+#endif
+
+// Slice-by-8 tables, and whether the CPU has the CRC32 instruction
+static void init_crc32c(void) {
+    for (uint32_t n = 0; n < 256; n++) {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++) c = c & 1 ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        crc_table[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; n++) {
+        for (int k = 1; k < 8; k++) {
+            crc_table[k][n] = (crc_table[k - 1][n] >> 8) ^ crc_table[0][crc_table[k - 1][n] & 0xff];
+        }
+    }
+#if defined(__x86_64__)
+    crc_hardware = __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+#if defined(__x86_64__)
+// SSE4.2 computes CRC-32C natively, 8 bytes per instruction
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_hardware(uint32_t crc, const unsigned char *p, size_t len) {
+    uint64_t c = crc;
+    while (len >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        c = _mm_crc32_u64(c, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t)c;
+    while (len--) crc = _mm_crc32_u8(crc, *p++);
+    return crc;
+}
+#endif
+
+static uint32_t crc32c_software(uint32_t crc, const unsigned char *p, size_t len) {
+    while (len >= 8) {
+        uint32_t lo = crc ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+        uint32_t hi = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24;
+        crc = crc_table[7][lo & 0xff] ^ crc_table[6][(lo >> 8) & 0xff] ^
+              crc_table[5][(lo >> 16) & 0xff] ^ crc_table[4][lo >> 24] ^
+              crc_table[3][hi & 0xff] ^ crc_table[2][(hi >> 8) & 0xff] ^
+              crc_table[1][(hi >> 16) & 0xff] ^ crc_table[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--) crc = crc_table[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return crc;
+}
+
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t len) {
+    pthread_once(&crc_once, init_crc32c);
+    crc = ~crc;
+#if defined(__x86_64__)
+    if (crc_hardware) return ~crc32c_hardware(crc, data, len);
+#endif
+    return ~crc32c_software(crc, data, len);
+}
+
+// Multiply a 32x32 matrix over GF(2) by vec
+static uint32_t gf2_times(const uint32_t *mat, uint32_t vec) {
+    uint32_t sum = 0;
+    for (; vec; vec >>= 1, mat++) {
+        if (vec & 1) sum ^= *mat;
+    }
+    return sum;
+}
+
+static void gf2_square(uint32_t *square, const uint32_t *mat) {
+    for (int n = 0; n < 32; n++) square[n] = gf2_times(mat, mat[n]);
+}
+
+// Append len_b zero bytes to a by squaring the one-zero-bit operator, then fold in b
+uint32_t crc32c_combine(uint32_t a, uint32_t b, uint64_t len_b) {
+    if (len_b == 0) return a;
+
+    uint32_t even[32], odd[32];
+    odd[0] = CRC32C_POLY;
+    for (int n = 1; n < 32; n++) odd[n] = 1u << (n - 1);
+    gf2_square(even, odd);  // Two zero bits
+    gf2_square(odd, even);  // Four zero bits
+
+    while (len_b) {
+        gf2_square(even, odd);
+        if (len_b & 1) a = gf2_times(even, a);
+        len_b >>= 1;
+        if (!len_b) break;
+        gf2_square(odd, even);
+        if (len_b & 1) a = gf2_times(odd, a);
+        len_b >>= 1;
+    }
+    return a ^ b;
+}
+
+typedef struct Bench Bench;
+
+// One Range request of a download; its handle is reused by every download
+typedef struct {
+    Transfer t;             // First, so CURLINFO_PRIVATE leads back to the segment
+    Bench *bench;
+    int64_t from;           // First byte, -1 for the whole object
+    int64_t to;             // Last byte
+    bool measure;           // Counted in the results, false for the size probe
+    uint64_t bytes;         // Body bytes received
+    uint32_t crc;
+    bool ignored_range;     // The server sent the whole object instead of the range
+    int64_t size;           // Object size from Content-Range, -1 if not given
+    CURLcode result;
+    long status;
+    double started;
+    double finished;
+    char range[48];
+} RangeSegment;
+
+// Goodput of one connection, told apart by its addresses
+typedef struct {
+    char ip[64];            // Server address
+    long local_port;
+    int requests;
+    uint64_t bytes;
+    double busy;            // Seconds it carried segments over all downloads
+    double first;           // Span of its segments in the current download, first < 0 if none
+    double last;
+} Connection;
+
+struct Bench {
+    METADATA *md;
+    const Throughput *tp;
+    CURLM *multi;
+    RangeSegment *segs;
+    Stats stats;            // Every measured segment
+    Series series;          // Goodput and segment latency per second
+    uint64_t received;      // Body bytes of measured segments so far
+    uint64_t credited;      // Of which already added to the series
+    double start;
+    double compacted;
+    Connection *conns;
+    int conn_count;
+    int conn_cap;
+};
+
+// Count and optionally checksum the body as it streams in, nothing is kept
+static size_t sink_callback(char *data, size_t size, size_t nmemb, void *userp) {
+    uint64_t start = prof_ticks();
+    RangeSegment *s = (RangeSegment *)userp;
+    size_t len = size * nmemb;
+    if (s->bytes == 0 && s->from >= 0) {
+        // A server without range support answers 200 with the whole object
+        long code = 0;
+        curl_easy_getinfo(s->t.curl, CURLINFO_RESPONSE_CODE, &code);
+        if (code == 200) {
+            s->ignored_range = true;
+            return 0;
+        }
+    }
+    if (s->bench->tp->sink == SINK_CRC32C) s->crc = crc32c_update(s->crc, data, len);
+    s->bytes += len;
+    if (s->measure) s->bench->received += len;
+    prof_end(PROF_BODY, start);
+    return len;
+}
+
+// Pick the object size out of Content-Range: bytes 0-0/SIZE
+static size_t probe_header_callback(char *data, size_t size, size_t nmemb, void *userp) {
+    RangeSegment *s = (RangeSegment *)userp;
+    size_t len = size * nmemb;
+    if (len > 14 && strncasecmp(data, "Content-Range:", 14) == 0) {
+        char line[128];
+        size_t n = len < sizeof(line) - 1 ? len : sizeof(line) - 1;
+        memcpy(line, data, n);
+        line[n] = '\0';
+        const char *slash = strchr(line, '/');
+        long long total = -1;
+        s->size = slash && sscanf(slash + 1, "%lld", &total) == 1 ? total : -1;
+    }
+    return len;
+}
+
+// Configure the segment's handle for bytes from..to (from < 0 for all) and add it to the loop
+static int start_segment(Bench *b, RangeSegment *s, int64_t from, int64_t to, bool probe) {
+    s->from = from;
+    s->to = to;
+    s->measure = !probe;
+    s->bytes = 0;
+    s->crc = 0;
+    s->ignored_range = false;
+    s->size = -1;
+    s->result = CURLE_OK;
+    s->status = 0;
+
+    s->t.discard = true;
+    if (setup_transfer(&s->t, b->md, NULL, 0)) {
+        reset_transfer(&s->t);
+        return -1;
+    }
+    CURL *curl = s->t.curl;
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, sink_callback);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, s);
+    if (from >= 0) {
+        snprintf(s->range, sizeof(s->range), "%" PRId64 "-%" PRId64, from, to);
+        curl_easy_setopt(curl, CURLOPT_RANGE, s->range);
+    }
+    if (probe) {
+        curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, probe_header_callback);
+        curl_easy_setopt(curl, CURLOPT_HEADERDATA, s);
+    }
+    if (curl_multi_add_handle(b->multi, curl) != CURLM_OK) {
+        reset_transfer(&s->t);
+        return -1;
+    }
+    s->started = now_seconds();
+    return 0;
+}
+
+static Connection *find_connection(Bench *b, CURL *curl) {
+    char *ip = NULL;
+    long port = 0;
+    curl_easy_getinfo(curl, CURLINFO_PRIMARY_IP, &ip);
+    curl_easy_getinfo(curl, CURLINFO_LOCAL_PORT, &port);
+    if (!ip) ip = "";
+
+    for (int i = 0; i < b->conn_count; i++) {
+        if (b->conns[i].local_port == port && strcmp(b->conns[i].ip, ip) == 0) return &b->conns[i];
+    }
+    if (b->conn_count == b->conn_cap) {
+        int cap = b->conn_cap ? b->conn_cap * 2 : 16;
+        Connection *temp = realloc(b->conns, cap * sizeof(Connection));
+        if (!temp) return NULL;
+        b->conns = temp;
+        b->conn_cap = cap;
+    }
+    Connection *c = &b->conns[b->conn_count++];
+    memset(c, 0, sizeof(Connection));
+    snprintf(c->ip, sizeof(c->ip), "%s", ip);
+    c->local_port = port;
+    c->first = -1;
+    return c;
+}
+
+// Record a finished segment against the test, the current second and its connection
+static void finish_segment(Bench *b, RangeSegment *s, CURLcode result) {
+    CURL *curl = s->t.curl;
+    s->result = result;
+    s->finished = now_seconds();
+    curl_off_t total_us = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &s->status);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &total_us);
+    if (!s->measure) return;
+
+    Stats *win = series_window(&b->series, s->finished - b->start);
+    if (result != CURLE_OK) {
+        b->stats.failures++;
+        if (win) win->failures++;
+    } else {
+        record_latency(&b->stats, (double)total_us);
+        if (win) record_latency(win, (double)total_us);
+        if (s->status >= 400) {
+            b->stats.http_errors++;
+            if (win) win->http_errors++;
+        }
+    }
+    b->stats.bytes += s->bytes;
+
+    Connection *c = result == CURLE_OK || s->bytes > 0 ? find_connection(b, curl) : NULL;
+    if (c) {
+        c->requests++;
+        c->bytes += s->bytes;
+        if (c->first < 0 || s->started < c->first) c->first = s->started;
+        if (s->finished > c->last) c->last = s->finished;
+    }
+}
+
+// Add the bytes received since the last turn to the current second
+static void sample_series(Bench *b) {
+    double now = now_seconds();
+    Stats *win = series_window(&b->series, now - b->start);
+    if (win) {
+        win->bytes += b->received - b->credited;
+        b->credited = b->received;
+    }
+    if (now - b->compacted >= 1.0) {
+        compact_series(&b->series, now - b->start);
+        b->compacted = now;
+    }
+}
+
+// Drive the started segments to completion
+static void run_segments(Bench *b, int active) {
+    while (active > 0) {
+        uint64_t turn = prof_ticks();
+        int running = 0;
+        curl_multi_perform(b->multi, &running);
+
+        CURLMsg *msg;
+        int left;
+        while ((msg = curl_multi_info_read(b->multi, &left)) != NULL) {
+            if (msg->msg != CURLMSG_DONE) continue;
+            CURL *easy = msg->easy_handle;
+            CURLcode result = msg->data.result;
+            Transfer *t = NULL;
+            curl_easy_getinfo(easy, CURLINFO_PRIVATE, (char **)&t);
+            finish_segment(b, (RangeSegment *)t, result);
+            curl_multi_remove_handle(b->multi, easy);
+            reset_transfer(t);
+            active--;
+        }
+
+        sample_series(b);
+        prof_end(PROF_LOOP, turn);
+        if (active == 0) break;
+        uint64_t wait = prof_ticks();
+        curl_multi_poll(b->multi, NULL, 0, 100, NULL);
+        prof_end(PROF_WAIT, wait);
+    }
+}
+
+// Ask for the first byte to learn the object size and whether byte ranges are served
+static int64_t probe_size(Bench *b, const char *path) {
+    RangeSegment *s = &b->segs[0];
+    if (start_segment(b, s, 0, 0, true)) return -1;
+    run_segments(b, 1);
+
+    if (s->ignored_range) {
+        LOG_WARN("%s: the server does not serve byte ranges, downloading in one piece", path);
+    } else if (s->result != CURLE_OK) {
+        LOG_WARN("%s: size probe failed (%s), downloading in one piece", path, curl_easy_strerror(s->result));
+    } else if (s->status != 206) {
+        LOG_WARN("%s: size probe got HTTP %ld, downloading in one piece", path, s->status);
+    } else if (s->size < 0) {
+        LOG_WARN("%s: the server did not tell the object size, downloading in one piece", path);
+    } else {
+        return s->size;
+    }
+    return -1;
+}
+
+// Whether a segment delivered its whole range, logging why not
+static bool segment_complete(const RangeSegment *s, int index) {
+    if (s->ignored_range) {
+        LOG_ERROR("Segment %d: the server ignored the Range header", index + 1);
+    } else if (s->result != CURLE_OK) {
+        LOG_ERROR("Segment %d failed: %s", index + 1, curl_easy_strerror(s->result));
+    } else if (s->status >= 400 || (s->from >= 0 && s->status != 206)) {
+        LOG_ERROR("Segment %d: HTTP %ld", index + 1, s->status);
+    } else if (s->from >= 0 && s->bytes != (uint64_t)(s->to - s->from + 1)) {
+        LOG_ERROR("Segment %d: received %llu of %lld bytes", index + 1,
+                  (unsigned long long)s->bytes, (long long)(s->to - s->from + 1));
+    } else {
+        return true;
+    }
+    return false;
+}
+
+// Close the per-download span of every connection into its busy time
+static void close_connection_spans(Bench *b) {
+    for (int i = 0; i < b->conn_count; i++) {
+        Connection *c = &b->conns[i];
+        if (c->first < 0) continue;
+        c->busy += c->last - c->first;
+        c->first = -1;
+    }
+}
+
+static void print_connections(const Bench *b) {
+    LOG_INFO("Connections: %d", b->conn_count);
+    for (int i = 0; i < b->conn_count && i < MAX_LISTED_CONNECTIONS; i++) {
+        const Connection *c = &b->conns[i];
+        LOG_INFO("  %s from port %ld: %d requests, %.2f MB, %.2f MB/s", c->ip[0] ? c->ip : "(socket)",
+                 c->local_port, c->requests, c->bytes / 1e6, c->busy > 0 ? c->bytes / 1e6 / c->busy : 0.0);
+    }
+    if (b->conn_count > MAX_LISTED_CONNECTIONS) {
+        LOG_INFO("  ... and %d more", b->conn_count - MAX_LISTED_CONNECTIONS);
+    }
+}
+
+int run_throughput(const char *path, METADATA *md, const LoadOptions *opts) {
+    const Throughput *tp = md->throughput;
+    Bench b;
+    memset(&b, 0, sizeof(Bench));
+    b.md = md;
+    b.tp = tp;
+    init_stats(&b.stats);
+    init_series(&b.series);
+
+    int rc = -1;
+    b.multi = curl_multi_init();
+    b.segs = calloc(tp->segments, sizeof(RangeSegment));
+    if (!b.multi || !b.segs) {
+        LOG_ERROR("Failed to allocate throughput test");
+        goto DONE;
+    }
+    // One connection per segment, so each gets its own congestion window even over HTTP/2
+    curl_multi_setopt(b.multi, CURLMOPT_PIPELINING, (long)CURLPIPE_NOTHING);
+    curl_multi_setopt(b.multi, CURLMOPT_MAXCONNECTS, (long)tp->segments + 1);
+    for (int i = 0; i < tp->segments; i++) {
+        b.segs[i].bench = &b;
+        b.segs[i].t.curl = curl_easy_init();
+        if (!b.segs[i].t.curl) {
+            LOG_ERROR("curl_easy_init failed");
+            goto DONE;
+        }
+    }
+
+    // The size probe is part of the test: a client has to learn the size too
+    b.start = now_seconds();
+    b.compacted = b.start;
+    double cpu_start = thread_cpu_seconds();
+    int segments = 1;
+    int64_t size = -1;
+    if (tp->segments > 1) {
+        size = probe_size(&b, path);
+        if (size > 0) segments = size < tp->segments ? (int)size : tp->segments;
+    }
+    int64_t chunk = size > 0 ? (size + segments - 1) / segments : 0;
+    int downloads = opts->requests > 0 ? (int)opts->requests : tp->downloads;
+    const char *sink = tp->sink == SINK_CRC32C ? "crc32c" : "discard";
+    if (size > 0) {
+        LOG_INFO("Throughput test of %s: %.2f MB in %d segments of up to %.2f MB, sink %s", path,
+                 size / 1e6, segments, chunk / 1e6, sink);
+    } else {
+        LOG_INFO("Throughput test of %s: one request per download, sink %s", path, sink);
+    }
+
+    int done = 0, failed = 0;
+    double best = 0, worst = 0, sum = 0;
+    uint32_t first_crc = 0;
+    while (opts->duration > 0 ? now_seconds() - b.start < opts->duration : done < downloads) {
+        double t0 = now_seconds();
+        uint64_t before = b.received;
+        int started = 0;
+        for (int i = 0; i < segments; i++) {
+            int64_t from = size > 0 ? i * chunk : -1;
+            int64_t to = size > 0 ? (from + chunk < size ? from + chunk : size) - 1 : -1;
+            if (start_segment(&b, &b.segs[i], from, to, false)) break;
+            started++;
+        }
+        run_segments(&b, started);
+        close_connection_spans(&b);
+        double took = now_seconds() - t0;
+        done++;
+        if (started < segments) {
+            LOG_ERROR("Failed to start segment %d of download %d", started + 1, done);
+            failed++;
+            break;
+        }
+
+        // Segments are checksummed independently and combined in order
+        bool ok = true;
+        uint32_t crc = 0;
+        uint64_t bytes = b.received - before;
+        for (int i = 0; i < segments; i++) {
+            if (!segment_complete(&b.segs[i], i)) ok = false;
+            crc = crc32c_combine(crc, b.segs[i].crc, b.segs[i].bytes);
+        }
+        double mbps = took > 0 ? bytes / 1e6 / took : 0;
+        if (tp->sink == SINK_CRC32C) {
+            LOG_INFO("Download %d: %.2f MB in %.2f s, %.2f MB/s, crc32c %08x", done, bytes / 1e6, took, mbps, crc);
+        } else {
+            LOG_INFO("Download %d: %.2f MB in %.2f s, %.2f MB/s", done, bytes / 1e6, took, mbps);
+        }
+        if (ok && tp->sink == SINK_CRC32C) {
+            if (tp->verify && crc != tp->crc32c) {
+                LOG_ERROR("Download %d: crc32c %08x does not match the expected %08x", done, crc, tp->crc32c);
+                ok = false;
+            } else if (!tp->verify && done > 1 && crc != first_crc) {
+                LOG_WARN("Download %d: crc32c %08x differs from the first download's %08x", done, crc, first_crc);
+            }
+            if (done == 1) first_crc = crc;
+        }
+        if (!ok) {
+            failed++;
+            continue;
+        }
+        sum += mbps;
+        if (mbps > best) best = mbps;
+        if (worst == 0 || mbps < worst) worst = mbps;
+    }
+    double elapsed = now_seconds() - b.start;
+    double cpu = thread_cpu_seconds() - cpu_start;
+    sample_series(&b);
+    compact_series(&b.series, elapsed);
+
+    const Stats *st = &b.stats;
+    int passed = done - failed;
+    LOG_INFO("========== THROUGHPUT SUMMARY ========");
+    LOG_INFO("Downloads: %d (failed %d), %.2f MB received in %.2f s", done, failed, st->bytes / 1e6, elapsed);
+    LOG_INFO("Goodput: %.2f MB/s aggregate, per download min %.2f  mean %.2f  max %.2f MB/s",
+             elapsed > 0 ? st->bytes / 1e6 / elapsed : 0.0, worst, passed ? sum / passed : 0.0, best);
+    LOG_INFO("Segments: %llu (failed %llu, HTTP >= 400: %llu), p50 %.2f  p99 %.2f  max %.2f ms",
+             (unsigned long long)(st->count + st->failures), (unsigned long long)st->failures,
+             (unsigned long long)st->http_errors, stats_quantile(st, 0.50) / 1000,
+             stats_quantile(st, 0.99) / 1000, st->max_us / 1000);
+    print_connections(&b);
+    LOG_INFO("Client: %.2f s CPU, %.0f%% of the test", cpu, elapsed > 0 ? cpu / elapsed * 100 : 0.0);
+    if (elapsed > 0 && client_saturated(cpu / elapsed)) {
+        LOG_WARN("Client saturated: goodput may be limited by capis rather than the server%s",
+                 tp->sink == SINK_CRC32C ? ", try sink: discard" : "");
+    }
+    print_series(path, &b.series, elapsed);
+    if (opts->timeseries) append_series_csv(opts->timeseries, path, &b.series, elapsed);
+    rc = failed ? -1 : 0;
+
+DONE:
+    for (int i = 0; b.segs && i < tp->segments; i++) {
+        if (b.segs[i].t.curl) curl_easy_cleanup(b.segs[i].t.curl);
+    }
+    free(b.segs);
+    if (b.multi) curl_multi_cleanup(b.multi);
+    free(b.conns);
+    free_series(&b.series);
+    return rc;
+}
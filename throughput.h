@@ -0,0 +1,20 @@
+#ifndef THROUGHPUT_H
+#define THROUGHPUT_H
+
+#include "multi_curl.h"
+#include "read_yaml.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32C (Castagnoli) of len more bytes after crc, 0 to start a new one
+uint32_t crc32c_update(uint32_t crc, const void *data, size_t len);
+
+// CRC-32C of a followed by b, from their checksums and the length of b
+uint32_t crc32c_combine(uint32_t a, uint32_t b, uint64_t len_b);
+
+// Download md as often as md->throughput asks, each download split into parallel Range
+// requests on one event loop with nothing buffered. Logs goodput per download, per
+// connection and in total. -n replaces the number of downloads, -d repeats them until it passes.
+int run_throughput(const char *path, METADATA *md, const LoadOptions *opts);
+
+#endif
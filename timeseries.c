@@ -0,0 +1,190 @@
+#include "timeseries.h"
+#include "log.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+// A window is rolled into a tier once the whole tier bucket holding it is older than age seconds.
+// Fresh results keep one-second detail, a 12 hour soak ends up with about 500 windows per case.
+typedef struct {
+    double span;
+    double age;
+} Tier;
+
+static const Tier tiers[] = {
+    {10, 60},       // 10 s windows after a minute
+    {60, 600},      // 1 min windows after 10 minutes
+    {600, 21600},   // 10 min windows after 6 hours
+};
+#define TIER_COUNT (int)(sizeof(tiers) / sizeof(tiers[0]))
+
+void init_series(Series *s) {
+    memset(s, 0, sizeof(Series));
+}
+
+void free_series(Series *s) {
+    free(s->windows);
+    init_series(s);
+}
+
+static Window *add_window(Series *s, double start, double span) {
+    if (s->count == s->cap) {
+        int cap = s->cap ? s->cap * 2 : 64;
+        Window *windows = realloc(s->windows, cap * sizeof(Window));
+        if (!windows) return NULL;
+        s->windows = windows;
+        s->cap = cap;
+    }
+    Window *w = &s->windows[s->count++];
+    w->start = start;
+    w->span = span;
+    init_stats(&w->stats);
+    w->untimed = 0;
+    w->churn = 0;
+    return w;
+}
+
+static void merge_window(Window *dst, const Window *src) {
+    merge_stats(&dst->stats, &src->stats);
+    dst->untimed += src->untimed;
+    dst->churn += src->churn;
+}
+
+Window *series_slot(Series *s, double t) {
+    if (t < 0) t = 0;
+    // Times only move forward, and compaction never reaches the current second
+    if (s->count > 0) {
+        Window *last = &s->windows[s->count - 1];
+        if (t < last->start + last->span) return last;
+    }
+    return add_window(s, floor(t), 1);
+}
+
+Stats *series_window(Series *s, double t) {
+    Window *w = series_slot(s, t);
+    return w ? &w->stats : NULL;
+}
+
+void compact_series(Series *s, double now) {
+    int out = 0;
+    for (int i = 0; i < s->count; i++) {
+        double start = s->windows[i].start;
+        double span = s->windows[i].span;
+
+        // Coarsest tier first: an old enough coarse bucket implies its finer ones are old enough too
+        for (int k = TIER_COUNT - 1; k >= 0 && tiers[k].span > span; k--) {
+            double bucket = floor(start / tiers[k].span) * tiers[k].span;
+            if (bucket + tiers[k].span <= now - tiers[k].age) {
+                start = bucket;
+                span = tiers[k].span;
+                break;
+            }
+        }
+
+        Window *prev = out > 0 ? &s->windows[out - 1] : NULL;
+        if (prev && prev->start == start && prev->span == span) {
+            merge_window(prev, &s->windows[i]);
+        } else {
+            if (out != i) s->windows[out] = s->windows[i];
+            s->windows[out].start = start;
+            s->windows[out].span = span;
+            out++;
+        }
+    }
+    s->count = out;
+}
+
+int merge_series(Series *dst, const Series *src) {
+    if (src->count == 0) return 0;
+
+    Series merged;
+    init_series(&merged);
+    int i = 0, j = 0;
+    while (i < dst->count || j < src->count) {
+        const Window *a = i < dst->count ? &dst->windows[i] : NULL;
+        const Window *b = j < src->count ? &src->windows[j] : NULL;
+        const Window *first = !b || (a && a->start <= b->start) ? a : b;
+        Window *w = add_window(&merged, first->start, first->span);
+        if (!w) {
+            free_series(&merged);
+            return -1;
+        }
+        if (a && a->start == first->start) {
+            merge_window(w, a);
+            i++;
+        }
+        if (b && b->start == first->start) {
+            merge_window(w, b);
+            j++;
+        }
+    }
+    free_series(dst);
+    *dst = merged;
+    return 0;
+}
+
+// Length of a window that was actually run: the last one may be cut short, but never below
+// the one-second resolution so a window that just opened does not report a burst
+static double window_length(const Window *w, double elapsed) {
+    double span = elapsed - w->start;
+    if (span > w->span || elapsed <= 0) return w->span;
+    return span < 1.0 ? 1.0 : span;
+}
+
+static void write_series_header(FILE *fp) {
+    fprintf(fp, "case,start_s,span_s,requests,rps,errors,mean_ms,p50_ms,p90_ms,p99_ms,max_ms,mb_s,churn\n");
+}
+
+static void write_series_csv(FILE *fp, const char *name, const Series *s, double elapsed) {
+    for (int i = 0; i < s->count; i++) {
+        const Window *w = &s->windows[i];
+        const Stats *st = &w->stats;
+        uint64_t requests = st->count + st->failures + w->untimed;
+        double mean = st->count ? st->total_us / st->count : 0;
+
+        fputc('"', fp);
+        for (const char *p = name; *p; p++) {
+            if (*p == '"') fputc('"', fp);
+            fputc(*p, fp);
+        }
+        fprintf(fp, "\",%.0f,%.0f,%llu,%.1f,%llu,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%llu\n",
+                w->start, w->span, (unsigned long long)requests, requests / window_length(w, elapsed),
+                (unsigned long long)(st->failures + st->http_errors), mean / 1000.0,
+                stats_quantile(st, 0.50) / 1000.0, stats_quantile(st, 0.90) / 1000.0,
+                stats_quantile(st, 0.99) / 1000.0, st->max_us / 1000.0,
+                st->bytes / 1e6 / window_length(w, elapsed), (unsigned long long)w->churn);
+    }
+}
+
+int append_series_csv(const char *file, const char *name, const Series *s, double elapsed) {
+    FILE *fp = fopen(file, "a");
+    if (!fp) {
+        LOG_ERROR("Failed to open time series file %s", file);
+        return -1;
+    }
+    if (ftell(fp) == 0) write_series_header(fp);
+    write_series_csv(fp, name, s, elapsed);
+    fclose(fp);
+    return 0;
+}
+
+void print_series(const char *name, const Series *s, double elapsed) {
+    print_series_unit(name, s, elapsed, "req/s");
+}
+
+void print_series_unit(const char *name, const Series *s, double elapsed, const char *unit) {
+    LOG_INFO("========== TIME SERIES %s ==========", name);
+    for (int i = 0; i < s->count; i++) {
+        const Window *w = &s->windows[i];
+        const Stats *st = &w->stats;
+        uint64_t requests = st->count + st->failures + w->untimed;
+        char churn[32] = "";
+        if (w->churn) snprintf(churn, sizeof(churn), " %6llu churn", (unsigned long long)w->churn);
+        LOG_INFO("%6.0fs +%-3.0fs %9.1f %s %6llu errors   p50 %8.2f   p90 %8.2f   p99 %8.2f   max %8.2f ms %9.2f MB/s%s",
+                 w->start, w->span, requests / window_length(w, elapsed), unit,
+                 (unsigned long long)(st->failures + st->http_errors),
+                 stats_quantile(st, 0.50) / 1000.0, stats_quantile(st, 0.90) / 1000.0,
+                 stats_quantile(st, 0.99) / 1000.0, st->max_us / 1000.0,
+                 st->bytes / 1e6 / window_length(w, elapsed), churn);
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef TIMESERIES_H
+#define TIMESERIES_H
+
+#include "stats.h"
+#include <stdio.h>
+
+// Results of one time window of a test
+typedef struct {
+    double start;  // Seconds since the test started, aligned to span
+    double span;   // 1 s while fresh, rolled into 10 s, 1 min and 10 min as it ages
+    Stats stats;
+    uint64_t untimed;  // Counted in the rate without a latency, like stream messages with no send time
+    uint64_t churn;    // Streams closed by the server or failed to open
+} Window;
+
+// Chronological windows of one case; memory grows with the run time, not the request count
+typedef struct {
+    Window *windows;
+    int count;
+    int cap;
+} Series;
+
+void init_series(Series *s);
+void free_series(Series *s);
+
+// The one-second window holding t (seconds since the start), NULL if out of memory
+Window *series_slot(Series *s, double t);
+
+// Histogram of the window series_slot returns
+Stats *series_window(Series *s, double t);
+
+// Roll windows that have aged past a tier into the coarser one; the result depends only on now,
+// so series compacted at the same time line up window for window
+void compact_series(Series *s, double now);
+
+// Fold src into dst, both compacted at the same time
+int merge_series(Series *dst, const Series *src);
+
+// Append one CSV row per window of s (RPS, errors, quantiles and churn) to file, with a header
+// if the file is new; elapsed cuts the last window short
+int append_series_csv(const char *file, const char *name, const Series *s, double elapsed);
+
+// Log the windows of s, one line each
+void print_series(const char *name, const Series *s, double elapsed);
+
+// Same, with the rate in unit, e.g. msg/s when each latency is a message
+void print_series_unit(const char *name, const Series *s, double elapsed, const char *unit);
+
+#endif
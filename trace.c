@@ -0,0 +1,172 @@
+#include "trace.h"
+#include "json.h"
+#include "log.h"
+#include "utils.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Load tests written so far, each gets its own block of process ids
+static int traced_tests = 0;
+
+void init_trace_buffer(TraceBuffer *b, size_t max) {
+    memset(b, 0, sizeof(TraceBuffer));
+    b->max = max;
+}
+
+void free_trace_buffer(TraceBuffer *b) {
+    free(b->events);
+    free(b->socket_conn);
+    memset(b, 0, sizeof(TraceBuffer));
+}
+
+// Connection track of the socket a transfer used; a new connection on a reused fd gets a new track
+static int connection_track(TraceBuffer *b, CURL *curl) {
+    curl_socket_t sock = CURL_SOCKET_BAD;
+    long connects = 0;
+    curl_easy_getinfo(curl, CURLINFO_ACTIVESOCKET, &sock);
+    curl_easy_getinfo(curl, CURLINFO_NUM_CONNECTS, &connects);
+    if (sock == CURL_SOCKET_BAD || sock < 0) return ++b->conns;
+
+    if ((int)sock >= b->socket_cap) {
+        int cap = b->socket_cap ? b->socket_cap : 64;
+        while (cap <= (int)sock) cap *= 2;
+        int *temp = realloc(b->socket_conn, cap * sizeof(int));
+        if (!temp) return ++b->conns;
+        memset(temp + b->socket_cap, 0, (cap - b->socket_cap) * sizeof(int));
+        b->socket_conn = temp;
+        b->socket_cap = cap;
+    }
+    if (connects > 0 || b->socket_conn[sock] == 0) b->socket_conn[sock] = ++b->conns;
+    return b->socket_conn[sock];
+}
+
+void trace_transfer(TraceBuffer *b, CURL *curl, double added_us, int case_index, CURLcode result) {
+    if (b->count == b->max) {
+        b->dropped++;
+        return;
+    }
+    if (b->count == b->cap) {
+        size_t cap = b->cap ? b->cap * 2 : 1024;
+        if (cap > b->max) cap = b->max;
+        TraceEvent *temp = realloc(b->events, cap * sizeof(TraceEvent));
+        if (!temp) {
+            b->dropped++;
+            return;
+        }
+        b->events = temp;
+        b->cap = cap;
+    }
+
+    TraceEvent *e = &b->events[b->count++];
+    memset(e, 0, sizeof(TraceEvent));
+    e->case_index = case_index;
+    e->result = result;
+    curl_easy_getinfo(curl, CURLINFO_NAMELOOKUP_TIME_T, &e->dns_us);
+    curl_easy_getinfo(curl, CURLINFO_CONNECT_TIME_T, &e->connect_us);
+    curl_easy_getinfo(curl, CURLINFO_APPCONNECT_TIME_T, &e->tls_us);
+    curl_easy_getinfo(curl, CURLINFO_PRETRANSFER_TIME_T, &e->send_us);
+    curl_easy_getinfo(curl, CURLINFO_STARTTRANSFER_TIME_T, &e->first_byte_us);
+    curl_easy_getinfo(curl, CURLINFO_TOTAL_TIME_T, &e->total_us);
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &e->status);
+
+    // A request on a reused connection may first wait for that connection to come free.
+    // Its slice starts once it holds the connection, everything since it was added is queued.
+    if (e->connect_us == 0 && e->send_us > 0) {
+        curl_off_t held = e->send_us;
+        e->dns_us = 0;
+        e->send_us = 0;
+        if (e->first_byte_us > 0) e->first_byte_us -= held;
+        e->total_us -= held;
+    }
+    e->start_us = now_seconds() * 1e6 - (double)e->total_us;
+    e->queued_us = e->start_us > added_us ? e->start_us - added_us : 0;
+    e->conn = connection_track(b, curl);
+}
+
+// Phase of a request as a nested slice, skipped when it took no time
+static void write_span(FILE *fp, const char *name, int pid, int tid, double start_us,
+                       curl_off_t from, curl_off_t to) {
+    if (to <= from) return;
+    fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"phase\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%lld,\"pid\":%d,\"tid\":%d}",
+            name, start_us + from, (long long)(to - from), pid, tid);
+}
+
+static void write_event(FILE *fp, const TraceEvent *e, const char *name, int pid) {
+    curl_off_t total = e->total_us > 0 ? e->total_us : 1;
+    fprintf(fp, ",\n{\"name\":%s,\"cat\":\"request\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%lld,\"pid\":%d,\"tid\":%d,"
+            "\"args\":{\"status\":%ld,\"queued_us\":%.0f",
+            name, e->start_us, (long long)total, pid, e->conn, e->status, e->queued_us);
+    if (e->result != CURLE_OK) fprintf(fp, ",\"error\":\"%s\"", curl_easy_strerror(e->result));
+    fprintf(fp, "}}");
+
+    // A reused connection reports no connect time, its phases start after the lookup
+    curl_off_t connected = e->dns_us;
+    if (e->connect_us > connected) connected = e->connect_us;
+    if (e->tls_us > connected) connected = e->tls_us;
+    write_span(fp, "dns", pid, e->conn, e->start_us, 0, e->dns_us);
+    write_span(fp, "connect", pid, e->conn, e->start_us, e->dns_us, e->connect_us);
+    if (e->tls_us > 0) write_span(fp, "tls", pid, e->conn, e->start_us, e->connect_us, e->tls_us);
+    write_span(fp, "send", pid, e->conn, e->start_us, connected, e->send_us);
+    if (e->first_byte_us > 0) {
+        write_span(fp, "wait", pid, e->conn, e->start_us, e->send_us, e->first_byte_us);
+        write_span(fp, "transfer", pid, e->conn, e->start_us, e->first_byte_us, e->total_us);
+    }
+}
+
+int write_trace(const char *path, const TraceBuffer *buffers, int count, const char *const *case_names) {
+    // Reopen an earlier test's array and continue it in place of its closing bracket
+    FILE *fp = fopen(path, "r+");
+    if (!fp) fp = fopen(path, "w");
+    if (!fp) {
+        LOG_ERROR("Failed to open trace file %s", path);
+        return -1;
+    }
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    if (size >= 2) {
+        fseek(fp, -2, SEEK_END);
+    } else {
+        fseek(fp, 0, SEEK_SET);
+    }
+    // Every record below starts with ",\n", so each test opens with a placeholder record
+    fprintf(fp, "%s{\"name\":\"trace\",\"ph\":\"M\",\"pid\":0,\"args\":{}}", size >= 2 ? ",\n" : "[\n");
+
+    int test = ++traced_tests;
+    int n = 0;
+    while (case_names[n]) n++;
+    char **names = calloc(n + 1, sizeof(char *));
+    for (int c = 0; names && c < n; c++) {
+        names[c] = json_quote(case_names[c]);
+    }
+
+    size_t dropped = 0;
+    for (int w = 0; w < count; w++) {
+        const TraceBuffer *b = &buffers[w];
+        int pid = test * 1000 + w + 1;
+        fprintf(fp, ",\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"args\":{\"name\":\"test %d worker %d\"}}",
+                pid, test, w + 1);
+        for (int conn = 1; conn <= b->conns; conn++) {
+            fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"conn %d\"}}",
+                    pid, conn, conn);
+        }
+        for (size_t i = 0; i < b->count; i++) {
+            const TraceEvent *e = &b->events[i];
+            const char *name = names && names[e->case_index] ? names[e->case_index] : "\"request\"";
+            write_event(fp, e, name, pid);
+        }
+        dropped += b->dropped;
+    }
+    fprintf(fp, "\n]");
+    fclose(fp);
+
+    for (int c = 0; names && c < n; c++) {
+        free(names[c]);
+    }
+    free(names);
+    if (dropped > 0) {
+        LOG_WARN("Trace buffer full, %zu requests were not traced", dropped);
+    }
+    return 0;
+}
@@ -0,0 +1,48 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <curl/curl.h>
+#include <stddef.h>
+
+// Events kept per load test before tracing stops, about 64 MB
+#define TRACE_MAX_EVENTS 1000000
+
+// One finished request; phase ends are microseconds after start, as libcurl reports them
+typedef struct {
+    double start_us;        // Monotonic time libcurl started the request
+    double queued_us;       // Time between adding it to the loop and its start
+    curl_off_t dns_us;
+    curl_off_t connect_us;
+    curl_off_t tls_us;      // 0 without TLS
+    curl_off_t send_us;     // Request about to be sent
+    curl_off_t first_byte_us;
+    curl_off_t total_us;
+    long status;
+    int conn;               // Connection track, unique within the worker
+    int case_index;
+    CURLcode result;
+} TraceEvent;
+
+// Per-worker event buffer, filled without locks and written once the test is over
+typedef struct {
+    TraceEvent *events;
+    size_t count;
+    size_t cap;
+    size_t max;             // Events to keep, later ones are counted as dropped
+    size_t dropped;
+    int *socket_conn;       // Connection track of each open socket, 0 for none yet
+    int socket_cap;
+    int conns;              // Connection tracks handed out
+} TraceBuffer;
+
+void init_trace_buffer(TraceBuffer *b, size_t max);
+void free_trace_buffer(TraceBuffer *b);
+
+// Record a transfer that just finished and was added to the loop at added_us
+void trace_transfer(TraceBuffer *b, CURL *curl, double added_us, int case_index, CURLcode result);
+
+// Add the buffers of one load test to a Chrome trace-event JSON array at path, one process per
+// worker and one thread per connection. The file stays valid JSON after every test.
+int write_trace(const char *path, const TraceBuffer *buffers, int count, const char *const *case_names);
+
+#endif
@@ -0,0 +1,156 @@
+#include "urlencode.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// 1 for RFC 3986 unreserved bytes (ALPHA / DIGIT / "-" / "." / "_" / "~"), copied as-is
+static const unsigned char unreserved[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 0,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 1,
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1,
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 1, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+};
+
+static const char hex[] = "0123456789ABCDEF";
+
+// RFC 3986 gen-delims and sub-delims, plus '%' so escapes already in a URL survive
+static bool reserved(unsigned char c) {
+    switch (c) {
+        case ':': case '/': case '?': case '#': case '[': case ']': case '@':
+        case '!': case '$': case '&': case '\'': case '(': case ')': case '*':
+        case '+': case ',': case ';': case '=': case '%':
+            return true;
+    }
+    return false;
+}
+
+#ifdef __SSE2__
+// Bitmask of the unreserved bytes among the 16 at p
+static inline unsigned safe_mask16(const char *p) {
+    __m128i v = _mm_loadu_si128((const __m128i *)p);
+    // Bytes >= 0x80 are negative as signed chars and fall outside every range
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+                                  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+    __m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                                  _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i mark = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('-')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('.'))),
+                                _mm_or_si128(_mm_cmpeq_epi8(v, _mm_set1_epi8('_')),
+                                             _mm_cmpeq_epi8(v, _mm_set1_epi8('~'))));
+    return (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_or_si128(digit, alpha), mark));
+}
+#endif
+
+size_t url_encode(const char *s, size_t len, char *out, EncodeMode mode) {
+    const char *p = s;
+    const char *end = s + len;
+    char *o = out;
+
+    while (p < end) {
+#ifdef __SSE2__
+        // Copy runs of unreserved bytes 16 at a time
+        while (end - p >= 16) {
+            unsigned mask = safe_mask16(p);
+            if (mask == 0xFFFF) {
+                memcpy(o, p, 16);
+                o += 16;
+                p += 16;
+                continue;
+            }
+            unsigned run = (unsigned)__builtin_ctz(~mask);
+            memcpy(o, p, run);
+            o += run;
+            p += run;
+            break;
+        }
+        if (p >= end) break;
+#endif
+        unsigned char c = (unsigned char)*p++;
+        if (unreserved[c] || (mode == ENCODE_URL && reserved(c))) {
+            *o++ = (char)c;
+        } else if (c == ' ' && mode == ENCODE_FORM) {
+            *o++ = '+';
+        } else {
+            o[0] = '%';
+            o[1] = hex[c >> 4];
+            o[2] = hex[c & 0x0F];
+            o += 3;
+        }
+    }
+    return o - out;
+}
+
+char *url_encode_dup(const char *s, EncodeMode mode) {
+    if (!s) return NULL;
+    size_t len = strlen(s);
+    char *out = malloc(URL_ENCODED_MAX(len) + 1);
+    if (!out) return NULL;
+    out[url_encode(s, len, out, mode)] = '\0';
+    return out;
+}
+
+char *join_params(char **keys, char **values, int count) {
+    size_t len = 0;
+    for (int i = 0; i < count; i++) {
+        len += strlen(keys[i]) + strlen(values[i]) + 2; // key=value&
+    }
+
+    char *out = malloc(len + 1);
+    if (!out) return NULL;
+
+    char *o = out;
+    for (int i = 0; i < count; i++) {
+        size_t key_len = strlen(keys[i]);
+        size_t value_len = strlen(values[i]);
+        if (i > 0) *o++ = '&';
+        memcpy(o, keys[i], key_len);
+        o += key_len;
+        *o++ = '=';
+        memcpy(o, values[i], value_len);
+        o += value_len;
+    }
+    *o = '\0';
+    return out;
+}
+
+char *build_url(const char *url, const char *host, const char *path, int secure, const char *query) {
+    const char *separator = "";
+    if (query && *query) {
+        const char *base = url && *url ? url : path;
+        separator = base && strchr(base, '?') ? "&" : "?";
+    } else {
+        query = "";
+    }
+
+    size_t len;
+    char *out;
+    if (url && *url) {
+        len = strlen(url) + strlen(query) + 2;
+        out = malloc(len);
+        if (out) snprintf(out, len, "%s%s%s", url, separator, query);
+    } else {
+        if (!host) host = "";
+        if (!path) path = "";
+        len = strlen(host) + strlen(path) + strlen(query) + 16;
+        out = malloc(len);
+        if (out) snprintf(out, len, "%s://%s%s%s%s", secure ? "https" : "http", host, path, separator, query);
+    }
+    return out;
+}
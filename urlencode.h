@@ -0,0 +1,27 @@
+#ifndef URLENCODE_H
+#define URLENCODE_H
+
+#include <stddef.h>
+
+typedef enum {
+    ENCODE_QUERY,  // RFC 3986: everything but unreserved bytes becomes %XX
+    ENCODE_FORM,   // application/x-www-form-urlencoded: like ENCODE_QUERY, but space becomes '+'
+    ENCODE_URL     // A URL or path: reserved bytes such as / : ? & = @ and % are kept as they are
+} EncodeMode;
+
+// Worst-case encoded length of len input bytes
+#define URL_ENCODED_MAX(len) ((len) * 3)
+
+// Percent-encode len bytes of s into out (at least URL_ENCODED_MAX(len) bytes), returns the length written
+size_t url_encode(const char *s, size_t len, char *out, EncodeMode mode);
+
+// Percent-encode a string into a newly allocated one
+char *url_encode_dup(const char *s, EncodeMode mode);
+
+// Join count already-encoded keys and values as k=v&k=v into a newly allocated string
+char *join_params(char **keys, char **values, int count);
+
+// Build url, or scheme://host/path when url is empty, with an optional encoded query appended
+char *build_url(const char *url, const char *host, const char *path, int secure, const char *query);
+
+#endif
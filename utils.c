@@ -1,44 +1,60 @@
 #include "utils.h"
 #include <stdlib.h>
+#include <strings.h>
 #include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+int ap_pathlist(PathList *l, const char *path) {
+    if (!l || !path) return -1;
+    if (l->count == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 16;
+        char **temp = realloc(l->paths, cap * sizeof(char *));
+        if (!temp) return -1;
+        l->paths = temp;
+        l->cap = cap;
+    }
+    char *copy = strdup(path);
+    if (!copy) return -1;
+    l->paths[l->count++] = copy;
+    return 0;
+}
 
-StrLList init_strllist() {
-    StrLList l = malloc(sizeof(Node));
-    if (!l) return NULL;
-    l->val = NULL;
-    l->next = NULL;
-    return l;
+static int compare_paths(const void *a, const void *b) {
+    return strcmp(*(char *const *)a, *(char *const *)b);
 }
 
-int ap_strllist(StrLList l, char *val) {
-    if (!l) return -1;
-    Node *node = malloc(sizeof(Node));
-    if (!node) return -1;
+void sort_pathlist(PathList *l, size_t from) {
+    if (!l || from >= l->count) return;
 
-    node->val = strdup(val);
-    if (!node->val) {
-        free(node);
-        return -1;
+    qsort(l->paths + from, l->count - from, sizeof(char *), compare_paths);
+    size_t out = from + 1;
+    for (size_t i = from + 1; i < l->count; i++) {
+        if (strcmp(l->paths[i], l->paths[out - 1]) == 0) {
+            free(l->paths[i]);
+        } else {
+            l->paths[out++] = l->paths[i];
+        }
     }
-    node->next = NULL;
-
-    Node *cur = l;
-    while (cur->next) cur = cur->next;
-    cur->next = node;
-
-    return 0;
+    l->count = out;
 }
 
-void free_strllist(StrLList l) {
+void free_pathlist(PathList *l) {
     if (!l) return;
 
-    Node *cur = l;
-    while (cur) {
-        Node *next = cur->next;
-        if (cur->val) free(cur->val);
-        free(cur);
-        cur = next;
+    for (size_t i = 0; i < l->count; i++) {
+        free(l->paths[i]);
     }
+    free(l->paths);
+    l->paths = NULL;
+    l->count = l->cap = 0;
 }
 
 char *strndup(const char *s, size_t n) {
@@ -106,3 +122,120 @@ char **split_lines(const char *str) {
     free(copy);
     return lines;
 }
+
+uint64_t hash_bytes(const void *data, size_t len) {
+    const unsigned char *p = (const unsigned char *)data;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < len; i++) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+    return h;
+}
+
+uint64_t next_random(uint64_t *state) {
+    uint64_t x = *state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+int64_t parse_size(const char *s) {
+    static const struct { const char *unit; double scale; } units[] = {
+        {"", 1}, {"b", 1},
+        {"k", 1e3}, {"kb", 1e3}, {"m", 1e6}, {"mb", 1e6}, {"g", 1e9}, {"gb", 1e9}, {"t", 1e12}, {"tb", 1e12},
+        {"kib", 1024.0}, {"mib", 1048576.0}, {"gib", 1073741824.0}, {"tib", 1099511627776.0},
+    };
+    if (!s) return -1;
+    char *end = NULL;
+    double v = strtod(s, &end);
+    if (end == s || v < 0) return -1;
+    while (*end == ' ') end++;
+    for (size_t i = 0; i < sizeof(units) / sizeof(units[0]); i++) {
+        if (strcasecmp(end, units[i].unit) == 0) {
+            double bytes = v * units[i].scale;
+            return bytes < 9.2e18 ? (int64_t)bytes : -1;
+        }
+    }
+    return -1;
+}
+
+double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+MappedFile *map_file(const char *path) {
+    if (!path) return NULL;
+
+    MappedFile *mf = calloc(1, sizeof(MappedFile));
+    if (!mf) return NULL;
+    mf->path = strdup(path);
+    if (!mf->path) {
+        free(mf);
+        return NULL;
+    }
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) goto FAIL;
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size)) {
+        CloseHandle(file);
+        goto FAIL;
+    }
+    mf->size = (size_t)size.QuadPart;
+    if (mf->size > 0) {
+        HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mapping) {
+            mf->data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping); // The view keeps the mapping alive
+        }
+    }
+    CloseHandle(file);
+    if (mf->size > 0 && !mf->data) goto FAIL;
+#else
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) goto FAIL;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        goto FAIL;
+    }
+    mf->size = (size_t)st.st_size;
+    if (mf->size > 0) {
+        void *data = mmap(NULL, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) {
+            close(fd);
+            goto FAIL;
+        }
+        madvise(data, mf->size, MADV_SEQUENTIAL);
+        mf->data = data;
+    }
+    close(fd); // The mapping stays valid after the descriptor is closed
+#endif
+    return mf;
+
+FAIL:
+    free(mf->path);
+    free(mf);
+    return NULL;
+}
+
+void unmap_file(MappedFile *mf) {
+    if (!mf) return;
+
+    if (mf->data) {
+#ifdef _WIN32
+        UnmapViewOfFile(mf->data);
+#else
+        munmap(mf->data, mf->size);
+#endif
+    }
+    free(mf->path);
+    free(mf);
+}
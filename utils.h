@@ -1,20 +1,52 @@
 #ifndef UTILS_H
 #define UTILS_H
 
-typedef struct Node {
-    char *val;
-    struct Node *next;
-} Node;
-
-typedef Node* StrLList;
-
 #include <stddef.h>
+#include <stdint.h>
+
+// Growable contiguous array of owned paths, zero-initialise to start empty
+typedef struct {
+    char **paths;
+    size_t count;
+    size_t cap;
+} PathList;
 
 char *strndup(const char *s, size_t n);
 
-StrLList init_strllist();
-int ap_strllist(StrLList l, char *val);
-void free_strllist(StrLList l);
+// Append a copy of path, amortised O(1)
+int ap_pathlist(PathList *l, const char *path);
+// Sort paths[from..count) and drop duplicates within that range
+void sort_pathlist(PathList *l, size_t from);
+void free_pathlist(PathList *l);
 char **split_lines(const char *str);
 
+// 64-bit FNV-1a hash of a byte range
+uint64_t hash_bytes(const void *data, size_t len);
+
+// xorshift64* step over a private, non-zero state
+uint64_t next_random(uint64_t *state);
+
+// splitmix64 finalizer, spreads a counter or seed over all 64 bits
+static inline uint64_t mix64(uint64_t z) {
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+// Parse a size such as 512, 64KB, 1.5MB or 1GiB into bytes (KB is 1000, KiB 1024), -1 if invalid
+int64_t parse_size(const char *s);
+
+// Monotonic clock in seconds
+double now_seconds(void);
+
+typedef struct {
+    char *path;   // Path the file was mapped from
+    char *data;   // Read-only mapping of the whole file (NULL when empty)
+    size_t size;  // Size of the mapping
+} MappedFile;
+
+// Map a whole file read-only into memory, NULL on failure
+MappedFile *map_file(const char *path);
+void unmap_file(MappedFile *mf);
+
 #endif
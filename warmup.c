@@ -0,0 +1,227 @@
+#include "warmup.h"
+#include "log.h"
+#include "urlencode.h"
+#include "utils.h"
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+void free_warmup(Warmup *wu) {
+    for (int i = 0; i < wu->count; i++) {
+        free(wu->origins[i].url);
+        free(wu->origins[i].host);
+    }
+    free(wu->origins);
+    curl_slist_free_all(wu->pins);
+    memset(wu, 0, sizeof(Warmup));
+}
+
+static int add_pin(Warmup *wu, const char *entry) {
+    struct curl_slist *temp = curl_slist_append(wu->pins, entry);
+    if (!temp) return -1;
+    wu->pins = temp;
+    return 0;
+}
+
+// Pin entry for host, on port or, with port 0, on any port
+static const char *find_pin(const Warmup *wu, const char *host, long port) {
+    size_t len = strlen(host);
+    for (struct curl_slist *p = wu->pins; p; p = p->next) {
+        if (strncmp(p->data, host, len) != 0 || p->data[len] != ':') continue;
+        if (port == 0 || strtol(p->data + len + 1, NULL, 10) == port) return p->data;
+    }
+    return NULL;
+}
+
+int case_origin(const METADATA *md, char **scheme, char **host, long *port) {
+    if (md->url_tpl || md->host_tpl) return -1;
+
+    char *url = build_url(md->url, md->host, "", md->secure, NULL);
+    CURLU *u = curl_url();
+    char *port_str = NULL;
+    int rc = -1;
+    *scheme = NULL;
+    *host = NULL;
+    if (url && u && curl_url_set(u, CURLUPART_URL, url, 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_SCHEME, scheme, 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_HOST, host, 0) == CURLUE_OK &&
+        curl_url_get(u, CURLUPART_PORT, &port_str, CURLU_DEFAULT_PORT) == CURLUE_OK) {
+        *port = strtol(port_str, NULL, 10);
+        rc = 0;
+    }
+    if (rc) {
+        curl_free(*scheme);
+        curl_free(*host);
+    }
+    curl_free(port_str);
+    curl_url_cleanup(u);
+    free(url);
+    return rc;
+}
+
+static int add_origin(Warmup *wu, const METADATA *md) {
+    char *scheme, *host;
+    long port;
+    if (case_origin(md, &scheme, &host, &port)) return 0;
+
+    int rc = 0;
+    size_t len = strlen(scheme) + strlen(host) + 32;
+    char *url = malloc(len);
+    if (url) snprintf(url, len, "%s://%s:%ld/", scheme, host, port);
+    for (int i = 0; url && i < wu->count; i++) {
+        const char *sock = wu->origins[i].unix_socket;
+        bool same_socket = sock && md->unix_socket ? strcmp(sock, md->unix_socket) == 0 : sock == md->unix_socket;
+        if (same_socket && strcmp(wu->origins[i].url, url) == 0) {
+            free(url);
+            url = NULL;
+            goto DONE;
+        }
+    }
+
+    Origin *temp = url ? realloc(wu->origins, (wu->count + 1) * sizeof(Origin)) : NULL;
+    if (!temp) {
+        free(url);
+        rc = -1;
+        goto DONE;
+    }
+    wu->origins = temp;
+    Origin *o = &wu->origins[wu->count++];
+    o->url = url;
+    o->host = strdup(host);
+    o->port = port;
+    o->secure = md->secure;
+    o->timeout = md->timeout;
+    o->unix_socket = md->unix_socket;
+    if (!o->host) rc = -1;
+
+DONE:
+    curl_free(scheme);
+    curl_free(host);
+    return rc;
+}
+
+// Look up host once and pin every address it has on port
+static int pin_origin(Warmup *wu, const Origin *o) {
+    unsigned char addr[sizeof(struct in6_addr)];
+    if (o->unix_socket) return 0;
+    if (o->host[0] == '[' || inet_pton(AF_INET, o->host, addr) == 1) return 0;
+    if (find_pin(wu, o->host, o->port)) return 0;
+
+    // Another port of a host already looked up reuses its addresses
+    char *addresses = NULL;
+    size_t len = 0;
+    const char *known = find_pin(wu, o->host, 0);
+    if (known) {
+        const char *colon = strchr(known + strlen(o->host) + 1, ':');
+        addresses = colon ? strdup(colon + 1) : NULL;
+    } else {
+        struct addrinfo hints, *res = NULL;
+        memset(&hints, 0, sizeof(hints));
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        int rc = getaddrinfo(o->host, NULL, &hints, &res);
+        if (rc != 0) {
+            LOG_WARN("Failed to resolve %s: %s", o->host, gai_strerror(rc));
+            return 0;
+        }
+        for (struct addrinfo *ai = res; ai; ai = ai->ai_next) {
+            char ip[INET6_ADDRSTRLEN];
+            const void *src = ai->ai_family == AF_INET6
+                ? (const void *)&((struct sockaddr_in6 *)ai->ai_addr)->sin6_addr
+                : (const void *)&((struct sockaddr_in *)ai->ai_addr)->sin_addr;
+            if (!inet_ntop(ai->ai_family, src, ip, sizeof(ip))) continue;
+
+            char entry[INET6_ADDRSTRLEN + 4];
+            snprintf(entry, sizeof(entry), ai->ai_family == AF_INET6 ? "[%s]" : "%s", ip);
+            if (addresses && strstr(addresses, entry)) continue;
+            char *temp = realloc(addresses, len + strlen(entry) + 2);
+            if (!temp) break;
+            addresses = temp;
+            len += sprintf(addresses + len, "%s%s", len ? "," : "", entry);
+        }
+        freeaddrinfo(res);
+        wu->resolved++;
+    }
+    if (!addresses) return 0;
+
+    size_t size = strlen(o->host) + strlen(addresses) + 32;
+    char *entry = malloc(size);
+    int rc = entry ? 0 : -1;
+    if (entry) {
+        snprintf(entry, size, "%s:%ld:%s", o->host, o->port, addresses);
+        rc = add_pin(wu, entry);
+    }
+    free(entry);
+    free(addresses);
+    return rc;
+}
+
+int prepare_warmup(Warmup *wu, const Scenario *mix) {
+    memset(wu, 0, sizeof(Warmup));
+    double start = now_seconds();
+
+    // Overrides go first so looked-up hosts never replace them
+    for (int c = 0; c < mix->count; c++) {
+        const METADATA *md = mix->cases[c].md;
+        for (char **entry = md->resolve; entry && *entry; entry++) {
+            if (add_pin(wu, *entry)) goto FAIL;
+        }
+    }
+    for (int c = 0; c < mix->count; c++) {
+        if (add_origin(wu, mix->cases[c].md)) goto FAIL;
+    }
+    for (int i = 0; i < wu->count; i++) {
+        if (pin_origin(wu, &wu->origins[i])) goto FAIL;
+    }
+    wu->resolve_ms = (now_seconds() - start) * 1000;
+    return 0;
+
+FAIL:
+    LOG_ERROR("Failed to allocate warm-up hosts");
+    free_warmup(wu);
+    return -1;
+}
+
+int open_connections(const Warmup *wu, CURLM *multi, Transfer *slots, int conns, const int *caps, CURLSH *share) {
+    int opened = 0;
+    for (int o = 0; o < wu->count; o++) {
+        const Origin *origin = &wu->origins[o];
+        int count = caps && caps[o] >= 0 && caps[o] < conns ? caps[o] : conns;
+        for (int i = 0; i < count; i++) {
+            CURL *curl = slots[i].curl;
+            if (!curl) continue;
+            curl_easy_setopt(curl, CURLOPT_URL, origin->url);
+            curl_easy_setopt(curl, CURLOPT_NOBODY, 1L);
+            curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, origin->timeout);
+            curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+            curl_easy_setopt(curl, CURLOPT_RESOLVE, wu->pins);
+            if (share) curl_easy_setopt(curl, CURLOPT_SHARE, share);
+            if (origin->unix_socket) curl_easy_setopt(curl, CURLOPT_UNIX_SOCKET_PATH, origin->unix_socket);
+            if (!origin->secure) {
+                curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0L);
+                curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0L);
+            }
+            curl_multi_add_handle(multi, curl);
+        }
+
+        // Any response leaves a connection behind, whatever its status
+        int running = 1;
+        while (running > 0) {
+            curl_multi_perform(multi, &running);
+            CURLMsg *msg;
+            int left;
+            while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+                if (msg->msg != CURLMSG_DONE) continue;
+                if (msg->data.result == CURLE_OK) opened++;
+                curl_multi_remove_handle(multi, msg->easy_handle);
+            }
+            if (running > 0) curl_multi_poll(multi, NULL, 0, 100, NULL);
+        }
+        for (int i = 0; i < count; i++) {
+            if (slots[i].curl) curl_easy_reset(slots[i].curl);
+        }
+    }
+    return opened;
+}
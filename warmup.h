@@ -0,0 +1,41 @@
+#ifndef WARMUP_H
+#define WARMUP_H
+
+#include "easy_curl.h"
+#include "scenario.h"
+#include <curl/curl.h>
+#include <stdbool.h>
+
+// One scheme://host:port the cases send to
+typedef struct {
+    char *url;      // Root URL used to open connections
+    char *host;
+    long port;
+    bool secure;    // Verify TLS, from the first case sending here
+    long timeout;
+    const char *unix_socket;  // Socket of the case, NULL for TCP
+} Origin;
+
+typedef struct {
+    Origin *origins;
+    int count;
+    struct curl_slist *pins;  // host:port:addresses for CURLOPT_RESOLVE, overrides first
+    int resolved;             // Hosts looked up here rather than taken from resolve:
+    double resolve_ms;
+} Warmup;
+
+// Scheme, host and port of a case, -1 when its URL is only known per send.
+// scheme and host are freed with curl_free.
+int case_origin(const METADATA *md, char **scheme, char **host, long *port);
+
+// Collect the distinct origins of mix and resolve each host once, so no measured request
+// pays for a lookup. Hosts given in a case's resolve: keep that address.
+int prepare_warmup(Warmup *wu, const Scenario *mix);
+void free_warmup(Warmup *wu);
+
+// Open conns keep-alive connections to every origin in the pool of multi, or of share when it is
+// set, with HEAD requests on the handles of slots, which are reset afterwards. caps holds a lower
+// count per origin, < 0 for none, or is NULL. Returns the number of connections opened.
+int open_connections(const Warmup *wu, CURLM *multi, Transfer *slots, int conns, const int *caps, CURLSH *share);
+
+#endif
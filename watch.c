@@ -0,0 +1,298 @@
+#include "watch.h"
+#include "discover.h"
+#include "log.h"
+
+#ifdef __linux__
+
+#include <dirent.h>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Quiet period that ends a burst of events, editors often write a file in several steps
+#define WATCH_SETTLE_MS 15
+
+typedef struct {
+    char *path;     // Path as given, or dir/name for files found in a watched directory
+    char *name;     // Base name inside the watched directory
+    int wd;         // Watch descriptor of that directory
+    METADATA *md;   // Compiled plan, NULL if the file is missing or failed to parse
+    bool dirty;     // Changed since it was last run
+} Case;
+
+typedef struct {
+    char *dir;
+    int wd;
+    bool all;       // Given on the command line: every YAML file in it is a case
+} WatchDir;
+
+typedef struct {
+    int fd;
+    Case *cases;
+    int case_count;
+    WatchDir *dirs;
+    int dir_count;
+} Watcher;
+
+static volatile sig_atomic_t stop_watching = 0;
+
+static void on_interrupt(int sig) {
+    (void)sig;
+    stop_watching = 1;
+}
+
+// Watch a directory once, returning its entry
+static WatchDir *add_dir(Watcher *w, const char *dir, bool all) {
+    for (int i = 0; i < w->dir_count; i++) {
+        if (strcmp(w->dirs[i].dir, dir) == 0) {
+            w->dirs[i].all |= all;
+            return &w->dirs[i];
+        }
+    }
+
+    int wd = inotify_add_watch(w->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_CREATE);
+    if (wd < 0) {
+        LOG_ERROR("Failed to watch %s: %s", dir, strerror(errno));
+        return NULL;
+    }
+    WatchDir *temp = realloc(w->dirs, (w->dir_count + 1) * sizeof(WatchDir));
+    if (!temp) return NULL;
+    w->dirs = temp;
+    WatchDir *d = &w->dirs[w->dir_count++];
+    d->dir = strdup(dir);
+    d->wd = wd;
+    d->all = all;
+    return d;
+}
+
+static Case *add_case(Watcher *w, const char *path, const char *name, int wd) {
+    Case *temp = realloc(w->cases, (w->case_count + 1) * sizeof(Case));
+    if (!temp) return NULL;
+    w->cases = temp;
+    Case *c = &w->cases[w->case_count++];
+    c->path = strdup(path);
+    c->name = strdup(name);
+    c->wd = wd;
+    c->md = NULL;
+    c->dirty = true;
+    return c;
+}
+
+// Add a case file, watching its directory so editors that replace files are seen
+static void add_file(Watcher *w, const char *path, bool all) {
+    const char *slash = strrchr(path, '/');
+    char *dir = slash ? strndup(path, slash == path ? 1 : (size_t)(slash - path)) : strdup(".");
+    if (!dir) return;
+    WatchDir *d = add_dir(w, dir, all);
+    if (d) add_case(w, path, slash ? slash + 1 : path, d->wd);
+    free(dir);
+}
+
+// Watch dir and every directory below it, skipping hidden ones as discover_cases does
+static void add_dir_tree(Watcher *w, const char *dir) {
+    if (!add_dir(w, dir, true)) return;
+    DIR *d = opendir(dir);
+    if (!d) return;
+    struct dirent *ent;
+    while ((ent = readdir(d)) != NULL) {
+        if (ent->d_name[0] == '.') continue;
+        struct stat st;
+        // Symlinked directories are not followed, like in discover_cases
+        bool is_dir = ent->d_type == DT_DIR ||
+                      (ent->d_type == DT_UNKNOWN && fstatat(dirfd(d), ent->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode));
+        if (!is_dir) continue;
+        size_t len = strlen(dir) + strlen(ent->d_name) + 2;
+        char *sub = malloc(len);
+        if (!sub) continue;
+        snprintf(sub, len, "%s/%s", dir, ent->d_name);
+        add_dir_tree(w, sub);
+        free(sub);
+    }
+    closedir(d);
+}
+
+// Watch a directory tree and add the cases discover_cases finds in it, so --watch runs the same set
+static void add_dir_cases(Watcher *w, const char *path) {
+    // Without trailing slashes, the directories of the found files match the watched ones
+    char *dir = strdup(path);
+    if (!dir) return;
+    for (size_t len = strlen(dir); len > 1 && dir[len - 1] == '/'; len--) dir[len - 1] = '\0';
+
+    add_dir_tree(w, dir);
+    PathList single = {&dir, 1, 1};
+    PathList found = {0};
+    discover_cases(&single, &found);
+    for (size_t i = 0; i < found.count; i++) {
+        add_file(w, found.paths[i], true);
+    }
+    free_pathlist(&found);
+    free(dir);
+}
+
+// Register a command-line path: a file, a directory tree or a glob
+static void add_path(Watcher *w, const char *path) {
+    // Globs are expanded once, files created later are only seen in watched directories
+    if (is_glob(path)) {
+        PathList single = {(char **)&path, 1, 1};
+        PathList found = {0};
+        discover_cases(&single, &found);
+        for (size_t i = 0; i < found.count; i++) {
+            add_path(w, found.paths[i]);
+        }
+        free_pathlist(&found);
+        return;
+    }
+
+    struct stat st;
+    if (stat(path, &st) == 0 && S_ISDIR(st.st_mode)) {
+        add_dir_cases(w, path);
+    } else {
+        add_file(w, path, false);
+    }
+}
+
+// Mark the case behind an inotify event dirty, adding new files and directories in fully watched ones
+static void handle_event(Watcher *w, const struct inotify_event *ev) {
+    if (ev->len == 0) return;
+    // A new file is run once it is written, a new directory as soon as it appears
+    if ((ev->mask & IN_CREATE) && !(ev->mask & IN_ISDIR)) return;
+
+    if (ev->mask & IN_ISDIR) {
+        if (!(ev->mask & (IN_CREATE | IN_MOVED_TO)) || ev->name[0] == '.') return;
+        for (int i = 0; i < w->dir_count; i++) {
+            if (w->dirs[i].wd != ev->wd || !w->dirs[i].all) continue;
+            size_t len = strlen(w->dirs[i].dir) + strlen(ev->name) + 2;
+            char *path = malloc(len);
+            if (!path) return;
+            snprintf(path, len, "%s/%s", w->dirs[i].dir, ev->name);
+            add_dir_cases(w, path);
+            free(path);
+            return;
+        }
+        return;
+    }
+
+    for (int i = 0; i < w->case_count; i++) {
+        if (w->cases[i].wd == ev->wd && strcmp(w->cases[i].name, ev->name) == 0) {
+            w->cases[i].dirty = true;
+            return;
+        }
+    }
+
+    for (int i = 0; i < w->dir_count; i++) {
+        WatchDir *d = &w->dirs[i];
+        if (d->wd != ev->wd || !d->all || ev->name[0] == '.' || !is_yaml_name(ev->name)) continue;
+        if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) return;
+        size_t len = strlen(d->dir) + strlen(ev->name) + 2;
+        char *path = malloc(len);
+        if (!path) return;
+        snprintf(path, len, "%s/%s", d->dir, ev->name);
+        add_case(w, path, ev->name, d->wd);
+        free(path);
+        return;
+    }
+}
+
+// Read all pending events, then keep reading until the burst settles
+static int collect_events(Watcher *w) {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct pollfd pfd = {w->fd, POLLIN, 0};
+    int timeout = -1;
+
+    while (1) {
+        int n = poll(&pfd, 1, timeout);
+        if (n < 0) return errno == EINTR ? 0 : -1;
+        if (n == 0) return 0;
+
+        ssize_t len = read(w->fd, buf, sizeof(buf));
+        if (len <= 0) return len < 0 && errno != EINTR && errno != EAGAIN ? -1 : 0;
+        for (char *p = buf; p < buf + len;) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            handle_event(w, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+        timeout = WATCH_SETTLE_MS;
+    }
+}
+
+// Re-parse and re-run the dirty cases; untouched cases keep their compiled plans
+static void run_dirty(Watcher *w, CaseRunner run, void *arg) {
+    for (int i = 0; i < w->case_count; i++) {
+        Case *c = &w->cases[i];
+        if (!c->dirty) continue;
+        c->dirty = false;
+
+        double start = now_seconds();
+        free_metadata(c->md);
+        c->md = NULL;
+        if (access(c->path, F_OK) != 0) {
+            LOG_INFO("Removed %s", c->path);
+            continue;
+        }
+        c->md = load_metadata(c->path);
+        if (!c->md) continue;
+        run(c->path, c->md, arg);
+        LOG_INFO("Re-ran %s in %.1f ms", c->path, (now_seconds() - start) * 1000);
+    }
+}
+
+int watch_cases(const PathList *paths, CaseRunner run, void *arg) {
+    Watcher w = {0};
+    w.fd = inotify_init1(IN_CLOEXEC);
+    if (w.fd < 0) {
+        LOG_ERROR("inotify_init1 failed: %s", strerror(errno));
+        return -1;
+    }
+
+    for (size_t i = 0; i < paths->count; i++) {
+        add_path(&w, paths->paths[i]);
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_interrupt;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    run_dirty(&w, run, arg);
+    LOG_INFO("Watching %d cases for changes, press Ctrl-C to stop", w.case_count);
+    while (!stop_watching) {
+        if (collect_events(&w)) {
+            LOG_ERROR("Failed to read file events: %s", strerror(errno));
+            break;
+        }
+        if (!stop_watching) run_dirty(&w, run, arg);
+    }
+
+    for (int i = 0; i < w.case_count; i++) {
+        free(w.cases[i].path);
+        free(w.cases[i].name);
+        free_metadata(w.cases[i].md);
+    }
+    for (int i = 0; i < w.dir_count; i++) {
+        free(w.dirs[i].dir);
+    }
+    free(w.cases);
+    free(w.dirs);
+    close(w.fd);
+    return 0;
+}
+
+#else
+
+int watch_cases(const PathList *paths, CaseRunner run, void *arg) {
+    (void)paths;
+    (void)run;
+    (void)arg;
+    LOG_ERROR("--watch needs inotify and is only supported on Linux");
+    return -1;
+}
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "read_yaml.h"
+#include "utils.h"
+
+// Runs one parsed case; path is the YAML file it came from
+typedef int (*CaseRunner)(const char *path, METADATA *md, void *arg);
+
+// Run every case once, then re-parse and re-run only the cases whose files change, until interrupted.
+// Paths may be YAML files, globs or directories, whose *.yml / *.yaml files are all watched.
+int watch_cases(const PathList *paths, CaseRunner run, void *arg);
+
+#endif